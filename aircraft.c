@@ -38,6 +38,7 @@ struct aircraft *aircraftGet(uint32_t addr) {
 }
 
 void freeAircraft(struct aircraft *a) {
+        apiRemove(a);
         traceCleanup(a);
 
         free(a);
@@ -72,6 +73,10 @@ struct aircraft *aircraftCreate(struct modesMessage *mm) {
     if (Modes.json_globe_index) {
         a->globe_index = -5;
     }
+    a->api_index = -1;
+
+    // nothing from the previous day to rewrite
+    a->trace_rollover = Modes.traceRolloverDay;
 
     // initialize data validity ages
     //adjustExpire(a, 58);
@@ -85,146 +90,111 @@ struct aircraft *aircraftCreate(struct modesMessage *mm) {
 
     return a;
 }
-void apiClear() {
-    Modes.avLen = 0;
-}
-
-void apiAdd(struct aircraft *a) {
-    if (!trackDataValid(&a->position_valid))
-        return;
-
-    if (Modes.avLen > API_INDEX_MAX) {
-        fprintf(stderr, "too many aircraft!.\n");
-        return;
-    }
-    struct av byLat;
-    struct av byLon;
-
-    byLat.addr = a->addr;
-    byLat.value = (int32_t) (a->lat * 1E6);
-
-    byLon.addr = a->addr;
-    byLon.value = (int32_t) (a->lon * 1E6);
-
-    Modes.byLat[Modes.avLen] = byLat;
-    Modes.byLon[Modes.avLen] = byLon;
+static int apiCell(double lat, double lon) {
+    int latCell = (int) floor((lat + 90.0) / API_GRID_DEG);
+    int lonCell = (int) floor((lon + 180.0) / API_GRID_DEG);
 
-    Modes.avLen++;
-}
+    latCell = latCell < 0 ? 0 : (latCell >= API_GRID_LAT ? API_GRID_LAT - 1 : latCell);
+    lonCell = lonCell < 0 ? 0 : (lonCell >= API_GRID_LON ? API_GRID_LON - 1 : lonCell);
 
-static int compareValue(const void *p1, const void *p2) {
-    struct av *a1 = (struct av*) p1;
-    struct av *a2 = (struct av*) p2;
-    return (a1->value > a2->value) - (a1->value < a2->value);
+    return latCell * API_GRID_LON + lonCell;
 }
 
-void apiSort() {
-    qsort(Modes.byLat, Modes.avLen, sizeof(struct av), compareValue);
-    qsort(Modes.byLon, Modes.avLen, sizeof(struct av), compareValue);
+void apiInit() {
+    Modes.apiGrid = malloc(API_GRID_CELLS * sizeof(struct craftArray));
+    if (!Modes.apiGrid) {
+        fprintf(stderr, "apiInit(): out of memory!\n");
+        exit(1);
+    }
+    for (int i = 0; i < API_GRID_CELLS; i++) {
+        ca_init(&Modes.apiGrid[i]);
+    }
 }
 
-static struct range findRange(int32_t ref_from, int32_t ref_to, struct av *list, int len) {
-    struct range res = {0, 0};
-    if (len == 0 || ref_from > ref_to)
-        return res;
-
-    // get lower bound
-    int i = 0;
-    int j = len - 1;
-    while (j > i + 1) {
-
-        int pivot = (i + j) / 2;
-
-        if (list[pivot].value < ref_from)
-            i = pivot;
-        else
-            j = pivot;
+void apiDestroy() {
+    if (!Modes.apiGrid)
+        return;
+    for (int i = 0; i < API_GRID_CELLS; i++) {
+        ca_destroy(&Modes.apiGrid[i]);
     }
-    if (list[j].value < ref_from)
-        res.from = j;
-    else
-        res.from = i;
+    free(Modes.apiGrid);
+    Modes.apiGrid = NULL;
+}
 
-    // get upper bound (exclusive)
-    i = res.from;
-    j = len - 1;
-    while (j > i + 1) {
+// move the aircraft to the grid cell matching its current position
+// called from the tracker whenever the position is updated
+void apiUpdate(struct aircraft *a) {
+    if (!Modes.apiGrid)
+        return;
 
-        int pivot = (i + j) / 2;
+    int new_index = apiCell(a->lat, a->lon);
+    if (new_index == a->api_index)
+        return;
 
-        if (list[pivot].value <= ref_to)
-            i = pivot;
-        else
-            j = pivot;
-    }
-    if (list[j].value > ref_to)
-        res.to = j + 1;
-    else
-        res.to = i + 1;
+    if (a->api_index >= 0 && a->api_index < API_GRID_CELLS)
+        ca_remove(&Modes.apiGrid[a->api_index], a);
 
-    return res;
+    ca_add(&Modes.apiGrid[new_index], a);
+    a->api_index = new_index;
 }
 
-static int compareUint32(const void *p1, const void *p2) {
-    uint32_t *a1 = (uint32_t *) p1;
-    uint32_t *a2 = (uint32_t *) p2;
-    return (*a1 > *a2) - (*a1 < *a2);
+// remove the aircraft from the grid, must be called before it's freed
+void apiRemove(struct aircraft *a) {
+    if (Modes.apiGrid && a->api_index >= 0 && a->api_index < API_GRID_CELLS)
+        ca_remove(&Modes.apiGrid[a->api_index], a);
+
+    a->api_index = -1;
 }
 
+// collect the addresses of all aircraft with a valid position inside the bounding box
+// only the grid cells overlapping the box are visited
+// scratch needs space for API_INDEX_MAX + 1 entries, the result list is 0 terminated
 void apiReq(double latMin, double latMax, double lonMin, double lonMax, uint32_t *scratch) {
+    int n = 0;
+    scratch[0] = 0;
 
-    int32_t lat1 = (int32_t) (latMin * 1E6);
-    int32_t lat2 = (int32_t) (latMax * 1E6);
-    int32_t lon1 = (int32_t) (lonMin * 1E6);
-    int32_t lon2 = (int32_t) (lonMax * 1E6);
-
-    struct range rangeLat = findRange(lat1, lat2, Modes.byLat, Modes.avLen);
-    struct range rangeLon = findRange(lon1, lon2, Modes.byLon, Modes.avLen);
-
-    int allocLat = rangeLat.to - rangeLat.from;
-    int allocLon = rangeLon.to - rangeLon.from;
-
-    fprintf(stderr, "%d %d %d %d %d %d\n", allocLat, allocLon, rangeLat.from, rangeLat.to, rangeLon.from, rangeLon.to);
-
-    if (!allocLat || !allocLon) {
-        scratch[0] = 0;
+    if (!Modes.apiGrid || latMin > latMax)
         return;
-    }
-
-    uint32_t *listLat = &scratch[1 * API_INDEX_MAX];
-    uint32_t *listLon = &scratch[2 * API_INDEX_MAX];
 
-    for (int i = 0; i < allocLat; i++) {
-        listLat[i] = Modes.byLat[rangeLat.from + i].addr;
-    }
-    qsort(listLat, allocLat, sizeof(uint32_t), compareUint32);
-
-    for (int i = 0; i < allocLon; i++) {
-        listLon[i] = Modes.byLon[rangeLon.from + i].addr;
-    }
-    qsort(listLon, allocLon, sizeof(uint32_t), compareUint32);
-
-    int i = 0;
-    int j = 0;
-    int k = 0;
-    while (j < allocLat && k < allocLon) {
-        if (listLat[j] < listLon[k]) {
-            j++;
-            continue;
-        }
-        if (listLat[j] > listLon[k]) {
-            k++;
-            continue;
+    int lat1 = apiCell(latMin, -180) / API_GRID_LON;
+    int lat2 = apiCell(latMax, -180) / API_GRID_LON;
+    int lon1 = apiCell(-90, lonMin);
+    int lon2 = apiCell(-90, lonMax);
+
+    // bounding box crossing the antimeridian
+    int wrap = (lonMin > lonMax);
+    int lonCells = wrap ? (API_GRID_LON - lon1 + lon2 + 1) : (lon2 - lon1 + 1);
+
+    for (int i = lat1; i <= lat2; i++) {
+        for (int k = 0; k < lonCells; k++) {
+            struct craftArray *ca = &Modes.apiGrid[i * API_GRID_LON + (lon1 + k) % API_GRID_LON];
+
+            for (int j = 0; j < ca->len; j++) {
+                struct aircraft *a = ca->list[j];
+                if (!a)
+                    continue;
+                if (!trackDataValid(&a->position_valid))
+                    continue;
+                if (a->lat < latMin || a->lat > latMax)
+                    continue;
+                if (wrap ? (a->lon < lonMin && a->lon > lonMax) : (a->lon < lonMin || a->lon > lonMax))
+                    continue;
+
+                if (n >= API_INDEX_MAX) {
+                    static uint64_t antiSpam;
+                    uint64_t now = mstime();
+                    if (now > antiSpam + 30 * SECONDS) {
+                        antiSpam = now;
+                        fprintf(stderr, "apiReq(): too many aircraft, result truncated!\n");
+                    }
+                    scratch[n] = 0;
+                    return;
+                }
+                scratch[n++] = a->addr;
+            }
         }
-
-        scratch[i] = listLat[j];
-        fprintf(stderr, "%06x %06x\n", listLat[j], listLon[k]);
-        i++;
-        j++;
-        k++;
     }
-    scratch[i] = 0;
-    return;
+    scratch[n] = 0;
 }
 
 void toBinCraft(struct aircraft *a, struct binCraft *new, uint64_t now) {
@@ -425,13 +395,13 @@ static char *sprintDB(char *p, char *end, dbEntry *d) {
     p = safe_snprintf(p, end, "},");
     return p;
 }
-static void dbToJson() {
+static void dbToJson(struct dbIndex *index) {
     size_t buflen = 32 * 1024 * 1024;
     char *buf = (char *) malloc(buflen), *p = buf, *end = buf + buflen;
     p = safe_snprintf(p, end, "{");
 
     for (int j = 0; j < DB_BUCKETS; j++) {
-        for (dbEntry *d = Modes.db2Index[j]; d; d = d->next) {
+        for (dbEntry *d = index->buckets[j]; d; d = d->next) {
             p = sprintDB(p, end, d);
             if ((p + 1000) >= end) {
                 int used = p - buf;
@@ -466,8 +436,100 @@ static inline int nextToken(char delim, char **sot, char **eot, char **eol) {
     return 1;
 }
 
-int dbUpdate() {
-    struct char_buffer cb = {0};
+static void dbIndexFree(struct dbIndex *index) {
+    if (!index)
+        return;
+    for (int k = 0; k < DB_ARENA_BLOCKS; k++)
+        free(index->blocks[k]);
+    free(index->buckets);
+    free(index);
+}
+
+// next unused entry of the arena, the entry only counts once dbPut is called
+static dbEntry *dbArenaNext(struct dbIndex *index) {
+    uint32_t block = index->count / DB_ARENA_BLOCK;
+    if (block >= DB_ARENA_BLOCKS)
+        return NULL;
+    if (!index->blocks[block]) {
+        index->blocks[block] = malloc(DB_ARENA_BLOCK * sizeof(dbEntry));
+        if (!index->blocks[block])
+            return NULL;
+    }
+    return &index->blocks[block][index->count % DB_ARENA_BLOCK];
+}
+
+// parse one line of the CSV file into the arena
+// returns 0 if the arena can't take another entry
+static int dbParseLine(struct dbIndex *index, char *sol, char *eol) {
+    char *sot;
+    char *eot = sol - 1; // this pointer must not be dereferenced, nextToken will increment it.
+
+    dbEntry *curr = dbArenaNext(index);
+    if (!curr)
+        return 0;
+    memset(curr, 0, sizeof(dbEntry));
+
+    if (!nextToken(';', &sot, &eot, &eol)) return 1;
+    curr->addr = strtol(sot, NULL, 16);
+    if (curr->addr == 0)
+        return 1;
+
+    if (!nextToken(';', &sot, &eot, &eol)) return 1;
+    memcpy(curr->registration, sot, min(sizeof(curr->registration), eot - sot));
+    sanitize(curr->registration, sizeof(curr->registration));
+
+    if (!nextToken(';', &sot, &eot, &eol)) return 1;
+    memcpy(curr->typeCode, sot, min(sizeof(curr->typeCode), eot - sot));
+    sanitize(curr->typeCode, sizeof(curr->typeCode));
+
+    if (!nextToken(';', &sot, &eot, &eol)) return 1;
+    for (int j = 0; j < 16 && sot < eot; j++, sot++)
+        curr->dbFlags |= ((*sot == '1') << j);
+
+
+    // nextToken wouldn't work as there is no trailing ;, set sot / eot by hand
+    sot = eot + 1;
+    eot = eol;
+    memcpy(curr->typeLong, sot, min(sizeof(curr->typeLong), eot - sot));
+    sanitize(curr->typeLong, sizeof(curr->typeLong));
+
+    if (false) // debugging output
+        fprintf(stdout, "%06X;%.12s;%.4s;%c%c;%.54s\n",
+                curr->addr,
+                curr->registration,
+                curr->typeCode,
+                curr->dbFlags & 1 ? '1' : '0',
+                curr->dbFlags & 2 ? '1' : '0',
+                curr->typeLong);
+
+    index->count++;
+    // add to hashtable
+    dbPut(curr->addr, index, curr);
+    return 1;
+}
+
+#define DB_READ_SIZE (1024 * 1024)
+
+// state of a database update spanning several steps of the db misc job
+static struct {
+    gzFile gzfp;
+    char *filename;
+    uint64_t modTime;
+    struct dbIndex *index; // index under construction, not visible to anyone else
+    char *buf; // DB_READ_SIZE bytes, starts with the incomplete line of the previous read
+    size_t carry;
+    uint64_t bytes;
+} dbLoad;
+
+static void dbLoadReset() {
+    if (dbLoad.gzfp)
+        gzclose(dbLoad.gzfp);
+    dbIndexFree(dbLoad.index);
+    free(dbLoad.buf);
+    memset(&dbLoad, 0, sizeof(dbLoad));
+}
+
+static int dbLoadStart() {
     char *filename = Modes.db_file;
     if (!filename || !strlen(filename) || !strcmp(filename, "none"))
         return 0;
@@ -483,135 +545,123 @@ int dbUpdate() {
     struct stat fileinfo = {0};
     if (fstat(fd, &fileinfo)) {
         fprintf(stderr, "%s: dbUpdate: fstat failed, wat?!\n", filename);
-        goto DBU0;
+        close(fd);
+        return 0;
     }
     uint64_t modTime = fileinfo.st_mtim.tv_sec;
 
+    if (Modes.dbModificationTime == modTime) {
+        close(fd);
+        return 0;
+    }
 
-    if (Modes.dbModificationTime == modTime)
-        goto DBU0;
-
-    int alloc = (1<<20);
-    Modes.db2 = malloc(alloc * sizeof(dbEntry));
-    Modes.db2Index = calloc(DB_BUCKETS, sizeof(void*));
+    dbLoad.filename = filename;
+    dbLoad.modTime = modTime;
+    dbLoad.buf = malloc(DB_READ_SIZE);
+    dbLoad.index = calloc(1, sizeof(struct dbIndex));
+    if (dbLoad.index)
+        dbLoad.index->buckets = calloc(DB_BUCKETS, sizeof(dbEntry *));
 
-    if (!Modes.db2 || !Modes.db2Index) {
+    if (!dbLoad.buf || !dbLoad.index || !dbLoad.index->buckets) {
         fprintf(stderr, "db update error: malloc failure!\n");
-        goto DBU0;
+        close(fd);
+        dbLoadReset();
+        return 0;
     }
 
-    gzFile gzfp = gzdopen(fd, "r");
-    if (!gzfp) {
+    dbLoad.gzfp = gzdopen(fd, "r");
+    if (!dbLoad.gzfp) {
         fprintf(stderr, "db update error: gzdopen failed.\n");
-        goto DBU0;
+        close(fd);
+        dbLoadReset();
+        return 0;
     }
+    gzbuffer(dbLoad.gzfp, 256 * 1024);
+    return 1;
+}
 
+// make the finished index current, lookups still using the previous index
+// are done long before the next update frees it
+static void dbPublish() {
+    struct dbIndex *index = dbLoad.index;
+    dbLoad.index = NULL;
 
-    cb = readWholeGz(gzfp, filename);
-    if (!cb.buffer) {
-        fprintf(stderr, "readWholeGz failed.\n");
-        gzclose(gzfp);
-        goto DBU0;
-    }
-    if (cb.len < 1000) {
-        fprintf(stderr, "database file very small, bailing out of dbUpdate.\n");
-        gzclose(gzfp);
-        goto DBU0;
-    }
+    if (Modes.debug_dbJson)
+        dbToJson(index);
 
-    char *eob = cb.buffer + cb.len;
-    char *sol = cb.buffer;
-    char *eol;
-    for (int i = 0; eob > sol && (eol = memchr(sol, '\n', eob - sol)); sol = eol + 1) {
-
-        char *sot;
-        char *eot = sol - 1; // this pointer must not be dereferenced, nextToken will increment it.
-
-        dbEntry *curr = &Modes.db2[i];
-        memset(curr, 0, sizeof(dbEntry));
-
-        if (!nextToken(';', &sot, &eot, &eol)) continue;
-        curr->addr = strtol(sot, NULL, 16);
-        if (curr->addr == 0)
-            continue;
-
-        if (!nextToken(';', &sot, &eot, &eol)) continue;
-        memcpy(curr->registration, sot, min(sizeof(curr->registration), eot - sot));
-        sanitize(curr->registration, sizeof(curr->registration));
-
-        if (!nextToken(';', &sot, &eot, &eol)) continue;
-        memcpy(curr->typeCode, sot, min(sizeof(curr->typeCode), eot - sot));
-        sanitize(curr->typeCode, sizeof(curr->typeCode));
-
-        if (!nextToken(';', &sot, &eot, &eol)) continue;
-        for (int j = 0; j < 16 && sot < eot; j++, sot++)
-            curr->dbFlags |= ((*sot == '1') << j);
-
-
-        // nextToken wouldn't work as there is no trailing ;, set sot / eot by hand
-        sot = eot + 1;
-        eot = eol;
-        memcpy(curr->typeLong, sot, min(sizeof(curr->typeLong), eot - sot));
-        sanitize(curr->typeLong, sizeof(curr->typeLong));
-
-        if (false) // debugging output
-            fprintf(stdout, "%06X;%.12s;%.4s;%c%c;%.54s\n",
-                    curr->addr,
-                    curr->registration,
-                    curr->typeCode,
-                    curr->dbFlags & 1 ? '1' : '0',
-                    curr->dbFlags & 2 ? '1' : '0',
-                    curr->typeLong);
-
-        i++; // increment db array index
-        // add to hashtable
-        dbPut(curr->addr, Modes.db2Index, curr);
-    }
-    //fflush(stdout);
+    dbIndexFree(Modes.dbRetired);
+    Modes.dbRetired = Modes.db;
+
+    index->generation = Modes.dbGeneration + 1;
+    __atomic_store_n(&Modes.db, index, __ATOMIC_RELEASE);
+    __atomic_store_n(&Modes.dbGeneration, index->generation, __ATOMIC_RELEASE);
 
-    gzclose(gzfp);
-    free(cb.buffer);
-    Modes.dbModificationTime = modTime;
+    Modes.dbModificationTime = dbLoad.modTime;
     writeJsonToFile(Modes.json_dir, "receiver.json", generateReceiverJson());
-    return 1;
-DBU0:
-    free(cb.buffer);
-    free(Modes.db2);
-    free(Modes.db2Index);
-    Modes.db2 = NULL;
-    Modes.db2Index = NULL;
-    close(fd);
-    return 0;
+    fprintf(stderr, "db update done: %u entries\n", index->count);
 }
 
-int dbFinishUpdate() {
-    // finish db update
-    if (Modes.db2 && Modes.db2Index) {
-        if (Modes.debug_dbJson)
-            dbToJson();
-        free(Modes.dbIndex);
-        free(Modes.db);
-        Modes.dbIndex = Modes.db2Index;
-        Modes.db = Modes.db2;
-        Modes.db2Index = NULL;
-        Modes.db2 = NULL;
-
-        for (int j = 0; j < AIRCRAFT_BUCKETS; j++) {
-            for (struct aircraft *a = Modes.aircraft[j]; a; a = a->next) {
-                updateTypeReg(a);
+// streams the database file into a new index, at most until deadline
+// the new index is published with a single pointer swap once the whole file is parsed,
+// aircraft pick up their new type / registration lazily (dbRefresh)
+int dbUpdate(uint64_t now, uint64_t deadline) {
+    if (!dbLoad.gzfp && !dbLoadStart())
+        return 0;
+
+    while (now < deadline) {
+        int len = gzread(dbLoad.gzfp, dbLoad.buf + dbLoad.carry, DB_READ_SIZE - dbLoad.carry);
+        if (len < 0) {
+            int err;
+            fprintf(stderr, "%s: db update error: gzread: %s\n", dbLoad.filename, gzerror(dbLoad.gzfp, &err));
+            dbLoadReset();
+            return 0;
+        }
+        if (len == 0) {
+            // like before, a last line without newline is ignored
+            if (dbLoad.bytes < 1000) {
+                fprintf(stderr, "database file very small, bailing out of dbUpdate.\n");
+            } else {
+                dbPublish();
             }
+            dbLoadReset();
+            return 0;
         }
-        fprintf(stderr, "db update done!\n");
-        return 1;
+        dbLoad.bytes += len;
+
+        char *eob = dbLoad.buf + dbLoad.carry + len;
+        char *sol = dbLoad.buf;
+        char *eol;
+        for (; eob > sol && (eol = memchr(sol, '\n', eob - sol)); sol = eol + 1) {
+            if (!dbParseLine(dbLoad.index, sol, eol)) {
+                fprintf(stderr, "db update error: more than %d entries or malloc failure!\n",
+                        DB_ARENA_BLOCK * DB_ARENA_BLOCKS);
+                dbLoadReset();
+                return 0;
+            }
+        }
+
+        dbLoad.carry = eob - sol;
+        if (dbLoad.carry == DB_READ_SIZE) // no newline in the whole buffer, drop it
+            dbLoad.carry = 0;
+        memmove(dbLoad.buf, sol, dbLoad.carry);
+
+        now = mstime();
     }
-    return 0;
+    return 1;
 }
 
+void dbCleanup() {
+    dbLoadReset();
+    dbIndexFree(Modes.db);
+    dbIndexFree(Modes.dbRetired);
+    Modes.db = NULL;
+    Modes.dbRetired = NULL;
+}
 
-dbEntry *dbGet(uint32_t addr, dbEntry **index) {
+dbEntry *dbGet(uint32_t addr, struct dbIndex *index) {
     if (!index)
         return NULL;
-    dbEntry *d = index[dbHash(addr)];
+    dbEntry *d = index->buckets[dbHash(addr)];
 
     while (d && d->addr != addr) {
         d = d->next;
@@ -619,14 +669,16 @@ dbEntry *dbGet(uint32_t addr, dbEntry **index) {
     return d;
 }
 
-void dbPut(uint32_t addr, dbEntry **index, dbEntry *d) {
+void dbPut(uint32_t addr, struct dbIndex *index, dbEntry *d) {
     uint32_t hash = dbHash(addr);
-    d->next = index[hash];
-    index[hash] = d;
+    d->next = index->buckets[hash];
+    index->buckets[hash] = d;
 }
 
 void updateTypeReg(struct aircraft *a) {
-    dbEntry *d = dbGet(a->addr, Modes.dbIndex);
+    struct dbIndex *index = __atomic_load_n(&Modes.db, __ATOMIC_ACQUIRE);
+    a->dbGeneration = index ? index->generation : 0;
+    dbEntry *d = dbGet(a->addr, index);
     if (d) {
         memcpy(a->registration, d->registration, sizeof(a->registration));
         memcpy(a->typeCode, d->typeCode, sizeof(a->typeCode));
@@ -3,6 +3,12 @@
 
 #define API_INDEX_MAX 32000
 
+// spatial index for the API: grid of API_GRID_DEG x API_GRID_DEG degree cells
+#define API_GRID_DEG 1
+#define API_GRID_LAT (180 / API_GRID_DEG)
+#define API_GRID_LON (360 / API_GRID_DEG)
+#define API_GRID_CELLS (API_GRID_LAT * API_GRID_LON)
+
 uint32_t aircraftHash(uint32_t addr);
 struct aircraft *aircraftGet(uint32_t addr);
 struct aircraft *aircraftCreate(struct modesMessage *mm);
@@ -17,24 +23,27 @@ typedef struct dbEntry {
     uint8_t dbFlags;
 } dbEntry;
 
-uint32_t dbHash(uint32_t addr);
-dbEntry *dbGet(uint32_t addr, dbEntry **index);
-void dbPut(uint32_t addr, dbEntry **index, dbEntry *d);
+#define DB_ARENA_BLOCK (1 << 16) // entries per arena block
+#define DB_ARENA_BLOCKS 128 // at most 8M entries
 
-void apiClear();
-void apiAdd(struct aircraft *a);
-void apiSort();
-void apiReq(double latMin, double latMax, double lonMin, double lonMax, uint32_t *scratch);
-
-struct av {
-    uint32_t addr;
-    int32_t value;
+// aircraft database built by dbUpdate, published with an atomic pointer swap (Modes.db)
+// entries live in a few large blocks, a published index is never modified
+struct dbIndex {
+    uint32_t generation; // compared with aircraft->dbGeneration to refresh type / registration
+    uint32_t count;
+    dbEntry **buckets; // DB_BUCKETS hash chains
+    dbEntry *blocks[DB_ARENA_BLOCKS];
 };
 
-struct range {
-    int from; // inclusive
-    int to; // exclusive
-};
+uint32_t dbHash(uint32_t addr);
+dbEntry *dbGet(uint32_t addr, struct dbIndex *index);
+void dbPut(uint32_t addr, struct dbIndex *index, dbEntry *d);
+
+void apiInit();
+void apiDestroy();
+void apiUpdate(struct aircraft *a);
+void apiRemove(struct aircraft *a);
+void apiReq(double latMin, double latMax, double lonMin, double lonMax, uint32_t *scratch);
 
 struct binCraft {
   uint32_t hex;
@@ -162,8 +171,9 @@ struct binCraft {
 } __attribute__ ((__packed__));
 
 void toBinCraft(struct aircraft *a, struct binCraft *new, uint64_t now);
-int dbUpdate();
-int dbFinishUpdate();
+// reads the next part of a changed database file, returns 1 until the new index is published
+int dbUpdate(uint64_t now, uint64_t deadline);
+void dbCleanup();
 
 void updateTypeReg(struct aircraft *a);
 
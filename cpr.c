@@ -52,102 +52,81 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 
+#include "cpr.h"
+
+// CPR latitudes and longitudes are encoded in 17 bits
+#define CPR_MAX (1 << 17)
+
+// Latitudes are handled as integers in units of 1 / (2 * 59 * 2^17) degrees:
+// every even (60 zones) and odd (59 zones) latitude of the airborne (360 degrees)
+// and surface (90 degrees) encodings is a whole number of units.
+// Longitudes are handled in units of 1 / 2^17 of the longitude zone that was decoded.
+#define LAT_UNITS ((int64_t) 2 * 59 * CPR_MAX) // per degree
+
 //
 //=========================================================================
 //
-// Always positive MOD operation, used for CPR decoding.
+// Always positive MOD operation and rounding down division, used for CPR decoding.
 //
-static int cprModInt(int a, int b) {
-    int res = a % b;
+static inline int64_t cprMod(int64_t a, int64_t b) {
+    int64_t res = a % b;
     if (res < 0) res += b;
     return res;
 }
 
-static double cprModDouble(double a, double b) {
-    double res = fmod(a, b);
-    if (res < 0) res += b;
-    return res;
+static inline int64_t cprFloorDiv(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    if (a % b < 0) q--;
+    return q;
 }
 
 //
 //=========================================================================
 //
 // The NL function uses the precomputed table from 1090-WP-9-14
-//
-static int cprNLFunction(double lat) {
+// The thresholds are the latitudes at which NL drops from 59 to 2, in LAT_UNITS rounded up,
+// so lat < threshold compares the same as with exact values.
+//
+static const int64_t cprNLTable[58] = {
+    161941503, 229339900, 281277773, 325251053,
+    364159343, 399487947, 432118233, 462623882,
+    491403013, 518745261, 544869126, 569944261,
+    594105524, 617462221, 640104421, 662107395,
+    683534824, 704441160, 724873411, 744872500,
+    764474321, 783710578, 802609446, 821196104,
+    839493173, 857521071, 875298310, 892841739,
+    910166755, 927287470, 944216864, 960966907,
+    977548664, 993972388, 1010247594, 1026383124,
+    1042387199, 1058267462, 1074031009, 1089684409,
+    1105233713, 1120684444, 1136041576, 1151309478,
+    1166491830, 1181591481, 1196610233, 1211548490,
+    1226404700, 1241174428, 1255848751, 1270411328,
+    1284832670, 1299057844, 1312976550, 1326335802,
+    1338398954, 1345585152,
+};
+
+static int cprNLFunction(int64_t lat) {
     if (lat < 0) lat = -lat; // Table is simmetric about the equator
-    if (lat > 60) goto L60;
-    if (lat > 44.2) goto L442;
-    if (lat > 30) goto L30;
-    if (lat < 10.47047130) return 59;
-    if (lat < 14.82817437) return 58;
-    if (lat < 18.18626357) return 57;
-    if (lat < 21.02939493) return 56;
-    if (lat < 23.54504487) return 55;
-    if (lat < 25.82924707) return 54;
-    if (lat < 27.93898710) return 53;
-    if (lat < 29.91135686) return 52;
-L30:
-    if (lat < 31.77209708) return 51;
-    if (lat < 33.53993436) return 50;
-    if (lat < 35.22899598) return 49;
-    if (lat < 36.85025108) return 48;
-    if (lat < 38.41241892) return 47;
-    if (lat < 39.92256684) return 46;
-    if (lat < 41.38651832) return 45;
-    if (lat < 42.80914012) return 44;
-    if (lat < 44.19454951) return 43;
-L442:
-    if (lat < 45.54626723) return 42;
-    if (lat < 46.86733252) return 41;
-    if (lat < 48.16039128) return 40;
-    if (lat < 49.42776439) return 39;
-    if (lat < 50.67150166) return 38;
-    if (lat < 51.89342469) return 37;
-    if (lat < 53.09516153) return 36;
-    if (lat < 54.27817472) return 35;
-    if (lat < 55.44378444) return 34;
-    if (lat < 56.59318756) return 33;
-    if (lat < 57.72747354) return 32;
-    if (lat < 58.84763776) return 31;
-    if (lat < 59.95459277) return 30;
-L60:
-    if (lat < 61.04917774) return 29;
-    if (lat < 62.13216659) return 28;
-    if (lat < 63.20427479) return 27;
-    if (lat < 64.26616523) return 26;
-    if (lat < 65.31845310) return 25;
-    if (lat < 66.36171008) return 24;
-    if (lat < 67.39646774) return 23;
-    if (lat < 68.42322022) return 22;
-    if (lat < 69.44242631) return 21;
-    if (lat < 70.45451075) return 20;
-    if (lat < 71.45986473) return 19;
-    if (lat < 72.45884545) return 18;
-    if (lat < 73.45177442) return 17;
-    if (lat < 74.43893416) return 16;
-    if (lat < 75.42056257) return 15;
-    if (lat < 76.39684391) return 14;
-    if (lat < 77.36789461) return 13;
-    if (lat < 78.33374083) return 12;
-    if (lat < 79.29428225) return 11;
-    if (lat < 80.24923213) return 10;
-    if (lat < 81.19801349) return 9;
-    if (lat < 82.13956981) return 8;
-    if (lat < 83.07199445) return 7;
-    if (lat < 83.99173563) return 6;
-    if (lat < 84.89166191) return 5;
-    if (lat < 85.75541621) return 4;
-    if (lat < 86.53536998) return 3;
-    if (lat < 87.00000000) return 2;
-    else return 1;
+
+    // number of thresholds <= lat
+    int lo = 0;
+    int hi = 58;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cprNLTable[mid] <= lat)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return 59 - lo;
 }
 //
 //=========================================================================
 //
-static int cprNFunction(double lat, int fflag) {
+static int cprNFunction(int64_t lat, int fflag) {
     int nl = cprNLFunction(lat) - (fflag ? 1 : 0);
     if (nl < 1) nl = 1;
     return nl;
@@ -155,67 +134,48 @@ static int cprNFunction(double lat, int fflag) {
 //
 //=========================================================================
 //
-static double cprDlonFunction(double lat, int fflag, int surface) {
-    return (surface ? 90.0 : 360.0) / cprNFunction(lat, fflag);
-}
-//
-//=========================================================================
-//
 // This algorithm comes from:
 // http://www.lll.lu/~edward/edward/adsb/DecodingADSBposition.html.
 //
-// A few remarks:
-// 1) 131072 is 2^17 since CPR latitude and longitude are encoded in 17 bits.
+// All zone arithmetic is done on integers, the result is converted to degrees at the end.
+// Latitudes in zone units (2^17 per zone) are scaled to LAT_UNITS by 708 / 720 (airborne
+// even / odd) and 177 / 180 (surface).
 //
 int decodeCPRairborne(int even_cprlat, int even_cprlon,
         int odd_cprlat, int odd_cprlon,
         int fflag,
         double *out_lat, double *out_lon) {
-    double AirDlat0 = 360.0 / 60.0;
-    double AirDlat1 = 360.0 / 59.0;
-    double lat0 = even_cprlat;
-    double lat1 = odd_cprlat;
-    double lon0 = even_cprlon;
-    double lon1 = odd_cprlon;
-
-    double rlat, rlon;
 
     // Compute the Latitude Index "j"
-    int j = (int) floor(((59 * lat0 - 60 * lat1) / 131072) + 0.5);
-    double rlat0 = AirDlat0 * (cprModInt(j, 60) + lat0 / 131072);
-    double rlat1 = AirDlat1 * (cprModInt(j, 59) + lat1 / 131072);
+    int64_t j = cprFloorDiv(59 * (int64_t) even_cprlat - 60 * (int64_t) odd_cprlat + CPR_MAX / 2, CPR_MAX);
+    int64_t rlat0 = (cprMod(j, 60) * CPR_MAX + even_cprlat) * 708;
+    int64_t rlat1 = (cprMod(j, 59) * CPR_MAX + odd_cprlat) * 720;
 
-    if (rlat0 >= 270) rlat0 -= 360;
-    if (rlat1 >= 270) rlat1 -= 360;
+    if (rlat0 >= 270 * LAT_UNITS) rlat0 -= 360 * LAT_UNITS;
+    if (rlat1 >= 270 * LAT_UNITS) rlat1 -= 360 * LAT_UNITS;
 
     // Check to see that the latitude is in range: -90 .. +90
-    if (rlat0 < -90 || rlat0 > 90 || rlat1 < -90 || rlat1 > 90)
+    if (rlat0 < -90 * LAT_UNITS || rlat0 > 90 * LAT_UNITS || rlat1 < -90 * LAT_UNITS || rlat1 > 90 * LAT_UNITS)
         return (-2); // bad data
 
     // Check that both are in the same latitude zone, or abort.
-    if (cprNLFunction(rlat0) != cprNLFunction(rlat1))
+    int nl = cprNLFunction(rlat0);
+    if (nl != cprNLFunction(rlat1))
         return (-1); // positions crossed a latitude zone, try again later
 
     // Compute ni and the Longitude Index "m"
-    if (fflag) { // Use odd packet.
-        int ni = cprNFunction(rlat1, 1);
-        int m = (int) floor((((lon0 * (cprNLFunction(rlat1) - 1)) -
-                (lon1 * cprNLFunction(rlat1))) / 131072.0) + 0.5);
-        rlon = cprDlonFunction(rlat1, 1, 0) * (cprModInt(m, ni) + lon1 / 131072);
-        rlat = rlat1;
-    } else { // Use even packet.
-        int ni = cprNFunction(rlat0, 0);
-        int m = (int) floor((((lon0 * (cprNLFunction(rlat0) - 1)) -
-                (lon1 * cprNLFunction(rlat0))) / 131072) + 0.5);
-        rlon = cprDlonFunction(rlat0, 0, 0) * (cprModInt(m, ni) + lon0 / 131072);
-        rlat = rlat0;
-    }
+    int64_t rlat = fflag ? rlat1 : rlat0;
+    int64_t ni = cprNFunction(rlat, fflag);
+    int64_t m = cprFloorDiv((int64_t) even_cprlon * (nl - 1) - (int64_t) odd_cprlon * nl + CPR_MAX / 2, CPR_MAX);
+    // longitude in units of 360 / (ni * 2^17) degrees
+    int64_t full = ni * CPR_MAX;
+    int64_t rlon = cprMod(m, ni) * CPR_MAX + (fflag ? odd_cprlon : even_cprlon);
 
     // Renormalize to -180 .. +180
-    rlon -= floor((rlon + 180) / 360) * 360;
+    if (2 * rlon >= full) rlon -= full;
 
-    *out_lat = rlat;
-    *out_lon = rlon;
+    *out_lat = rlat / (double) LAT_UNITS;
+    *out_lon = rlon * (360.0 / full);
 
     return 0;
 }
@@ -225,18 +185,11 @@ int decodeCPRsurface(double reflat, double reflon,
         int odd_cprlat, int odd_cprlon,
         int fflag,
         double *out_lat, double *out_lon) {
-    double AirDlat0 = 90.0 / 60.0;
-    double AirDlat1 = 90.0 / 59.0;
-    double lat0 = even_cprlat;
-    double lat1 = odd_cprlat;
-    double lon0 = even_cprlon;
-    double lon1 = odd_cprlon;
-    double rlon, rlat;
 
     // Compute the Latitude Index "j"
-    int j = (int) floor(((59 * lat0 - 60 * lat1) / 131072) + 0.5);
-    double rlat0 = AirDlat0 * (cprModInt(j, 60) + lat0 / 131072);
-    double rlat1 = AirDlat1 * (cprModInt(j, 59) + lat1 / 131072);
+    int64_t j = cprFloorDiv(59 * (int64_t) even_cprlat - 60 * (int64_t) odd_cprlat + CPR_MAX / 2, CPR_MAX);
+    int64_t rlat0 = (cprMod(j, 60) * CPR_MAX + even_cprlat) * 177;
+    int64_t rlat1 = (cprMod(j, 59) * CPR_MAX + odd_cprlat) * 180;
 
     // Pick the quadrant that's closest to the reference location -
     // this is not necessarily the same quadrant that contains the
@@ -261,46 +214,43 @@ int decodeCPRsurface(double reflat, double reflon,
     // As a special case, -90, 0 and +90 all encode to zero, so
     // there's a little extra work to do there.
 
+    // an integer is larger than reflat exactly when it is larger than its floor
+    int64_t reflatFloor = (int64_t) floor(reflat * LAT_UNITS);
+
     if (rlat0 == 0) {
         if (reflat < -45)
-            rlat0 = -90;
+            rlat0 = -90 * LAT_UNITS;
         else if (reflat > 45)
-            rlat0 = 90;
-    } else if ((rlat0 - reflat) > 45) {
-        rlat0 -= 90;
+            rlat0 = 90 * LAT_UNITS;
+    } else if (rlat0 - 45 * LAT_UNITS > reflatFloor) {
+        rlat0 -= 90 * LAT_UNITS;
     }
 
     if (rlat1 == 0) {
         if (reflat < -45)
-            rlat1 = -90;
+            rlat1 = -90 * LAT_UNITS;
         else if (reflat > 45)
-            rlat1 = 90;
-    } else if ((rlat1 - reflat) > 45) {
-        rlat1 -= 90;
+            rlat1 = 90 * LAT_UNITS;
+    } else if (rlat1 - 45 * LAT_UNITS > reflatFloor) {
+        rlat1 -= 90 * LAT_UNITS;
     }
 
     // Check to see that the latitude is in range: -90 .. +90
-    if (rlat0 < -90 || rlat0 > 90 || rlat1 < -90 || rlat1 > 90)
+    if (rlat0 < -90 * LAT_UNITS || rlat0 > 90 * LAT_UNITS || rlat1 < -90 * LAT_UNITS || rlat1 > 90 * LAT_UNITS)
         return (-2); // bad data
 
     // Check that both are in the same latitude zone, or abort.
-    if (cprNLFunction(rlat0) != cprNLFunction(rlat1))
+    int nl = cprNLFunction(rlat0);
+    if (nl != cprNLFunction(rlat1))
         return (-1); // positions crossed a latitude zone, try again later
 
     // Compute ni and the Longitude Index "m"
-    if (fflag) { // Use odd packet.
-        int ni = cprNFunction(rlat1, 1);
-        int m = (int) floor((((lon0 * (cprNLFunction(rlat1) - 1)) -
-                (lon1 * cprNLFunction(rlat1))) / 131072.0) + 0.5);
-        rlon = cprDlonFunction(rlat1, 1, 1) * (cprModInt(m, ni) + lon1 / 131072);
-        rlat = rlat1;
-    } else { // Use even packet.
-        int ni = cprNFunction(rlat0, 0);
-        int m = (int) floor((((lon0 * (cprNLFunction(rlat0) - 1)) -
-                (lon1 * cprNLFunction(rlat0))) / 131072) + 0.5);
-        rlon = cprDlonFunction(rlat0, 0, 1) * (cprModInt(m, ni) + lon0 / 131072);
-        rlat = rlat0;
-    }
+    int64_t rlat = fflag ? rlat1 : rlat0;
+    int64_t ni = cprNFunction(rlat, fflag);
+    int64_t m = cprFloorDiv((int64_t) even_cprlon * (nl - 1) - (int64_t) odd_cprlon * nl + CPR_MAX / 2, CPR_MAX);
+    // longitude in units of 90 / (ni * 2^17) degrees
+    int64_t quarter = ni * CPR_MAX;
+    int64_t rlon = cprMod(m, ni) * CPR_MAX + (fflag ? odd_cprlon : even_cprlon);
 
     // Pick the quadrant that's closest to the reference location -
     // this is not necessarily the same quadrant that contains the
@@ -308,13 +258,14 @@ int decodeCPRsurface(double reflat, double reflon,
     // quadrants are valid.
 
     // if reflon is more than 45 degrees away, move some multiple of 90 degrees towards it
-    rlon += floor((reflon - rlon + 45) / 90) * 90; // this might move us outside (-180..+180), we fix this below
+    int64_t reflonFloor = (int64_t) floor(reflon * (quarter / 90.0));
+    rlon += cprFloorDiv(reflonFloor - rlon + quarter / 2, quarter) * quarter; // this might move us outside (-180..+180), we fix this below
 
     // Renormalize to -180 .. +180
-    rlon -= floor((rlon + 180) / 360) * 360;
+    rlon -= cprFloorDiv(rlon + 2 * quarter, 4 * quarter) * 4 * quarter;
 
-    *out_lat = rlat;
-    *out_lon = rlon;
+    *out_lat = rlat / (double) LAT_UNITS;
+    *out_lon = rlon * (90.0 / quarter);
     return 0;
 }
 
@@ -328,47 +279,57 @@ int decodeCPRsurface(double reflat, double reflon,
 // See Figure 5-5 / 5-6 and note that floor is applied to (0.5 + fRP - fEP), not
 // directly to (fRP - fEP). Eq 38 is correct.
 //
+// The reference position is converted to zone units (2^17 per zone) once, from there on
+// everything is integer: floor(x) and ceil(x) of the reference give the exact result of
+// comparing it with integers.
+//
 int decodeCPRrelative(double reflat, double reflon,
         int cprlat, int cprlon,
         int fflag, int surface,
         double *out_lat, double *out_lon) {
-    double AirDlat;
-    double AirDlon;
-    double fractional_lat = cprlat / 131072.0;
-    double fractional_lon = cprlon / 131072.0;
-    double rlon, rlat;
-    int j, m;
+    int64_t span = surface ? 90 : 360; // degrees covered by the zones
+    int64_t nz = fflag ? 59 : 60;
 
-    AirDlat = (surface ? 90.0 : 360.0) / (fflag ? 59.0 : 60.0);
+    double refLatZ = reflat * (nz * CPR_MAX) / span;
+    int64_t refLatFloor = (int64_t) floor(refLatZ);
+    int64_t refLatCeil = refLatFloor + (refLatZ > refLatFloor);
 
     // Compute the Latitude Index "j"
-    j = (int) (floor(reflat / AirDlat) +
-            floor(0.5 + cprModDouble(reflat, AirDlat) / AirDlat - fractional_lat));
-    rlat = AirDlat * (j + fractional_lat);
-    if (rlat >= 270) rlat -= 360;
+    int64_t j = cprFloorDiv(refLatFloor, CPR_MAX)
+        + cprFloorDiv(CPR_MAX / 2 + cprMod(refLatFloor, CPR_MAX) - cprlat, CPR_MAX);
+    int64_t rlat = j * CPR_MAX + cprlat;
+    int64_t full = nz * CPR_MAX * 360 / span; // zone units per 360 degrees
+    if (4 * rlat >= 3 * full) rlat -= full;
 
     // Check to see that the latitude is in range: -90 .. +90
-    if (rlat < -90 || rlat > 90) {
+    if (4 * rlat < -full || 4 * rlat > full) {
         return (-1); // Time to give up - Latitude error
     }
 
     // Check to see that answer is reasonable - ie no more than 1/2 cell away
-    if (fabs(rlat - reflat) > (AirDlat / 2)) {
+    if (rlat - CPR_MAX / 2 > refLatFloor || rlat + CPR_MAX / 2 < refLatCeil) {
         return (-1); // Time to give up - Latitude error
     }
 
     // Compute the Longitude Index "m"
-    AirDlon = cprDlonFunction(rlat, fflag, surface);
-    m = (int) (floor(reflon / AirDlon) +
-            floor(0.5 + cprModDouble(reflon, AirDlon) / AirDlon - fractional_lon));
-    rlon = AirDlon * (m + fractional_lon);
-    if (rlon > 180) rlon -= 360;
+    int64_t rlatUnits = rlat * (span * 2 * 59 / nz);
+    int64_t ni = cprNFunction(rlatUnits, fflag);
+
+    double refLonZ = reflon * (ni * CPR_MAX) / span;
+    int64_t refLonFloor = (int64_t) floor(refLonZ);
+    int64_t refLonCeil = refLonFloor + (refLonZ > refLonFloor);
+
+    int64_t m = cprFloorDiv(refLonFloor, CPR_MAX)
+        + cprFloorDiv(CPR_MAX / 2 + cprMod(refLonFloor, CPR_MAX) - cprlon, CPR_MAX);
+    int64_t rlon = m * CPR_MAX + cprlon;
+    int64_t lonFull = ni * CPR_MAX * 360 / span;
+    if (2 * rlon > lonFull) rlon -= lonFull;
 
     // Check to see that answer is reasonable - ie no more than 1/2 cell away
-    if (fabs(rlon - reflon) > (AirDlon / 2))
+    if (rlon - CPR_MAX / 2 > refLonFloor || rlon + CPR_MAX / 2 < refLonCeil)
         return (-1); // Time to give up - Longitude error
 
-    *out_lat = rlat;
-    *out_lon = rlon;
+    *out_lat = rlatUnits / (double) LAT_UNITS;
+    *out_lon = rlon * ((double) span / (ni * CPR_MAX));
     return (0);
 }
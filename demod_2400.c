@@ -210,7 +210,7 @@ static void tryPhase(int try_phase, uint16_t *m, int j, unsigned char **bestmsg,
 // Given 'mlen' magnitude samples in 'm', sampled at 2.4MHz,
 // try to demodulate some Mode S messages.
 //
-void demodulate2400(struct mag_buf *mag) {
+void demodulate2400(struct sdrDevice *sdr, struct mag_buf *mag) {
     static struct modesMessage zeroMessage;
     struct modesMessage mm;
     unsigned char msg1[MODES_LONG_MSG_BYTES], msg2[MODES_LONG_MSG_BYTES], *msg;
@@ -251,7 +251,7 @@ void demodulate2400(struct mag_buf *mag) {
         uint32_t ref_level;
 
         // reduce number of preamble detections if we recently dropped samples
-        if (Modes.stats_15min.samples_dropped)
+        if (Modes.statsWindows[STATS_WINDOW_15MIN].sum.samples_dropped)
             ref_level = base_noise / 2 * max(80, Modes.preambleThreshold);
         else
             ref_level = base_noise / 2 * Modes.preambleThreshold;
@@ -320,6 +320,7 @@ void demodulate2400(struct mag_buf *mag) {
 
         // Set initial mm structure details
         mm = zeroMessage;
+        mm.receiverId = sdr->receiverId;
 
         // For consistency with how the Beast / Radarcape does it,
         // we report the timestamp at the end of bit 56 (even if
@@ -342,6 +343,7 @@ void demodulate2400(struct mag_buf *mag) {
                 continue;
             } else {
                 Modes.stats_current.demod_accepted[mm.correctedbits]++;
+                sdr->stats.messages++;
             }
         }
 
@@ -482,13 +484,14 @@ static void draw_modeac(uint16_t *m, unsigned modeac, unsigned f1_clock, unsigne
 //            1.00us = 60 cycles } one bit period = 1.45us = 87 cycles
 //
 // one 2.4MHz sample = 25 cycles
-void demodulate2400AC(struct mag_buf *mag) {
+void demodulate2400AC(struct sdrDevice *sdr, struct mag_buf *mag) {
     struct modesMessage mm;
     uint16_t *m = mag->data;
     uint32_t mlen = mag->length;
     unsigned f1_sample;
 
     memset(&mm, 0, sizeof (mm));
+    mm.receiverId = sdr->receiverId;
 
     double noise_stddev = sqrt(mag->mean_power - mag->mean_level * mag->mean_level); // Var(X) = E[(X-E[X])^2] = E[X^2] - (E[X])^2
     unsigned noise_level = (unsigned) ((mag->mean_power + noise_stddev) * 65535 + 0.5);
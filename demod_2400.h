@@ -27,8 +27,9 @@
 #include <stdint.h>
 
 struct mag_buf;
+struct sdrDevice;
 
-void demodulate2400 (struct mag_buf *mag);
-void demodulate2400AC (struct mag_buf *mag);
+void demodulate2400 (struct sdrDevice *sdr, struct mag_buf *mag);
+void demodulate2400AC (struct sdrDevice *sdr, struct mag_buf *mag);
 
 #endif
@@ -1,8 +1,6 @@
 #include "readsb.h"
 
-#define LEG_FOCUS (0xc0ffeeba)
 
-static void mark_legs(struct aircraft *a);
 static void load_blob(int blob);
 
 ssize_t check_write(int fd, const void *buf, size_t count, const char *error_context) {
@@ -14,362 +12,6 @@ ssize_t check_write(int fd, const void *buf, size_t count, const char *error_con
     return res;
 }
 
-void init_globe_index(struct tile *s_tiles) {
-    int count = 0;
-
-    // Arctic
-    s_tiles[count++] = (struct tile) {
-        60, -126,
-        90, 0
-    };
-    s_tiles[count++] = (struct tile) {
-        60, 0,
-        90, 150
-    };
-
-    // Alaska and Chukotka
-    s_tiles[count++] = (struct tile) {
-        51, 150,
-        90, -126
-    };
-    // North Pacific
-    s_tiles[count++] = (struct tile) {
-        9, 150,
-        51, -126
-    };
-
-    // Northern Canada
-    s_tiles[count++] = (struct tile) {
-        51, -126,
-        60, -69
-    };
-
-    // Northwest USA
-    s_tiles[count++] = (struct tile) {
-        45, -120,
-        51, -114
-    };
-    s_tiles[count++] = (struct tile) {
-        45, -114,
-        51, -102
-    };
-    s_tiles[count++] = (struct tile) {
-        45, -102,
-        51, -90
-    };
-    // Eastern Canada
-    s_tiles[count++] = (struct tile) {
-        45, -90,
-        51, -75
-    };
-
-    s_tiles[count++] = (struct tile) {
-        45, -75,
-        51, -69
-    };
-    // Balkan
-    s_tiles[count++] = (struct tile) {
-        42, 12,
-        48, 18
-    };
-    s_tiles[count++] = (struct tile) {
-        42, 18,
-        48, 24
-    };
-    // Poland
-    s_tiles[count++] = (struct tile) {
-        48, 18,
-        54, 24
-    };
-    // Sweden
-    s_tiles[count++] = (struct tile) {
-        54, 12,
-        60, 24
-    };
-    // Denmark
-    s_tiles[count++] = (struct tile) {
-        54, 3,
-        60, 12
-    };
-    // Northern UK
-    s_tiles[count++] = (struct tile) {
-        54, -9,
-        60, 3
-    };
-
-    // Golfo de Vizcaya / Bay of Biscay
-    s_tiles[count++] = (struct tile) {
-        42, -9,
-        48, 0
-    };
-
-    // West Russia
-    s_tiles[count++] = (struct tile) {
-        42, 24,
-        51, 51
-    };
-    s_tiles[count++] = (struct tile) {
-        51, 24,
-        60, 51
-    };
-
-    // Central Russia
-    s_tiles[count++] = (struct tile) {
-        30, 51,
-        60, 90
-    };
-
-    // East Russia
-    s_tiles[count++] = (struct tile) {
-        30, 90,
-        60, 120
-    };
-    // Koreas and Japan and some Russia
-    s_tiles[count++] = (struct tile) {
-        30, 120,
-        39, 129
-    };
-    s_tiles[count++] = (struct tile) {
-        30, 129,
-        39, 138
-    };
-    s_tiles[count++] = (struct tile) {
-        30, 138,
-        39, 150
-    };
-    s_tiles[count++] = (struct tile) {
-        39, 120,
-        60, 150
-    };
-    // Vietnam
-    s_tiles[count++] = (struct tile) {
-        9, 90,
-        21, 111
-    };
-
-    // South China
-    s_tiles[count++] = (struct tile) {
-        21, 90,
-        30, 111
-    };
-
-    // South China and ICAO special use
-    s_tiles[count++] = (struct tile) {
-        9, 111,
-        24, 129
-    };
-    s_tiles[count++] = (struct tile) {
-        24, 111,
-        30, 120
-    };
-    s_tiles[count++] = (struct tile) {
-        24, 120,
-        30, 129
-    };
-
-    // mostly pacific south of Japan
-    s_tiles[count++] = (struct tile) {
-        9, 129,
-        30, 150
-    };
-
-
-    // Persian Gulf / Arabian Sea
-    s_tiles[count++] = (struct tile) {
-        9, 51,
-        30, 69
-    };
-
-    // India
-    s_tiles[count++] = (struct tile) {
-        9, 69,
-        30, 90
-    };
-
-    // South Atlantic / South Africa
-    s_tiles[count++] = (struct tile) {
-        -90, -30,
-        9, 51
-    };
-    //Indian Ocean
-    s_tiles[count++] = (struct tile) {
-        -90, 51,
-        9, 111
-    };
-
-    // Australia
-    s_tiles[count++] = (struct tile) {
-        -90, 111,
-        -18, 160
-    };
-    s_tiles[count++] = (struct tile) {
-        -18, 111,
-        9, 160
-    };
-
-    // South Pacific and NZ
-    s_tiles[count++] = (struct tile) {
-        -90, 160,
-        -42, -90
-    };
-    s_tiles[count++] = (struct tile) {
-        -42, 160,
-        9, -90
-    };
-
-    // North South America
-    s_tiles[count++] = (struct tile) {
-        -9, -90,
-        9, -42
-    };
-
-    // South South America
-    // west
-    s_tiles[count++] = (struct tile) {
-        -90, -90,
-        -9, -63
-    };
-    // east
-    s_tiles[count++] = (struct tile) {
-        -21, -63,
-        -9, -42
-    };
-    s_tiles[count++] = (struct tile) {
-        -90, -63,
-        -21, -42
-    };
-
-    s_tiles[count++] = (struct tile) {
-        -90, -42,
-        9, -30
-    };
-
-    // Guatemala / Mexico
-    s_tiles[count++] = (struct tile) {
-        9, -126,
-        33, -117
-    };
-    s_tiles[count++] = (struct tile) {
-        9, -117,
-        30, -102
-    };
-    // western gulf + east mexico
-    s_tiles[count++] = (struct tile) {
-        9, -102,
-        27, -90
-    };
-    // Eastern Gulf of Mexico
-    s_tiles[count++] = (struct tile) {
-        24, -90,
-        30, -84
-    };
-
-    // south of jamaica
-    s_tiles[count++] = (struct tile) {
-        9, -90,
-        18, -69
-    };
-
-    // Cuba / Haiti
-    s_tiles[count++] = (struct tile) {
-        18, -90,
-        24, -69
-    };
-
-    // Mediterranean
-    s_tiles[count++] = (struct tile) {
-        36, 6,
-        42, 18
-    };
-    s_tiles[count++] = (struct tile) {
-        36, 18,
-        42, 30
-    };
-
-    // North Africa
-    s_tiles[count++] = (struct tile) {
-        9, -9,
-        39, 6
-    };
-    s_tiles[count++] = (struct tile) {
-        9, 6,
-        36, 30
-    };
-
-    // Middle East
-    s_tiles[count++] = (struct tile) {
-        9, 30,
-        42, 51
-    };
-
-    // west of Bermuda
-    s_tiles[count++] = (struct tile) {
-        24, -75,
-        39, -69
-    };
-    // North Atlantic
-    s_tiles[count++] = (struct tile) {
-        9, -69,
-        30, -33
-    };
-    s_tiles[count++] = (struct tile) {
-        30, -69,
-        60, -33
-    };
-    s_tiles[count++] = (struct tile) {
-        9, -33,
-        30, -9
-    };
-    s_tiles[count++] = (struct tile) {
-        30, -33,
-        60, -9
-    };
-
-    Modes.specialTileCount = count;
-
-    if (count + 1 >= GLOBE_SPECIAL_INDEX)
-        fprintf(stderr, "increase GLOBE_SPECIAL_INDEX please!\n");
-}
-
-int globe_index(double lat_in, double lon_in) {
-    int grid = GLOBE_INDEX_GRID;
-    int lat = grid * ((int) ((lat_in + 90) / grid)) - 90;
-    int lon = grid * ((int) ((lon_in + 180) / grid)) - 180;
-
-    struct tile *tiles = Modes.json_globe_special_tiles;
-
-    for (int i = 0; tiles[i].south != 0 || tiles[i].north != 0; i++) {
-        struct tile tile = tiles[i];
-        if (lat >= tile.south && lat < tile.north) {
-            if (tile.west < tile.east && lon >= tile.west && lon < tile.east) {
-                return i;
-            }
-            if (tile.west > tile.east && (lon >= tile.west || lon < tile.east)) {
-                return i;
-            }
-        }
-    }
-
-
-    int i = (lat + 90) / grid;
-    int j = (lon + 180) / grid;
-
-    int res = (i * GLOBE_LAT_MULT + j + GLOBE_MIN_INDEX);
-    if (res > GLOBE_MAX_INDEX) {
-        fprintf(stderr, "globe_index out of bounds: %d %d %d\n", res, lat, lon);
-        return 0;
-    }
-    return res;
-    // highest number returned: globe_index(90, 180)
-    // first 1000 are reserved for special use
-}
-
-int globe_index_index(int index) {
-    double lat = ((index - GLOBE_MIN_INDEX) /  GLOBE_LAT_MULT) * GLOBE_INDEX_GRID - 90;
-    double lon = ((index - GLOBE_MIN_INDEX) % GLOBE_LAT_MULT) * GLOBE_INDEX_GRID - 180;
-    return globe_index(lat, lon);
-}
-
 static void createDateDir(char *base_dir, struct tm *utc, char *dateDir) {
     if (!strcmp(TDATE_FORMAT, "%Y/%m/%d")) {
         char yy[100];
@@ -417,12 +59,12 @@ static void traceWrite(struct aircraft *a, uint64_t now, int init) {
         return;
 
     if (!init) {
-        mark_legs(a);
+        markLegs(a);
     }
 
     int start24 = 0;
     for (int i = 0; i < a->trace_len; i++) {
-        if (a->trace[i].timestamp > now - (24 * HOURS + 15 * MINUTES)) {
+        if (getState(a, i)->timestamp > now - (24 * HOURS + 15 * MINUTES)) {
             start24 = i;
             break;
         }
@@ -478,10 +120,10 @@ static void traceWrite(struct aircraft *a, uint64_t now, int init) {
             int start = -1;
             int end = -1;
             for (int i = 0; i < a->trace_len; i++) {
-                if (start == -1 && a->trace[i].timestamp > start_of_day) {
+                if (start == -1 && getState(a, i)->timestamp > start_of_day) {
                     start = i;
                 }
-                if (a->trace[i].timestamp < end_of_day) {
+                if (getState(a, i)->timestamp < end_of_day) {
                     end = i;
                 }
             }
@@ -550,11 +192,17 @@ static int load_aircraft(char **p, char *end, uint64_t now) {
         return -1;
     }
 
-    a->trace = NULL;
-    a->trace_all = NULL;
+    a->trace_chunks = NULL;
+    a->trace_chunk_first = 0;
+    a->trace_chunk_ring = 0;
+    a->trace_chunk_count = 0;
+    a->trace_head = 0;
+    a->trace_alloc = 0;
+    a->legs = NULL;
+    a->api_index = -1;
+    a->dbGeneration = 0; // refresh type / registration from the current database
 
     if (!Modes.keep_traces) {
-        a->trace_alloc = 0;
         a->trace_len = 0;
     }
 
@@ -572,26 +220,21 @@ static int load_aircraft(char **p, char *end, uint64_t now) {
     int size_all = stateAllBytes(a->trace_len);
     if (a->trace_len > 0
             && a->trace_len <= TRACE_SIZE
-            && a->trace_alloc >= a->trace_len
-            && a->trace_alloc <= TRACE_SIZE
        ) {
 
 
         if (end - *p < (long) (size_state + size_all)) {
             // TRACE FAIL
             fprintf(stderr, "read trace fail 1\n");
-            a->trace = NULL;
-            a->trace_all = NULL;
-            a->trace_alloc = 0;
             a->trace_len = 0;
+        } else if (!traceReserve(a, a->trace_len + TRACE_MARGIN) || !traceImport(a, a->trace_len, *p)) {
+            fprintf(stderr, "read trace fail: out of memory\n");
+            traceFree(a);
+            a->trace_len = 0;
+            *p += size_state + size_all;
         } else {
             // TRACE SUCCESS
-            traceRealloc(a, a->trace_alloc);
-
-            memcpy(a->trace, *p, size_state);
-            *p += size_state;
-            memcpy(a->trace_all, *p, size_all);
-            *p += size_all;
+            *p += size_state + size_all;
 
             if (a->addr == LEG_FOCUS) {
                 a->trace_next_fw = now;
@@ -604,10 +247,7 @@ static int load_aircraft(char **p, char *end, uint64_t now) {
             fprintf(stderr, "read trace fail 2\n");
             *p += a->trace_len * (size_state + size_all); // increment pointer not to invalidate state file
         }
-        a->trace = NULL;
-        a->trace_all = NULL;
         a->trace_len = 0;
-        a->trace_alloc = 0;
     }
 
     if (a->globe_index > GLOBE_MAX_INDEX)
@@ -648,6 +288,9 @@ static int load_aircraft(char **p, char *end, uint64_t now) {
     int new_index = a->globe_index;
     a->globe_index = -5;
     set_globe_index(a, new_index);
+
+    if (a->position_valid.source != SOURCE_INVALID)
+        apiUpdate(a);
     updateValidities(a, now);
 
     return 0;
@@ -710,299 +353,6 @@ void *jsonTraceThreadEntryPoint(void *arg) {
     pthread_exit(NULL);
 }
 
-static void mark_legs(struct aircraft *a) {
-    if (a->trace_len < 20)
-        return;
-
-    int high = 0;
-    int low = 100000;
-
-    int last_five[5] = { 0 };
-    uint32_t five_pos = 0;
-
-    double sum = 0;
-
-    struct state *last_leg = NULL;
-    struct state *new_leg = NULL;
-
-    for (int i = 0; i < a->trace_len; i++) {
-        int32_t altitude = a->trace[i].altitude * 25;
-        int on_ground = a->trace[i].flags.on_ground;
-        int altitude_valid = a->trace[i].flags.altitude_valid;
-
-        if (a->trace[i].flags.leg_marker) {
-            a->trace[i].flags.leg_marker = 0;
-            // reset leg marker
-            last_leg = &a->trace[i];
-        }
-
-        if (!altitude_valid)
-            continue;
-
-        if (on_ground) {
-            int avg = 0;
-            for (int i = 0; i < 5; i++) avg += last_five[i];
-            avg /= 5;
-            altitude = avg;
-        } else {
-            if (five_pos == 0) {
-                for (int i = 0; i < 5; i++)
-                    last_five[i] = altitude;
-            } else {
-                last_five[five_pos % 5] = altitude;
-            }
-            five_pos++;
-        }
-
-        sum += altitude;
-    }
-
-    int threshold = (int) (sum / (double) (a->trace_len * 3));
-
-    if (a->addr == LEG_FOCUS) {
-        fprintf(stderr, "threshold: %d\n", threshold);
-        fprintf(stderr, "trace_len: %d\n", a->trace_len);
-    }
-
-
-    if (threshold > 10000)
-        threshold = 10000;
-    if (threshold < 200)
-        threshold = 200;
-
-    high = 0;
-    low = 100000;
-
-    uint64_t major_climb = 0;
-    uint64_t major_descent = 0;
-    int major_climb_index = 0;
-    int major_descent_index = 0;
-    uint64_t last_high = 0;
-    uint64_t last_low = 0;
-
-    int last_low_index = 0;
-
-    uint64_t last_airborne = 0;
-    uint64_t last_ground = 0;
-
-    int was_ground = 0;
-
-    for (int i = 0; i < 5; i++)
-        last_five[i] = 0;
-    five_pos = 0;
-
-    int prev_tmp = 0;
-    for (int i = 1; i < a->trace_len; i++) {
-        struct state *state = &a->trace[i];
-        int prev_index = prev_tmp;
-        struct state *prev = &a->trace[prev_index];
-
-        uint64_t elapsed = state->timestamp - prev->timestamp;
-
-        int32_t altitude = state->altitude * 25;
-        //int32_t geom_rate = state->geom_rate * 32;
-        //int geom_rate_valid = state->flags.geom_rate_valid;
-        //int stale = state->flags.stale;
-        int on_ground = state->flags.on_ground;
-        int altitude_valid = state->flags.altitude_valid;
-        //int gs_valid = state->flags.gs_valid;
-        //int track_valid = state->flags.track_valid;
-        //int leg_marker = state->flags.leg_marker;
-        //
-        if (!on_ground && !altitude_valid)
-            continue;
-
-        prev_tmp = i;
-
-        if (on_ground) {
-            int avg = 0;
-            for (int i = 0; i < 5; i++)
-                avg += last_five[i];
-            avg /= 5;
-            altitude = avg - threshold / 2;
-        } else {
-            if (five_pos == 0) {
-                for (int i = 0; i < 5; i++)
-                    last_five[i] = altitude;
-            } else {
-                last_five[five_pos % 5] = altitude;
-            }
-            five_pos++;
-        }
-
-        if (!on_ground)
-            last_airborne = state->timestamp;
-        else
-            last_ground = state->timestamp;
-
-        if (altitude >= high) {
-            high = altitude;
-        }
-        if (altitude <= low) {
-            low = altitude;
-        }
-
-        /*
-        if (state->timestamp > a->trace[i-1].timestamp + 45 * 60 * 1000) {
-            high = low = altitude;
-        }
-        */
-
-        if (abs(low - altitude) < threshold * 1 / 3 && elapsed < 30 * MINUTES) {
-            last_low = state->timestamp;
-            last_low_index = i;
-        }
-        if (abs(high - altitude) < threshold * 1 / 3)
-            last_high = state->timestamp;
-
-        if (high - low > threshold) {
-            if (last_high > last_low) {
-                // only set new major climb time if this is after a major descent.
-                // then keep that time associated with the climb
-                // still report continuation of thta climb
-                if (major_climb <= major_descent) {
-                    int bla = min(a->trace_len - 1, last_low_index + 3);
-                    major_climb = a->trace[bla].timestamp;
-                    major_climb_index = bla;
-                }
-                if (a->addr == LEG_FOCUS) {
-                    time_t nowish = major_climb/1000;
-                    struct tm utc;
-                    gmtime_r(&nowish, &utc);
-                    char tstring[100];
-                    strftime (tstring, 100, "%H:%M:%S", &utc);
-                    fprintf(stderr, "climb: %d %s\n", altitude, tstring);
-                }
-                low = high - threshold * 9/10;
-            } else if (last_high < last_low) {
-                int bla = max(0, last_low_index - 3);
-                major_descent = a->trace[bla].timestamp;
-                major_descent_index = bla;
-                if (a->addr == LEG_FOCUS) {
-                    time_t nowish = major_descent/1000;
-                    struct tm utc;
-                    gmtime_r(&nowish, &utc);
-                    char tstring[100];
-                    strftime (tstring, 100, "%H:%M:%S", &utc);
-                    fprintf(stderr, "desc: %d %s\n", altitude, tstring);
-                }
-                high = low + threshold * 9/10;
-            }
-        }
-        int leg_now = 0;
-        if ( (major_descent && (on_ground || was_ground) && elapsed > 25 * 60 * 1000) ||
-                (major_descent && (on_ground || was_ground) && state->timestamp > last_airborne + 45 * 60 * 1000)
-           )
-        {
-            if (a->addr == LEG_FOCUS)
-                fprintf(stderr, "ground leg\n");
-            leg_now = 1;
-        }
-        double distance = greatcircle(
-                (double) a->trace[i].lat / 1E6,
-                (double) a->trace[i].lon / 1E6,
-                (double) a->trace[i-1].lat / 1E6,
-                (double) a->trace[i-1].lon / 1E6
-                );
-
-        if ( elapsed > 30 * 60 * 1000 && distance < 10E3 * (elapsed / (30 * 60 * 1000.0)) && distance > 1) {
-            leg_now = 1;
-            if (a->addr == LEG_FOCUS)
-                fprintf(stderr, "time/distance leg, elapsed: %0.fmin, distance: %0.f\n", elapsed / (60 * 1000.0), distance / 1000.0);
-        }
-
-        int leg_float = 0;
-        if (major_climb && major_descent &&
-                (major_climb > major_descent + 8 * MINUTES || last_ground > major_descent - 2 * MINUTES)
-           ) {
-            for (int i = major_descent_index + 1; i < major_climb_index; i++) {
-                if (a->trace[i].timestamp > a->trace[i - 1].timestamp + 5 * MINUTES) {
-                    leg_float = 1;
-                    if (a->addr == LEG_FOCUS)
-                        fprintf(stderr, "float leg\n");
-                }
-            }
-        }
-
-
-        if (leg_float || leg_now)
-        {
-            uint64_t leg_ts = 0;
-
-            if (leg_now) {
-                new_leg = &a->trace[prev_index + 1];
-                for (int k = prev_index + 1; k < i; k++) {
-                    struct state *state = &a->trace[i];
-                    struct state *last = &a->trace[i - 1];
-
-                    if (state->timestamp > last->timestamp + 5 * 60 * 1000) {
-                        new_leg = state;
-                        break;
-                    }
-                }
-            } else if (major_descent_index + 1 == major_climb_index) {
-                new_leg = &a->trace[major_climb_index];
-            } else {
-                for (int i = major_climb_index; i > major_descent_index; i--) {
-                    struct state *state = &a->trace[i];
-                    struct state *last = &a->trace[i - 1];
-
-                    if (state->timestamp > last->timestamp + 5 * 60 * 1000) {
-                        new_leg = state;
-                        break;
-                    }
-                }
-                uint64_t half = major_descent + (major_climb - major_descent) / 2;
-                for (int i = major_descent_index + 1; i < major_climb_index; i++) {
-                    struct state *state = &a->trace[i];
-
-                    if (state->timestamp > half) {
-                        new_leg = state;
-                        break;
-                    }
-                }
-            }
-
-            if (new_leg) {
-                leg_ts = new_leg->timestamp;
-                new_leg->flags.leg_marker = 1;
-                // set leg marker
-            }
-
-            major_climb = 0;
-            major_climb_index = 0;
-            major_descent = 0;
-            major_descent_index = 0;
-            low += threshold;
-            high -= threshold;
-
-            if (a->addr == LEG_FOCUS) {
-                if (new_leg) {
-                    time_t nowish = leg_ts/1000;
-                    struct tm utc;
-                    gmtime_r(&nowish, &utc);
-                    char tstring[100];
-                    strftime (tstring, 100, "%H:%M:%S", &utc);
-                    fprintf(stderr, "leg: %s\n", tstring);
-                } else {
-                    time_t nowish = state->timestamp/1000;
-                    struct tm utc;
-                    gmtime_r(&nowish, &utc);
-                    char tstring[100];
-                    strftime (tstring, 100, "%H:%M:%S", &utc);
-                    fprintf(stderr, "resetting major_c/d without leg: %s\n", tstring);
-                }
-            }
-        }
-
-        was_ground = on_ground;
-    }
-    if (last_leg != new_leg) {
-        a->trace_full_write = 9999;
-        //fprintf(stderr, "%06x\n", a->addr);
-    }
-}
-
 void ca_init (struct craftArray *ca) {
     //*ca = (struct craftArray) {0};
     pthread_mutex_init(&ca->mutex , NULL);
@@ -1128,19 +478,86 @@ ssize_t stateAllBytes(int len) {
     return (len + 3) / 4 * sizeof(struct state_all);
 }
 
-void traceRealloc(struct aircraft *a, int len) {
-    if (len == 0) {
-        traceCleanup(a);
+// decimation tiers for traces kept longer than a day (--keep-traces)
+// the history files are written from memory until the day is over, only older points are thinned out
+static const struct {
+    int64_t age; // points older than this
+    int64_t spacing; // are kept at most once per spacing
+} traceTiers[] = {
+    { 26 * HOURS, 1 * MINUTES },
+    { 3 * 24 * HOURS, 5 * MINUTES },
+    { 7 * 24 * HOURS, 15 * MINUTES },
+};
+#define TRACE_TIERS ((int) (sizeof(traceTiers) / sizeof(traceTiers[0])))
+
+static int64_t tierSpacing(uint64_t now, uint64_t timestamp) {
+    int64_t spacing = 0;
+    for (int t = 0; t < TRACE_TIERS; t++) {
+        if ((int64_t) (now - timestamp) > traceTiers[t].age)
+            spacing = traceTiers[t].spacing;
+    }
+    return spacing;
+}
+
+// thin out the points older than the first tier in place
+// gaps (stale), leg markers and ground / air changes are kept
+// the number of removed points is a multiple of 4 so the newer points keep their state_all
+static void traceDecimate(struct aircraft *a, uint64_t now) {
+    int end = 0;
+    while (end < a->trace_len && tierSpacing(now, getState(a, end)->timestamp))
+        end++;
+    end -= end % 4;
+    if (end < 8)
         return;
+
+    uint8_t *keep = malloc(end);
+    if (!keep)
+        return;
+
+    int dropped = 0;
+    struct state *kept = getState(a, 0);
+    keep[0] = 1;
+    for (int i = 1; i < end; i++) {
+        struct state *state = getState(a, i);
+        int gapNext = (i + 1 < a->trace_len && getState(a, i + 1)->flags.stale);
+        keep[i] = (state->flags.stale || gapNext || state->flags.leg_marker
+                || state->flags.on_ground != kept->flags.on_ground
+                || (int64_t) (state->timestamp - kept->timestamp) >= tierSpacing(now, state->timestamp));
+        if (keep[i])
+            kept = state;
+        else
+            dropped++;
+    }
+    // keep the newest candidates until the rest of the trace moves by a multiple of 4
+    for (int i = end - 1; dropped % 4 != 0; i--) {
+        if (!keep[i]) {
+            keep[i] = 1;
+            dropped--;
+        }
     }
-    a->trace_alloc = len;
-    if (a->trace_alloc > TRACE_SIZE)
-        a->trace_alloc = TRACE_SIZE;
-    a->trace = realloc(a->trace, stateBytes(a->trace_alloc));
-    a->trace_all = realloc(a->trace_all, stateAllBytes(a->trace_alloc));
 
-    if (a->trace_len >= TRACE_SIZE / 2)
-        fprintf(stderr, "Quite a long trace: %06x (%d).\n", a->addr, a->trace_len);
+    if (dropped > 0) {
+        int total = a->trace_len + a->tracePosBuffered;
+        int j = 0;
+        for (int i = 0; i < total; i++) {
+            if (i < end && !keep[i])
+                continue;
+            if (i != j) {
+                *getState(a, j) = *getState(a, i);
+                if (j % 4 == 0)
+                    *getStateAll(a, j) = *getStateAll(a, i);
+            }
+            j++;
+        }
+        a->trace_len -= dropped;
+        // indexes changed, leg detection starts over
+        legsCleanup(a);
+        a->trace_full_write = 9999;
+
+        if (Modes.debug_traceAlloc)
+            fprintf(stderr, "%06x: decimate: dropped %d of %d points\n", a->addr, dropped, end);
+    }
+    free(keep);
 }
 
 void traceResize(struct aircraft *a, uint64_t now) {
@@ -1153,16 +570,19 @@ void traceResize(struct aircraft *a, uint64_t now) {
         return;
     }
 
+    if (Modes.keep_traces > traceTiers[0].age)
+        traceDecimate(a, now);
+
     uint64_t keep_after = now - Modes.keep_traces;
 
-    if (a->trace_len == TRACE_SIZE || a->trace->timestamp < keep_after - 20 * MINUTES)  {
+    if (a->trace_len == TRACE_SIZE || getState(a, 0)->timestamp < keep_after - 20 * MINUTES)  {
         int new_start = a->trace_len;
 
         if (a->trace_len + TRACE_MARGIN >= TRACE_SIZE) {
             new_start = TRACE_SIZE / 64 + TRACE_MARGIN;
         } else {
             for (int i = 0; i < a->trace_len; i++) {
-                struct state *state = &a->trace[i];
+                struct state *state = getState(a, i);
                 if (state->timestamp > keep_after) {
                     new_start = i;
                     break;
@@ -1186,16 +606,8 @@ void traceResize(struct aircraft *a, uint64_t now) {
 
         a->trace_len -= new_start;
 
-        // carry over buffered position
-        if (a->tracePosBuffered)
-            a->trace_len++;
-
-        memmove(a->trace, a->trace + new_start, stateBytes(a->trace_len));
-        memmove(a->trace_all, a->trace_all + stateAllBytes(new_start) / sizeof(struct state_all), stateAllBytes(a->trace_len));
-
-        // remove buffered position from part of trace that's final
-        if (a->tracePosBuffered)
-            a->trace_len--;
+        // advance the start of the trace, the buffered position stays right after the end
+        traceDropStart(a, new_start);
 
         //a->trace_write = 1;
         //a->trace_full_write = 9999; // rewrite full history file
@@ -1204,14 +616,11 @@ void traceResize(struct aircraft *a, uint64_t now) {
 
     int oldAlloc = a->trace_alloc;
 
-    // shrink allocation
-    int shrinkTo = (a->trace_alloc - TRACE_MARGIN) * 3 / 4;
-    if (a->trace_len && a->trace_len < shrinkTo - 2 * TRACE_MARGIN && shrinkTo >= 2 * TRACE_MARGIN) {
-        traceRealloc(a, shrinkTo);
-    }
+    // hand chunks at the end back to the pool, keep more room than traceMaintenance grows at
+    traceShrink(a, a->trace_len + 2 * TRACE_MARGIN);
 
     if (Modes.debug_traceAlloc && a->trace_alloc != oldAlloc) {
-        fprintf(stderr, "%06x: shrink: trace_len: %d traceRealloc: %d -> %d\n", a->addr, a->trace_len, oldAlloc, a->trace_alloc);
+        fprintf(stderr, "%06x: shrink: trace_len: %d trace_alloc: %d -> %d\n", a->addr, a->trace_len, oldAlloc, a->trace_alloc);
     }
 }
 
@@ -1229,13 +638,10 @@ int traceUsePosBuffered(struct aircraft *a) {
 }
 
 void traceCleanup(struct aircraft *a) {
-    free(a->trace);
-    free(a->trace_all);
+    traceFree(a);
+    legsCleanup(a);
 
     a->tracePosBuffered = 0;
-    a->trace_alloc = 0;
-    a->trace = NULL;
-    a->trace_all = NULL;
     a->trace_len = 0;
 
     traceUnlink(a);
@@ -1254,13 +660,16 @@ void traceMaintenance(struct aircraft *a, uint64_t now) {
         traceResize(a, now);
     }
 
-    // grow allocation if necessary
-    if (a->trace_alloc && a->trace_len + TRACE_MARGIN >= a->trace_alloc) {
-        traceRealloc(a, a->trace_alloc * 4 / 3 + TRACE_MARGIN);
+    // link another chunk if necessary, traceAdd only uses the room that's there
+    if (a->trace_alloc && a->trace_len + TRACE_MARGIN >= a->trace_alloc && a->trace_alloc < TRACE_SIZE) {
+        traceReserve(a, a->trace_len + TRACE_MARGIN + 1);
+
+        if (a->trace_len >= TRACE_SIZE / 2 && oldAlloc < TRACE_SIZE / 2 + TRACE_CHUNK_SIZE)
+            fprintf(stderr, "Quite a long trace: %06x (%d).\n", a->addr, a->trace_len);
     }
 
     if (Modes.debug_traceAlloc && a->trace_alloc != oldAlloc) {
-        fprintf(stderr, "%06x: grow: trace_len: %d traceRealloc: %d -> %d\n", a->addr, a->trace_len, oldAlloc, a->trace_alloc);
+        fprintf(stderr, "%06x: grow: trace_len: %d trace_alloc: %d -> %d\n", a->addr, a->trace_len, oldAlloc, a->trace_alloc);
     }
 
     if (Modes.json_globe_index) {
@@ -1269,12 +678,16 @@ void traceMaintenance(struct aircraft *a, uint64_t now) {
             a->trace_write = 1;
         }
 
-        if (Modes.doFullTraceWrite) {
-            if (now < a->seen_pos + 3 * HOURS) {
-                a->trace_next_fw = now + random() % (2 * MINUTES); // spread over 2 mins
-                a->trace_full_write = 0xc0ffee;
-            } else {
-                a->trace_next_fw = now + 3 * MINUTES + random() % (2 * MINUTES); // spread over 2 mins
+        if (Modes.traceRolloverDay && a->trace_rollover != Modes.traceRolloverDay) {
+            // paced rewrite after the day boundary: recently seen aircraft during the first half
+            // of the window, the others during the second half, spread by address
+            uint64_t half = TRACE_ROLLOVER_WINDOW / 2;
+            uint64_t due = Modes.traceRolloverStart
+                + ((now < a->seen_pos + 3 * HOURS) ? 0 : half)
+                + (a->addr * 2654435761u) % half;
+            if (now >= due) {
+                a->trace_rollover = Modes.traceRolloverDay;
+                a->trace_next_fw = now;
                 a->trace_full_write = 0xc0ffee;
             }
         }
@@ -1323,8 +736,8 @@ int traceAdd(struct aircraft *a, uint64_t now) {
     }
 
     for (int i = max(0, a->trace_len - 6); i < a->trace_len; i++) {
-        if ( (int32_t) (a->lat * 1E6) == a->trace[i].lat
-                && (int32_t) (a->lon * 1E6) == a->trace[i].lon ) {
+        if ( (int32_t) (a->lat * 1E6) == getState(a, i)->lat
+                && (int32_t) (a->lon * 1E6) == getState(a, i)->lon ) {
             return 0;
         }
     }
@@ -1355,10 +768,10 @@ int traceAdd(struct aircraft *a, uint64_t now) {
     if (a->trace_len == 0 )
         goto save_state;
 
-    struct state *last = &(a->trace[a->trace_len-1]);
+    struct state *last = getState(a, a->trace_len-1);
 
     if (a->tracePosBuffered) {
-        elapsed_buffered = (int64_t) a->trace[a->trace_len].timestamp - (int64_t) last->timestamp;
+        elapsed_buffered = (int64_t) getState(a, a->trace_len)->timestamp - (int64_t) last->timestamp;
     }
 
     int alt = a->altitude_baro;
@@ -1524,10 +937,17 @@ save_state_no_buf:
 
 no_save_state:
 
-    if (!a->trace || !a->trace_len) {
+    recordEvent(REC_TRACE_ADD, now, a->addr, a->lastPosReceiverId,
+            posUsed ? 1 : (bufferedPosUsed ? 2 : 0), on_ground ? REC_SURFACE : 0,
+            a->lat, a->lon, distance, elapsed / 1000.0);
+
+    if (!a->trace_chunk_count || !a->trace_len) {
         // allocate trace memory
-        traceRealloc(a, 2 * TRACE_MARGIN);
-        a->trace->timestamp = now;
+        if (!traceReserve(a, 2 * TRACE_MARGIN)) {
+            fprintf(stderr, "%06x: traceAdd: out of memory\n", a->addr);
+            return 0;
+        }
+        getState(a, 0)->timestamp = now;
         a->trace_full_write = 9999; // rewrite full history file
 
         //fprintf(stderr, "%06x: new trace\n", a->addr);
@@ -1541,7 +961,7 @@ no_save_state:
         return 0;
     }
 
-    struct state *new = &(a->trace[a->trace_len]);
+    struct state *new = getState(a, a->trace_len);
     memset(new, 0, sizeof(struct state));
 
     new->lat = (int32_t) nearbyint(a->lat * 1E6);
@@ -1601,7 +1021,7 @@ no_save_state:
     // trace_all stuff:
 
     if (a->trace_len % 4 == 0) {
-        struct state_all *new_all = &(a->trace_all[a->trace_len/4]);
+        struct state_all *new_all = getStateAll(a, a->trace_len);
         memset(new_all, 0, sizeof(struct state_all));
 
         to_state_all(a, new_all, now);
@@ -1700,10 +1120,8 @@ void save_blob(int blob) {
                 memcpy(p, a, sizeof(struct aircraft));
                 p += sizeof(struct aircraft);
                 if (a->trace_len > 0) {
-                    memcpy(p, a->trace, size_state);
-                    p += size_state;
-                    memcpy(p, a->trace_all, size_all);
-                    p += size_all;
+                    traceExport(a, a->trace_len, p);
+                    p += size_state + size_all;
                 }
             } else {
                 fprintf(stderr, "%06x: too big for save_blob!\n", a->addr);
@@ -1809,56 +1227,35 @@ static void load_blob(int blob) {
 }
 
 
-int handleHeatmap(uint64_t now) {
-    if (!Modes.heatmap)
-        return 0;
-
-    time_t nowish = (now - 30 * MINUTES)/1000;
+// heatmap generation is spread over several calls: aircraft buckets are scanned in steps
+// until the deadline passes, the state is kept here in between
+static struct {
+    int active;
+    int half_hour;
     struct tm utc;
-    gmtime_r(&nowish, &utc);
-    int half_hour = utc.tm_hour * 2 + utc.tm_min / 30;
-
-    if (Modes.heatmap_current_interval < -1) {
-        Modes.heatmap_current_interval++;
-        return 0;
-        // startup delay before first time heatmap is written
-    }
-
-    // don't write on startup when persistent state isn't enabled
-    if (!Modes.state_dir && Modes.heatmap_current_interval < 0) {
-        Modes.heatmap_current_interval = half_hour;
-        return 0;
-    }
-    // only do this every 30 minutes.
-    if (half_hour == Modes.heatmap_current_interval)
-        return 0;
-
-    Modes.heatmap_current_interval = half_hour;
-
-    utc.tm_hour = half_hour / 2;
-    utc.tm_min = 30 * (half_hour % 2);
-    utc.tm_sec = 0;
-    uint64_t start = 1000 * (uint64_t) (timegm(&utc));
-    uint64_t end = start + 30 * MINUTES;
-    int num_slices = (30 * MINUTES) / Modes.heatmap_interval;
-
-
-    char pathbuf[PATH_MAX];
-    char tmppath[PATH_MAX];
-    int len = 0;
-    int len2 = 0;
-    int alloc = 1 * 1024 * 1024;
-    struct heatEntry *buffer = malloc(alloc * sizeof(struct heatEntry));
-    struct heatEntry *buffer2 = malloc(alloc * sizeof(struct heatEntry));
-    int *slices = malloc(alloc * sizeof(int));
-    struct heatEntry index[num_slices];
-
-    for (int j = 0; j < AIRCRAFT_BUCKETS; j++) {
+    uint64_t start;
+    uint64_t end;
+    int num_slices;
+    int bucket; // next aircraft bucket to scan
+    int len;
+    int alloc;
+    struct heatEntry *buffer;
+    int *slices;
+} heat;
+
+static void heatmapCollect(int bucket_start, int bucket_end) {
+    uint64_t start = heat.start;
+    uint64_t end = heat.end;
+    struct heatEntry *buffer = heat.buffer;
+    int *slices = heat.slices;
+    int len = heat.len;
+    int alloc = heat.alloc;
+
+    for (int j = bucket_start; j < bucket_end; j++) {
         for (struct aircraft *a = Modes.aircraft[j]; a; a = a->next) {
             if (a->addr & MODES_NON_ICAO_ADDRESS) continue;
             if (a->trace_len == 0) continue;
 
-            struct state *trace = a->trace;
             uint64_t next = start;
             int slice = 0;
             uint32_t squawk = 0x8888; // impossible squawk
@@ -1867,10 +1264,10 @@ int handleHeatmap(uint64_t now) {
             for (int i = 0; i < a->trace_len; i++) {
                 if (len >= alloc)
                     break;
-                if (trace[i].timestamp > end)
+                if (getState(a, i)->timestamp > end)
                     break;
-                if (trace[i].timestamp > start && i % 4 == 0) {
-                    struct state_all *all = &(a->trace_all[i/4]);
+                if (getState(a, i)->timestamp > start && i % 4 == 0) {
+                    struct state_all *all = getStateAll(a, i);
                     uint64_t *cs = (uint64_t *) &(all->callsign);
                     if (*cs != callsign || squawk != all->squawk) {
 
@@ -1892,27 +1289,27 @@ int handleHeatmap(uint64_t now) {
                         len++;
                     }
                 }
-                if (trace[i].timestamp < next)
+                if (getState(a, i)->timestamp < next)
                     continue;
-                if (!trace[i].flags.altitude_valid)
+                if (!getState(a, i)->flags.altitude_valid)
                     continue;
 
-                while (trace[i].timestamp > next + Modes.heatmap_interval) {
+                while (getState(a, i)->timestamp > next + Modes.heatmap_interval) {
                     next += Modes.heatmap_interval;
                     slice++;
                 }
 
                 buffer[len].hex = a->addr;
-                buffer[len].lat = trace[i].lat;
-                buffer[len].lon = trace[i].lon;
+                buffer[len].lat = getState(a, i)->lat;
+                buffer[len].lon = getState(a, i)->lon;
 
-                if (!trace[i].flags.on_ground)
-                    buffer[len].alt = trace[i].altitude;
+                if (!getState(a, i)->flags.on_ground)
+                    buffer[len].alt = getState(a, i)->altitude;
                 else
                     buffer[len].alt = -123; // on ground
 
-                if (trace[i].flags.gs_valid)
-                    buffer[len].gs = trace[i].gs;
+                if (getState(a, i)->flags.gs_valid)
+                    buffer[len].gs = getState(a, i)->gs;
                 else
                     buffer[len].gs = -1; // invalid
 
@@ -1925,6 +1322,26 @@ int handleHeatmap(uint64_t now) {
             }
         }
     }
+    heat.len = len;
+}
+
+static void heatmapWrite() {
+    uint64_t start = heat.start;
+    int num_slices = heat.num_slices;
+    struct heatEntry *buffer = heat.buffer;
+    int *slices = heat.slices;
+    int len = heat.len;
+
+    char pathbuf[PATH_MAX];
+    char tmppath[PATH_MAX];
+    int len2 = 0;
+    struct heatEntry *buffer2 = malloc(heat.alloc * sizeof(struct heatEntry));
+    struct heatEntry index[num_slices];
+
+    if (!buffer2) {
+        fprintf(stderr, "heatmap: out of memory!\n");
+        return;
+    }
 
     for (int i = 0; i < num_slices; i++) {
         struct heatEntry specialSauce = (struct heatEntry) {0};
@@ -1953,13 +1370,13 @@ int handleHeatmap(uint64_t now) {
 
     char dateDir[PATH_MAX * 3/4];
 
-    createDateDir(base_dir, &utc, dateDir);
+    createDateDir(base_dir, &heat.utc, dateDir);
 
     snprintf(pathbuf, PATH_MAX, "%s/heatmap", dateDir);
     if (mkdir(pathbuf, 0755) && errno != EEXIST)
         perror(pathbuf);
 
-    snprintf(pathbuf, PATH_MAX, "%s/heatmap/%02d.bin.ttf", dateDir, half_hour);
+    snprintf(pathbuf, PATH_MAX, "%s/heatmap/%02d.bin.ttf", dateDir, heat.half_hour);
     snprintf(tmppath, PATH_MAX, "%s/heatmap/temp_%lx_%lx", dateDir, random(), random());
 
     //fprintf(stderr, "%s using %d positions\n", pathbuf, len);
@@ -1990,64 +1407,156 @@ int handleHeatmap(uint64_t now) {
         perror("");
     }
 
-    free(buffer);
     free(buffer2);
-    free(slices);
+}
 
-    return 1;
+// returns 1 if the heatmap for the last half hour is in progress and this needs to be called again
+int handleHeatmap(uint64_t now, uint64_t deadline) {
+    if (!Modes.heatmap)
+        return 0;
+
+    if (!heat.active) {
+        time_t nowish = (now - 30 * MINUTES)/1000;
+        struct tm utc;
+        gmtime_r(&nowish, &utc);
+        int half_hour = utc.tm_hour * 2 + utc.tm_min / 30;
+
+        if (Modes.heatmap_current_interval < -1) {
+            Modes.heatmap_current_interval++;
+            return 0;
+            // startup delay before first time heatmap is written
+        }
+
+        // don't write on startup when persistent state isn't enabled
+        if (!Modes.state_dir && Modes.heatmap_current_interval < 0) {
+            Modes.heatmap_current_interval = half_hour;
+            return 0;
+        }
+        // only do this every 30 minutes.
+        if (half_hour == Modes.heatmap_current_interval)
+            return 0;
+
+        Modes.heatmap_current_interval = half_hour;
+
+        utc.tm_hour = half_hour / 2;
+        utc.tm_min = 30 * (half_hour % 2);
+        utc.tm_sec = 0;
+
+        heat.half_hour = half_hour;
+        heat.utc = utc;
+        heat.start = 1000 * (uint64_t) (timegm(&utc));
+        heat.end = heat.start + 30 * MINUTES;
+        heat.num_slices = (30 * MINUTES) / Modes.heatmap_interval;
+        heat.bucket = 0;
+        heat.len = 0;
+        heat.alloc = 1 * 1024 * 1024;
+        heat.buffer = malloc(heat.alloc * sizeof(struct heatEntry));
+        heat.slices = malloc(heat.alloc * sizeof(int));
+        if (!heat.buffer || !heat.slices) {
+            fprintf(stderr, "heatmap: out of memory!\n");
+            free(heat.buffer);
+            free(heat.slices);
+            return 0;
+        }
+        heat.active = 1;
+    }
+
+    while (heat.bucket < AIRCRAFT_BUCKETS) {
+        int stop = min(AIRCRAFT_BUCKETS, heat.bucket + HEATMAP_BUCKETS_STEP);
+        heatmapCollect(heat.bucket, stop);
+        heat.bucket = stop;
+        if (heat.bucket < AIRCRAFT_BUCKETS && mstime() > deadline)
+            return 1;
+    }
+
+    heatmapWrite();
+
+    free(heat.buffer);
+    free(heat.slices);
+    heat.buffer = NULL;
+    heat.slices = NULL;
+    heat.active = 0;
+
+    return 0;
 }
 
 
-void checkNewDay(uint64_t now) {
+// create the directory tree for the day containing time
+// the traces directory stays unreadable for the webserver until the day is finished
+static void createTraceDirs(uint64_t time) {
     char filename[PATH_MAX];
     char dateDir[PATH_MAX * 3/4];
     struct tm utc;
+    time_t t = time / 1000;
+    gmtime_r(&t, &utc);
 
-    if (!Modes.globe_history_dir || !Modes.json_globe_index)
-        return;
+    createDateDir(Modes.globe_history_dir, &utc, dateDir);
 
-    // nineteen_ago changes day 19 min after midnight: stop writing the previous days traces
-    // twenty_ago changes day 20 min after midnight: allow webserver to read the previous days traces
-    // this is in seconds, not milliseconds
-    time_t twenty_ago = now / 1000 - 20 * 60;
-    gmtime_r(&twenty_ago, &utc);
+    snprintf(filename, PATH_MAX, "%s/traces", dateDir);
+    if (mkdir(filename, 0700) && errno != EEXIST)
+        perror(filename);
 
-    if (utc.tm_mday != Modes.traceDay) {
-        Modes.traceDay = utc.tm_mday;
+    for (int i = 0; i < 256; i++) {
+        snprintf(filename, PATH_MAX, "%s/traces/%02x", dateDir, i);
+        if (mkdir(filename, 0755) && errno != EEXIST)
+            perror(filename);
+    }
+}
 
-        time_t yesterday = now / 1000 - 24 * 3600;
-        gmtime_r(&yesterday, &utc);
+static uint64_t dirsPrepared; // last day boundary (ms) with directories in place
 
-        createDateDir(Modes.globe_history_dir, &utc, dateDir); // doesn't usually create a directory ... but use the function anyhow worst that can happen is an empty directory for yesterday
+// misc job: create the date directories of the upcoming day hours in advance
+// so the day boundary doesn't wait on 258 mkdir
+int traceDateDirs(uint64_t now) {
+    if (!Modes.globe_history_dir || !Modes.json_globe_index)
+        return 0;
 
-        snprintf(filename, PATH_MAX, "%s/traces", dateDir);
-        chmod(filename, 0755);
+    for (uint64_t time = now; time <= now + 12 * HOURS; time += 12 * HOURS) {
+        uint64_t day = time / (24 * HOURS) * (24 * HOURS);
+        if (day > dirsPrepared) {
+            createTraceDirs(day);
+            dirsPrepared = day;
+        }
     }
+    return 0;
+}
+
+void checkNewDay(uint64_t now) {
+    if (!Modes.globe_history_dir || !Modes.json_globe_index)
+        return;
 
-    // 2 seconds after midnight, start a permanent write of all traces
-    // create the new directory for writing traces
-    // prevent the webserver from reading it until they are in a finished state
-    time_t nowish = (now - 2000)/1000;
-    gmtime_r(&nowish, &utc);
+    // unix time has no leap seconds, day boundaries are multiples of 24 hours
 
-    if (utc.tm_mday != Modes.mday) {
-        Modes.mday = utc.tm_mday;
+    // 2 seconds after midnight, start the rewrite of all traces which finalizes the previous day
+    // the rewrite is paced by traceMaintenance over TRACE_ROLLOVER_WINDOW
+    uint64_t day = (now - 2 * SECONDS) / (24 * HOURS) * (24 * HOURS);
+    if (day != Modes.traceRolloverDay) {
+        if (day > dirsPrepared) {
+            // not prepared by traceDateDirs yet (startup)
+            createTraceDirs(day);
+            dirsPrepared = day;
+        }
+        Modes.traceRolloverStart = now;
+        Modes.traceRolloverDay = day;
+    }
 
-        Modes.doFullTraceWrite = 1;
+    // nineteen_ago changes day 19 min after midnight: stop writing the previous days traces (traceWrite)
+    // twenty_ago changes day 20 min after midnight: allow webserver to read the previous days traces
+    uint64_t finished = (now - 20 * MINUTES) / (24 * HOURS) * (24 * HOURS);
+    if (finished != Modes.traceDayFinished) {
+        Modes.traceDayFinished = finished;
+
+        char filename[PATH_MAX];
+        char dateDir[PATH_MAX * 3/4];
+        struct tm utc;
+        time_t yesterday = (finished - 1) / 1000;
+        gmtime_r(&yesterday, &utc);
 
-        createDateDir(Modes.globe_history_dir, &utc, dateDir);
+        createDateDir(Modes.globe_history_dir, &utc, dateDir); // doesn't usually create a directory ... but use the function anyhow worst that can happen is an empty directory for yesterday
 
         snprintf(filename, PATH_MAX, "%s/traces", dateDir);
-        if (mkdir(filename, 0700) && errno != EEXIST)
-            perror(filename);
-
-        for (int i = 0; i < 256; i++) {
-            snprintf(filename, PATH_MAX, "%s/traces/%02x", dateDir, i);
-            if (mkdir(filename, 0755) && errno != EEXIST)
-                perror(filename);
-        }
+        chmod(filename, 0755);
     }
-    return;
 }
 
 void *load_state(void *arg) {
@@ -4,6 +4,7 @@
 #define GLOBE_INDEX_GRID 3
 #define GLOBE_SPECIAL_INDEX 70
 #define GLOBE_LAT_MULT (360 / GLOBE_INDEX_GRID + 1)
+#define GLOBE_LAT_CELLS (180 / GLOBE_INDEX_GRID + 1)
 #define GLOBE_MIN_INDEX (1000)
 #define GLOBE_MAX_INDEX (180 / GLOBE_INDEX_GRID * GLOBE_LAT_MULT + GLOBE_MIN_INDEX)
 
@@ -19,7 +20,12 @@ struct tile {
     int east;
 };
 
+// the permanent traces of the previous day are finalized by a rewrite of all traces after midnight,
+// it's spread over this window and must be done before traces switch to the new day 19 min after midnight
+#define TRACE_ROLLOVER_WINDOW (10 * MINUTES)
+
 void checkNewDay(uint64_t now);
+int traceDateDirs(uint64_t now);
 ssize_t check_write(int fd, const void *buf, size_t count, const char *error_context);
 int globe_index(double lat_in, double lon_in);
 int globe_index_index(int index);
@@ -31,14 +37,14 @@ void save_blob(int blob);
 void *jsonTraceThreadEntryPoint(void *arg);
 ssize_t stateBytes(int len);
 ssize_t stateAllBytes(int len);
-void traceRealloc(struct aircraft *a, int len);
 void traceCleanup(struct aircraft *a);
 int traceAdd(struct aircraft *a, uint64_t now);
 void traceResize(struct aircraft *a, uint64_t now);
 int traceUsePosBuffered();
 void traceMaintenance(struct aircraft *a, uint64_t now);
 
-int handleHeatmap(uint64_t now);
+#define HEATMAP_BUCKETS_STEP 4096 // aircraft buckets scanned between deadline checks
+int handleHeatmap(uint64_t now, uint64_t deadline);
 
 struct craftArray {
     struct aircraft **list;
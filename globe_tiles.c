@@ -0,0 +1,384 @@
+#include "readsb.h"
+
+// globe tiles for the json_globe_index output
+//
+// special tiles of varying size cover the busy areas, everything else uses the regular grid of
+// GLOBE_INDEX_GRID degrees, globe_index is called for every position so it uses a lookup table
+// with one entry per grid cell that is filled when the special tiles are set up
+
+static int16_t globeLookup[GLOBE_LAT_CELLS * GLOBE_LAT_MULT];
+
+// tile of the grid cell with the south west corner lat / lon, walks the special tiles
+// not bounds checked, the lookup table stores this for every cell
+static int globe_index_scan(struct tile *tiles, int lat, int lon) {
+    int grid = GLOBE_INDEX_GRID;
+
+    for (int i = 0; tiles[i].south != 0 || tiles[i].north != 0; i++) {
+        struct tile tile = tiles[i];
+        if (lat >= tile.south && lat < tile.north) {
+            if (tile.west < tile.east && lon >= tile.west && lon < tile.east) {
+                return i;
+            }
+            if (tile.west > tile.east && (lon >= tile.west || lon < tile.east)) {
+                return i;
+            }
+        }
+    }
+
+
+    int i = (lat + 90) / grid;
+    int j = (lon + 180) / grid;
+
+    return (i * GLOBE_LAT_MULT + j + GLOBE_MIN_INDEX);
+    // first 1000 are reserved for special use
+}
+
+void init_globe_index(struct tile *s_tiles) {
+    int count = 0;
+
+    // Arctic
+    s_tiles[count++] = (struct tile) {
+        60, -126,
+        90, 0
+    };
+    s_tiles[count++] = (struct tile) {
+        60, 0,
+        90, 150
+    };
+
+    // Alaska and Chukotka
+    s_tiles[count++] = (struct tile) {
+        51, 150,
+        90, -126
+    };
+    // North Pacific
+    s_tiles[count++] = (struct tile) {
+        9, 150,
+        51, -126
+    };
+
+    // Northern Canada
+    s_tiles[count++] = (struct tile) {
+        51, -126,
+        60, -69
+    };
+
+    // Northwest USA
+    s_tiles[count++] = (struct tile) {
+        45, -120,
+        51, -114
+    };
+    s_tiles[count++] = (struct tile) {
+        45, -114,
+        51, -102
+    };
+    s_tiles[count++] = (struct tile) {
+        45, -102,
+        51, -90
+    };
+    // Eastern Canada
+    s_tiles[count++] = (struct tile) {
+        45, -90,
+        51, -75
+    };
+
+    s_tiles[count++] = (struct tile) {
+        45, -75,
+        51, -69
+    };
+    // Balkan
+    s_tiles[count++] = (struct tile) {
+        42, 12,
+        48, 18
+    };
+    s_tiles[count++] = (struct tile) {
+        42, 18,
+        48, 24
+    };
+    // Poland
+    s_tiles[count++] = (struct tile) {
+        48, 18,
+        54, 24
+    };
+    // Sweden
+    s_tiles[count++] = (struct tile) {
+        54, 12,
+        60, 24
+    };
+    // Denmark
+    s_tiles[count++] = (struct tile) {
+        54, 3,
+        60, 12
+    };
+    // Northern UK
+    s_tiles[count++] = (struct tile) {
+        54, -9,
+        60, 3
+    };
+
+    // Golfo de Vizcaya / Bay of Biscay
+    s_tiles[count++] = (struct tile) {
+        42, -9,
+        48, 0
+    };
+
+    // West Russia
+    s_tiles[count++] = (struct tile) {
+        42, 24,
+        51, 51
+    };
+    s_tiles[count++] = (struct tile) {
+        51, 24,
+        60, 51
+    };
+
+    // Central Russia
+    s_tiles[count++] = (struct tile) {
+        30, 51,
+        60, 90
+    };
+
+    // East Russia
+    s_tiles[count++] = (struct tile) {
+        30, 90,
+        60, 120
+    };
+    // Koreas and Japan and some Russia
+    s_tiles[count++] = (struct tile) {
+        30, 120,
+        39, 129
+    };
+    s_tiles[count++] = (struct tile) {
+        30, 129,
+        39, 138
+    };
+    s_tiles[count++] = (struct tile) {
+        30, 138,
+        39, 150
+    };
+    s_tiles[count++] = (struct tile) {
+        39, 120,
+        60, 150
+    };
+    // Vietnam
+    s_tiles[count++] = (struct tile) {
+        9, 90,
+        21, 111
+    };
+
+    // South China
+    s_tiles[count++] = (struct tile) {
+        21, 90,
+        30, 111
+    };
+
+    // South China and ICAO special use
+    s_tiles[count++] = (struct tile) {
+        9, 111,
+        24, 129
+    };
+    s_tiles[count++] = (struct tile) {
+        24, 111,
+        30, 120
+    };
+    s_tiles[count++] = (struct tile) {
+        24, 120,
+        30, 129
+    };
+
+    // mostly pacific south of Japan
+    s_tiles[count++] = (struct tile) {
+        9, 129,
+        30, 150
+    };
+
+
+    // Persian Gulf / Arabian Sea
+    s_tiles[count++] = (struct tile) {
+        9, 51,
+        30, 69
+    };
+
+    // India
+    s_tiles[count++] = (struct tile) {
+        9, 69,
+        30, 90
+    };
+
+    // South Atlantic / South Africa
+    s_tiles[count++] = (struct tile) {
+        -90, -30,
+        9, 51
+    };
+    //Indian Ocean
+    s_tiles[count++] = (struct tile) {
+        -90, 51,
+        9, 111
+    };
+
+    // Australia
+    s_tiles[count++] = (struct tile) {
+        -90, 111,
+        -18, 160
+    };
+    s_tiles[count++] = (struct tile) {
+        -18, 111,
+        9, 160
+    };
+
+    // South Pacific and NZ
+    s_tiles[count++] = (struct tile) {
+        -90, 160,
+        -42, -90
+    };
+    s_tiles[count++] = (struct tile) {
+        -42, 160,
+        9, -90
+    };
+
+    // North South America
+    s_tiles[count++] = (struct tile) {
+        -9, -90,
+        9, -42
+    };
+
+    // South South America
+    // west
+    s_tiles[count++] = (struct tile) {
+        -90, -90,
+        -9, -63
+    };
+    // east
+    s_tiles[count++] = (struct tile) {
+        -21, -63,
+        -9, -42
+    };
+    s_tiles[count++] = (struct tile) {
+        -90, -63,
+        -21, -42
+    };
+
+    s_tiles[count++] = (struct tile) {
+        -90, -42,
+        9, -30
+    };
+
+    // Guatemala / Mexico
+    s_tiles[count++] = (struct tile) {
+        9, -126,
+        33, -117
+    };
+    s_tiles[count++] = (struct tile) {
+        9, -117,
+        30, -102
+    };
+    // western gulf + east mexico
+    s_tiles[count++] = (struct tile) {
+        9, -102,
+        27, -90
+    };
+    // Eastern Gulf of Mexico
+    s_tiles[count++] = (struct tile) {
+        24, -90,
+        30, -84
+    };
+
+    // south of jamaica
+    s_tiles[count++] = (struct tile) {
+        9, -90,
+        18, -69
+    };
+
+    // Cuba / Haiti
+    s_tiles[count++] = (struct tile) {
+        18, -90,
+        24, -69
+    };
+
+    // Mediterranean
+    s_tiles[count++] = (struct tile) {
+        36, 6,
+        42, 18
+    };
+    s_tiles[count++] = (struct tile) {
+        36, 18,
+        42, 30
+    };
+
+    // North Africa
+    s_tiles[count++] = (struct tile) {
+        9, -9,
+        39, 6
+    };
+    s_tiles[count++] = (struct tile) {
+        9, 6,
+        36, 30
+    };
+
+    // Middle East
+    s_tiles[count++] = (struct tile) {
+        9, 30,
+        42, 51
+    };
+
+    // west of Bermuda
+    s_tiles[count++] = (struct tile) {
+        24, -75,
+        39, -69
+    };
+    // North Atlantic
+    s_tiles[count++] = (struct tile) {
+        9, -69,
+        30, -33
+    };
+    s_tiles[count++] = (struct tile) {
+        30, -69,
+        60, -33
+    };
+    s_tiles[count++] = (struct tile) {
+        9, -33,
+        30, -9
+    };
+    s_tiles[count++] = (struct tile) {
+        30, -33,
+        60, -9
+    };
+
+    Modes.specialTileCount = count;
+
+    if (count + 1 >= GLOBE_SPECIAL_INDEX)
+        fprintf(stderr, "increase GLOBE_SPECIAL_INDEX please!\n");
+
+    for (int i = 0; i < GLOBE_LAT_CELLS; i++) {
+        for (int j = 0; j < GLOBE_LAT_MULT; j++) {
+            int lat = i * GLOBE_INDEX_GRID - 90;
+            int lon = j * GLOBE_INDEX_GRID - 180;
+            globeLookup[i * GLOBE_LAT_MULT + j] = globe_index_scan(s_tiles, lat, lon);
+        }
+    }
+}
+
+int globe_index(double lat_in, double lon_in) {
+    int i = (int) ((lat_in + 90) / GLOBE_INDEX_GRID);
+    int j = (int) ((lon_in + 180) / GLOBE_INDEX_GRID);
+    int lat = i * GLOBE_INDEX_GRID - 90;
+    int lon = j * GLOBE_INDEX_GRID - 180;
+
+    int res;
+    if (i >= 0 && i < GLOBE_LAT_CELLS && j >= 0 && j < GLOBE_LAT_MULT)
+        res = globeLookup[i * GLOBE_LAT_MULT + j];
+    else
+        res = globe_index_scan(Modes.json_globe_special_tiles, lat, lon); // outside of -90 .. 90 / -180 .. 180
+
+    if (res > GLOBE_MAX_INDEX) {
+        fprintf(stderr, "globe_index out of bounds: %d %d %d\n", res, lat, lon);
+        return 0;
+    }
+    return res;
+}
+
+int globe_index_index(int index) {
+    double lat = ((index - GLOBE_MIN_INDEX) /  GLOBE_LAT_MULT) * GLOBE_INDEX_GRID - 90;
+    double lon = ((index - GLOBE_MIN_INDEX) % GLOBE_LAT_MULT) * GLOBE_INDEX_GRID - 180;
+    return globe_index(lat, lon);
+}
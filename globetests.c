@@ -0,0 +1,127 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// globetests.c - tests for the globe tile lookup
+//
+// globe_index() uses a lookup table per grid cell, it's compared against
+// the original scan of the special tiles (globeIndexReference below) on a
+// fine grid across the whole globe including the cell boundaries.
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "readsb.h"
+
+struct _Modes Modes;
+
+// globe_index as it was before the lookup table, don't change
+static int globeIndexReference(double lat_in, double lon_in) {
+    int grid = GLOBE_INDEX_GRID;
+    int lat = grid * ((int) ((lat_in + 90) / grid)) - 90;
+    int lon = grid * ((int) ((lon_in + 180) / grid)) - 180;
+
+    struct tile *tiles = Modes.json_globe_special_tiles;
+
+    for (int i = 0; tiles[i].south != 0 || tiles[i].north != 0; i++) {
+        struct tile tile = tiles[i];
+        if (lat >= tile.south && lat < tile.north) {
+            if (tile.west < tile.east && lon >= tile.west && lon < tile.east) {
+                return i;
+            }
+            if (tile.west > tile.east && (lon >= tile.west || lon < tile.east)) {
+                return i;
+            }
+        }
+    }
+
+
+    int i = (lat + 90) / grid;
+    int j = (lon + 180) / grid;
+
+    int res = (i * GLOBE_LAT_MULT + j + GLOBE_MIN_INDEX);
+    if (res > GLOBE_MAX_INDEX) {
+        fprintf(stderr, "globe_index out of bounds: %d %d %d\n", res, lat, lon);
+        return 0;
+    }
+    return res;
+}
+
+static int checkIndex(double lat, double lon, int *failures) {
+    int res = globe_index(lat, lon);
+    int ref = globeIndexReference(lat, lon);
+    if (res == ref)
+        return 1;
+    if (++*failures <= 10)
+        fprintf(stderr, "testGlobeIndex: FAIL: lat %.6f lon %.6f: %d, reference %d\n", lat, lon, res, ref);
+    return 0;
+}
+
+static int testGlobeIndex() {
+    int failures = 0;
+    int count = 0;
+
+    // steps of 0.05 degrees hit every cell boundary exactly and plenty of points in between
+    // latitude 90 is left out, it's out of bounds for most longitudes and just spams the log
+    for (int y = -1800; y < 1800; y++) {
+        for (int x = -3600; x <= 3600; x++) {
+            checkIndex(y / 20.0, x / 20.0, &failures);
+            count++;
+        }
+    }
+
+    // just below the cell boundaries
+    for (int lat = -90; lat < 90; lat += GLOBE_INDEX_GRID) {
+        for (int lon = -180; lon <= 180; lon += GLOBE_INDEX_GRID) {
+            checkIndex(nextafter(lat, -100), nextafter(lon, -200), &failures);
+            checkIndex(nextafter(lat, 100), nextafter(lon, 200), &failures);
+            count += 2;
+        }
+    }
+
+    // slightly out of range values as produced by bad positions
+    double oddLat[] = { -93.5, -92, -91, -90.5 };
+    double oddLon[] = { -181, -180.5, 180.5, 182 };
+    for (int k = 0; k < 4; k++) {
+        checkIndex(oddLat[k], 0, &failures);
+        checkIndex(0, oddLon[k], &failures);
+        count += 2;
+    }
+
+    // every regular tile maps back to itself
+    for (int index = GLOBE_MIN_INDEX; index <= GLOBE_MAX_INDEX; index++) {
+        double lat = ((index - GLOBE_MIN_INDEX) /  GLOBE_LAT_MULT) * GLOBE_INDEX_GRID - 90;
+        double lon = ((index - GLOBE_MIN_INDEX) % GLOBE_LAT_MULT) * GLOBE_INDEX_GRID - 180;
+        if (globe_index_index(index) != globeIndexReference(lat, lon)) {
+            if (++failures <= 10)
+                fprintf(stderr, "testGlobeIndex: FAIL: globe_index_index(%d)\n", index);
+        }
+        count++;
+    }
+
+    if (failures) {
+        fprintf(stderr, "testGlobeIndex: %d of %d lookups differ\n", failures, count);
+        return 0;
+    }
+    fprintf(stderr, "testGlobeIndex: PASS (%d lookups)\n", count);
+    return 1;
+}
+
+int main(int __attribute__ ((unused)) argc, char __attribute__ ((unused)) **argv) {
+    Modes.json_globe_special_tiles = calloc(GLOBE_SPECIAL_INDEX, sizeof(struct tile));
+    init_globe_index(Modes.json_globe_special_tiles);
+
+    int ok = 1;
+    ok = testGlobeIndex() && ok;
+
+    free(Modes.json_globe_special_tiles);
+    return ok ? 0 : 1;
+}
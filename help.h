@@ -64,6 +64,7 @@ static struct argp_option optionsReadsb[] = {
     {"device-type", OptDeviceType, "<type>", 0, "Select SDR type", 1},
     {"gain", OptGain, "<db>", 0, "Set gain (default: max gain. Use -10 for auto-gain)", 1},
     {"freq", OptFreq, "<hz>", 0, "Set frequency (default: 1090 MHz)", 1},
+    {"add-device", OptAddDevice, "<type>[,<device>[,<gain>]]", 0, "Additional local SDR device sharing the tracker, device is the index / serial / file name, other driver options are taken from the first device (can be specified multiple times)", 1},
     {"interactive", OptInteractive, 0, 0, "Interactive mode refreshing data on screen. Implies --throttle", 1},
     {"raw", OptRaw, 0, 0, "Show only messages hex values", 1},
     {"preamble-threshold", OptPreambleThreshold, "<1-100>", 0, "lower threshold --> more CPU usage (default: 60, pi zero / pi 1: 80, hot CPU: 42)", 1},
@@ -73,6 +74,7 @@ static struct argp_option optionsReadsb[] = {
     {"stats", OptStats, 0, 0, "With --ifile print stats at exit. No other output", 1},
     {"stats-range", OptStatsRange, 0, 0, "Collect/show range histogram", 1},
     {"stats-every", OptStatsEvery, "<sec>", 0, "Show and reset stats every <sec> seconds", 1},
+    {"stats-window", OptStatsWindow, "<minutes>", 0, "Additional stats.json window besides 1, 5 and 15 minutes, can be specified multiple times (e.g. 60, 1440; max 1440)", 1},
     {"onlyaddr", OptOnlyAddr, 0, 0, "Show only ICAO addresses", 1},
     {"gnss", OptGnss, 0, 0, "Show altitudes as GNSS when available", 1},
     {"snip", OptSnip, "<level>", 0, "Strip IQ file removing samples < level", 1},
@@ -80,11 +82,15 @@ static struct argp_option optionsReadsb[] = {
     {"receiver-focus", OptReceiverFocus, "<receiverId>", 0, "only process messages from receiverId", 1},
     {"cpr-focus", OptCprFocus, "<hex>", 0, "show CPR details for this hex", 1},
     {"trace-focus", OptTraceFocus, "<hex>", 0, "show traceAdd details for this hex", 1},
+    {"hot-set", OptHotSet, "<hex>[,<hex>...]", 0, "Addresses to keep decoding completely when a network client sends more than can be decoded, other messages are sampled (focus options are included automatically)", 1},
+    {"recorder-file", OptRecorderFile, "<file>", 0, "where to dump the flight recorder (CPR / speed check / receiver / trace decisions) on SIGUSR1 (default: /tmp/readsb_recorder.bin)", 1},
+    {"recorder-decode", OptRecorderDecode, "<file>", 0, "print a flight recorder dump as text and exit", 1},
     {"quiet", OptQuiet, 0, 0, "Disable output (default)", 1},
     {"dcfilter", OptDcFilter, 0, OPTION_HIDDEN, "Apply a 1Hz DC filter to input data (requires more CPU)", 1},
     {"enable-biastee", OptBiasTee, 0, OPTION_HIDDEN, "Enable bias tee on supporting interfaces (default: disabled)", 1},
     {"write-json", OptJsonDir, "<dir>", 0, "Periodically write json output to <dir>", 1},
     {"write-prom", OptPromFile, "<filepath>", 0, "Periodically write prometheus output to <filepath>", 1},
+    {"write-prom-clients", OptPromClientsFile, "<filepath>", 0, "Write per client prometheus output for network inputs to <filepath> every second", 1},
     {"write-globe-history", OptGlobeHistoryDir, "<dir>", 0, "Extended Globe History", 1},
     {"write-state", OptStateDir, "<dir>", 0, "Write state to disk to have traces after a restart", 1},
     {"heatmap-dir", OptHeatmapDir, "<dir>", 0, "Change the directory where heatmaps are saved (default is in globe history dir)", 1},
@@ -93,14 +99,16 @@ static struct argp_option optionsReadsb[] = {
     {"json-location-accuracy", OptJsonLocAcc , "<n>", 0, "Accuracy of receiver location in json metadata: 0=no location, 1=approximate, 2=exact", 1},
     {"write-json-globe-index", OptJsonGlobeIndex, 0, 0, "Write specially indexed globe_xxxx.json files (for tar1090)", 1},
     {"write-receiver-id-json", OptNetReceiverIdJson, 0, 0, "Write receivers.json", 1},
+    {"keep-traces", OptKeepTraces, "<hours>", 0, "With --write-json-globe-index: keep traces in memory this long, points older than 26 hours are progressively thinned out (default: 24.67, max: 960)", 1},
     {"json-trace-interval", OptJsonTraceInt, "<seconds>", 0, "Interval after which a new position will guaranteed to be written to the trace and the json position output (default: 30)", 1},
     {"write-json-gzip", OptJsonGzip, 0, 0, "Write aircraft.json also as aircraft.json.gz", 1},
+    {"write-json-history-files", OptJsonHistoryFiles, 0, 0, "Write the aircraft history as 120 history_N.json files instead of a single history.binCraft, for web interfaces that don't read binCraft (needs a build with HISTORY=yes)", 1},
     {"write-json-binCraft-only", OptJsonBinCraft, "<n>", 0, "Use only binary binCraft format for globe files (1), for aircraft.json as well (2)", 1},
     {"json-reliable", OptJsonReliable,"<n>", 0, "Minimum position reliability to put it into json (default: 1, globe options will default set this to 2, disable speed filter: -1, max: 4)", 1},
     {"jaero-timeout", OptJaeroTimeout,"<n>", 0, "How long in minutes JAERO positions remain valid and on the map in tar1090 (default:33)", 1},
     {"db-file", OptDbFile, "<file.csv.gz>", 0, "disable db loading: --db-file none Default: /usr/local/share/tar1090/git-db/aircraft.csv.gz", 1},
     {0,0,0,0, "Network options:", 2},
-    {"net-connector", OptNetConnector, "<ip,port,protocol>", 0, "Establish connection, can be specified multiple times (e.g. 127.0.0.1,23004,beast_out) Protocols: beast_out, beast_in, raw_out, raw_in, sbs_in, sbs_in_jaero, sbs_out, sbs_out_jaero, vrs_out, json_out (one failover ip/address,port can be specified: primary-address,primary-port,protocol,failover-address,failover-port)", 2},
+    {"net-connector", OptNetConnector, "<ip,port,protocol>", 0, "Establish connection, can be specified multiple times (e.g. 127.0.0.1,23004,beast_out) Protocols: beast_out, beast_in, raw_out, raw_in, sbs_in, sbs_in_jaero, sbs_out, sbs_out_jaero, vrs_out, json_out, beast_zlib_out and beast_reduce_zlib_out (zlib compressed, the Beast input of readsb detects it) (one failover ip/address,port can be specified: primary-address,primary-port,protocol,failover-address,failover-port)", 2},
     {"net", OptNet, 0, 0, "Enable networking", 2},
     {"net-only", OptNetOnly, 0, 0, "Enable just networking, no RTL device or file used", 2},
     {"net-bind-address", OptNetBindAddr, "<ip>", 0, "IP address to bind to (default: Any; Use 127.0.0.1 for private)", 2},
@@ -121,12 +129,17 @@ static struct argp_option optionsReadsb[] = {
     {"net-receiver-id", OptNetReceiverId, 0, 0, "forward receiver ID", 2},
     {"net-ingest", OptNetIngest, 0, 0, "primary ingest node", 2},
     {"net-garbage", OptGarbage, "<ports>", 0, "timeout receivers, output messages from timed out receivers as beast on <ports>", 2},
+    {"net-quarantine", OptNetQuarantine, "<low>[,<high>[,<n>]]", OPTION_ARG_OPTIONAL, "quarantine beast input clients with a quality score below <low> (0-1), only every <n>th message is decoded until the score recovers above <high> (default: off, 0.5,0.75,8 when given without values)", 2},
     {"uuid-file", OptUuidFile, "<path>", 0, "path to UUID file", 2},
     {"net-ro-size", OptNetRoSize, "<size>", 0, "TCP output flush size (maximum amount of internally buffered data before writing to network) (default: 1200)", 2},
     {"net-ro-interval", OptNetRoIntervall, "<rate>", 0, "TCP output flush interval in seconds (maximum interval between two network writes of accumulated data)(default: 0.05, valid values 0.005 - 1.0)", 2},
+    {"net-multicast", OptNetMulticast, "<group,port,protocol>", 0, "UDP multicast, can be specified multiple times (e.g. 239.255.30.5,30005,beast_out). Protocols: beast_out and sbs_out send the output once per flush to the group, beast_in receives such a group as Beast input. Datagrams start with a 4 byte source id and a 4 byte sequence number (big endian), lost datagrams are counted in the stats.", 2},
     {"net-connector-delay", OptNetConnectorDelay, "<seconds>", 0, "Outbound re-connection delay (default: 30)", 2},
     {"net-heartbeat", OptNetHeartbeat, "<rate>", 0, "TCP heartbeat rate in seconds (default: 60 sec; 0 to disable)", 2},
     {"net-buffer", OptNetBuffer, "<n>", 0, "TCP buffer size 64Kb * (2^n) (default: n=2, 256Kb)", 2},
+    {"net-json-port-delta", OptNetJsonPortDelta, 0, 0, "json position output: after the first complete object of an aircraft only write fields that changed, fields no longer valid are written as null. Complete objects are written every 60 seconds and after a consumer connects.", 2},
+    {"net-replay", OptNetReplay, "<KiB>", 0, "Keep this much of the Beast, SBS and json position output for reconnecting consumers (default: 0, disabled, min: 64). A consumer sends 'RESUME <offset>' and a newline within 1 second of connecting and gets 'OFFSET <n>' and a newline back, followed by the output starting at byte offset n. Without a request the output starts at the connect time.", 2},
+    {"net-output-filters", OptNetOutputFilters, 0, 0, "Beast, SBS and json position output consumers may send a filter and a newline within 1 second of connecting, only matching output is sent to them: 'FILTER [bbox=<south>,<north>,<west>,<east>] [addr=<hex>,<hex>,...] [df=<n>,<n>,...] [minalt=<ft>] [mil]'. The reply is 'FILTER OK' or 'FILTER ERROR <reason>' and a newline. Not available on the json position output with --net-json-port-delta.", 2},
     {"net-verbatim", OptNetVerbatim, 0, 0, "Forward messages unchanged", 2},
 #ifdef ENABLE_RTLSDR
     {0,0,0,0, "RTL-SDR options:", 3},
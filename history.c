@@ -0,0 +1,219 @@
+#include "readsb.h"
+
+#define HISTORY_WORDS (sizeof(struct binCraft) / sizeof(uint32_t))
+
+_Static_assert(HISTORY_WORDS <= 32, "the changed words of a record need to fit the 32 bit mask");
+
+struct historySnapshot {
+    uint64_t now;
+    uint32_t count; // aircraft
+    uint32_t len; // bytes of data
+    char *data;
+};
+
+static struct historySnapshot ring[HISTORY_SIZE];
+static uint32_t ringFirst;
+static uint32_t ringCount;
+
+// newest snapshot decoded, base for the next delta
+static struct binCraft *last;
+static uint32_t lastCount;
+
+static int compareHex(const void *p1, const void *p2) {
+    uint32_t h1 = ((const struct binCraft *) p1)->hex;
+    uint32_t h2 = ((const struct binCraft *) p2)->hex;
+    return (h1 > h2) - (h1 < h2);
+}
+
+// both arrays sorted by hex
+static void encode(struct historySnapshot *snap, struct binCraft *records, uint32_t count,
+        struct binCraft *base, uint32_t baseCount) {
+    char *buf = malloc(count * (2 + HISTORY_WORDS) * sizeof(uint32_t) + 1);
+    if (!buf) {
+        fprintf(stderr, "history: out of memory\n");
+        snap->count = snap->len = 0;
+        snap->data = NULL;
+        return;
+    }
+    char *p = buf;
+    uint32_t b = 0;
+    static const struct binCraft zero;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t hex = records[i].hex;
+        while (b < baseCount && base[b].hex < hex)
+            b++;
+        const struct binCraft *prev = (b < baseCount && base[b].hex == hex) ? &base[b] : &zero;
+
+        uint32_t cur[HISTORY_WORDS];
+        uint32_t old[HISTORY_WORDS];
+        memcpy(cur, &records[i], sizeof(cur));
+        memcpy(old, prev, sizeof(old));
+
+        uint32_t mask = 0;
+        char *maskPos = p + sizeof(uint32_t);
+        memcpy(p, &hex, sizeof(hex));
+        p += 2 * sizeof(uint32_t);
+        for (uint32_t w = 0; w < HISTORY_WORDS; w++) {
+            uint32_t diff = cur[w] ^ old[w];
+            if (!diff)
+                continue;
+            mask |= 1U << w;
+            memcpy(p, &diff, sizeof(diff));
+            p += sizeof(diff);
+        }
+        memcpy(maskPos, &mask, sizeof(mask));
+    }
+
+    snap->count = count;
+    snap->len = p - buf;
+    // most records only have a few words changed, don't keep the worst case allocation
+    snap->data = realloc(buf, snap->len + 1);
+    if (!snap->data)
+        snap->data = buf;
+}
+
+// returns the records sorted by hex, NULL on failure
+static struct binCraft *decode(struct historySnapshot *snap, struct binCraft *base, uint32_t baseCount) {
+    struct binCraft *records = malloc((snap->count + 1) * sizeof(struct binCraft));
+    if (!records) {
+        fprintf(stderr, "history: out of memory\n");
+        return NULL;
+    }
+    char *p = snap->data;
+    uint32_t b = 0;
+    static const struct binCraft zero;
+
+    for (uint32_t i = 0; i < snap->count; i++) {
+        uint32_t hex, mask;
+        memcpy(&hex, p, sizeof(hex));
+        memcpy(&mask, p + sizeof(uint32_t), sizeof(mask));
+        p += 2 * sizeof(uint32_t);
+
+        while (b < baseCount && base[b].hex < hex)
+            b++;
+        const struct binCraft *prev = (b < baseCount && base[b].hex == hex) ? &base[b] : &zero;
+
+        uint32_t words[HISTORY_WORDS];
+        memcpy(words, prev, sizeof(words));
+        for (uint32_t w = 0; w < HISTORY_WORDS; w++) {
+            if (!(mask & (1U << w)))
+                continue;
+            uint32_t diff;
+            memcpy(&diff, p, sizeof(diff));
+            p += sizeof(diff);
+            words[w] ^= diff;
+        }
+        memcpy(&records[i], words, sizeof(words));
+    }
+    return records;
+}
+
+void historyDestroy() {
+    for (uint32_t i = 0; i < HISTORY_SIZE; i++) {
+        free(ring[i].data);
+        ring[i].data = NULL;
+    }
+    ringFirst = ringCount = 0;
+    free(last);
+    last = NULL;
+    lastCount = 0;
+}
+
+uint32_t historyCount() {
+    return ringCount;
+}
+
+// drop the oldest snapshot, the next one becomes the one stored without delta
+static void historyDropOldest() {
+    struct historySnapshot *oldest = &ring[ringFirst];
+    struct historySnapshot *next = &ring[(ringFirst + 1) % HISTORY_SIZE];
+
+    if (ringCount > 1) {
+        struct binCraft *a = decode(oldest, NULL, 0);
+        struct binCraft *b = a ? decode(next, a, oldest->count) : NULL;
+        if (b) {
+            free(next->data);
+            encode(next, b, next->count, NULL, 0);
+        }
+        free(a);
+        free(b);
+    }
+
+    free(oldest->data);
+    oldest->data = NULL;
+    ringFirst = (ringFirst + 1) % HISTORY_SIZE;
+    ringCount--;
+}
+
+void historyAdd(struct binCraft *records, uint32_t count, uint64_t now) {
+    qsort(records, count, sizeof(struct binCraft), compareHex);
+
+    if (ringCount == HISTORY_SIZE)
+        historyDropOldest();
+
+    struct historySnapshot *snap = &ring[(ringFirst + ringCount) % HISTORY_SIZE];
+    snap->now = now;
+    if (ringCount)
+        encode(snap, records, count, last, lastCount);
+    else
+        encode(snap, records, count, NULL, 0);
+
+    if (!snap->data) {
+        // keep the ring consistent, start over with the next snapshot
+        historyDestroy();
+        free(records);
+        return;
+    }
+    ringCount++;
+
+    free(last);
+    last = records;
+    lastCount = count;
+}
+
+struct char_buffer generateHistoryBin() {
+    struct char_buffer cb = { 0 };
+    uint32_t elementSize = sizeof(struct binCraft);
+
+    size_t buflen = 0;
+    for (uint32_t k = 0; k < ringCount; k++)
+        buflen += (ring[(ringFirst + k) % HISTORY_SIZE].count + 1) * elementSize;
+
+    char *buf = malloc(buflen + 1), *p = buf;
+    if (!buf) {
+        fprintf(stderr, "history: out of memory\n");
+        return cb;
+    }
+
+#define memWrite(p, var) do { memcpy(p, &var, sizeof(var)); p += sizeof(var); } while(0)
+
+    struct binCraft *base = NULL;
+    uint32_t baseCount = 0;
+    for (uint32_t k = 0; k < ringCount; k++) {
+        struct historySnapshot *snap = &ring[(ringFirst + k) % HISTORY_SIZE];
+        struct binCraft *records = decode(snap, base, baseCount);
+        free(base);
+        base = records;
+        baseCount = snap->count;
+        if (!records)
+            break;
+
+        char *header = p;
+        memset(header, 0, elementSize);
+        memWrite(p, snap->now);
+        memWrite(p, elementSize);
+        memWrite(p, snap->count);
+        p = header + elementSize;
+
+        memcpy(p, records, snap->count * elementSize);
+        p += snap->count * elementSize;
+    }
+    free(base);
+
+#undef memWrite
+
+    cb.len = p - buf;
+    cb.buffer = buf;
+    return cb;
+}
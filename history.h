@@ -0,0 +1,22 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+// aircraft history: ring of the last HISTORY_SIZE snapshots of aircraft.json,
+// taken every HISTORY_INTERVAL as binCraft records sorted by hex
+//
+// a snapshot is stored as delta against the previous one, the oldest one against nothing:
+// per aircraft: uint32 hex, uint32 mask, then the 32 bit words of the record XOR the previous
+// record of the same hex (or zero) for every bit set in the mask
+// aircraft missing in a snapshot are gone from it, the json thread owns the ring
+//
+// exported as history.binCraft, the snapshots oldest first, each one:
+// a header element (uint64 now, uint32 elementSize, uint32 aircraft count) padded to elementSize
+// followed by the records
+
+void historyDestroy();
+// takes ownership of records
+void historyAdd(struct binCraft *records, uint32_t count, uint64_t now);
+uint32_t historyCount();
+struct char_buffer generateHistoryBin();
+
+#endif
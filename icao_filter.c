@@ -121,6 +121,82 @@ uint32_t icaoFilterTestFuzzy(uint32_t partial) {
     return 0;
 }
 
+// hot set, same scheme as the filter: two tables, the older one is cleared on every flip
+#define HOT_SET_TTL 60000
+#define HOT_SET_MASK (HOT_SET_SIZE - 1)
+
+static uint32_t hot_set_a[HOT_SET_SIZE];
+static uint32_t hot_set_b[HOT_SET_SIZE];
+static uint32_t *hot_set_active;
+static int hot_set_count; // entries in the active table
+
+static void hotSetAddStatic() {
+    for (int i = 0; i < Modes.hotSetStaticCount; i++)
+        hotSetAdd(Modes.hotSetStatic[i]);
+    // 0xc0ffeeba means the focus option isn't set
+    if (Modes.trace_focus != 0xc0ffeeba)
+        hotSetAdd(Modes.trace_focus);
+    if (Modes.cpr_focus != 0xc0ffeeba)
+        hotSetAdd(Modes.cpr_focus);
+    if (Modes.show_only != 0xc0ffeeba)
+        hotSetAdd(Modes.show_only);
+}
+
+void hotSetInit() {
+    memset(hot_set_a, 0xFF, sizeof(hot_set_a));
+    memset(hot_set_b, 0xFF, sizeof(hot_set_b));
+    hot_set_active = hot_set_a;
+    hot_set_count = 0;
+    hotSetAddStatic();
+}
+
+void hotSetAdd(uint32_t addr) {
+    uint32_t h = aircraftHash(addr) & HOT_SET_MASK;
+    while (hot_set_active[h] != EMPTY && hot_set_active[h] != addr)
+        h = (h + 1) & HOT_SET_MASK;
+    if (hot_set_active[h] == addr)
+        return;
+    // keep the probe sequences short, too many hot addresses aren't hot anymore anyhow
+    if (hot_set_count >= HOT_SET_SIZE / 2) {
+        static uint64_t antiSpam;
+        uint64_t now = mstime();
+        if (now > antiSpam + 300 * SECONDS) {
+            antiSpam = now;
+            fprintf(stderr, "hot set full, not adding more addresses (suppressing for 5 minutes)\n");
+        }
+        return;
+    }
+    hot_set_active[h] = addr;
+    hot_set_count++;
+}
+
+int hotSetTest(uint32_t addr) {
+    uint32_t h0 = aircraftHash(addr) & HOT_SET_MASK;
+
+    // the tables are never more than half full, probing ends at an empty slot
+    for (uint32_t h = h0; hot_set_a[h] != EMPTY; h = (h + 1) & HOT_SET_MASK) {
+        if (hot_set_a[h] == addr)
+            return 1;
+    }
+    for (uint32_t h = h0; hot_set_b[h] != EMPTY; h = (h + 1) & HOT_SET_MASK) {
+        if (hot_set_b[h] == addr)
+            return 1;
+    }
+    return 0;
+}
+
+void hotSetExpire(uint64_t now) {
+    static uint64_t next_flip = 0;
+
+    if (now >= next_flip) {
+        hot_set_active = (hot_set_active == hot_set_a) ? hot_set_b : hot_set_a;
+        memset(hot_set_active, 0xFF, sizeof(hot_set_a));
+        hot_set_count = 0;
+        hotSetAddStatic();
+        next_flip = now + HOT_SET_TTL;
+    }
+}
+
 // call this periodically:
 void icaoFilterExpire(uint64_t now) {
     static uint64_t next_flip = 0;
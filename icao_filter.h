@@ -42,4 +42,25 @@ uint32_t icaoFilterTestFuzzy (uint32_t partial);
 // old entries.
 void icaoFilterExpire ();
 
+// Hot set: addresses someone is looking at right now (focus options, --hot-set,
+// network consumers calling hotSetAdd). When the decode thread can't keep up
+// with a client, messages for the hot set are all decoded while only every
+// HOT_SET_SAMPLE-th of the other messages is (see modesReadFromClient).
+
+#define HOT_SET_SIZE 4096 // table size, at most half of it is used
+#define HOT_SET_STATIC_MAX 64 // addresses given on the command line
+#define HOT_SET_SAMPLE 4
+
+// Call once after the configuration is parsed:
+void hotSetInit ();
+
+// Add an address, it stays hot for 1 to 2 minutes unless added again
+void hotSetAdd (uint32_t addr);
+
+// Test if the given address is in the hot set
+int hotSetTest (uint32_t addr);
+
+// Call this periodically to expire addresses nobody asked for recently
+void hotSetExpire (uint64_t now);
+
 #endif
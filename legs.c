@@ -0,0 +1,331 @@
+#include "readsb.h"
+
+// leg detection, marks the first point of each leg in the trace (flags.leg_marker)
+//
+// the first pass sums up the altitudes to determine the threshold for a major climb / descent,
+// the second pass looks for climbs, descents, ground contact and gaps
+// both passes are resumed at the first new point when the trace has only grown since the last call,
+// for the second pass this requires the threshold to be unchanged (it's clamped, so that's the usual
+// case for aircraft at cruise altitude)
+// otherwise the second pass starts over at the beginning of the trace
+
+static void legTime(const char *prefix, uint64_t ts) {
+    time_t nowish = ts/1000;
+    struct tm utc;
+    gmtime_r(&nowish, &utc);
+    char tstring[100];
+    strftime (tstring, 100, "%H:%M:%S", &utc);
+    fprintf(stderr, "%s%s\n", prefix, tstring);
+}
+
+static void secondPassReset(struct legState *s) {
+    s->resumable = 1;
+    s->leg_max = -1;
+    s->new_leg = -1;
+
+    s->high = 0;
+    s->low = 100000;
+    for (int i = 0; i < 5; i++)
+        s->last_five[i] = 0;
+    s->five_pos = 0;
+
+    s->major_climb = 0;
+    s->major_descent = 0;
+    s->major_climb_index = 0;
+    s->major_descent_index = 0;
+    s->last_high = 0;
+    s->last_low = 0;
+    s->last_low_index = 0;
+    s->last_airborne = 0;
+    s->last_ground = 0;
+    s->was_ground = 0;
+    s->prev_tmp = 0;
+}
+
+void markLegs(struct aircraft *a) {
+    if (a->trace_len < 20)
+        return;
+
+    int trace_len = a->trace_len;
+
+    if (!a->legs) {
+        a->legs = malloc(sizeof(struct legState));
+        if (!a->legs) {
+            fprintf(stderr, "markLegs: out of memory!\n");
+            return;
+        }
+        a->legs->n = 0;
+    }
+    struct legState *s = a->legs;
+
+    if (s->n <= 0 || s->n > trace_len || getState(a, 0)->timestamp != s->first_ts || getState(a, s->n - 1)->timestamp != s->last_ts) {
+        // trace was shifted or replaced, start over
+        s->n = 0;
+        s->resumable = 0;
+        s->sum = 0;
+        for (int i = 0; i < 5; i++)
+            s->sum_five[i] = 0;
+        s->sum_five_pos = 0;
+    }
+
+    int last_leg = -1;
+
+    for (int i = s->n; i < trace_len; i++) {
+        int32_t altitude = getState(a, i)->altitude * 25;
+        int on_ground = getState(a, i)->flags.on_ground;
+        int altitude_valid = getState(a, i)->flags.altitude_valid;
+
+        if (getState(a, i)->flags.leg_marker) {
+            getState(a, i)->flags.leg_marker = 0;
+            // reset leg marker
+            last_leg = i;
+        }
+
+        if (!altitude_valid)
+            continue;
+
+        if (on_ground) {
+            int avg = 0;
+            for (int i = 0; i < 5; i++) avg += s->sum_five[i];
+            avg /= 5;
+            altitude = avg;
+        } else {
+            if (s->sum_five_pos == 0) {
+                for (int i = 0; i < 5; i++)
+                    s->sum_five[i] = altitude;
+            } else {
+                s->sum_five[s->sum_five_pos % 5] = altitude;
+            }
+            s->sum_five_pos++;
+        }
+
+        s->sum += altitude;
+    }
+
+    int threshold = (int) (s->sum / (double) (trace_len * 3));
+
+    if (a->addr == LEG_FOCUS) {
+        fprintf(stderr, "threshold: %d\n", threshold);
+        fprintf(stderr, "trace_len: %d\n", trace_len);
+    }
+
+
+    if (threshold > 10000)
+        threshold = 10000;
+    if (threshold < 200)
+        threshold = 200;
+
+    int start;
+    if (s->resumable && s->threshold == threshold) {
+        // the leg markers of the already processed points are still correct
+        if (last_leg < 0)
+            last_leg = s->leg_max;
+        start = s->n;
+    } else {
+        if (last_leg < 0) {
+            for (int i = s->n - 1; i >= 0; i--) {
+                if (getState(a, i)->flags.leg_marker) {
+                    last_leg = i;
+                    break;
+                }
+            }
+        }
+        for (int i = 0; i < s->n; i++)
+            getState(a, i)->flags.leg_marker = 0;
+
+        secondPassReset(s);
+        start = 1;
+    }
+
+    for (int i = start; i < trace_len; i++) {
+        struct state *state = getState(a, i);
+        int prev_index = s->prev_tmp;
+        struct state *prev = getState(a, prev_index);
+
+        uint64_t elapsed = state->timestamp - prev->timestamp;
+
+        int32_t altitude = state->altitude * 25;
+        int on_ground = state->flags.on_ground;
+        int altitude_valid = state->flags.altitude_valid;
+
+        if (!on_ground && !altitude_valid)
+            continue;
+
+        s->prev_tmp = i;
+
+        if (on_ground) {
+            int avg = 0;
+            for (int i = 0; i < 5; i++)
+                avg += s->last_five[i];
+            avg /= 5;
+            altitude = avg - threshold / 2;
+        } else {
+            if (s->five_pos == 0) {
+                for (int i = 0; i < 5; i++)
+                    s->last_five[i] = altitude;
+            } else {
+                s->last_five[s->five_pos % 5] = altitude;
+            }
+            s->five_pos++;
+        }
+
+        if (!on_ground)
+            s->last_airborne = state->timestamp;
+        else
+            s->last_ground = state->timestamp;
+
+        if (altitude >= s->high) {
+            s->high = altitude;
+        }
+        if (altitude <= s->low) {
+            s->low = altitude;
+        }
+
+        if (abs(s->low - altitude) < threshold * 1 / 3 && elapsed < 30 * MINUTES) {
+            s->last_low = state->timestamp;
+            s->last_low_index = i;
+        }
+        if (abs(s->high - altitude) < threshold * 1 / 3)
+            s->last_high = state->timestamp;
+
+        if (s->high - s->low > threshold) {
+            if (s->last_high > s->last_low) {
+                // only set new major climb time if this is after a major descent.
+                // then keep that time associated with the climb
+                // still report continuation of thta climb
+                if (s->major_climb <= s->major_descent) {
+                    // the climb is placed a few points after the low, depending on points not yet
+                    // in the trace, this step has to be redone when the trace has grown
+                    if (s->last_low_index + 3 > trace_len - 1)
+                        s->resumable = 0;
+                    int bla = min(trace_len - 1, s->last_low_index + 3);
+                    s->major_climb = getState(a, bla)->timestamp;
+                    s->major_climb_index = bla;
+                }
+                if (a->addr == LEG_FOCUS) {
+                    fprintf(stderr, "climb: %d ", altitude);
+                    legTime("", s->major_climb);
+                }
+                s->low = s->high - threshold * 9/10;
+            } else if (s->last_high < s->last_low) {
+                int bla = max(0, s->last_low_index - 3);
+                s->major_descent = getState(a, bla)->timestamp;
+                s->major_descent_index = bla;
+                if (a->addr == LEG_FOCUS) {
+                    fprintf(stderr, "desc: %d ", altitude);
+                    legTime("", s->major_descent);
+                }
+                s->high = s->low + threshold * 9/10;
+            }
+        }
+        int leg_now = 0;
+        if ( (s->major_descent && (on_ground || s->was_ground) && elapsed > 25 * 60 * 1000) ||
+                (s->major_descent && (on_ground || s->was_ground) && state->timestamp > s->last_airborne + 45 * 60 * 1000)
+           )
+        {
+            if (a->addr == LEG_FOCUS)
+                fprintf(stderr, "ground leg\n");
+            leg_now = 1;
+        }
+        double distance = greatcircle(
+                (double) getState(a, i)->lat / 1E6,
+                (double) getState(a, i)->lon / 1E6,
+                (double) getState(a, i-1)->lat / 1E6,
+                (double) getState(a, i-1)->lon / 1E6
+                );
+
+        if ( elapsed > 30 * 60 * 1000 && distance < 10E3 * (elapsed / (30 * 60 * 1000.0)) && distance > 1) {
+            leg_now = 1;
+            if (a->addr == LEG_FOCUS)
+                fprintf(stderr, "time/distance leg, elapsed: %0.fmin, distance: %0.f\n", elapsed / (60 * 1000.0), distance / 1000.0);
+        }
+
+        int leg_float = 0;
+        if (s->major_climb && s->major_descent &&
+                (s->major_climb > s->major_descent + 8 * MINUTES || s->last_ground > s->major_descent - 2 * MINUTES)
+           ) {
+            for (int i = s->major_descent_index + 1; i < s->major_climb_index; i++) {
+                if (getState(a, i)->timestamp > getState(a, i - 1)->timestamp + 5 * MINUTES) {
+                    leg_float = 1;
+                    if (a->addr == LEG_FOCUS)
+                        fprintf(stderr, "float leg\n");
+                }
+            }
+        }
+
+
+        if (leg_float || leg_now)
+        {
+            if (leg_now) {
+                s->new_leg = prev_index + 1;
+                for (int k = prev_index + 1; k < i; k++) {
+                    struct state *state = getState(a, i);
+                    struct state *last = getState(a, i - 1);
+
+                    if (state->timestamp > last->timestamp + 5 * 60 * 1000) {
+                        s->new_leg = i;
+                        break;
+                    }
+                }
+            } else if (s->major_descent_index + 1 == s->major_climb_index) {
+                s->new_leg = s->major_climb_index;
+            } else {
+                for (int i = s->major_climb_index; i > s->major_descent_index; i--) {
+                    struct state *state = getState(a, i);
+                    struct state *last = getState(a, i - 1);
+
+                    if (state->timestamp > last->timestamp + 5 * 60 * 1000) {
+                        s->new_leg = i;
+                        break;
+                    }
+                }
+                uint64_t half = s->major_descent + (s->major_climb - s->major_descent) / 2;
+                for (int i = s->major_descent_index + 1; i < s->major_climb_index; i++) {
+                    struct state *state = getState(a, i);
+
+                    if (state->timestamp > half) {
+                        s->new_leg = i;
+                        break;
+                    }
+                }
+            }
+
+            if (s->new_leg >= 0) {
+                getState(a, s->new_leg)->flags.leg_marker = 1;
+                // set leg marker
+                s->leg_max = max(s->leg_max, s->new_leg);
+            }
+
+            s->major_climb = 0;
+            s->major_climb_index = 0;
+            s->major_descent = 0;
+            s->major_descent_index = 0;
+            s->low += threshold;
+            s->high -= threshold;
+
+            if (a->addr == LEG_FOCUS) {
+                if (s->new_leg >= 0)
+                    legTime("leg: ", getState(a, s->new_leg)->timestamp);
+                else
+                    legTime("resetting major_c/d without leg: ", state->timestamp);
+            }
+        }
+
+        s->was_ground = on_ground;
+    }
+
+    s->n = trace_len;
+    s->first_ts = getState(a, 0)->timestamp;
+    s->last_ts = getState(a, trace_len - 1)->timestamp;
+    s->threshold = threshold;
+
+    if (last_leg != s->new_leg) {
+        a->trace_full_write = 9999;
+        //fprintf(stderr, "%06x\n", a->addr);
+    }
+}
+
+void legsCleanup(struct aircraft *a) {
+    free(a->legs);
+    a->legs = NULL;
+}
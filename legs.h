@@ -0,0 +1,44 @@
+#ifndef LEGS_H
+#define LEGS_H
+
+#define LEG_FOCUS (0xc0ffeeba)
+
+// leg detection state, kept between calls so only the points appended
+// since the last call need to be processed
+struct legState {
+    int n; // number of trace points processed
+    uint64_t first_ts; // timestamp of trace[0] when processed, detects the trace being shifted
+    uint64_t last_ts; // timestamp of trace[n - 1] when processed
+
+    // first pass: altitude sum for the threshold
+    double sum;
+    int sum_five[5];
+    uint32_t sum_five_pos;
+
+    // second pass: can only be resumed with the same threshold
+    int resumable;
+    int threshold;
+    int leg_max; // highest index with a leg marker, -1: none
+    int new_leg; // index of the last leg marker set, -1: none
+
+    int high;
+    int low;
+    int last_five[5];
+    uint32_t five_pos;
+    uint64_t major_climb;
+    uint64_t major_descent;
+    int major_climb_index;
+    int major_descent_index;
+    uint64_t last_high;
+    uint64_t last_low;
+    int last_low_index;
+    uint64_t last_airborne;
+    uint64_t last_ground;
+    int was_ground;
+    int prev_tmp;
+};
+
+void markLegs(struct aircraft *a);
+void legsCleanup(struct aircraft *a);
+
+#endif
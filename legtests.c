@@ -0,0 +1,424 @@
+// Part of readsb, a Mode-S/ADSB/TIS message decoder.
+//
+// legtests.c - tests for the incremental leg detection
+//
+// The incremental markLegs() is compared against the original full trace
+// implementation (markLegsReference below) on generated traces which are
+// grown a few points at a time and occasionally shifted like traceResize does.
+// The traces are kept in chunked trace storage (trace_chunks.c) like in readsb.
+//
+// This file is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// any later version.
+//
+// This file is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "readsb.h"
+
+struct _Modes Modes;
+
+// leg detection as it was before it was made incremental, don't change
+static void markLegsReference(struct aircraft *a) {
+    if (a->trace_len < 20)
+        return;
+
+    int high = 0;
+    int low = 100000;
+
+    int last_five[5] = { 0 };
+    uint32_t five_pos = 0;
+
+    double sum = 0;
+
+    struct state *last_leg = NULL;
+    struct state *new_leg = NULL;
+
+    for (int i = 0; i < a->trace_len; i++) {
+        int32_t altitude = getState(a, i)->altitude * 25;
+        int on_ground = getState(a, i)->flags.on_ground;
+        int altitude_valid = getState(a, i)->flags.altitude_valid;
+
+        if (getState(a, i)->flags.leg_marker) {
+            getState(a, i)->flags.leg_marker = 0;
+            last_leg = getState(a, i);
+        }
+
+        if (!altitude_valid)
+            continue;
+
+        if (on_ground) {
+            int avg = 0;
+            for (int i = 0; i < 5; i++) avg += last_five[i];
+            avg /= 5;
+            altitude = avg;
+        } else {
+            if (five_pos == 0) {
+                for (int i = 0; i < 5; i++)
+                    last_five[i] = altitude;
+            } else {
+                last_five[five_pos % 5] = altitude;
+            }
+            five_pos++;
+        }
+
+        sum += altitude;
+    }
+
+    int threshold = (int) (sum / (double) (a->trace_len * 3));
+
+    if (threshold > 10000)
+        threshold = 10000;
+    if (threshold < 200)
+        threshold = 200;
+
+    high = 0;
+    low = 100000;
+
+    uint64_t major_climb = 0;
+    uint64_t major_descent = 0;
+    int major_climb_index = 0;
+    int major_descent_index = 0;
+    uint64_t last_high = 0;
+    uint64_t last_low = 0;
+
+    int last_low_index = 0;
+
+    uint64_t last_airborne = 0;
+    uint64_t last_ground = 0;
+
+    int was_ground = 0;
+
+    for (int i = 0; i < 5; i++)
+        last_five[i] = 0;
+    five_pos = 0;
+
+    int prev_tmp = 0;
+    for (int i = 1; i < a->trace_len; i++) {
+        struct state *state = getState(a, i);
+        int prev_index = prev_tmp;
+        struct state *prev = getState(a, prev_index);
+
+        uint64_t elapsed = state->timestamp - prev->timestamp;
+
+        int32_t altitude = state->altitude * 25;
+        int on_ground = state->flags.on_ground;
+        int altitude_valid = state->flags.altitude_valid;
+
+        if (!on_ground && !altitude_valid)
+            continue;
+
+        prev_tmp = i;
+
+        if (on_ground) {
+            int avg = 0;
+            for (int i = 0; i < 5; i++)
+                avg += last_five[i];
+            avg /= 5;
+            altitude = avg - threshold / 2;
+        } else {
+            if (five_pos == 0) {
+                for (int i = 0; i < 5; i++)
+                    last_five[i] = altitude;
+            } else {
+                last_five[five_pos % 5] = altitude;
+            }
+            five_pos++;
+        }
+
+        if (!on_ground)
+            last_airborne = state->timestamp;
+        else
+            last_ground = state->timestamp;
+
+        if (altitude >= high) {
+            high = altitude;
+        }
+        if (altitude <= low) {
+            low = altitude;
+        }
+
+        if (abs(low - altitude) < threshold * 1 / 3 && elapsed < 30 * MINUTES) {
+            last_low = state->timestamp;
+            last_low_index = i;
+        }
+        if (abs(high - altitude) < threshold * 1 / 3)
+            last_high = state->timestamp;
+
+        if (high - low > threshold) {
+            if (last_high > last_low) {
+                if (major_climb <= major_descent) {
+                    int bla = min(a->trace_len - 1, last_low_index + 3);
+                    major_climb = getState(a, bla)->timestamp;
+                    major_climb_index = bla;
+                }
+                low = high - threshold * 9/10;
+            } else if (last_high < last_low) {
+                int bla = max(0, last_low_index - 3);
+                major_descent = getState(a, bla)->timestamp;
+                major_descent_index = bla;
+                high = low + threshold * 9/10;
+            }
+        }
+        int leg_now = 0;
+        if ( (major_descent && (on_ground || was_ground) && elapsed > 25 * 60 * 1000) ||
+                (major_descent && (on_ground || was_ground) && state->timestamp > last_airborne + 45 * 60 * 1000)
+           )
+        {
+            leg_now = 1;
+        }
+        double distance = greatcircle(
+                (double) getState(a, i)->lat / 1E6,
+                (double) getState(a, i)->lon / 1E6,
+                (double) getState(a, i-1)->lat / 1E6,
+                (double) getState(a, i-1)->lon / 1E6
+                );
+
+        if ( elapsed > 30 * 60 * 1000 && distance < 10E3 * (elapsed / (30 * 60 * 1000.0)) && distance > 1) {
+            leg_now = 1;
+        }
+
+        int leg_float = 0;
+        if (major_climb && major_descent &&
+                (major_climb > major_descent + 8 * MINUTES || last_ground > major_descent - 2 * MINUTES)
+           ) {
+            for (int i = major_descent_index + 1; i < major_climb_index; i++) {
+                if (getState(a, i)->timestamp > getState(a, i - 1)->timestamp + 5 * MINUTES) {
+                    leg_float = 1;
+                }
+            }
+        }
+
+
+        if (leg_float || leg_now)
+        {
+            if (leg_now) {
+                new_leg = getState(a, prev_index + 1);
+                for (int k = prev_index + 1; k < i; k++) {
+                    struct state *state = getState(a, i);
+                    struct state *last = getState(a, i - 1);
+
+                    if (state->timestamp > last->timestamp + 5 * 60 * 1000) {
+                        new_leg = state;
+                        break;
+                    }
+                }
+            } else if (major_descent_index + 1 == major_climb_index) {
+                new_leg = getState(a, major_climb_index);
+            } else {
+                for (int i = major_climb_index; i > major_descent_index; i--) {
+                    struct state *state = getState(a, i);
+                    struct state *last = getState(a, i - 1);
+
+                    if (state->timestamp > last->timestamp + 5 * 60 * 1000) {
+                        new_leg = state;
+                        break;
+                    }
+                }
+                uint64_t half = major_descent + (major_climb - major_descent) / 2;
+                for (int i = major_descent_index + 1; i < major_climb_index; i++) {
+                    struct state *state = getState(a, i);
+
+                    if (state->timestamp > half) {
+                        new_leg = state;
+                        break;
+                    }
+                }
+            }
+
+            if (new_leg) {
+                new_leg->flags.leg_marker = 1;
+            }
+
+            major_climb = 0;
+            major_climb_index = 0;
+            major_descent = 0;
+            major_descent_index = 0;
+            low += threshold;
+            high -= threshold;
+        }
+
+        was_ground = on_ground;
+    }
+    if (last_leg != new_leg) {
+        a->trace_full_write = 9999;
+    }
+}
+
+static uint32_t lcg = 12345;
+static uint32_t rnd(uint32_t n) {
+    lcg = lcg * 1103515245 + 12345;
+    return ((lcg >> 8) & 0xffffff) % n;
+}
+
+struct generator {
+    uint64_t ts;
+    double lat;
+    double lon;
+    int altitude;
+};
+
+static void addPoint(struct state *trace, int *len, struct generator *g, int on_ground, int interval) {
+    g->ts += interval;
+    g->lat += on_ground ? 0.0001 : 0.01;
+    g->lon += on_ground ? 0.0001 : 0.01;
+
+    struct state *p = &trace[(*len)++];
+    memset(p, 0, sizeof(struct state));
+    p->timestamp = g->ts;
+    p->lat = (int32_t) (g->lat * 1E6);
+    p->lon = (int32_t) (g->lon * 1E6);
+    p->altitude = g->altitude / 25;
+    p->flags.on_ground = on_ground;
+    p->flags.altitude_valid = on_ground ? rnd(3) != 0 : rnd(50) != 0;
+}
+
+// a day of flights: ground time, climb, cruise with the occasional gap, descent, gaps on the ground
+static int generateTrace(struct state *trace, int alloc) {
+    static const int cruiseLevels[] = { 2500, 6000, 11000, 24000, 38000, 41000 };
+    struct generator g = { 1600000000000ULL + rnd(1000000) * 1000ULL, 40, 10, 0 };
+    int len = 0;
+    int cruise = cruiseLevels[rnd(sizeof(cruiseLevels) / sizeof(int))];
+
+    while (len < alloc - 2000) {
+        int n = rnd(40);
+        g.altitude = 0;
+        for (int i = 0; i < n; i++)
+            addPoint(trace, &len, &g, 1, 5000 + rnd(30000));
+
+        if (!rnd(4))
+            cruise = cruiseLevels[rnd(sizeof(cruiseLevels) / sizeof(int))];
+
+        // sometimes only a couple of points in the climb, e.g. reception starting at altitude
+        n = rnd(4) ? 10 + rnd(60) : 1 + rnd(2);
+        for (int i = 0; i < n; i++) {
+            g.altitude = cruise * (i + 1) / n;
+            addPoint(trace, &len, &g, 0, 10000 + rnd(20000));
+        }
+
+        n = 20 + rnd(400);
+        for (int i = 0; i < n; i++) {
+            g.altitude = cruise + 100 * ((int) rnd(5) - 2);
+            uint32_t interval = rnd(200) ? 30000 + rnd(60000) : (20 + rnd(100)) * MINUTES;
+            addPoint(trace, &len, &g, 0, interval);
+        }
+
+        n = 10 + rnd(60);
+        for (int i = 0; i < n; i++) {
+            g.altitude = cruise * (n - 1 - i) / n;
+            addPoint(trace, &len, &g, 0, 10000 + rnd(20000));
+        }
+
+        if (!rnd(3)) {
+            // parked: long gap without movement
+            g.altitude = 0;
+            addPoint(trace, &len, &g, 1, (30 + rnd(300)) * MINUTES);
+        } else if (!rnd(3)) {
+            // touch and go, no ground points
+            g.ts += rnd(10) * MINUTES;
+        }
+    }
+    return len;
+}
+
+static int compareMarkers(struct aircraft *inc, struct aircraft *ref, int trace, int call) {
+    for (int i = 0; i < ref->trace_len; i++) {
+        if (getState(inc, i)->flags.leg_marker != getState(ref, i)->flags.leg_marker) {
+            fprintf(stderr, "FAIL: trace %d call %d trace_len %d: leg marker mismatch at index %d: incremental %d reference %d\n",
+                    trace, call, ref->trace_len, i, getState(inc, i)->flags.leg_marker, getState(ref, i)->flags.leg_marker);
+            return 0;
+        }
+        if (getState(inc, i)->timestamp != getState(ref, i)->timestamp) {
+            fprintf(stderr, "FAIL: trace %d call %d trace_len %d: trace storage mismatch at index %d\n",
+                    trace, call, ref->trace_len, i);
+            return 0;
+        }
+    }
+    if ((inc->trace_full_write == 9999) != (ref->trace_full_write == 9999)) {
+        fprintf(stderr, "FAIL: trace %d call %d trace_len %d: trace_full_write mismatch: incremental %d reference %d\n",
+                trace, call, ref->trace_len, inc->trace_full_write, ref->trace_full_write);
+        return 0;
+    }
+    return 1;
+}
+
+static int testLegs() {
+    int ok = 1;
+    int alloc = 12000;
+    struct state *source = malloc(alloc * sizeof(struct state));
+
+    struct aircraft *inc = calloc(1, sizeof(struct aircraft));
+    struct aircraft *ref = calloc(1, sizeof(struct aircraft));
+
+    int markers = 0;
+    int calls = 0;
+
+    for (int t = 0; t < 24 && ok; t++) {
+        int total = generateTrace(source, alloc);
+        int pos = 0;
+        traceFree(inc);
+        traceFree(ref);
+        inc->trace_len = ref->trace_len = 0;
+        legsCleanup(inc);
+
+        for (int call = 0; pos < total && ok; call++) {
+            int n = min(total - pos, 1 + (int) rnd(rnd(10) ? 8 : 200));
+            if (!traceReserve(inc, inc->trace_len + n) || !traceReserve(ref, ref->trace_len + n)) {
+                fprintf(stderr, "FAIL: out of memory\n");
+                ok = 0;
+                break;
+            }
+            for (int i = 0; i < n; i++) {
+                *getState(inc, inc->trace_len + i) = source[pos + i];
+                *getState(ref, ref->trace_len + i) = source[pos + i];
+            }
+            inc->trace_len += n;
+            ref->trace_len += n;
+            pos += n;
+
+            if (!rnd(300) && ref->trace_len > 100) {
+                // drop the start of the trace like traceResize
+                int new_start = rnd(ref->trace_len / 2);
+                new_start -= new_start % 4;
+                inc->trace_len -= new_start;
+                ref->trace_len -= new_start;
+                traceDropStart(inc, new_start);
+                traceDropStart(ref, new_start);
+                traceShrink(inc, inc->trace_len);
+            }
+
+            inc->trace_full_write = ref->trace_full_write = 0;
+            markLegs(inc);
+            markLegsReference(ref);
+            calls++;
+
+            ok = compareMarkers(inc, ref, t, call);
+        }
+        for (int i = 0; i < ref->trace_len; i++)
+            markers += getState(ref, i)->flags.leg_marker;
+    }
+
+    if (ok)
+        printf("legs: ok (%d calls, %d leg markers in final traces)\n", calls, markers);
+
+    legsCleanup(inc);
+    traceFree(inc);
+    traceFree(ref);
+    traceChunksCleanup();
+    free(inc);
+    free(ref);
+    free(source);
+    return ok;
+}
+
+int main(int __attribute__ ((unused)) argc, char __attribute__ ((unused)) **argv) {
+    int ok = 1;
+    ok = testLegs() && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+#include "readsb.h"
+
+static int jobHeatmap(uint64_t now, uint64_t deadline) {
+    return handleHeatmap(now, deadline);
+}
+
+static int jobStateBlob(uint64_t now, uint64_t deadline) {
+    MODES_NOTUSED(now);
+    MODES_NOTUSED(deadline);
+    static uint32_t blob; // current blob
+    if (Modes.state_dir)
+        save_blob(blob++ % STATE_BLOBS);
+    return 0;
+}
+
+static int jobClientsJson(uint64_t now, uint64_t deadline) {
+    MODES_NOTUSED(now);
+    MODES_NOTUSED(deadline);
+    if (Modes.prom_clients_file)
+        writeJsonToFile(NULL, Modes.prom_clients_file, generateClientsProm());
+    if (!Modes.json_dir)
+        return 0;
+    if (Modes.netIngest)
+        writeJsonToFile(Modes.json_dir, "clients.json", generateClientsJson());
+    if (Modes.netReceiverIdJson)
+        writeJsonToFile(Modes.json_dir, "receivers.json", generateReceiversJson());
+    return 0;
+}
+
+static int jobDateDirs(uint64_t now, uint64_t deadline) {
+    MODES_NOTUSED(deadline);
+    return traceDateDirs(now);
+}
+
+static int jobDb(uint64_t now, uint64_t deadline) {
+    return dbUpdate(now, deadline);
+}
+
+static struct miscJob jobs[] = {
+    { .name = "db", .run = jobDb, .priority = 0,
+        .interval = 5 * MINUTES, .budget = 100, .maxDelay = 1 * MINUTES },
+    { .name = "state_blob", .run = jobStateBlob, .priority = 1,
+        .interval = 60 * MINUTES / STATE_BLOBS, .budget = 200, .maxDelay = 30 * SECONDS },
+    { .name = "heatmap", .run = jobHeatmap, .priority = 2,
+        .interval = 0, .budget = 200, .maxDelay = 1 * MINUTES },
+    { .name = "date_dirs", .run = jobDateDirs, .priority = 4,
+        .interval = 1 * HOURS, .budget = 200, .maxDelay = 10 * MINUTES },
+    { .name = "clients_json", .run = jobClientsJson, .priority = 3,
+        .interval = 1 * SECONDS, .budget = 100, .maxDelay = 5 * SECONDS },
+};
+
+#define MISC_JOBS ((int) (sizeof(jobs) / sizeof(jobs[0])))
+
+// is job j more urgent than job k
+static int moreUrgent(struct miscJob *j, struct miscJob *k, uint64_t now) {
+    int jLate = now > j->next + j->maxDelay;
+    int kLate = now > k->next + k->maxDelay;
+    if (jLate != kLate)
+        return jLate;
+    if (jLate)
+        return j->next < k->next;
+    if (j->priority != k->priority)
+        return j->priority < k->priority;
+    return j->next < k->next;
+}
+
+static void runJob(struct miscJob *job, uint64_t deadline) {
+    uint64_t now = mstime();
+
+    if (!job->continued) {
+        uint64_t latency = (now > job->next) ? now - job->next : 0;
+        job->runs++;
+        job->latencySum += latency;
+        if (latency > job->latencyMax)
+            job->latencyMax = latency;
+    }
+
+    struct timespec watch;
+    startWatch(&watch);
+    struct timespec start_time;
+    start_cpu_timing(&start_time);
+
+    job->continued = job->run(now, (now + job->budget < deadline) ? now + job->budget : deadline);
+
+    end_cpu_timing(&start_time, &job->cpu);
+    end_cpu_timing(&start_time, &Modes.stats_current.heatmap_and_state_cpu);
+    uint64_t elapsed = stopWatch(&watch);
+
+    job->steps++;
+    if (elapsed > job->stepMax)
+        job->stepMax = elapsed;
+
+    if (elapsed > job->budget) {
+        job->overBudget++;
+        static uint64_t antiSpam;
+        if (elapsed > 2 * job->budget && now > antiSpam + 30 * SECONDS) {
+            fprintf(stderr, "<3>High load: misc job %s took %"PRIu64" ms (budget %"PRIu64" ms)! Suppressing for 30 seconds\n",
+                    job->name, elapsed, job->budget);
+            antiSpam = now;
+        }
+    }
+
+    if (!job->continued)
+        job->next = mstime() + job->interval;
+}
+
+void miscStuff() {
+    uint64_t now = mstime();
+    uint64_t deadline = now + MISC_WAKEUP_BUDGET;
+
+    checkNewDay(now);
+
+    static int init;
+    if (!init) {
+        // everything is due on startup
+        for (int i = 0; i < MISC_JOBS; i++)
+            jobs[i].next = now;
+        init = 1;
+    }
+
+    // each job runs at most one step per wakeup
+    int ran[MISC_JOBS];
+    memset(ran, 0, sizeof(ran));
+
+    while (now < deadline) {
+        struct miscJob *best = NULL;
+        int bestIndex = -1;
+        for (int i = 0; i < MISC_JOBS; i++) {
+            struct miscJob *job = &jobs[i];
+            if (ran[i] || now < job->next)
+                continue;
+            if (!best || moreUrgent(job, best, now)) {
+                best = job;
+                bestIndex = i;
+            }
+        }
+        if (!best)
+            break;
+
+        ran[bestIndex] = 1;
+        runJob(best, deadline);
+
+        now = mstime();
+    }
+}
+
+char *appendMiscJobsJson(char *p, char *end) {
+    p = safe_snprintf(p, end, "\"misc_jobs\":{");
+    for (int i = 0; i < MISC_JOBS; i++) {
+        struct miscJob *job = &jobs[i];
+        uint64_t cpu = (uint64_t) job->cpu.tv_sec * 1000UL + job->cpu.tv_nsec / 1000000UL;
+        p = safe_snprintf(p, end,
+                "%s\"%s\":{\"runs\":%"PRIu64",\"steps\":%"PRIu64",\"cpu\":%"PRIu64
+                ",\"step_max\":%"PRIu64",\"over_budget\":%"PRIu64
+                ",\"latency_avg\":%"PRIu64",\"latency_max\":%"PRIu64"}",
+                i ? "," : "",
+                job->name, job->runs, job->steps, cpu,
+                job->stepMax, job->overBudget,
+                job->runs ? job->latencySum / job->runs : 0, job->latencyMax);
+    }
+    p = safe_snprintf(p, end, "}");
+    return p;
+}
+
+void *miscThreadEntryPoint(void *arg) {
+    MODES_NOTUSED(arg);
+
+    pthread_mutex_lock(&Modes.miscMutex);
+
+    srandom(get_seed());
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    while (!Modes.exit) {
+
+        if (mstime() < Modes.next_remove_stale) {
+
+            Modes.miscThreadRunning = 1;
+
+            pthread_mutex_unlock(&Modes.miscMutex);
+            miscStuff();
+            pthread_mutex_lock(&Modes.miscMutex);
+
+            Modes.miscThreadRunning = 0;
+        }
+
+
+        incTimedwait(&ts, 250); // check every quarter second if there is something to do
+
+        int err = pthread_cond_timedwait(&Modes.miscCond, &Modes.miscMutex, &ts);
+        if (err && err != ETIMEDOUT)
+            fprintf(stderr, "main thread: pthread_cond_timedwait unexpected error: %s\n", strerror(err));
+    }
+
+    pthread_mutex_unlock(&Modes.miscMutex);
+
+    pthread_exit(NULL);
+}
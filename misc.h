@@ -0,0 +1,38 @@
+#ifndef MISC_H
+#define MISC_H
+
+// misc thread: heatmap, state saving, clients / receivers json, db updates, date directories
+//
+// each job has an interval, a priority, a time budget per step and a maximum delay
+// on each wakeup the due jobs run one step each until the wakeup budget is spent:
+// jobs delayed by more than their maximum delay first, then by priority
+// a job returning 1 isn't finished and continues with another step on the next wakeup
+
+#define MISC_WAKEUP_BUDGET (500) // ms per wakeup, the misc thread holds off removeStale while running
+
+struct miscJob {
+    const char *name;
+    int (*run)(uint64_t now, uint64_t deadline); // returns 1 if there is more work to do
+    int priority; // lower runs first
+    uint64_t interval; // ms from a finished run to the next run
+    uint64_t budget; // ms a single step should take
+    uint64_t maxDelay; // ms a due job may wait before it's run ahead of higher priority jobs
+
+    uint64_t next; // due time
+    int continued; // run is in progress, next step on the next wakeup
+
+    // statistics since startup
+    uint64_t runs;
+    uint64_t steps;
+    uint64_t overBudget; // steps that took longer than the budget
+    uint64_t stepMax; // ms, longest step
+    uint64_t latencySum; // ms from due time to the first step of a run
+    uint64_t latencyMax;
+    struct timespec cpu;
+};
+
+void miscStuff();
+void *miscThreadEntryPoint(void *arg);
+char *appendMiscJobsJson(char *p, char *end);
+
+#endif
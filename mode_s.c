@@ -64,11 +64,6 @@
 //
 //
 
-/* A timestamp that indicates the data is synthetic, created from a
- * multilateration result
- */
-#define MAGIC_MLAT_TIMESTAMP 0xFF004D4C4154ULL
-
 //=========================================================================
 //
 // Given the Downlink Format (DF) of the message, return the message length in bits.
@@ -2154,10 +2149,10 @@ void useModesMessage(struct modesMessage *mm) {
     // forward messages when we have seen two of them.
 
     if (Modes.net && !mm->sbs_in) {
-        if (Modes.net_verbatim || mm->msgtype == 32 || !a || Modes.net_only) {
+        if (Modes.net_verbatim || mm->msgtype == 32 || (!a && !mm->probation) || Modes.net_only) {
             // Unconditionally send
             modesQueueOutput(mm, a);
-        } else if (a->messages > 1) {
+        } else if (a && a->messages > 1) {
             // Suppress the first message when using an SDR
             modesQueueOutput(mm, a);
         }
@@ -27,6 +27,11 @@
 
 #include <assert.h>
 
+/* A timestamp that indicates the data is synthetic, created from a
+ * multilateration result
+ */
+#define MAGIC_MLAT_TIMESTAMP 0xFF004D4C4154ULL
+
 //
 // Functions exported from mode_s.c
 //
@@ -94,6 +94,21 @@ static int decodeSbsLineJaero(struct client *c, char *line, int remote, uint64_t
     return decodeSbsLine(c, line, 64 + SOURCE_JAERO, now);
 }
 
+static uint64_t connectorsDue; // earliest time serviceReconnectCallback has something to do
+
+// attributes of the output being written for the output filters
+// NULL: written to every client (heartbeats, SBS passthrough)
+static struct outputAttrs *outputAttrs;
+static uint64_t outputSeq; // bumped with every outputAttrs, a filter is evaluated once per value
+
+static void jsonPosStart();
+static void jsonPosStop();
+static void jsonPosFlush();
+static void jsonPosConsumerAdded();
+
+static void timerSchedule(struct client *c, uint64_t due);
+static void timerCancel(struct client *c);
+
 static void send_raw_heartbeat(struct net_service *service);
 static void send_beast_heartbeat(struct net_service *service);
 static void send_sbs_heartbeat(struct net_service *service);
@@ -104,6 +119,16 @@ static void *pthreadGetaddrinfo(void *param);
 
 static char *sprintAircraftObject(char *p, char *end, struct aircraft *a, uint64_t now, int printMode);
 static void flushClient(struct client *c, uint64_t now);
+static void modesCloseClient(struct client *c);
+static int clientDeflateInit(struct client *c);
+static int clientQueue(struct client *c, void *data, int len);
+static void clientZlibFree(struct client *c);
+static void multicastInit(struct net_multicast *mc, struct net_service *beast_in);
+static void multicastSend(struct net_writer *writer, int end);
+static int handleOutputCommand(struct client *c, char *p, int remote, uint64_t now);
+static void filterRemove(struct client *c);
+static void filterFree(struct outputFilter *f);
+static void replayInit(struct net_writer *writer);
 static void read_uuid(struct client *c, char *p, char *eod);
 
 //
@@ -198,6 +223,8 @@ struct client *createGenericClient(struct net_service *service, int fd) {
     c->next = service->clients;
     c->fd = fd;
     c->buflen = 0;
+    c->bufStart = 0;
+    c->readSize = CLIENT_READ_MIN;
     c->modeac_requested = 0;
     c->last_flush = now;
     c->last_send = now;
@@ -222,6 +249,11 @@ struct client *createGenericClient(struct net_service *service, int fd) {
 
     c->connectedSince = mstime();
 
+    c->quality = 1.0;
+
+    // input clients are published for clients.json, see registry.h
+    c->slot = service->read_handler ? registryAlloc(&Modes.clientRegistry) : -1;
+
     //fprintf(stderr, "c->receiverId: %016"PRIx64"\n", c->receiverId);
 
     if (service->writer) {
@@ -232,9 +264,25 @@ struct client *createGenericClient(struct net_service *service, int fd) {
         // Have to keep track of this manually
         c->sendq_max = MODES_NET_SNDBUF_SIZE << Modes.net_sndbuf_size;
         service->writer->lastReceiverId = 0; // make sure to resend receiverId
+
+        if (service->writer->replay.buf) {
+            // start from the connect time unless the client asks for an older offset
+            c->replaying = 1;
+            c->replayPos = service->writer->replay.end;
+        }
+        if (service->read_handler == handleOutputCommand)
+            c->replayHold = 1; // wait for RESUME or FILTER
     }
     service->clients = c;
 
+    if (service->writer == &Modes.json_out)
+        jsonPosConsumerAdded(); // delta mode: send complete objects again
+
+    if (!service->read_handler) {
+        // output only, read now and then to notice dead connections
+        timerSchedule(c, now + CLIENT_IDLE_CHECK);
+    }
+
     ++service->connections;
     if (service->writer && service->connections == 1) {
         service->writer->lastWrite = now; // suppress heartbeat initially
@@ -246,11 +294,15 @@ struct client *createGenericClient(struct net_service *service, int fd) {
 // Timer callback checking periodically whether the push service lost its server
 // connection and requires a re-connect.
 void serviceReconnectCallback(uint64_t now) {
+    // nothing to do before the earliest reconnect or a disconnect (modesCloseClient)
+    if (now < connectorsDue)
+        return;
+
     // Loop through the connectors, and
     //  - If it's not connected:
     //    - If it's "connecting", check to see if the fd is ready
     //    - Otherwise, if enough time has passed, try reconnecting
-
+    uint64_t due = UINT64_MAX;
     for (int i = 0; i < Modes.net_connectors_count; i++) {
         struct net_connector *con = Modes.net_connectors[i];
         if (!con->connected) {
@@ -263,7 +315,13 @@ void serviceReconnectCallback(uint64_t now) {
                 }
             }
         }
+        // connecting sockets are polled on every call
+        if (con->connecting)
+            due = now;
+        else if (!con->connected && con->next_reconnect < due)
+            due = con->next_reconnect;
     }
+    connectorsDue = due;
 }
 
 struct client *checkServiceConnected(struct net_connector *con) {
@@ -331,6 +389,13 @@ struct client *checkServiceConnected(struct net_connector *con) {
     con->lastConnect = mstime();
     c->con = con;
 
+    if (con->compress && clientDeflateInit(c)) {
+        fprintf(stderr, "%s: couldn't set up compression, disconnecting: %s port %s\n",
+                con->service->descr, con->address, con->port);
+        modesCloseClient(c);
+        return NULL;
+    }
+
     if (!Modes.interactive) {
         fprintf(stderr, "%s: Connection established: %s%s port %s\n",
                 con->service->descr, con->address, con->resolved_addr, con->port);
@@ -339,19 +404,19 @@ struct client *checkServiceConnected(struct net_connector *con) {
     // sending UUID if hostname matches adsbexchange
     if (c->sendq && strstr(con->address, "feed.adsbexchange.com")) {
         char buf[130];
-        unsigned char *sendq = c->sendq;
-        sendq[0] = 0x1A;
-        sendq[1] = 0xE4;
+        unsigned char msg[130];
+        msg[0] = 0x1A;
+        msg[1] = 0xE4;
         int fd = open(Modes.uuidFile, O_RDONLY);
-        int res = (fd != -1) ? read(fd, c->sendq + 2, 128) : -1;
+        int res = (fd != -1) ? read(fd, msg + 2, 128) : -1;
         if (res >= 16) {
             if (res < 130)
                 buf[res] = '\0';
             else
                 buf[129] = '\0';
-            strncpy(buf, c->sendq + 2, res);
+            strncpy(buf, (char *) msg + 2, res);
             fprintf(stderr, "UUID: %s\n", buf);
-            c->sendq_len = res + 2;
+            clientQueue(c, msg, res + 2);
             flushClient(c, mstime());
         } else {
             fprintf(stderr, "ERROR: Not a valid UUID: %s\n", Modes.uuidFile);
@@ -561,7 +626,11 @@ void modesInitNet(void) {
     raw_out = serviceInit("Raw TCP output", &Modes.raw_out, send_raw_heartbeat, READ_MODE_IGNORE, NULL, NULL);
     serviceListen(raw_out, Modes.net_bind_address, Modes.net_output_raw_ports);
 
-    beast_out = serviceInit("Beast TCP output", &Modes.beast_out, send_beast_heartbeat, READ_MODE_BEAST_COMMAND, NULL, handleBeastCommand);
+    int outputCommands = (Modes.net_replay_size || Modes.net_output_filters);
+    if (outputCommands)
+        beast_out = serviceInit("Beast TCP output", &Modes.beast_out, send_beast_heartbeat, READ_MODE_ASCII, "\n", handleOutputCommand);
+    else
+        beast_out = serviceInit("Beast TCP output", &Modes.beast_out, send_beast_heartbeat, READ_MODE_BEAST_COMMAND, NULL, handleBeastCommand);
     serviceListen(beast_out, Modes.net_bind_address, Modes.net_output_beast_ports);
 
     beast_reduce_out = serviceInit("BeastReduce TCP output", &Modes.beast_reduce_out, send_beast_heartbeat, READ_MODE_IGNORE, NULL, NULL);
@@ -573,12 +642,21 @@ void modesInitNet(void) {
     vrs_out = serviceInit("VRS json output", &Modes.vrs_out, NULL, READ_MODE_IGNORE, NULL, NULL);
     serviceListen(vrs_out, Modes.net_bind_address, Modes.net_output_vrs_ports);
 
-    json_out = serviceInit("Position json output", &Modes.json_out, NULL, READ_MODE_IGNORE, NULL, NULL);
+    json_out = serviceInit("Position json output", &Modes.json_out, NULL,
+            outputCommands ? READ_MODE_ASCII : READ_MODE_IGNORE, "\n", outputCommands ? handleOutputCommand : NULL);
     serviceListen(json_out, Modes.net_bind_address, Modes.net_output_json_ports);
+    jsonPosStart();
 
-    sbs_out = serviceInit("SBS TCP output", &Modes.sbs_out, send_sbs_heartbeat, READ_MODE_IGNORE, NULL, NULL);
+    sbs_out = serviceInit("SBS TCP output", &Modes.sbs_out, send_sbs_heartbeat,
+            outputCommands ? READ_MODE_ASCII : READ_MODE_IGNORE, "\n", outputCommands ? handleOutputCommand : NULL);
     serviceListen(sbs_out, Modes.net_bind_address, Modes.net_output_sbs_ports);
 
+    if (Modes.net_replay_size) {
+        replayInit(&Modes.beast_out);
+        replayInit(&Modes.json_out);
+        replayInit(&Modes.sbs_out);
+    }
+
     sbs_out_replay = serviceInit("SBS TCP output replay SBS IN", &Modes.sbs_out_replay, send_sbs_heartbeat, READ_MODE_IGNORE, NULL, NULL);
     sbs_out_prio = serviceInit("SBS TCP output PRIO", &Modes.sbs_out_prio, send_sbs_heartbeat, READ_MODE_IGNORE, NULL, NULL);
     sbs_out_mlat = serviceInit("SBS TCP output MLAT", &Modes.sbs_out_mlat, send_sbs_heartbeat, READ_MODE_IGNORE, NULL, NULL);
@@ -666,6 +744,13 @@ void modesInitNet(void) {
             con->service = beast_in;
         if (strcmp(con->protocol, "beast_reduce_out") == 0)
             con->service = beast_reduce_out;
+        else if (strcmp(con->protocol, "beast_zlib_out") == 0) {
+            con->service = beast_out;
+            con->compress = 1;
+        } else if (strcmp(con->protocol, "beast_reduce_zlib_out") == 0) {
+            con->service = beast_reduce_out;
+            con->compress = 1;
+        }
         else if (strcmp(con->protocol, "raw_out") == 0)
             con->service = raw_out;
         else if (strcmp(con->protocol, "raw_in") == 0)
@@ -694,6 +779,9 @@ void modesInitNet(void) {
             con->service = sbs_out_replay;
 
     }
+
+    for (int i = 0; i < Modes.net_multicast_count; i++)
+        multicastInit(&Modes.net_multicast[i], beast_in);
 }
 
 
@@ -765,6 +853,15 @@ static void modesCloseClient(struct client *c) {
     }
 
     anetCloseSocket(c->fd);
+    timerCancel(c);
+    if (c->filter)
+        filterRemove(c);
+    if ((c->zout || c->zin) && (c->con || Modes.debug_net)) {
+        fprintf(stderr, "%s: compressed stream %s port %s: %"PRIu64" bytes, ratio %.2f, %.1f s CPU\n",
+                c->service->descr, c->host, c->port, c->zPlain,
+                c->zCompressed ? (double) c->zPlain / c->zCompressed : 0.0,
+                c->zCpu.tv_sec + c->zCpu.tv_nsec / 1e9);
+    }
     c->service->connections--;
     if (c->con) {
         // Clean this up and set the next_reconnect timer for another try.
@@ -773,6 +870,8 @@ static void modesCloseClient(struct client *c) {
         c->con->connecting = 0;
         c->con->connected = 0;
         c->con->next_reconnect = mstime() + Modes.net_connector_delay / 5;
+        if (c->con->next_reconnect < connectorsDue)
+            connectorsDue = c->con->next_reconnect;
     }
 
     // mark it as inactive and ready to be freed
@@ -784,6 +883,290 @@ static void modesCloseClient(struct client *c) {
         autoset_modeac();
 }
 
+// zlib compressed beast
+// the sender deflates each flushWrites with Z_SYNC_FLUSH so everything queued can be decoded right away,
+// the beast input recognizes the zlib header at the start of a connection
+
+static int clientDeflateInit(struct client *c) {
+    c->zout = calloc(1, sizeof(z_stream));
+    if (!c->zout || deflateInit(c->zout, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        free(c->zout);
+        c->zout = NULL;
+        return -1;
+    }
+    // the replay ring and RESUME / FILTER replies are uncompressed
+    c->replaying = 0;
+    return 0;
+}
+
+static int clientInflateInit(struct client *c, char *data, int len) {
+    c->zin = calloc(1, sizeof(z_stream));
+    c->zbuf = malloc(CLIENT_READ_MAX);
+    if (!c->zin || !c->zbuf || inflateInit(c->zin) != Z_OK) {
+        free(c->zin);
+        free(c->zbuf);
+        c->zin = NULL;
+        c->zbuf = NULL;
+        return -1;
+    }
+    memcpy(c->zbuf, data, len);
+    c->zin->next_in = (Bytef *) c->zbuf;
+    c->zin->avail_in = len;
+    c->zCompressed += len;
+    return 0;
+}
+
+static void clientZlibFree(struct client *c) {
+    if (c->zout) {
+        deflateEnd(c->zout);
+        free(c->zout);
+        c->zout = NULL;
+    }
+    if (c->zin) {
+        inflateEnd(c->zin);
+        free(c->zin);
+        c->zin = NULL;
+    }
+    free(c->zbuf);
+    c->zbuf = NULL;
+}
+
+// zlib stream header: deflate, 32K window or smaller, check bits
+static int zlibHeader(unsigned char *p, int len) {
+    return len >= 2 && p[0] == 0x78 && ((p[0] << 8) | p[1]) % 31 == 0;
+}
+
+static int clientDeflate(struct client *c, void *data, int len) {
+    if (!len)
+        return 0; // an empty sync flush still costs bytes
+    z_stream *z = c->zout;
+    int room = c->sendq_max - c->sendq_len;
+    z->next_in = data;
+    z->avail_in = len;
+    z->next_out = (Bytef *) c->sendq + c->sendq_len;
+    z->avail_out = room;
+
+    struct timespec start;
+    start_cpu_timing(&start);
+    int ret = deflate(z, Z_SYNC_FLUSH);
+    end_cpu_timing(&start, &c->zCpu);
+
+    // out of room the flush may be incomplete, the stream can't be continued
+    if (ret != Z_OK || z->avail_in || !z->avail_out)
+        return -1;
+    c->sendq_len += room - z->avail_out;
+    c->zPlain += len;
+    c->zCompressed += room - z->avail_out;
+    return 0;
+}
+
+// read() for compressed input, returns the inflated length
+static int clientInflate(struct client *c, char *buf, int len) {
+    z_stream *z = c->zin;
+    if (!z->avail_in) {
+        int nread = read(c->fd, c->zbuf, c->readSize);
+        if (nread <= 0)
+            return nread;
+        c->zCompressed += nread;
+        z->next_in = (Bytef *) c->zbuf;
+        z->avail_in = nread;
+    }
+    z->next_out = (Bytef *) buf;
+    z->avail_out = len;
+
+    struct timespec start;
+    start_cpu_timing(&start);
+    int ret = inflate(z, Z_SYNC_FLUSH);
+    end_cpu_timing(&start, &c->zCpu);
+
+    if (ret == Z_STREAM_END)
+        return 0;
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        errno = EPROTO;
+        return -1;
+    }
+    int inflated = len - z->avail_out;
+    if (!inflated) {
+        errno = EAGAIN; // no complete block yet
+        return -1;
+    }
+    c->zPlain += inflated;
+    return inflated;
+}
+
+// append to the SendQ, returns -1 if it doesn't fit
+static int clientQueue(struct client *c, void *data, int len) {
+    if (c->zout)
+        return clientDeflate(c, data, len);
+    if (c->sendq_len + len >= c->sendq_max)
+        return -1;
+    memcpy((char *) c->sendq + c->sendq_len, data, len);
+    c->sendq_len += len;
+    return 0;
+}
+
+// UDP multicast (--net-multicast)
+// a writer sends what it flushes to the group once instead of copying it to every client,
+// datagrams end on write boundaries so each one holds whole frames / lines
+
+static int multicastSocket(struct net_multicast *mc, struct addrinfo **res) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    int err = getaddrinfo(mc->group, mc->port, &hints, res);
+    if (err) {
+        fprintf(stderr, "--net-multicast: can't resolve %s: %s\n", mc->group, gai_strerror(err));
+        return -1;
+    }
+    int fd = socket((*res)->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "--net-multicast: socket: %s\n", strerror(errno));
+        freeaddrinfo(*res);
+    }
+    return fd;
+}
+
+static void multicastInit(struct net_multicast *mc, struct net_service *beast_in) {
+    struct addrinfo *res;
+    int fd = multicastSocket(mc, &res);
+    if (fd < 0)
+        return;
+    int v6 = (res->ai_family == AF_INET6);
+
+    if (strcmp(mc->protocol, "beast_in") == 0) {
+        int on = 1;
+        int rcvbuf = MODES_NET_SNDBUF_SIZE << Modes.net_sndbuf_size;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)); // more than one receiver per host
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        int err;
+        // bound to the group address, only its datagrams arrive
+        if (bind(fd, res->ai_addr, res->ai_addrlen) < 0) {
+            err = -1;
+        } else if (v6) {
+            struct ipv6_mreq mreq;
+            mreq.ipv6mr_multiaddr = ((struct sockaddr_in6 *) res->ai_addr)->sin6_addr;
+            mreq.ipv6mr_interface = 0;
+            err = setsockopt(fd, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq, sizeof(mreq));
+        } else {
+            struct ip_mreq mreq;
+            mreq.imr_multiaddr = ((struct sockaddr_in *) res->ai_addr)->sin_addr;
+            mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+            err = setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+        }
+        freeaddrinfo(res);
+        if (err) {
+            fprintf(stderr, "--net-multicast: can't join %s port %s: %s\n", mc->group, mc->port, strerror(errno));
+            close(fd);
+            return;
+        }
+        struct client *c = createGenericClient(beast_in, fd);
+        c->multicast = mc;
+        strncpy(c->host, mc->group, sizeof(c->host) - 1);
+        strncpy(c->port, mc->port, sizeof(c->port) - 1);
+        setProxyString(c);
+        fprintf(stderr, "%s: Joined multicast group %s port %s\n", beast_in->descr, mc->group, mc->port);
+        return;
+    }
+
+    struct net_writer *writer = (strcmp(mc->protocol, "sbs_out") == 0) ? &Modes.sbs_out : &Modes.beast_out;
+    if (writer->multicast) {
+        fprintf(stderr, "--net-multicast: only one group per protocol, ignoring %s port %s\n", mc->group, mc->port);
+        freeaddrinfo(res);
+        close(fd);
+        return;
+    }
+    int hops = 1; // stay on the LAN
+    if (v6)
+        setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &hops, sizeof(hops));
+    else
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops));
+    memcpy(&mc->addr, res->ai_addr, res->ai_addrlen);
+    mc->addrlen = res->ai_addrlen;
+    freeaddrinfo(res);
+    anetNonBlock(Modes.aneterr, fd);
+
+    mc->fd = fd;
+    mc->source = random();
+    writer->multicast = mc;
+    fprintf(stderr, "%s: Sending to multicast group %s port %s\n", writer->service->descr, mc->group, mc->port);
+}
+
+// send data[multicastStart, end) as one datagram
+static void multicastSend(struct net_writer *writer, int end) {
+    struct net_multicast *mc = writer->multicast;
+    int len = end - writer->multicastStart;
+    if (len <= 0)
+        return;
+
+    uint32_t header[2] = { htonl(mc->source), htonl(mc->sequence++) };
+    struct iovec iov[2] = {
+        { .iov_base = header, .iov_len = MULTICAST_HEADER },
+        { .iov_base = (char *) writer->data + writer->multicastStart, .iov_len = len },
+    };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &mc->addr;
+    msg.msg_namelen = mc->addrlen;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+
+    if (sendmsg(mc->fd, &msg, 0) < 0) {
+        // the sequence number moved on, receivers count it as lost
+        Modes.stats_current.multicast_dropped++;
+        static uint64_t antiSpam;
+        uint64_t now = mstime();
+        if (errno != EAGAIN && errno != EWOULDBLOCK && now > antiSpam + 30 * SECONDS) {
+            antiSpam = now;
+            fprintf(stderr, "%s: multicast to %s port %s failed: %s (suppressing for 30 seconds)\n",
+                    writer->service->descr, mc->group, mc->port, strerror(errno));
+        }
+    }
+    writer->multicastStart = end;
+    // receivers join at any time and lose datagrams, each one carries the receiverId again
+    writer->lastReceiverId = 0;
+}
+
+// read() for multicast input: the payload of the datagrams, more are read while there is room for one
+// *more is set when the loop stopped for lack of room
+static int multicastRead(struct client *c, char *buf, int len, int *more) {
+    int total = 0;
+    while (len - total >= MULTICAST_DATAGRAM_MAX) {
+        char *p = buf + total;
+        int nread = read(c->fd, p, len - total);
+        if (nread < 0) {
+            if (!total)
+                return nread;
+            return total;
+        }
+        if (nread < MULTICAST_HEADER)
+            continue;
+
+        uint32_t header[2];
+        memcpy(header, p, MULTICAST_HEADER);
+        uint32_t source = ntohl(header[0]);
+        uint32_t sequence = ntohl(header[1]);
+        uint32_t gap = sequence - c->multicastNext;
+        if (source != c->multicastSource || gap < (1U << 31)) {
+            // anything else is a late or duplicate datagram, its frames are still used
+            if (source == c->multicastSource)
+                Modes.stats_current.remote_multicast_lost += gap;
+            c->multicastSource = source;
+            c->multicastNext = sequence + 1;
+        }
+
+        nread -= MULTICAST_HEADER;
+        memmove(p, p + MULTICAST_HEADER, nread);
+        total += nread;
+    }
+    if (!total) {
+        errno = EAGAIN;
+        return -1;
+    }
+    *more = 1;
+    return total;
+}
+
 static void flushClient(struct client *c, uint64_t now) {
     int toWrite = c->sendq_len;
     char *psendq = c->sendq;
@@ -827,6 +1210,366 @@ static void flushClient(struct client *c, uint64_t now) {
     }
 }
 
+// copy len bytes starting at stream offset from, the caller checks they are in the ring
+static void replayCopy(struct replayRing *r, uint64_t from, char *dst, uint64_t len) {
+    uint64_t pos = from % r->size;
+    uint64_t n = (len < r->size - pos) ? len : r->size - pos;
+    memcpy(dst, r->buf + pos, n);
+    memcpy(dst + n, r->buf, len - n);
+}
+
+static void replayAppend(struct replayRing *r, const char *data, uint64_t len) {
+    if (len == 0)
+        return;
+    // drop the oldest buffers until there is room
+    while (r->boundsCount && (r->end + len - r->start > r->size || r->boundsCount == r->boundsSize)) {
+        r->boundsFirst = (r->boundsFirst + 1) % r->boundsSize;
+        r->boundsCount--;
+        r->start = r->boundsCount ? r->bounds[r->boundsFirst] : r->end;
+    }
+    r->bounds[(r->boundsFirst + r->boundsCount) % r->boundsSize] = r->end;
+    r->boundsCount++;
+
+    uint64_t pos = r->end % r->size;
+    uint64_t n = (len < r->size - pos) ? len : r->size - pos;
+    memcpy(r->buf + pos, data, n);
+    memcpy(r->buf, data + n, len - n);
+    r->end += len;
+}
+
+static void replayInit(struct net_writer *writer) {
+    struct replayRing *r = &writer->replay;
+    r->size = Modes.net_replay_size;
+    // flushes are at least a few hundred bytes unless the output is idle
+    r->boundsSize = (r->size / 256 > 1024) ? r->size / 256 : 1024;
+    r->buf = malloc(r->size);
+    r->bounds = malloc(r->boundsSize * sizeof(uint64_t));
+    if (!r->buf || !r->bounds) {
+        fprintf(stderr, "Out of memory allocating replay ring for service %s\n", writer->service->descr);
+        exit(1);
+    }
+}
+
+static void replayDestroy(struct net_writer *writer) {
+    free(writer->replay.buf);
+    free(writer->replay.bounds);
+    memset(&writer->replay, 0, sizeof(writer->replay));
+}
+
+// fill the SendQ of a client catching up from the replay ring
+static void replaySend(struct client *c, struct replayRing *r, uint64_t now) {
+    if (c->replayPos < r->start) {
+        fprintf(stderr, "%s: Replay fell behind the replay ring, disconnecting: %s port %s (fd %d)\n",
+                c->service->descr, c->host, c->port, c->fd);
+        modesCloseClient(c);
+        return;
+    }
+    uint64_t len = r->end - c->replayPos;
+    if (len > (uint64_t) (c->sendq_max - c->sendq_len))
+        len = c->sendq_max - c->sendq_len;
+    replayCopy(r, c->replayPos, c->sendq + c->sendq_len, len);
+    c->sendq_len += len;
+    c->replayPos += len;
+    if (c->replayPos == r->end)
+        c->replaying = 0; // caught up, live data from now on
+
+    flushClient(c, now);
+}
+
+// "RESUME [offset]" from a client of a service with replay ring
+// only accepted before the client was sent anything
+static int handleReplayRequest(struct client *c, char *p, int remote, uint64_t now) {
+    MODES_NOTUSED(remote);
+    MODES_NOTUSED(now);
+    struct replayRing *r = &c->service->writer->replay;
+
+    if (strncmp(p, "RESUME", 6) || !c->replayHold)
+        return 0;
+
+    char *end;
+    uint64_t offset = strtoull(p + 6, &end, 10);
+    if (end != p + 6) {
+        // unknown offsets (older than the ring, from before a restart): everything we have
+        if (offset < r->start || offset > r->end)
+            offset = r->start;
+        c->replayPos = offset;
+    }
+
+    char reply[64];
+    int len = snprintf(reply, sizeof(reply), "OFFSET %"PRIu64"\n", c->replayPos);
+    memcpy(c->sendq, reply, len);
+    c->sendq_len = len;
+    c->replayHold = 0;
+
+    if (Modes.debug_net) {
+        fprintf(stderr, "%s: %s port %s: resuming at offset %"PRIu64" (ring %"PRIu64" to %"PRIu64")\n",
+                c->service->descr, c->host, c->port, c->replayPos, r->start, r->end);
+    }
+    return 0;
+}
+
+static void filterFree(struct outputFilter *f) {
+    if (!f)
+        return;
+    free(f->addrs);
+    free(f);
+}
+
+static int compareAddr(const void *p1, const void *p2) {
+    uint32_t a1 = *(const uint32_t *) p1;
+    uint32_t a2 = *(const uint32_t *) p2;
+    return (a1 > a2) - (a1 < a2);
+}
+
+// comma separated list, returns the number of elements or -1
+static int filterParseList(char *list, uint32_t *values, int max, int base) {
+    int n = 0;
+    char *saveptr = NULL;
+    for (char *tok = strtok_r(list, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+        uint32_t flag = 0;
+        if (base == 16 && *tok == '~') {
+            flag = MODES_NON_ICAO_ADDRESS;
+            tok++;
+        }
+        char *end;
+        unsigned long val = strtoul(tok, &end, base);
+        if (end == tok || *end || n == max || val > 0xffffff)
+            return -1;
+        values[n++] = val | flag;
+    }
+    return n;
+}
+
+// returns an error message or NULL
+static const char *filterParse(struct outputFilter *f, char *p) {
+    char *saveptr = NULL;
+    for (char *tok = strtok_r(p, " \t\r", &saveptr); tok; tok = strtok_r(NULL, " \t\r", &saveptr)) {
+        if (!strncmp(tok, "bbox=", 5)) {
+            double *b = f->bbox;
+            if (sscanf(tok + 5, "%lf,%lf,%lf,%lf", &b[0], &b[1], &b[2], &b[3]) != 4
+                    || b[0] < -90 || b[1] > 90 || b[0] > b[1]
+                    || b[2] < -180 || b[2] > 180 || b[3] < -180 || b[3] > 180)
+                return "bad bbox";
+            f->hasBbox = 1;
+        } else if (!strncmp(tok, "addr=", 5)) {
+            free(f->addrs);
+            f->addrs = malloc(FILTER_ADDR_MAX * sizeof(uint32_t));
+            int n = f->addrs ? filterParseList(tok + 5, f->addrs, FILTER_ADDR_MAX, 16) : -1;
+            if (n <= 0)
+                return "bad addr";
+            qsort(f->addrs, n, sizeof(uint32_t), compareAddr);
+            f->addrCount = n;
+        } else if (!strncmp(tok, "df=", 3)) {
+            uint32_t dfs[32];
+            int n = filterParseList(tok + 3, dfs, 32, 10);
+            if (n <= 0)
+                return "bad df";
+            for (int i = 0; i < n; i++) {
+                if (dfs[i] > 31)
+                    return "bad df";
+                f->dfMask |= 1U << dfs[i];
+            }
+        } else if (!strncmp(tok, "minalt=", 7)) {
+            char *end;
+            f->minAltitude = strtol(tok + 7, &end, 10);
+            if (end == tok + 7 || *end)
+                return "bad minalt";
+            f->hasAlt = 1;
+        } else if (!strcmp(tok, "mil")) {
+            f->military = 1;
+        } else {
+            return "unknown condition";
+        }
+    }
+    return NULL;
+}
+
+// keep the addresses of a filter decoded when the decode thread is overloaded
+static void filterHotSet(struct outputFilter *f) {
+    for (uint32_t i = 0; i < f->addrCount && i < FILTER_HOT_MAX; i++)
+        hotSetAdd(f->addrs[i]);
+}
+
+static void filterRemove(struct client *c) {
+    struct net_writer *writer = c->service->writer;
+    for (int i = 0; i < writer->filteredCount; i++) {
+        if (writer->filtered[i] == c) {
+            writer->filtered[i] = writer->filtered[--writer->filteredCount];
+            break;
+        }
+    }
+}
+
+// "FILTER <conditions>", only accepted before the client was sent anything
+// on error the client can send another one until the hold expires
+static int handleFilterRequest(struct client *c, char *p) {
+    struct net_writer *writer = c->service->writer;
+    if (!c->replayHold || c->filter)
+        return 0;
+
+    char reply[128];
+    struct outputFilter *f = calloc(1, sizeof(struct outputFilter));
+    const char *error = f ? filterParse(f, p) : "out of memory";
+
+    // a delta object is useless without the complete object before it, which the filter might have dropped
+    if (!error && writer == &Modes.json_out && Modes.net_output_json_delta)
+        error = "not available with delta output";
+
+    if (!error && writer->filteredCount == writer->filteredAlloc) {
+        int alloc = writer->filteredAlloc ? 2 * writer->filteredAlloc : 16;
+        struct client **filtered = realloc(writer->filtered, alloc * sizeof(struct client *));
+        if (filtered) {
+            writer->filtered = filtered;
+            writer->filteredAlloc = alloc;
+        } else {
+            error = "out of memory";
+        }
+    }
+
+    int len;
+    if (error) {
+        filterFree(f);
+        len = snprintf(reply, sizeof(reply), "FILTER ERROR %s\n", error);
+    } else {
+        c->filter = f;
+        writer->filtered[writer->filteredCount++] = c;
+        // live data from now on, the replay ring isn't filtered
+        c->replaying = 0;
+        c->replayHold = 0;
+        filterHotSet(f);
+        len = snprintf(reply, sizeof(reply), "FILTER OK\n");
+    }
+    if (c->sendq_len + len < c->sendq_max) {
+        memcpy((char *) c->sendq + c->sendq_len, reply, len);
+        c->sendq_len += len;
+    }
+
+    if (Modes.debug_net) {
+        fprintf(stderr, "%s: %s port %s: %s", c->service->descr, c->host, c->port, reply);
+    }
+    return 0;
+}
+
+// requests of Beast, SBS and json position output consumers
+static int handleOutputCommand(struct client *c, char *p, int remote, uint64_t now) {
+    if (c->zout)
+        return 0; // replies and the replay ring aren't compressed
+    if (!strncmp(p, "RESUME", 6) && c->service->writer->replay.buf)
+        return handleReplayRequest(c, p, remote, now);
+    if (!strncmp(p, "FILTER", 6) && Modes.net_output_filters)
+        return handleFilterRequest(c, p + 6);
+    return 0;
+}
+
+// evaluated once per outputSeq, the result is reused for the other writers of the same message
+static int filterMatch(struct client *c, struct outputAttrs *m) {
+    if (c->filterSeq == outputSeq)
+        return c->filterMatch;
+
+    struct outputFilter *f = c->filter;
+    int match = 1;
+    if (f->dfMask && m->df >= 0 && (m->df > 31 || !(f->dfMask & (1U << m->df))))
+        match = 0;
+    else if (f->addrs && !bsearch(&m->addr, f->addrs, f->addrCount, sizeof(uint32_t), compareAddr))
+        match = 0;
+    else if (f->military && !m->military)
+        match = 0;
+    else if (f->hasAlt && (!m->hasAlt || m->altitude < f->minAltitude))
+        match = 0;
+    else if (f->hasBbox) {
+        const double *b = f->bbox;
+        if (!m->hasPos || m->lat < b[0] || m->lat > b[1])
+            match = 0;
+        else if (b[2] <= b[3])
+            match = (m->lon >= b[2] && m->lon <= b[3]);
+        else
+            match = (m->lon >= b[2] || m->lon <= b[3]);
+    }
+
+    c->filterSeq = outputSeq;
+    c->filterMatch = match;
+    return match;
+}
+
+// copy one write to the SendQ of every filtered client it matches
+static char *beastReceiverIdFrame(char *p, uint64_t receiverId);
+
+static void filterDeliver(struct net_writer *writer, char *data, int len) {
+    if (writer->idWrite) {
+        data += writer->idFrameLen;
+        len -= writer->idFrameLen;
+    }
+    for (int i = 0; i < writer->filteredCount; i++) {
+        struct client *c = writer->filtered[i];
+        if (outputAttrs && !filterMatch(c, outputAttrs))
+            continue;
+        char idFrame[2 + 2 * 8];
+        int idLen = 0;
+        if (writer->idWrite && c->lastReceiverId != writer->writeReceiverId)
+            idLen = beastReceiverIdFrame(idFrame, writer->writeReceiverId) - idFrame;
+        if (c->sendq_len + idLen + len >= c->sendq_max) {
+            fprintf(stderr, "%s: Dropped due to full SendQ: %s port %s (fd %d, SendQ %d, RecvQ %d)\n",
+                    c->service->descr, c->host, c->port,
+                    c->fd, c->sendq_len, c->buflen);
+            modesCloseClient(c); // removes it from writer->filtered
+            i--;
+            continue;
+        }
+        if (idLen) {
+            memcpy((char *) c->sendq + c->sendq_len, idFrame, idLen);
+            c->sendq_len += idLen;
+            c->lastReceiverId = writer->writeReceiverId;
+        }
+        memcpy((char *) c->sendq + c->sendq_len, data, len);
+        c->sendq_len += len;
+    }
+}
+
+static void outputAttrsFromMessage(struct outputAttrs *m, struct modesMessage *mm, struct aircraft *a) {
+    memset(m, 0, sizeof(struct outputAttrs));
+    m->addr = mm->addr;
+    m->df = mm->msgtype; // 32 for Mode A/C
+    if (!a)
+        return;
+    m->military = (a->dbFlags & 1);
+    if (!(trackDataValid(&a->airground_valid) && a->airground == AG_GROUND) && altReliable(a)) {
+        m->hasAlt = 1;
+        m->altitude = a->altitude_baro;
+    }
+    if (posReliable(a)) {
+        m->hasPos = 1;
+        m->lat = a->lat;
+        m->lon = a->lon;
+    }
+}
+
+// a client that asked for nothing is released after REPLAY_HOLD, returns 1 while it's held
+// without replay it gets live data from the next write on, which repeats the receiverId frame
+static int replayHeld(struct client *c, struct net_writer *writer, uint64_t now) {
+    if (!c->replayHold)
+        return 0;
+    if (now <= c->connectedSince + REPLAY_HOLD)
+        return 1;
+    c->replayHold = 0;
+    if (c->replaying)
+        return 0;
+    writer->lastReceiverId = 0;
+    return 1;
+}
+
+// move the clients of a writer along the replay ring between flushes,
+// pending writer data stays until the flush interval or buffer size is reached
+static void replayPump(struct net_writer *writer, uint64_t now) {
+    for (struct client *c = writer->service->clients; c; c = c->next) {
+        if (!c->service || c->service->writer != writer->service->writer)
+            continue;
+        if (replayHeld(c, writer, now) || c->filter)
+            continue;
+        if (c->replaying)
+            replaySend(c, &writer->replay, now);
+    }
+}
+
 //
 //=========================================================================
 //
@@ -836,14 +1579,28 @@ static void flushWrites(struct net_writer *writer) {
     struct client *c;
     uint64_t now = mstime();
 
+    if (writer->replay.buf)
+        replayAppend(&writer->replay, writer->data, writer->dataUsed);
+    if (writer->multicast)
+        multicastSend(writer, writer->dataUsed);
+
     for (c = writer->service->clients; c; c = c->next) {
         if (!c->service)
             continue;
         if (c->service->writer == writer->service->writer) {
-            uintptr_t psendq_end = (uintptr_t)c->sendq + c->sendq_len; // Pointer to end of sendq
-
+            if (replayHeld(c, writer, now))
+                continue;
+            if (c->filter) {
+                // matching writes are already in the SendQ (filterDeliver)
+                flushClient(c, now);
+                continue;
+            }
+            if (c->replaying) {
+                replaySend(c, &writer->replay, now);
+                continue;
+            }
             // Add the buffer to the client's SendQ
-            if ((c->sendq_len + writer->dataUsed) >= c->sendq_max) {
+            if (clientQueue(c, writer->data, writer->dataUsed)) {
                 // Too much data in client SendQ.  Drop client - SendQ exceeded.
                 fprintf(stderr, "%s: Dropped due to full SendQ: %s port %s (fd %d, SendQ %d, RecvQ %d)\n",
                         c->service->descr, c->host, c->port,
@@ -851,15 +1608,13 @@ static void flushWrites(struct net_writer *writer) {
                 modesCloseClient(c);
                 continue;	// Go to the next client
             }
-            // Append the data to the end of the queue, increment len
-            memcpy((void*)psendq_end, writer->data, writer->dataUsed);
-            c->sendq_len += writer->dataUsed;
             // Try flushing...
             flushClient(c, now);
         }
     }
-    writer->dataUsed = 0;
     writer->lastWrite = now;
+    writer->dataUsed = 0;
+    writer->multicastStart = 0;
     return;
 }
 
@@ -868,7 +1623,7 @@ static void flushWrites(struct net_writer *writer) {
 static void *prepareWrite(struct net_writer *writer, int len) {
     if (!writer ||
             !writer->service ||
-            !writer->service->connections ||
+            (!writer->service->connections && !writer->replay.buf && !writer->multicast) ||
             !writer->data)
         return NULL;
 
@@ -880,6 +1635,11 @@ static void *prepareWrite(struct net_writer *writer, int len) {
         flushWrites(writer);
     }
 
+    // end the datagram before the write that would make it too large,
+    // the write then starts the next datagram with its own receiverId frame
+    if (writer->multicast && writer->dataUsed + len - writer->multicastStart > MULTICAST_PAYLOAD)
+        multicastSend(writer, writer->dataUsed);
+
     return writer->data + writer->dataUsed;
 }
 
@@ -887,6 +1647,10 @@ static void *prepareWrite(struct net_writer *writer, int len) {
 // endptr should point one byte past the last byte written
 // to the buffer returned from prepareWrite.
 static void completeWrite(struct net_writer *writer, void *endptr) {
+    if (writer->filteredCount) {
+        char *start = (char *) writer->data + writer->dataUsed;
+        filterDeliver(writer, start, (char *) endptr - start);
+    }
     writer->dataUsed = endptr - writer->data;
 
     if (writer->dataUsed >= Modes.net_output_flush_size) {
@@ -894,6 +1658,21 @@ static void completeWrite(struct net_writer *writer, void *endptr) {
     }
 }
 
+// receiverId, big-endian, in own message to make it backwards compatible
+static char *beastReceiverIdFrame(char *p, uint64_t receiverId) {
+    unsigned char ch;
+    *p++ = 0x1a;
+    // other dump1090 / readsb versions or beast implementations should discard unknown message types
+    *p++ = 0xe3; // good enough guess no one is using this.
+    for (int i = 7; i >= 0; i--) {
+        *p++ = (ch = ((receiverId >> (8 * i)) & 0xFF));
+        if (0x1A == ch) {
+            *p++ = ch;
+        }
+    }
+    return p;
+}
+
 //
 //=========================================================================
 //
@@ -902,6 +1681,7 @@ static void completeWrite(struct net_writer *writer, void *endptr) {
 static void modesSendBeastOutput(struct modesMessage *mm, struct net_writer *writer) {
     int msgLen = mm->msgbits / 8;
     char *p = prepareWrite(writer, 2 + 2 * (7 + 8 + msgLen));
+    char *start = p;
     unsigned char ch;
     int j;
     int sig;
@@ -910,20 +1690,12 @@ static void modesSendBeastOutput(struct modesMessage *mm, struct net_writer *wri
     if (!p)
         return;
 
-    // receiverId, big-endian, in own message to make it backwards compatible
     // only send the receiverId when it changes
     if (Modes.netReceiverId && writer->lastReceiverId != mm->receiverId) {
         writer->lastReceiverId = mm->receiverId;
-        *p++ = 0x1a;
-        // other dump1090 / readsb versions or beast implementations should discard unknown message types
-        *p++ = 0xe3; // good enough guess no one is using this.
-        for (int i = 7; i >= 0; i--) {
-            *p++ = (ch = ((mm->receiverId >> (8 * i)) & 0xFF));
-            if (0x1A == ch) {
-                *p++ = ch;
-            }
-        }
+        p = beastReceiverIdFrame(p, mm->receiverId);
     }
+    int idFrameLen = p - start;
 
     *p++ = 0x1a;
     if (msgLen == MODES_SHORT_MSG_BYTES) {
@@ -979,7 +1751,13 @@ static void modesSendBeastOutput(struct modesMessage *mm, struct net_writer *wri
         }
     }
 
+    if (Modes.netReceiverId) {
+        writer->idWrite = 1;
+        writer->idFrameLen = idFrameLen;
+        writer->writeReceiverId = mm->receiverId;
+    }
     completeWrite(writer, p);
+    writer->idWrite = 0;
 }
 
 static void send_beast_heartbeat(struct net_service *service) {
@@ -1509,18 +2287,6 @@ static void send_sbs_heartbeat(struct net_service *service) {
     completeWrite(service->writer, data + len);
 }
 
-void jsonPositionOutput(struct modesMessage *mm, struct aircraft *a) {
-    MODES_NOTUSED(mm);
-    char *p;
-
-    p = prepareWrite(&Modes.json_out, 1000);
-    if (!p)
-        return;
-    char *end = p + 1000;
-
-    p = sprintAircraftObject(p, end, a, mm->sysTimestampMsg, 2);
-    completeWrite(&Modes.json_out, p);
-}
 //
 //=========================================================================
 //
@@ -1533,6 +2299,13 @@ void modesQueueOutput(struct modesMessage *mm, struct aircraft *a) {
         return;
     }
 
+    struct outputAttrs attrs;
+    if (Modes.net_output_filters) {
+        outputAttrsFromMessage(&attrs, mm, a);
+        outputAttrs = &attrs;
+        outputSeq++;
+    }
+
     if (a && !is_mlat && mm->correctedbits < 2) {
         // Don't ever forward 2-bit-corrected messages via SBS output.
         // Don't ever forward mlat messages via SBS output.
@@ -1553,6 +2326,8 @@ void modesQueueOutput(struct modesMessage *mm, struct aircraft *a) {
             modesSendBeastOutput(mm, &Modes.beast_reduce_out);
         }
     }
+
+    outputAttrs = NULL;
 }
 
 // Decode a little-endian IEEE754 float (binary32)
@@ -1644,9 +2419,9 @@ static int handleApiRequest(struct client *c, char *p, int remote, uint64_t now)
     remote = remote;
     c = c;
 
-    static uint32_t scratch[3 * API_INDEX_MAX];
+    static uint32_t scratch[API_INDEX_MAX + 1];
 
-    //writeJsonToNet(&Modes.api_out, generateAircraftJson(-1));
+    //writeJsonToNet(&Modes.api_out, generateAircraftJson(0));
     apiReq(50, 51, 10, 11, scratch);
 
     return 0;
@@ -1679,6 +2454,14 @@ static int handleBeastCommand(struct client *c, char *p, int remote, uint64_t no
     return 0;
 }
 
+// address of a Mode S message without decoding it, 0 if it's only in the parity
+static inline uint32_t hotSetAddress(unsigned char *msg) {
+    int df = msg[0] >> 3;
+    if (df == 11 || df == 17 || df == 18)
+        return (msg[1] << 16) | (msg[2] << 8) | msg[3];
+    return 0;
+}
+
 //
 //=========================================================================
 //
@@ -1805,6 +2588,33 @@ static int decodeBinMessage(struct client *c, char *p, int remote, uint64_t now)
         }
     }
 
+    int hot = msgLen != MODEAC_MSG_BYTES && hotSetTest(hotSetAddress(msg));
+
+    // quarantined feeders: decode only a sample of the messages, but all of the hot set
+    if (c->quarantined && !hot && (c->sampleCounter++ % Modes.netQuarantineSample) != 0) {
+        c->quarantineDropped++;
+        return 0;
+    }
+
+    c->qual.frames++;
+
+    // the timestamps of one receiver only go backwards when its clock is broken
+    // (or once a day for GPS timestamps), allow for some reordering: 1 second at 12 MHz
+    if (mm.timestampMsg && mm.timestampMsg != MAGIC_MLAT_TIMESTAMP) {
+        if (mm.receiverId == c->lastTimestampId && mm.timestampMsg + 12 * 1000 * 1000 < c->lastTimestamp)
+            c->qual.clockBad++;
+        c->lastTimestamp = mm.timestampMsg;
+        c->lastTimestampId = mm.receiverId;
+    }
+
+    // client over its read budget: decode the hot set and a sample of the rest
+    // pseudo random sample, counting would always pick the same of a few interleaved aircraft
+    if (c->overloaded && msgLen != MODEAC_MSG_BYTES && !hot
+            && ((c->overloadRandom = c->overloadRandom * 1664525 + 1013904223) >> 16) % HOT_SET_SAMPLE != 0) {
+        Modes.stats_current.remote_overload_sampled++;
+        return 0;
+    }
+
     int result = -10;
     if (msgLen == MODEAC_MSG_BYTES) { // ModeA or ModeC
         if (remote) {
@@ -1834,6 +2644,7 @@ static int decodeBinMessage(struct client *c, char *p, int remote, uint64_t now)
                 } else {
                     Modes.stats_current.demod_rejected_bad++;
                 }
+                c->qual.bad++;
             }
         } else {
             if (remote) {
@@ -2058,72 +2869,6 @@ static const char *hexEscapeString(const char *str, char *buf, int len) {
     return buf;
 }
 
-static char *append_flags(char *p, char *end, struct aircraft *a, datasource_t source) {
-    p = safe_snprintf(p, end, "[");
-
-    char *start = p;
-    if (a->callsign_valid.source == source)
-        p = safe_snprintf(p, end, "\"callsign\",");
-    if (a->altitude_baro_valid.source == source)
-        p = safe_snprintf(p, end, "\"altitude\",");
-    if (a->altitude_geom_valid.source == source)
-        p = safe_snprintf(p, end, "\"alt_geom\",");
-    if (a->gs_valid.source == source)
-        p = safe_snprintf(p, end, "\"gs\",");
-    if (a->ias_valid.source == source)
-        p = safe_snprintf(p, end, "\"ias\",");
-    if (a->tas_valid.source == source)
-        p = safe_snprintf(p, end, "\"tas\",");
-    if (a->mach_valid.source == source)
-        p = safe_snprintf(p, end, "\"mach\",");
-    if (a->track_valid.source == source)
-        p = safe_snprintf(p, end, "\"track\",");
-    if (a->track_rate_valid.source == source)
-        p = safe_snprintf(p, end, "\"track_rate\",");
-    if (a->roll_valid.source == source)
-        p = safe_snprintf(p, end, "\"roll\",");
-    if (a->mag_heading_valid.source == source)
-        p = safe_snprintf(p, end, "\"mag_heading\",");
-    if (a->true_heading_valid.source == source)
-        p = safe_snprintf(p, end, "\"true_heading\",");
-    if (a->baro_rate_valid.source == source)
-        p = safe_snprintf(p, end, "\"baro_rate\",");
-    if (a->geom_rate_valid.source == source)
-        p = safe_snprintf(p, end, "\"geom_rate\",");
-    if (a->squawk_valid.source == source)
-        p = safe_snprintf(p, end, "\"squawk\",");
-    if (a->emergency_valid.source == source)
-        p = safe_snprintf(p, end, "\"emergency\",");
-    if (a->nav_qnh_valid.source == source)
-        p = safe_snprintf(p, end, "\"nav_qnh\",");
-    if (a->nav_altitude_mcp_valid.source == source)
-        p = safe_snprintf(p, end, "\"nav_altitude_mcp\",");
-    if (a->nav_altitude_fms_valid.source == source)
-        p = safe_snprintf(p, end, "\"nav_altitude_fms\",");
-    if (a->nav_heading_valid.source == source)
-        p = safe_snprintf(p, end, "\"nav_heading\",");
-    if (a->nav_modes_valid.source == source)
-        p = safe_snprintf(p, end, "\"nav_modes\",");
-    if (a->position_valid.source == source)
-        p = safe_snprintf(p, end, "\"lat\",\"lon\",\"nic\",\"rc\",");
-    if (a->nic_baro_valid.source == source)
-        p = safe_snprintf(p, end, "\"nic_baro\",");
-    if (a->nac_p_valid.source == source)
-        p = safe_snprintf(p, end, "\"nac_p\",");
-    if (a->nac_v_valid.source == source)
-        p = safe_snprintf(p, end, "\"nac_v\",");
-    if (a->sil_valid.source == source)
-        p = safe_snprintf(p, end, "\"sil\",\"sil_type\",");
-    if (a->gva_valid.source == source)
-        p = safe_snprintf(p, end, "\"gva\",");
-    if (a->sda_valid.source == source)
-        p = safe_snprintf(p, end, "\"sda\",");
-    if (p != start)
-        --p;
-    p = safe_snprintf(p, end, "]");
-    return p;
-}
-
 static struct {
     nav_modes_t flag;
     const char *name;
@@ -2404,13 +3149,18 @@ struct char_buffer generateGlobeJson(int globe_index){
     return cb;
 }
 
-struct char_buffer generateAircraftJson(){
+// history: also add the aircraft to the history ring (history.h)
+struct char_buffer generateAircraftJson(int history){
     struct char_buffer cb;
     uint64_t now = mstime();
     struct aircraft *a;
     size_t buflen = 6*1024*1024; // The initial buffer is resized as needed
     char *buf = (char *) malloc(buflen), *p = buf, *end = buf + buflen;
 
+    struct binCraft *records = NULL;
+    uint32_t recordCount = 0;
+    uint32_t recordAlloc = 0;
+
     p = safe_snprintf(p, end,
             "{ \"now\" : %.1f,\n"
             "  \"messages\" : %u,\n",
@@ -2448,6 +3198,20 @@ struct char_buffer generateAircraftJson(){
 
             if (p >= end)
                 fprintf(stderr, "buffer overrun aircraft json\n");
+
+            if (history) {
+                if (recordCount == recordAlloc) {
+                    recordAlloc = recordAlloc ? 2 * recordAlloc : 1024;
+                    records = realloc(records, recordAlloc * sizeof(struct binCraft));
+                    if (!records) {
+                        fprintf(stderr, "generateAircraftJson: out of memory\n");
+                        history = 0;
+                        recordCount = recordAlloc = 0;
+                        continue;
+                    }
+                }
+                toBinCraft(a, &records[recordCount++], now);
+            }
         }
     }
     if (*(p-1) == ',')
@@ -2455,6 +3219,9 @@ struct char_buffer generateAircraftJson(){
 
     p = safe_snprintf(p, end, "\n  ]\n}\n");
 
+    if (history)
+        historyAdd(records, recordCount, now);
+
     //    fprintf(stderr, "%u\n", ac_counter);
 
     cb.len = p - buf;
@@ -2494,12 +3261,13 @@ struct char_buffer generateTraceJson(struct aircraft *a, int start, int last) {
     }
 
     if (start <= last && last < a->trace_len) {
-        p = safe_snprintf(p, end, ",\n\"timestamp\": %.3f", (a->trace + start)->timestamp / 1000.0);
+        uint64_t startTs = getState(a, start)->timestamp;
+        p = safe_snprintf(p, end, ",\n\"timestamp\": %.3f", startTs / 1000.0);
 
         p = safe_snprintf(p, end, ",\n\"trace\":[ ");
 
         for (int i = start; i <= last; i++) {
-            struct state *trace = &a->trace[i];
+            struct state *trace = getState(a, i);
 
             int32_t altitude = trace->altitude * 25;
             int32_t rate = trace->rate * 32;
@@ -2515,7 +3283,7 @@ struct char_buffer generateTraceJson(struct aircraft *a, int start, int last) {
 
                 // in the air
                 p = safe_snprintf(p, end, "\n[%.1f,%f,%f",
-                        (trace->timestamp - (a->trace + start)->timestamp) / 1000.0, trace->lat / 1E6, trace->lon / 1E6);
+                        (trace->timestamp - startTs) / 1000.0, trace->lat / 1E6, trace->lon / 1E6);
 
                 if (on_ground)
                     p = safe_snprintf(p, end, ",\"ground\"");
@@ -2544,7 +3312,7 @@ struct char_buffer generateTraceJson(struct aircraft *a, int start, int last) {
 
                 if (i % 4 == 0) {
                     uint64_t now = trace->timestamp;
-                    struct state_all *all = &(a->trace_all[i/4]);
+                    struct state_all *all = getStateAll(a, i);
                     struct aircraft b;
                     memset(&b, 0, sizeof(struct aircraft));
                     struct aircraft *ac = &b;
@@ -2586,8 +3354,11 @@ struct char_buffer generateReceiverJson() {
 
     p = safe_snprintf(p, end, "{ "
             "\"refresh\": %.0f, "
-            "\"history\": %d",
-            1.0 * Modes.json_interval, Modes.json_aircraft_history_next + 1);
+            "\"history\": %d, "
+            "\"binCraftHistory\": %u",
+            1.0 * Modes.json_interval,
+            Modes.json_history_files ? Modes.json_aircraft_history_next + 1 : 0,
+            historyCount());
 
 
     if (Modes.json_location_accuracy && (Modes.fUserLat != 0.0 || Modes.fUserLon != 0.0)) {
@@ -2604,7 +3375,7 @@ struct char_buffer generateReceiverJson() {
         }
     }
 
-    if (Modes.db || Modes.db2)
+    if (Modes.db)
         p = safe_snprintf(p, end, ", \"dbServer\": true");
 
 
@@ -2762,6 +3533,46 @@ static void periodicReadFromClient(struct client *c) {
     }
 }
 
+// per service timer list: only the clients at the head are due
+// clients are mostly scheduled with the same interval and appended at the tail,
+// the walk from the tail keeps the order for other intervals
+static void timerSchedule(struct client *c, uint64_t due) {
+    struct net_service *s = c->service;
+    timerCancel(c);
+    c->timerDue = due ? due : 1;
+
+    struct client *prev = s->timerTail;
+    while (prev && prev->timerDue > c->timerDue)
+        prev = prev->timerPrev;
+
+    c->timerPrev = prev;
+    c->timerNext = prev ? prev->timerNext : s->timerHead;
+    if (c->timerNext)
+        c->timerNext->timerPrev = c;
+    else
+        s->timerTail = c;
+    if (prev)
+        prev->timerNext = c;
+    else
+        s->timerHead = c;
+}
+
+static void timerCancel(struct client *c) {
+    if (!c->timerDue)
+        return;
+    struct net_service *s = c->service;
+    if (c->timerPrev)
+        c->timerPrev->timerNext = c->timerNext;
+    else
+        s->timerHead = c->timerNext;
+    if (c->timerNext)
+        c->timerNext->timerPrev = c->timerPrev;
+    else
+        s->timerTail = c->timerPrev;
+    c->timerNext = c->timerPrev = NULL;
+    c->timerDue = 0;
+}
+
 //
 //=========================================================================
 //
@@ -2786,9 +3597,26 @@ static void modesReadFromClient(struct client *c) {
     uint64_t start = mstime();
     uint64_t now = start;
 
-    for (int loop = 0; bContinue && loop < 32; loop++, now = mstime()) {
+    // quarantined feeders get a smaller share of the decode thread
+    int maxLoops = c->quarantined ? 4 : 32;
+    uint64_t budget = c->quarantined ? 50 : 200;
+
+    // over budget: only messages for the hot set and a sample of the rest are decoded
+    // twice over budget: the data is discarded
+    c->overloaded = 0;
+
+    for (int loop = 0; bContinue && loop < maxLoops; loop++, now = mstime()) {
 
-        if (!discard && now > start + 200) {
+        if (!c->overloaded && now > start + budget) {
+            c->overloaded = 1;
+            static uint64_t antiSpam;
+            if (now > antiSpam + 30 * SECONDS && Modes.debug_net) {
+                antiSpam = now;
+                fprintf(stderr, "%s: not enough CPU: decoding only the hot set and a sample from: %s port %s (fd %d) (suppressing for 30 seconds)\n",
+                        c->service->descr, c->host, c->port, c->fd);
+            }
+        }
+        if (!discard && now > start + 2 * budget) {
             discard = 1;
             static uint64_t antiSpam;
             if (now > antiSpam + 30 * SECONDS) {
@@ -2800,24 +3628,46 @@ static void modesReadFromClient(struct client *c) {
                             c->service->descr, c->host, c->port, c->fd);
             }
         }
-        if (discard)
+        if (discard) {
             c->buflen = 0;
+            c->bufStart = 0;
+        }
+
+        // leave 1 extra byte for NUL termination in the ASCII case
+        left = MODES_CLIENT_BUF_SIZE - c->bufStart - c->buflen - 1;
 
-        left = MODES_CLIENT_BUF_SIZE - c->buflen - 1; // leave 1 extra byte for NUL termination in the ASCII case
+        if (left < c->readSize && c->bufStart > 0) {
+            // not enough space behind the data, move it to the front
+            memmove(c->buf, c->buf + c->bufStart, c->buflen);
+            c->bufStart = 0;
+            c->compactions++;
+            left = MODES_CLIENT_BUF_SIZE - c->buflen - 1;
+        }
 
         // If our buffer is full discard it, this is some badly formatted shit
         if (left <= 0) {
             c->garbage += c->buflen;
+            c->qual.garbage += c->buflen;
             Modes.stats_current.remote_malformed_beast += c->buflen;
             c->buflen = 0;
-            left = MODES_CLIENT_BUF_SIZE - c->buflen - 1; // leave 1 extra byte for NUL termination in the ASCII case
+            left = MODES_CLIENT_BUF_SIZE - c->buflen - 1;
             // If there is garbage, read more to discard it ASAP
         }
-        nread = read(c->fd, c->buf + c->buflen, left);
+        if (left > c->readSize)
+            left = c->readSize;
+
+        int more = 0;
+        if (c->zin)
+            nread = clientInflate(c, c->buf + c->bufStart + c->buflen, left);
+        else if (c->multicast)
+            nread = multicastRead(c, c->buf + c->bufStart + c->buflen, left, &more);
+        else
+            nread = read(c->fd, c->buf + c->bufStart + c->buflen, left);
         int err = errno;
+        c->readCalls++;
 
         // If we didn't get all the data we asked for, then return once we've processed what we did get.
-        if (nread != left) {
+        if (nread != left && !more) {
             bContinue = 0;
         }
 
@@ -2876,10 +3726,24 @@ static void modesReadFromClient(struct client *c) {
         if (discard)
             continue;
 
+        if (!c->bytesReceived && !c->zin && c->service->read_mode == READ_MODE_BEAST
+                && zlibHeader((unsigned char *) c->buf + c->bufStart + c->buflen, nread)) {
+            // compressed beast (beast_zlib_out connector), inflate what was read
+            if (clientInflateInit(c, c->buf + c->bufStart + c->buflen, nread)) {
+                fprintf(stderr, "%s: couldn't set up decompression, disconnecting: %s port %s\n",
+                        c->service->descr, c->host, c->port);
+                modesCloseClient(c);
+                return;
+            }
+            bContinue = 1;
+            continue;
+        }
+
         c->buflen += nread;
         c->bytesReceived += nread;
+        c->qual.bytes += nread;
 
-        char *som = c->buf; // first byte of next message
+        char *som = c->buf + c->bufStart; // first byte of next message
         char *eod = som + c->buflen; // one byte past end of data
         char *p;
         int remote = 1; // Messages will be marked remote by default
@@ -2954,6 +3818,7 @@ static void modesReadFromClient(struct client *c) {
                 while (som < eod && ((p = memchr(som, (char) 0x1a, eod - som)) != NULL)) { // The first byte of buffer 'should' be 0x1a
 
                     c->garbage += p - som;
+                    c->qual.garbage += p - som;
                     Modes.stats_current.remote_malformed_beast += p - som;
 
                     som = p; // consume garbage up to the 0x1a
@@ -2982,6 +3847,7 @@ static void modesReadFromClient(struct client *c) {
                                 if (p < eod && 0x1A != *p) { // check that it's indeed a double escape
                                     // might be start of message rather than double escape.
                                     c->garbage += p - 1 - som;
+                                    c->qual.garbage += p - 1 - som;
                                     Modes.stats_current.remote_malformed_beast += p - 1 - som;
                                     som = p - 1;
                                     invalid = 1;
@@ -3027,6 +3893,7 @@ static void modesReadFromClient(struct client *c) {
                             if (p < eod && 0x1A != *p) { // check that it's indeed a double escape
                                 // might be start of message rather than double escape.
                                 c->garbage += p - 1 - som;
+                                c->qual.garbage += p - 1 - som;
                                 Modes.stats_current.remote_malformed_beast += p - 1 - som;
                                 som = p - 1;
                                 invalid = 1;
@@ -3056,6 +3923,7 @@ static void modesReadFromClient(struct client *c) {
 
                 if (eod - som > 256) {
                     c->garbage += eod - som;
+                    c->qual.garbage += eod - som;
                     Modes.stats_current.remote_malformed_beast += eod - som;
                     som = eod;
                 }
@@ -3141,9 +4009,9 @@ static void modesReadFromClient(struct client *c) {
             }
         }
 
-        if (som > c->buf) { // We processed something - so
+        if (som > c->buf + c->bufStart) { // We processed something - so
             c->buflen = eod - som; //     Update the unprocessed buffer length
-            memmove(c->buf, som, c->buflen); //     Move what's remaining to the start of the buffer
+            c->bufStart = c->buflen ? som - c->buf : 0; // the rest stays where it is until space runs short
         } else { // If no message was decoded process the next client
             return;
         }
@@ -3170,36 +4038,181 @@ const char *airground_enum_string(airground_t ag) {
     }
 }
 
+// Score an input client by the share of bad data it sent since the last update:
+// malformed bytes, frames failing CRC / decoding, timestamps jumping backwards and
+// positions failing CPR or speed checks. The score is smoothed over several updates,
+// clients below netQuarantineLow are quarantined until they recover above netQuarantineHigh.
+static void clientQualityUpdate(struct client *c, uint64_t now) {
+    struct clientQuality *q = &c->qual;
+    struct clientQuality *l = &c->qualLast;
+
+    q->positions = c->positionCounter;
+
+    uint64_t frames = q->frames - l->frames;
+    uint64_t bytes = q->bytes - l->bytes;
+    uint64_t garbage = q->garbage - l->garbage;
+    uint64_t bad = (q->bad - l->bad) + (q->clockBad - l->clockBad);
+    uint64_t positions = (q->positions - l->positions) + (q->posBad - l->posBad);
+    uint64_t posBad = q->posBad - l->posBad;
+
+    // not enough data to judge, keep accumulating
+    if (frames < 100 && bytes < 4096)
+        return;
+
+    double good = 1.0;
+    if (bytes)
+        good *= 1.0 - fmin(1.0, garbage / (double) bytes);
+    if (frames)
+        good *= 1.0 - fmin(1.0, bad / (double) frames);
+    if (positions >= 20)
+        good *= 1.0 - fmin(1.0, posBad / (double) positions);
+
+    c->quality = 0.5 * c->quality + 0.5 * good;
+    *l = *q;
+
+    if (!Modes.netQuarantine)
+        return;
+
+    char *name = c->proxy_string[0] ? c->proxy_string : c->host;
+
+    if (!c->quarantined && c->quality < Modes.netQuarantineLow) {
+        c->quarantined = 1;
+        c->quarantinedSince = now;
+        c->sampleCounter = 0;
+        if (!Modes.netIngest || Modes.debug_receiver) {
+            fprintf(stderr, "Quarantine: %016"PRIx64" %s port %s quality %.2f\n",
+                    c->receiverId, name, c->port, c->quality);
+        }
+    } else if (c->quarantined && c->quality > Modes.netQuarantineHigh
+            && now > c->quarantinedSince + CLIENT_QUARANTINE_MIN) {
+        c->quarantined = 0;
+        if (!Modes.netIngest || Modes.debug_receiver) {
+            fprintf(stderr, "Quarantine: released %016"PRIx64" %s port %s quality %.2f after %.0f s\n",
+                    c->receiverId, name, c->port, c->quality, (now - c->quarantinedSince) / 1000.0);
+        }
+    }
+}
+
+// size reads so a chatty client is drained with few syscalls and a quiet one
+// rarely forces the unprocessed data to be moved to the front of the buffer
+static void clientReadSize(struct client *c, uint64_t now) {
+    static uint64_t last;
+    static uint64_t elapsed;
+    if (c == NULL) {
+        elapsed = now > last ? now - last : 0;
+        last = now;
+        return;
+    }
+    if (elapsed < 500)
+        return;
+    uint64_t rate = (c->bytesReceived - c->readBytesLast) * 1000 / elapsed; // bytes per second
+    c->readBytesLast = c->bytesReceived;
+
+    // roughly what arrives in a quarter second
+    int size = CLIENT_READ_MIN;
+    while (size < CLIENT_READ_MAX && (uint64_t) size < rate / 4)
+        size *= 2;
+    c->readSize = size;
+}
+
+static void clientPublish(struct client *c) {
+    struct clientEntry e = {
+        .receiverId = c->receiverId,
+        .receiverId2 = c->receiverId2,
+        .connectedSince = c->connectedSince,
+        .bytesReceived = c->bytesReceived,
+        .messageCounter = c->messageCounter,
+        .positionCounter = c->positionCounter,
+        .quarantineDropped = c->quarantineDropped,
+        .readCalls = c->readCalls,
+        .compactions = c->compactions,
+        .zPlain = c->zPlain,
+        .zCompressed = c->zCompressed,
+        .zCpu = (uint64_t) c->zCpu.tv_sec * 1000 + c->zCpu.tv_nsec / 1000000,
+        .readSize = c->readSize,
+        .quality = c->quality,
+        .quarantined = c->quarantined,
+    };
+    // the host ends up in json strings and prometheus labels
+    for (uint32_t i = 0; i < sizeof(e.host) - 1 && c->proxy_string[i]; i++) {
+        char ch = c->proxy_string[i];
+        e.host[i] = (ch == '"' || ch == '\\' || (unsigned char) ch < 0x20) ? '_' : ch;
+    }
+    registryPublish(&Modes.clientRegistry, c->slot, &e);
+}
+
 void modesNetSecondWork(void) {
     struct client *c;
     struct net_service *s;
     uint64_t now = mstime();
 
+    clientReadSize(NULL, now);
+
+    static uint64_t nextFilterHotSet;
+    if (Modes.net_output_filters && now > nextFilterHotSet) {
+        // hot set entries expire after a minute or two
+        nextFilterHotSet = now + 30 * SECONDS;
+        struct net_writer *writers[] = { &Modes.beast_out, &Modes.sbs_out, &Modes.json_out };
+        for (uint32_t k = 0; k < sizeof(writers) / sizeof(writers[0]); k++) {
+            for (int i = 0; i < writers[k]->filteredCount; i++)
+                filterHotSet(writers[k]->filtered[i]->filter);
+        }
+    }
+
     for (s = Modes.services; s; s = s->next) {
-        if (s->read_handler)
+        if (!s->read_handler)
             continue;
         for (c = s->clients; c; c = c->next) {
             if (!c->service)
                 continue;
-            if (c->last_read + 30000 < now) {
-                // This is called if there is no read handler - we just read and discard to try to trigger socket errors
-                // (if 30 sec have passed)
-                periodicReadFromClient(c);
+            clientReadSize(c, now);
+            clientPublish(c);
+        }
+    }
+
+    static uint64_t nextQualityUpdate;
+    if (now > nextQualityUpdate) {
+        nextQualityUpdate = now + CLIENT_QUALITY_INTERVAL;
+        for (s = Modes.services; s; s = s->next) {
+            if (s->read_mode != READ_MODE_BEAST)
+                continue;
+            for (c = s->clients; c; c = c->next) {
+                if (c->service)
+                    clientQualityUpdate(c, now);
+            }
+        }
+    }
+
+    for (s = Modes.services; s; s = s->next) {
+        if (s->read_handler)
+            continue;
+        while ((c = s->timerHead) && c->timerDue <= now) {
+            // This is called if there is no read handler - we just read and discard to try to trigger socket errors
+            // (if 30 sec have passed)
+            timerCancel(c);
+            periodicReadFromClient(c);
+            if (c->service) {
                 c->last_read = now;
+                timerSchedule(c, now + CLIENT_IDLE_CHECK);
             }
         }
     }
 
     // If we have generated no messages for a while, send
     // a heartbeat
-    if (Modes.net_heartbeat_interval) {
+    // lastWrite only moves forward, no writer needs one before the earliest deadline seen last time
+    static uint64_t heartbeatDue;
+    if (Modes.net_heartbeat_interval && now >= heartbeatDue) {
+        heartbeatDue = now + Modes.net_heartbeat_interval;
         for (s = Modes.services; s; s = s->next) {
-            if (s->writer &&
-                    s->connections &&
-                    s->writer->send_heartbeat &&
-                    (s->writer->lastWrite + Modes.net_heartbeat_interval) <= now) {
+            if (!s->writer || !s->writer->send_heartbeat)
+                continue;
+            if ((s->connections || s->writer->multicast) && (s->writer->lastWrite + Modes.net_heartbeat_interval) <= now) {
                 s->writer->send_heartbeat(s);
             }
+            uint64_t due = s->writer->lastWrite + Modes.net_heartbeat_interval;
+            if (due > now && due < heartbeatDue)
+                heartbeatDue = due;
         }
     }
 }
@@ -3214,6 +4227,9 @@ void netFreeClients() {
             if (c->fd == -1) {
                 // Recently closed, prune from list
                 *prev = c->next;
+                registryRelease(&Modes.clientRegistry, c->slot);
+                filterFree(c->filter);
+                clientZlibFree(c);
                 free(c->sendq);
                 free(c);
             } else {
@@ -3269,6 +4285,8 @@ void modesNetPeriodicWork(void) {
         }
     }
 
+    jsonPosFlush();
+
     // If we have data that has been waiting to be written for a while,
     // write it now.
     for (struct net_service *s = Modes.services; s; s = s->next) {
@@ -3276,6 +4294,9 @@ void modesNetPeriodicWork(void) {
                 s->writer->dataUsed &&
                 ((s->writer->lastWrite + Modes.net_output_flush_interval) <= now)) {
             flushWrites(s->writer);
+        } else if (s->writer && s->writer->replay.buf && s->connections) {
+            // clients catching up or waiting for their RESUME request
+            replayPump(s->writer, now);
         }
     }
 
@@ -3563,169 +4584,842 @@ static void *pthreadGetaddrinfo(void *param) {
     return NULL;
 }
 
-static char *sprintAircraftObject(char *p, char *end, struct aircraft *a, uint64_t now, int printMode) {
+// json position output
+//
+// the decode thread captures a compact copy of each position event (struct jsonPos),
+// hands the events to the encoder thread in batches and writes the encoded lines to Modes.json_out
+// one json object per line, terminated by a newline
+// with --net-output-filters the encoder puts the struct outputAttrs of each line in front of it
+// with --net-json-port-delta only fields changed since the last object of the aircraft are written,
+// fields no longer valid are written as null, every JSON_POS_FULL_INTERVAL and for every aircraft
+// after a consumer connects the object is complete
+
+#define JSON_POS_QUEUE_MAX (64 * 1024) // events waiting for the encoder
+#define JSON_POS_STATE_SIZE 4096 // delta mode: last object per aircraft, direct mapped
+#define JSON_POS_FULL_INTERVAL (60 * SECONDS)
+
+enum {
+    JP_TYPE = 1ULL << 0,
+    JP_FLIGHT = 1ULL << 1,
+    JP_REG = 1ULL << 2,
+    JP_TYPECODE = 1ULL << 3,
+    JP_DBFLAGS = 1ULL << 4,
+    JP_DESC = 1ULL << 5,
+    JP_GROUND = 1ULL << 6,
+    JP_ALT_BARO = 1ULL << 7,
+    JP_ALT_GEOM = 1ULL << 8,
+    JP_GS = 1ULL << 9,
+    JP_IAS = 1ULL << 10,
+    JP_TAS = 1ULL << 11,
+    JP_MACH = 1ULL << 12,
+    JP_WIND = 1ULL << 13,
+    JP_TEMP = 1ULL << 14,
+    JP_TRACK = 1ULL << 15,
+    JP_CALC_TRACK = 1ULL << 16,
+    JP_TRACK_RATE = 1ULL << 17,
+    JP_ROLL = 1ULL << 18,
+    JP_MAG_HEADING = 1ULL << 19,
+    JP_TRUE_HEADING = 1ULL << 20,
+    JP_BARO_RATE = 1ULL << 21,
+    JP_GEOM_RATE = 1ULL << 22,
+    JP_SQUAWK = 1ULL << 23,
+    JP_EMERGENCY = 1ULL << 24,
+    JP_CATEGORY = 1ULL << 25,
+    JP_NAV_QNH = 1ULL << 26,
+    JP_NAV_ALT_MCP = 1ULL << 27,
+    JP_NAV_ALT_FMS = 1ULL << 28,
+    JP_NAV_HEADING = 1ULL << 29,
+    JP_NAV_MODES = 1ULL << 30,
+    JP_POS = 1ULL << 31,
+    JP_RR = 1ULL << 32,
+    JP_VERSION = 1ULL << 33,
+    JP_NIC_BARO = 1ULL << 34,
+    JP_NAC_P = 1ULL << 35,
+    JP_NAC_V = 1ULL << 36,
+    JP_SIL = 1ULL << 37,
+    JP_SIL_TYPE = 1ULL << 38,
+    JP_GVA = 1ULL << 39,
+    JP_SDA = 1ULL << 40,
+    JP_ALERT = 1ULL << 41,
+    JP_SPI = 1ULL << 42,
+    JP_RID = 1ULL << 43,
+    JP_NIC_RC = 1ULL << 44, // trace.json only, without the position
+};
+
+struct jsonPos {
+    uint64_t now;
+    uint64_t fields; // JP_ bits of the valid fields
+    uint64_t mlat; // JP_ bits of fields derived from MLAT
+    uint64_t tisb; // JP_ bits of fields derived from TIS-B
+    uint64_t receiverId;
+    double pos[2]; // lat, lon
+    double seenPos;
+    double seen;
+    double rssi;
+    uint32_t addr;
+    uint32_t messages;
+    int32_t altBaro;
+    int32_t altGeom;
+    int32_t baroRate;
+    int32_t geomRate;
+    int32_t navAltMcp;
+    int32_t navAltFms;
+    float gs;
+    float mach;
+    float wind[2]; // direction, speed
+    float temp[2]; // oat, tat
+    float track;
+    float calcTrack;
+    float trackRate;
+    float roll;
+    float magHeading;
+    float trueHeading;
+    float navQnh;
+    float navHeading;
+    float rr[2];
+    uint16_t ias;
+    uint16_t tas;
+    uint16_t squawk;
+    uint16_t posRc;
+    uint8_t posNic;
+    uint8_t addrtype;
+    uint8_t ground;
+    uint8_t emergency;
+    uint8_t category;
+    uint8_t navModes;
+    int8_t version;
+    uint8_t nicBaro;
+    uint8_t nacP;
+    uint8_t nacV;
+    uint8_t sil;
+    uint8_t silType;
+    uint8_t gva;
+    uint8_t sda;
+    uint8_t alert;
+    uint8_t spi;
+    uint8_t dbFlags;
+    char callsign[16];
+    char registration[12];
+    char typeCode[4];
+    char typeLong[64];
+};
+
+// delta mode: where the value of a field is stored and what to write once it's gone
+struct jsonPosField {
+    uint64_t bit;
+    uint32_t offset;
+    uint32_t size;
+    const char *nulls;
+};
+
+#define JP_FIELD(bit, member, nulls) { bit, offsetof(struct jsonPos, member), sizeof(((struct jsonPos *) 0)->member), nulls }
+
+static const struct jsonPosField jsonPosFields[] = {
+    JP_FIELD(JP_TYPE, addrtype, ""),
+    JP_FIELD(JP_FLIGHT, callsign, ",\"flight\":null"),
+    JP_FIELD(JP_REG, registration, ",\"r\":null"),
+    JP_FIELD(JP_TYPECODE, typeCode, ",\"t\":null"),
+    JP_FIELD(JP_DBFLAGS, dbFlags, ",\"dbFlags\":null"),
+    JP_FIELD(JP_DESC, typeLong, ",\"desc\":null"),
+    JP_FIELD(JP_GROUND, ground, ""),
+    JP_FIELD(JP_ALT_BARO, altBaro, ",\"alt_baro\":null"),
+    JP_FIELD(JP_ALT_GEOM, altGeom, ",\"alt_geom\":null"),
+    JP_FIELD(JP_GS, gs, ",\"gs\":null"),
+    JP_FIELD(JP_IAS, ias, ",\"ias\":null"),
+    JP_FIELD(JP_TAS, tas, ",\"tas\":null"),
+    JP_FIELD(JP_MACH, mach, ",\"mach\":null"),
+    JP_FIELD(JP_WIND, wind, ",\"wd\":null,\"ws\":null"),
+    JP_FIELD(JP_TEMP, temp, ",\"oat\":null,\"tat\":null"),
+    JP_FIELD(JP_TRACK, track, ",\"track\":null"),
+    JP_FIELD(JP_CALC_TRACK, calcTrack, ",\"calc_track\":null"),
+    JP_FIELD(JP_TRACK_RATE, trackRate, ",\"track_rate\":null"),
+    JP_FIELD(JP_ROLL, roll, ",\"roll\":null"),
+    JP_FIELD(JP_MAG_HEADING, magHeading, ",\"mag_heading\":null"),
+    JP_FIELD(JP_TRUE_HEADING, trueHeading, ",\"true_heading\":null"),
+    JP_FIELD(JP_BARO_RATE, baroRate, ",\"baro_rate\":null"),
+    JP_FIELD(JP_GEOM_RATE, geomRate, ",\"geom_rate\":null"),
+    JP_FIELD(JP_SQUAWK, squawk, ",\"squawk\":null"),
+    JP_FIELD(JP_EMERGENCY, emergency, ",\"emergency\":null"),
+    JP_FIELD(JP_CATEGORY, category, ",\"category\":null"),
+    JP_FIELD(JP_NAV_QNH, navQnh, ",\"nav_qnh\":null"),
+    JP_FIELD(JP_NAV_ALT_MCP, navAltMcp, ",\"nav_altitude_mcp\":null"),
+    JP_FIELD(JP_NAV_ALT_FMS, navAltFms, ",\"nav_altitude_fms\":null"),
+    JP_FIELD(JP_NAV_HEADING, navHeading, ",\"nav_heading\":null"),
+    JP_FIELD(JP_NAV_MODES, navModes, ",\"nav_modes\":null"),
+    JP_FIELD(JP_POS, pos, ",\"lat\":null,\"lon\":null,\"nic\":null,\"rc\":null,\"seen_pos\":null"),
+    JP_FIELD(JP_RR, rr, ",\"rr_lat\":null,\"rr_lon\":null"),
+    JP_FIELD(JP_VERSION, version, ",\"version\":null"),
+    JP_FIELD(JP_NIC_BARO, nicBaro, ",\"nic_baro\":null"),
+    JP_FIELD(JP_NAC_P, nacP, ",\"nac_p\":null"),
+    JP_FIELD(JP_NAC_V, nacV, ",\"nac_v\":null"),
+    JP_FIELD(JP_SIL, sil, ",\"sil\":null"),
+    JP_FIELD(JP_SIL_TYPE, silType, ",\"sil_type\":null"),
+    JP_FIELD(JP_GVA, gva, ",\"gva\":null"),
+    JP_FIELD(JP_SDA, sda, ",\"sda\":null"),
+    JP_FIELD(JP_ALERT, alert, ",\"alert\":null"),
+    JP_FIELD(JP_SPI, spi, ",\"spi\":null"),
+    JP_FIELD(JP_RID, receiverId, ",\"rId\":null"),
+};
+
+#undef JP_FIELD
+
+// names in the mlat / tisb lists, same order as before
+static const struct {
+    uint64_t bit;
+    const char *names;
+} jsonPosFlagNames[] = {
+    { JP_FLIGHT, "\"callsign\"" },
+    { JP_ALT_BARO, "\"altitude\"" },
+    { JP_ALT_GEOM, "\"alt_geom\"" },
+    { JP_GS, "\"gs\"" },
+    { JP_IAS, "\"ias\"" },
+    { JP_TAS, "\"tas\"" },
+    { JP_MACH, "\"mach\"" },
+    { JP_TRACK, "\"track\"" },
+    { JP_TRACK_RATE, "\"track_rate\"" },
+    { JP_ROLL, "\"roll\"" },
+    { JP_MAG_HEADING, "\"mag_heading\"" },
+    { JP_TRUE_HEADING, "\"true_heading\"" },
+    { JP_BARO_RATE, "\"baro_rate\"" },
+    { JP_GEOM_RATE, "\"geom_rate\"" },
+    { JP_SQUAWK, "\"squawk\"" },
+    { JP_EMERGENCY, "\"emergency\"" },
+    { JP_NAV_QNH, "\"nav_qnh\"" },
+    { JP_NAV_ALT_MCP, "\"nav_altitude_mcp\"" },
+    { JP_NAV_ALT_FMS, "\"nav_altitude_fms\"" },
+    { JP_NAV_HEADING, "\"nav_heading\"" },
+    { JP_NAV_MODES, "\"nav_modes\"" },
+    { JP_POS, "\"lat\",\"lon\",\"nic\",\"rc\"" },
+    { JP_NIC_BARO, "\"nic_baro\"" },
+    { JP_NAC_P, "\"nac_p\"" },
+    { JP_NAC_V, "\"nac_v\"" },
+    { JP_SIL, "\"sil\",\"sil_type\"" },
+    { JP_GVA, "\"gva\"" },
+    { JP_SDA, "\"sda\"" },
+};
+
+struct jsonPosState {
+    uint32_t addr;
+    uint32_t generation;
+    uint64_t fullAt;
+    struct jsonPos last;
+};
+
+static struct {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int running;
+    int exit;
+    // decode thread
+    struct jsonPos *pending;
+    uint32_t pendingCount;
+    uint32_t pendingAlloc;
+    char *drain;
+    size_t drainAlloc;
+    // protected by mutex
+    struct jsonPos *queue;
+    uint32_t queueCount;
+    uint32_t queueAlloc;
+    char *out;
+    size_t outLen;
+    size_t outAlloc;
+    uint64_t dropped;
+    // bumped by the decode thread when a consumer connects, read by the encoder
+    uint32_t generation;
+} jsonPos;
+
+static uint64_t jsonPosSourceMask(struct aircraft *a, datasource_t source) {
+    uint64_t mask = 0;
+    if (a->callsign_valid.source == source) mask |= JP_FLIGHT;
+    if (a->altitude_baro_valid.source == source) mask |= JP_ALT_BARO;
+    if (a->altitude_geom_valid.source == source) mask |= JP_ALT_GEOM;
+    if (a->gs_valid.source == source) mask |= JP_GS;
+    if (a->ias_valid.source == source) mask |= JP_IAS;
+    if (a->tas_valid.source == source) mask |= JP_TAS;
+    if (a->mach_valid.source == source) mask |= JP_MACH;
+    if (a->track_valid.source == source) mask |= JP_TRACK;
+    if (a->track_rate_valid.source == source) mask |= JP_TRACK_RATE;
+    if (a->roll_valid.source == source) mask |= JP_ROLL;
+    if (a->mag_heading_valid.source == source) mask |= JP_MAG_HEADING;
+    if (a->true_heading_valid.source == source) mask |= JP_TRUE_HEADING;
+    if (a->baro_rate_valid.source == source) mask |= JP_BARO_RATE;
+    if (a->geom_rate_valid.source == source) mask |= JP_GEOM_RATE;
+    if (a->squawk_valid.source == source) mask |= JP_SQUAWK;
+    if (a->emergency_valid.source == source) mask |= JP_EMERGENCY;
+    if (a->nav_qnh_valid.source == source) mask |= JP_NAV_QNH;
+    if (a->nav_altitude_mcp_valid.source == source) mask |= JP_NAV_ALT_MCP;
+    if (a->nav_altitude_fms_valid.source == source) mask |= JP_NAV_ALT_FMS;
+    if (a->nav_heading_valid.source == source) mask |= JP_NAV_HEADING;
+    if (a->nav_modes_valid.source == source) mask |= JP_NAV_MODES;
+    if (a->position_valid.source == source) mask |= JP_POS;
+    if (a->nic_baro_valid.source == source) mask |= JP_NIC_BARO;
+    if (a->nac_p_valid.source == source) mask |= JP_NAC_P;
+    if (a->nac_v_valid.source == source) mask |= JP_NAC_V;
+    if (a->sil_valid.source == source) mask |= JP_SIL;
+    if (a->gva_valid.source == source) mask |= JP_GVA;
+    if (a->sda_valid.source == source) mask |= JP_SDA;
+    return mask;
+}
+
+// the fields of the aircraft object, the text is written by jsonPosWrite
+// printMode == 0: aircraft.json
+// printMode == 1: trace.json
+// printMode == 2: json position output, written by the encoder thread
+// printMode == 3: globe.json
+static void jsonPosCapture(struct jsonPos *e, struct aircraft *a, uint64_t now, int printMode) {
+    memset(e, 0, sizeof(struct jsonPos));
+    uint64_t f = JP_TYPE;
+    int ground = trackDataValid(&a->airground_valid) && a->airground == AG_GROUND;
+
+    e->now = now;
+    e->addr = a->addr;
+    e->addrtype = a->addrtype;
 
-    // printMode == 0: aircraft.json
-    // printMode == 1: trace.json
-    // printMode == 2: jsonPositionOutput
-    // printMode == 3: globe.json
-
-    p = safe_snprintf(p, end, "\n{");
-    if (printMode == 2)
-        p = safe_snprintf(p, end, "\"now\" : %.1f,", now / 1000.0);
-    if (printMode != 1)
-        p = safe_snprintf(p, end, "\"hex\":\"%s%06x\",", (a->addr & MODES_NON_ICAO_ADDRESS) ? "~" : "", a->addr & 0xFFFFFF);
-    p = safe_snprintf(p, end, "\"type\":\"%s\"", addrtype_enum_string(a->addrtype));
     if (trackDataValid(&a->callsign_valid)) {
-        char buf[128];
-        p = safe_snprintf(p, end, ",\"flight\":\"%s\"", jsonEscapeString(a->callsign, buf, sizeof(buf)));
+        f |= JP_FLIGHT;
+        memcpy(e->callsign, a->callsign, sizeof(e->callsign) - 1);
     }
     if (Modes.db) {
         if (printMode != 1) {
-            if (a->registration[0])
-                p = safe_snprintf(p, end, ",\"r\":\"%.*s\"", (int) sizeof(a->registration), a->registration);
-            if (a->typeCode[0])
-                p = safe_snprintf(p, end, ",\"t\":\"%.*s\"", (int) sizeof(a->typeCode), a->typeCode);
-            if (a->dbFlags)
-                p = safe_snprintf(p, end, ",\"dbFlags\":%u", a->dbFlags);
-        }
-        if ((printMode == 0 || printMode == 2)&& !Modes.dbExchange) {
-            if (a->typeLong[0])
-                p = safe_snprintf(p, end, ",\"desc\":\"%.*s\"", (int) sizeof(a->typeLong), a->typeLong);
-        }
-    }
-    if (printMode != 1) {
-        if (trackDataValid(&a->airground_valid) && a->airground == AG_GROUND)
-            if (printMode == 2)
-                p = safe_snprintf(p, end, ",\"ground\":true");
-            else
-                p = safe_snprintf(p, end, ",\"alt_baro\":\"ground\"");
-        else {
-            if (altReliable(a))
-                p = safe_snprintf(p, end, ",\"alt_baro\":%d", a->altitude_baro);
-            if (printMode == 2)
-                p = safe_snprintf(p, end, ",\"ground\":false");
-        }
-    }
-    if (trackDataValid(&a->altitude_geom_valid))
-        p = safe_snprintf(p, end, ",\"alt_geom\":%d", a->altitude_geom);
-    if (printMode != 1 && trackDataValid(&a->gs_valid))
-        p = safe_snprintf(p, end, ",\"gs\":%.1f", a->gs);
-    if (trackDataValid(&a->ias_valid))
-        p = safe_snprintf(p, end, ",\"ias\":%u", a->ias);
-    if (trackDataValid(&a->tas_valid))
-        p = safe_snprintf(p, end, ",\"tas\":%u", a->tas);
-    if (trackDataValid(&a->mach_valid))
-        p = safe_snprintf(p, end, ",\"mach\":%.3f", a->mach);
+            if (a->registration[0]) {
+                f |= JP_REG;
+                memcpy(e->registration, a->registration, sizeof(e->registration));
+            }
+            if (a->typeCode[0]) {
+                f |= JP_TYPECODE;
+                memcpy(e->typeCode, a->typeCode, sizeof(e->typeCode));
+            }
+            if (a->dbFlags) {
+                f |= JP_DBFLAGS;
+                e->dbFlags = a->dbFlags;
+            }
+        }
+        if ((printMode == 0 || printMode == 2) && !Modes.dbExchange && a->typeLong[0]) {
+            f |= JP_DESC;
+            memcpy(e->typeLong, a->typeLong, sizeof(a->typeLong));
+        }
+    }
+    if (printMode == 2) {
+        // separate ground flag, alt_baro stays numeric
+        f |= JP_GROUND;
+        e->ground = ground;
+        if (!ground && altReliable(a)) {
+            f |= JP_ALT_BARO;
+            e->altBaro = a->altitude_baro;
+        }
+    } else if (printMode != 1) {
+        if (ground) {
+            f |= JP_ALT_BARO; // "ground"
+            e->ground = 1;
+        } else if (altReliable(a)) {
+            f |= JP_ALT_BARO;
+            e->altBaro = a->altitude_baro;
+        }
+    }
+    if (trackDataValid(&a->altitude_geom_valid)) { f |= JP_ALT_GEOM; e->altGeom = a->altitude_geom; }
+    if (printMode != 1 && trackDataValid(&a->gs_valid)) { f |= JP_GS; e->gs = a->gs; }
+    if (trackDataValid(&a->ias_valid)) { f |= JP_IAS; e->ias = a->ias; }
+    if (trackDataValid(&a->tas_valid)) { f |= JP_TAS; e->tas = a->tas; }
+    if (trackDataValid(&a->mach_valid)) { f |= JP_MACH; e->mach = a->mach; }
     if (now < a->wind_updated + TRACK_EXPIRE && abs(a->wind_altitude - a->altitude_baro) < 500) {
-        p = safe_snprintf(p, end, ",\"wd\":%.0f", a->wind_direction);
-        p = safe_snprintf(p, end, ",\"ws\":%.0f", a->wind_speed);
+        f |= JP_WIND;
+        e->wind[0] = a->wind_direction;
+        e->wind[1] = a->wind_speed;
     }
     if (now < a->oat_updated + TRACK_EXPIRE) {
-        p = safe_snprintf(p, end, ",\"oat\":%.0f", a->oat);
-        p = safe_snprintf(p, end, ",\"tat\":%.0f", a->tat);
-    }
-
-    if (trackDataValid(&a->track_valid))
-        p = safe_snprintf(p, end, ",\"track\":%.2f", a->track);
-    else if (printMode != 1 && trackDataValid(&a->position_valid) &&
-        !(trackDataValid(&a->airground_valid) && a->airground == AG_GROUND))
-        p = safe_snprintf(p, end, ",\"calc_track\":%.0f", a->calc_track);
-
-    if (trackDataValid(&a->track_rate_valid))
-        p = safe_snprintf(p, end, ",\"track_rate\":%.2f", a->track_rate);
-    if (trackDataValid(&a->roll_valid))
-        p = safe_snprintf(p, end, ",\"roll\":%.2f", a->roll);
-    if (trackDataValid(&a->mag_heading_valid))
-        p = safe_snprintf(p, end, ",\"mag_heading\":%.2f", a->mag_heading);
-    if (trackDataValid(&a->true_heading_valid))
-        p = safe_snprintf(p, end, ",\"true_heading\":%.2f", a->true_heading);
-    if (trackDataValid(&a->baro_rate_valid))
-        p = safe_snprintf(p, end, ",\"baro_rate\":%d", a->baro_rate);
-    if (trackDataValid(&a->geom_rate_valid))
-        p = safe_snprintf(p, end, ",\"geom_rate\":%d", a->geom_rate);
-    if (trackDataValid(&a->squawk_valid))
-        p = safe_snprintf(p, end, ",\"squawk\":\"%04x\"", a->squawk);
-    if (trackDataValid(&a->emergency_valid))
-        p = safe_snprintf(p, end, ",\"emergency\":\"%s\"", emergency_enum_string(a->emergency));
-    if (a->category != 0)
-        p = safe_snprintf(p, end, ",\"category\":\"%02X\"", a->category);
-    if (trackDataValid(&a->nav_qnh_valid))
-        p = safe_snprintf(p, end, ",\"nav_qnh\":%.1f", a->nav_qnh);
-    if (trackDataValid(&a->nav_altitude_mcp_valid))
-        p = safe_snprintf(p, end, ",\"nav_altitude_mcp\":%d", a->nav_altitude_mcp);
-    if (trackDataValid(&a->nav_altitude_fms_valid))
-        p = safe_snprintf(p, end, ",\"nav_altitude_fms\":%d", a->nav_altitude_fms);
-    if (trackDataValid(&a->nav_heading_valid))
-        p = safe_snprintf(p, end, ",\"nav_heading\":%.2f", a->nav_heading);
-    if (trackDataValid(&a->nav_modes_valid)) {
+        f |= JP_TEMP;
+        e->temp[0] = a->oat;
+        e->temp[1] = a->tat;
+    }
+    if (trackDataValid(&a->track_valid)) {
+        f |= JP_TRACK;
+        e->track = a->track;
+    } else if (printMode != 1 && trackDataValid(&a->position_valid) && !ground) {
+        f |= JP_CALC_TRACK;
+        e->calcTrack = a->calc_track;
+    }
+    if (trackDataValid(&a->track_rate_valid)) { f |= JP_TRACK_RATE; e->trackRate = a->track_rate; }
+    if (trackDataValid(&a->roll_valid)) { f |= JP_ROLL; e->roll = a->roll; }
+    if (trackDataValid(&a->mag_heading_valid)) { f |= JP_MAG_HEADING; e->magHeading = a->mag_heading; }
+    if (trackDataValid(&a->true_heading_valid)) { f |= JP_TRUE_HEADING; e->trueHeading = a->true_heading; }
+    if (trackDataValid(&a->baro_rate_valid)) { f |= JP_BARO_RATE; e->baroRate = a->baro_rate; }
+    if (trackDataValid(&a->geom_rate_valid)) { f |= JP_GEOM_RATE; e->geomRate = a->geom_rate; }
+    if (trackDataValid(&a->squawk_valid)) { f |= JP_SQUAWK; e->squawk = a->squawk; }
+    if (trackDataValid(&a->emergency_valid)) { f |= JP_EMERGENCY; e->emergency = a->emergency; }
+    if (a->category != 0) { f |= JP_CATEGORY; e->category = a->category; }
+    if (trackDataValid(&a->nav_qnh_valid)) { f |= JP_NAV_QNH; e->navQnh = a->nav_qnh; }
+    if (trackDataValid(&a->nav_altitude_mcp_valid)) { f |= JP_NAV_ALT_MCP; e->navAltMcp = a->nav_altitude_mcp; }
+    if (trackDataValid(&a->nav_altitude_fms_valid)) { f |= JP_NAV_ALT_FMS; e->navAltFms = a->nav_altitude_fms; }
+    if (trackDataValid(&a->nav_heading_valid)) { f |= JP_NAV_HEADING; e->navHeading = a->nav_heading; }
+    if (trackDataValid(&a->nav_modes_valid)) { f |= JP_NAV_MODES; e->navModes = a->nav_modes; }
+    if (printMode == 1) {
+        if (trackDataValid(&a->position_valid)) {
+            f |= JP_NIC_RC;
+            e->posNic = a->pos_nic;
+            e->posRc = a->pos_rc;
+        }
+    } else if (posReliable(a)) {
+        f |= JP_POS;
+        e->pos[0] = a->lat;
+        e->pos[1] = a->lon;
+        e->posNic = a->pos_nic;
+        e->posRc = a->pos_rc;
+        e->seenPos = (now < a->position_valid.updated) ? 0 : ((now - a->position_valid.updated) / 1000.0);
+    } else if (now < a->rr_seen + 2 * MINUTES) {
+        f |= JP_RR;
+        e->rr[0] = a->rr_lat;
+        e->rr[1] = a->rr_lon;
+    }
+    if (a->adsb_version >= 0) { f |= JP_VERSION; e->version = a->adsb_version; }
+    if (trackDataValid(&a->nic_baro_valid)) { f |= JP_NIC_BARO; e->nicBaro = a->nic_baro; }
+    if (trackDataValid(&a->nac_p_valid)) { f |= JP_NAC_P; e->nacP = a->nac_p; }
+    if (trackDataValid(&a->nac_v_valid)) { f |= JP_NAC_V; e->nacV = a->nac_v; }
+    if (trackDataValid(&a->sil_valid)) { f |= JP_SIL; e->sil = a->sil; }
+    if (a->sil_type != SIL_INVALID) { f |= JP_SIL_TYPE; e->silType = a->sil_type; }
+    if (trackDataValid(&a->gva_valid)) { f |= JP_GVA; e->gva = a->gva; }
+    if (trackDataValid(&a->sda_valid)) { f |= JP_SDA; e->sda = a->sda; }
+    if (trackDataValid(&a->alert_valid)) { f |= JP_ALERT; e->alert = a->alert; }
+    if (trackDataValid(&a->spi_valid)) { f |= JP_SPI; e->spi = a->spi; }
+    if (Modes.netReceiverIdPrint) { f |= JP_RID; e->receiverId = a->lastPosReceiverId; }
+
+    e->fields = f;
+    e->mlat = jsonPosSourceMask(a, SOURCE_MLAT);
+    e->tisb = jsonPosSourceMask(a, SOURCE_TISB);
+    e->messages = a->messages;
+    e->seen = (now < a->seen) ? 0 : ((now - a->seen) / 1000.0);
+    e->rssi = 10 * log10((a->signalLevel[0] + a->signalLevel[1] + a->signalLevel[2] + a->signalLevel[3] +
+                a->signalLevel[4] + a->signalLevel[5] + a->signalLevel[6] + a->signalLevel[7]) / 8 + 1.125e-5);
+}
+
+static char *jsonPosFlags(char *p, char *end, uint64_t mask) {
+    p = safe_snprintf(p, end, "[");
+    char *start = p;
+    for (uint32_t i = 0; i < sizeof(jsonPosFlagNames) / sizeof(jsonPosFlagNames[0]); i++) {
+        if (mask & jsonPosFlagNames[i].bit)
+            p = safe_snprintf(p, end, "%s,", jsonPosFlagNames[i].names);
+    }
+    if (p != start)
+        --p;
+    p = safe_snprintf(p, end, "]");
+    return p;
+}
+
+// write the fields in mask, prev: fields of the last object of this aircraft (delta mode) or NULL
+// printMode as for jsonPosCapture, only the json position output has the delta mode
+static char *jsonPosWrite(char *p, char *end, struct jsonPos *e, uint64_t mask, struct jsonPos *prev, int printMode) {
+    char buf[128];
+
+    if (printMode == 2) {
+        p = safe_snprintf(p, end, "{\"now\":%.1f", e->now / 1000.0);
+        p = safe_snprintf(p, end, ",\"hex\":\"%s%06x\"", (e->addr & MODES_NON_ICAO_ADDRESS) ? "~" : "", e->addr & 0xFFFFFF);
+        if (mask & JP_TYPE)
+            p = safe_snprintf(p, end, ",\"type\":\"%s\"", addrtype_enum_string(e->addrtype));
+    } else {
+        p = safe_snprintf(p, end, "\n{");
+        if (printMode != 1)
+            p = safe_snprintf(p, end, "\"hex\":\"%s%06x\",", (e->addr & MODES_NON_ICAO_ADDRESS) ? "~" : "", e->addr & 0xFFFFFF);
+        p = safe_snprintf(p, end, "\"type\":\"%s\"", addrtype_enum_string(e->addrtype));
+    }
+    if (mask & JP_FLIGHT)
+        p = safe_snprintf(p, end, ",\"flight\":\"%s\"", jsonEscapeString(e->callsign, buf, sizeof(buf)));
+    if (mask & JP_REG)
+        p = safe_snprintf(p, end, ",\"r\":\"%.*s\"", (int) sizeof(e->registration), e->registration);
+    if (mask & JP_TYPECODE)
+        p = safe_snprintf(p, end, ",\"t\":\"%.*s\"", (int) sizeof(e->typeCode), e->typeCode);
+    if (mask & JP_DBFLAGS)
+        p = safe_snprintf(p, end, ",\"dbFlags\":%u", e->dbFlags);
+    if (mask & JP_DESC)
+        p = safe_snprintf(p, end, ",\"desc\":\"%.*s\"", (int) sizeof(e->typeLong), e->typeLong);
+    if ((mask & JP_ALT_BARO) && e->ground && printMode != 2)
+        p = safe_snprintf(p, end, ",\"alt_baro\":\"ground\"");
+    else if (mask & JP_ALT_BARO)
+        p = safe_snprintf(p, end, ",\"alt_baro\":%d", e->altBaro);
+    if (mask & JP_GROUND)
+        p = safe_snprintf(p, end, ",\"ground\":%s", e->ground ? "true" : "false");
+    if (mask & JP_ALT_GEOM)
+        p = safe_snprintf(p, end, ",\"alt_geom\":%d", e->altGeom);
+    if (mask & JP_GS)
+        p = safe_snprintf(p, end, ",\"gs\":%.1f", e->gs);
+    if (mask & JP_IAS)
+        p = safe_snprintf(p, end, ",\"ias\":%u", e->ias);
+    if (mask & JP_TAS)
+        p = safe_snprintf(p, end, ",\"tas\":%u", e->tas);
+    if (mask & JP_MACH)
+        p = safe_snprintf(p, end, ",\"mach\":%.3f", e->mach);
+    if (mask & JP_WIND)
+        p = safe_snprintf(p, end, ",\"wd\":%.0f,\"ws\":%.0f", e->wind[0], e->wind[1]);
+    if (mask & JP_TEMP)
+        p = safe_snprintf(p, end, ",\"oat\":%.0f,\"tat\":%.0f", e->temp[0], e->temp[1]);
+    if (mask & JP_TRACK)
+        p = safe_snprintf(p, end, ",\"track\":%.2f", e->track);
+    if (mask & JP_CALC_TRACK)
+        p = safe_snprintf(p, end, ",\"calc_track\":%.0f", e->calcTrack);
+    if (mask & JP_TRACK_RATE)
+        p = safe_snprintf(p, end, ",\"track_rate\":%.2f", e->trackRate);
+    if (mask & JP_ROLL)
+        p = safe_snprintf(p, end, ",\"roll\":%.2f", e->roll);
+    if (mask & JP_MAG_HEADING)
+        p = safe_snprintf(p, end, ",\"mag_heading\":%.2f", e->magHeading);
+    if (mask & JP_TRUE_HEADING)
+        p = safe_snprintf(p, end, ",\"true_heading\":%.2f", e->trueHeading);
+    if (mask & JP_BARO_RATE)
+        p = safe_snprintf(p, end, ",\"baro_rate\":%d", e->baroRate);
+    if (mask & JP_GEOM_RATE)
+        p = safe_snprintf(p, end, ",\"geom_rate\":%d", e->geomRate);
+    if (mask & JP_SQUAWK)
+        p = safe_snprintf(p, end, ",\"squawk\":\"%04x\"", e->squawk);
+    if (mask & JP_EMERGENCY)
+        p = safe_snprintf(p, end, ",\"emergency\":\"%s\"", emergency_enum_string(e->emergency));
+    if (mask & JP_CATEGORY)
+        p = safe_snprintf(p, end, ",\"category\":\"%02X\"", e->category);
+    if (mask & JP_NAV_QNH)
+        p = safe_snprintf(p, end, ",\"nav_qnh\":%.1f", e->navQnh);
+    if (mask & JP_NAV_ALT_MCP)
+        p = safe_snprintf(p, end, ",\"nav_altitude_mcp\":%d", e->navAltMcp);
+    if (mask & JP_NAV_ALT_FMS)
+        p = safe_snprintf(p, end, ",\"nav_altitude_fms\":%d", e->navAltFms);
+    if (mask & JP_NAV_HEADING)
+        p = safe_snprintf(p, end, ",\"nav_heading\":%.2f", e->navHeading);
+    if (mask & JP_NAV_MODES) {
         p = safe_snprintf(p, end, ",\"nav_modes\":[");
-        p = append_nav_modes(p, end, a->nav_modes, "\"", ",");
+        p = append_nav_modes(p, end, e->navModes, "\"", ",");
         p = safe_snprintf(p, end, "]");
     }
-    if (printMode != 1) {
-        if (posReliable(a)) {
-            p = safe_snprintf(p, end, ",\"lat\":%f,\"lon\":%f,\"nic\":%u,\"rc\":%u,\"seen_pos\":%.1f",
-                    a->lat, a->lon, a->pos_nic, a->pos_rc,
-                    (now < a->position_valid.updated) ? 0 : ((now - a->position_valid.updated) / 1000.0));
-        } else if (now < a->rr_seen + 2 * MINUTES) {
-            p = safe_snprintf(p, end, ",\"rr_lat\":%.1f,\"rr_lon\":%.1f", a->rr_lat, a->rr_lon);
-        }
-    }
-
-    if (printMode == 1 && trackDataValid(&a->position_valid)) {
-        p = safe_snprintf(p, end, ",\"nic\":%u,\"rc\":%u",
-                a->pos_nic, a->pos_rc);
-    }
-    if (a->adsb_version >= 0)
-        p = safe_snprintf(p, end, ",\"version\":%d", a->adsb_version);
-    if (trackDataValid(&a->nic_baro_valid))
-        p = safe_snprintf(p, end, ",\"nic_baro\":%u", a->nic_baro);
-    if (trackDataValid(&a->nac_p_valid))
-        p = safe_snprintf(p, end, ",\"nac_p\":%u", a->nac_p);
-    if (trackDataValid(&a->nac_v_valid))
-        p = safe_snprintf(p, end, ",\"nac_v\":%u", a->nac_v);
-    if (trackDataValid(&a->sil_valid))
-        p = safe_snprintf(p, end, ",\"sil\":%u", a->sil);
-    if (a->sil_type != SIL_INVALID)
-        p = safe_snprintf(p, end, ",\"sil_type\":\"%s\"", sil_type_enum_string(a->sil_type));
-    if (trackDataValid(&a->gva_valid))
-        p = safe_snprintf(p, end, ",\"gva\":%u", a->gva);
-    if (trackDataValid(&a->sda_valid))
-        p = safe_snprintf(p, end, ",\"sda\":%u", a->sda);
-    if (trackDataValid(&a->alert_valid))
-        p = safe_snprintf(p, end, ",\"alert\":%u", a->alert);
-    if (trackDataValid(&a->spi_valid))
-        p = safe_snprintf(p, end, ",\"spi\":%u", a->spi);
-
-    /*
-    if (a->position_valid.source == SOURCE_JAERO)
-        p = safe_snprintf(p, end, ",\"jaero\": true");
-    if (a->position_valid.source == SOURCE_SBS)
-        p = safe_snprintf(p, end, ",\"sbs_other\": true");
-    */
-    if (Modes.netReceiverIdPrint) {
-        p = safe_snprintf(p, end, ",\"rId\":%016"PRIx64"", a->lastPosReceiverId);
-    }
-
-    if (printMode != 1) {
+    if (mask & JP_POS) {
+        p = safe_snprintf(p, end, ",\"lat\":%f,\"lon\":%f,\"nic\":%u,\"rc\":%u,\"seen_pos\":%.1f",
+                e->pos[0], e->pos[1], e->posNic, e->posRc, e->seenPos);
+    }
+    if (mask & JP_RR)
+        p = safe_snprintf(p, end, ",\"rr_lat\":%.1f,\"rr_lon\":%.1f", e->rr[0], e->rr[1]);
+    if (mask & JP_NIC_RC)
+        p = safe_snprintf(p, end, ",\"nic\":%u,\"rc\":%u", e->posNic, e->posRc);
+    if (mask & JP_VERSION)
+        p = safe_snprintf(p, end, ",\"version\":%d", e->version);
+    if (mask & JP_NIC_BARO)
+        p = safe_snprintf(p, end, ",\"nic_baro\":%u", e->nicBaro);
+    if (mask & JP_NAC_P)
+        p = safe_snprintf(p, end, ",\"nac_p\":%u", e->nacP);
+    if (mask & JP_NAC_V)
+        p = safe_snprintf(p, end, ",\"nac_v\":%u", e->nacV);
+    if (mask & JP_SIL)
+        p = safe_snprintf(p, end, ",\"sil\":%u", e->sil);
+    if (mask & JP_SIL_TYPE)
+        p = safe_snprintf(p, end, ",\"sil_type\":\"%s\"", sil_type_enum_string(e->silType));
+    if (mask & JP_GVA)
+        p = safe_snprintf(p, end, ",\"gva\":%u", e->gva);
+    if (mask & JP_SDA)
+        p = safe_snprintf(p, end, ",\"sda\":%u", e->sda);
+    if (mask & JP_ALERT)
+        p = safe_snprintf(p, end, ",\"alert\":%u", e->alert);
+    if (mask & JP_SPI)
+        p = safe_snprintf(p, end, ",\"spi\":%u", e->spi);
+    if (mask & JP_RID)
+        p = safe_snprintf(p, end, ",\"rId\":%016"PRIx64"", e->receiverId);
+
+    if (printMode == 1)
+        return safe_snprintf(p, end, "}");
+
+    if (prev) {
+        uint64_t gone = prev->fields & ~e->fields;
+        for (uint32_t i = 0; gone && i < sizeof(jsonPosFields) / sizeof(jsonPosFields[0]); i++) {
+            if (gone & jsonPosFields[i].bit)
+                p = safe_snprintf(p, end, "%s", jsonPosFields[i].nulls);
+        }
+    }
+
+    if (!prev || prev->mlat != e->mlat) {
         p = safe_snprintf(p, end, ",\"mlat\":");
-        p = append_flags(p, end, a, SOURCE_MLAT);
+        p = jsonPosFlags(p, end, e->mlat);
+    }
+    if (!prev || prev->tisb != e->tisb) {
         p = safe_snprintf(p, end, ",\"tisb\":");
-        p = append_flags(p, end, a, SOURCE_TISB);
-
-        p = safe_snprintf(p, end, ",\"messages\":%u,\"seen\":%.1f,\"rssi\":%.1f}",
-                a->messages, (now < a->seen) ? 0 : ((now - a->seen) / 1000.0),
-                10 * log10((a->signalLevel[0] + a->signalLevel[1] + a->signalLevel[2] + a->signalLevel[3] +
-                        a->signalLevel[4] + a->signalLevel[5] + a->signalLevel[6] + a->signalLevel[7]) / 8 + 1.125e-5));
-    } else {
-        p = safe_snprintf(p, end, "}");
+        p = jsonPosFlags(p, end, e->tisb);
     }
 
+    p = safe_snprintf(p, end, ",\"messages\":%u,\"seen\":%.1f,\"rssi\":%.1f}%s",
+            e->messages, e->seen, e->rssi, (printMode == 2) ? "\n" : "");
     return p;
 }
 
+// delta mode: fields valid now and different from the last object of the aircraft
+static uint64_t jsonPosChanged(struct jsonPos *e, struct jsonPos *prev) {
+    uint64_t mask = 0;
+    for (uint32_t i = 0; i < sizeof(jsonPosFields) / sizeof(jsonPosFields[0]); i++) {
+        const struct jsonPosField *field = &jsonPosFields[i];
+        if (!(e->fields & field->bit))
+            continue;
+        if (!(prev->fields & field->bit)
+                || memcmp((char *) e + field->offset, (char *) prev + field->offset, field->size)) {
+            mask |= field->bit;
+        }
+    }
+    return mask;
+}
+
+static char *sprintAircraftObject(char *p, char *end, struct aircraft *a, uint64_t now, int printMode) {
+    struct jsonPos e;
+    jsonPosCapture(&e, a, now, printMode);
+    return jsonPosWrite(p, end, &e, e.fields, NULL, printMode);
+}
+
+static void jsonPosAttrs(struct outputAttrs *m, struct jsonPos *e) {
+    memset(m, 0, sizeof(struct outputAttrs));
+    m->addr = e->addr;
+    m->df = -1;
+    m->military = (e->dbFlags & 1);
+    if (e->fields & JP_ALT_BARO) {
+        m->hasAlt = 1;
+        m->altitude = e->altBaro;
+    }
+    if (e->fields & JP_POS) {
+        m->hasPos = 1;
+        m->lat = e->pos[0];
+        m->lon = e->pos[1];
+    }
+}
+
+static void *jsonPosEntryPoint(void *arg) {
+    MODES_NOTUSED(arg);
+
+    struct jsonPos *batch = NULL;
+    uint32_t batchAlloc = 0;
+    size_t textAlloc = 0;
+    char *text = NULL;
+    struct jsonPosState *states = NULL;
+
+    pthread_mutex_lock(&jsonPos.mutex);
+
+    while (!jsonPos.exit) {
+        if (!jsonPos.queueCount) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            incTimedwait(&ts, 1000);
+            pthread_cond_timedwait(&jsonPos.cond, &jsonPos.mutex, &ts);
+            continue;
+        }
+
+        // take the whole queue, leave the previous batch array for the decode thread to fill
+        struct jsonPos *tmp = jsonPos.queue;
+        uint32_t tmpAlloc = jsonPos.queueAlloc;
+        uint32_t count = jsonPos.queueCount;
+        jsonPos.queue = batch;
+        jsonPos.queueAlloc = batchAlloc;
+        jsonPos.queueCount = 0;
+        batch = tmp;
+        batchAlloc = tmpAlloc;
+        uint32_t generation = __atomic_load_n(&jsonPos.generation, __ATOMIC_RELAXED);
+
+        pthread_mutex_unlock(&jsonPos.mutex);
+
+        size_t needed = (size_t) count * (1500 + sizeof(struct outputAttrs));
+        if (textAlloc < needed) {
+            free(text);
+            textAlloc = needed;
+            text = malloc(textAlloc);
+        }
+        if (Modes.net_output_json_delta && !states)
+            states = calloc(JSON_POS_STATE_SIZE, sizeof(struct jsonPosState));
+
+        char *p = text, *end = text + textAlloc;
+        for (uint32_t i = 0; text && i < count; i++) {
+            struct jsonPos *e = &batch[i];
+            if (Modes.net_output_filters) {
+                struct outputAttrs attrs;
+                jsonPosAttrs(&attrs, e);
+                memcpy(p, &attrs, sizeof(attrs));
+                p += sizeof(attrs);
+            }
+            if (!states) {
+                p = jsonPosWrite(p, end, e, e->fields, NULL, 2);
+                continue;
+            }
+            struct jsonPosState *s = &states[aircraftHash(e->addr) & (JSON_POS_STATE_SIZE - 1)];
+            if (s->addr != e->addr || s->generation != generation || e->now > s->fullAt) {
+                p = jsonPosWrite(p, end, e, e->fields, NULL, 2);
+                s->addr = e->addr;
+                s->generation = generation;
+                s->fullAt = e->now + JSON_POS_FULL_INTERVAL;
+            } else {
+                p = jsonPosWrite(p, end, e, jsonPosChanged(e, &s->last), &s->last, 2);
+            }
+            s->last = *e;
+        }
+        if (p >= end)
+            fprintf(stderr, "buffer overrun json position output\n");
+
+        pthread_mutex_lock(&jsonPos.mutex);
+
+        size_t len = p - text;
+        if (len && jsonPos.outLen + len > jsonPos.outAlloc) {
+            size_t alloc = 2 * (jsonPos.outLen + len);
+            char *out = realloc(jsonPos.out, alloc);
+            if (out) {
+                jsonPos.out = out;
+                jsonPos.outAlloc = alloc;
+            }
+        }
+        if (len && jsonPos.outLen + len <= jsonPos.outAlloc) {
+            memcpy(jsonPos.out + jsonPos.outLen, text, len);
+            jsonPos.outLen += len;
+        }
+    }
+
+    pthread_mutex_unlock(&jsonPos.mutex);
+
+    free(batch);
+    free(text);
+    free(states);
+    pthread_exit(NULL);
+}
+
+static void jsonPosStart() {
+    pthread_mutex_init(&jsonPos.mutex, NULL);
+    pthread_cond_init(&jsonPos.cond, NULL);
+    jsonPos.exit = 0;
+    if (pthread_create(&jsonPos.thread, NULL, jsonPosEntryPoint, NULL)) {
+        fprintf(stderr, "json position output: couldn't start the encoder thread\n");
+        return;
+    }
+    jsonPos.running = 1;
+}
+
+static void jsonPosStop() {
+    if (!jsonPos.running)
+        return;
+    pthread_mutex_lock(&jsonPos.mutex);
+    jsonPos.exit = 1;
+    pthread_cond_signal(&jsonPos.cond);
+    pthread_mutex_unlock(&jsonPos.mutex);
+    pthread_join(jsonPos.thread, NULL);
+    jsonPos.running = 0;
+
+    pthread_mutex_destroy(&jsonPos.mutex);
+    pthread_cond_destroy(&jsonPos.cond);
+    free(jsonPos.pending);
+    free(jsonPos.queue);
+    free(jsonPos.out);
+    free(jsonPos.drain);
+    memset(&jsonPos, 0, sizeof(jsonPos));
+}
+
+static void jsonPosConsumerAdded() {
+    __atomic_add_fetch(&jsonPos.generation, 1, __ATOMIC_RELAXED);
+}
+
+// called from the decode thread for every position
+void jsonPositionOutput(struct modesMessage *mm, struct aircraft *a) {
+    struct net_writer *writer = &Modes.json_out;
+    if (!jsonPos.running || !writer->service || (!writer->service->connections && !writer->replay.buf))
+        return;
+
+    if (jsonPos.pendingCount == jsonPos.pendingAlloc) {
+        if (jsonPos.pendingAlloc >= JSON_POS_QUEUE_MAX) {
+            jsonPos.dropped++;
+            return;
+        }
+        uint32_t alloc = jsonPos.pendingAlloc ? 2 * jsonPos.pendingAlloc : 256;
+        struct jsonPos *pending = realloc(jsonPos.pending, alloc * sizeof(struct jsonPos));
+        if (!pending)
+            return;
+        jsonPos.pending = pending;
+        jsonPos.pendingAlloc = alloc;
+    }
+    jsonPosCapture(&jsonPos.pending[jsonPos.pendingCount++], a, mm->sysTimestampMsg, 2);
+}
+
+// decode thread: hand the captured events to the encoder, write what it has finished
+static void jsonPosFlush() {
+    if (!jsonPos.running)
+        return;
+
+    size_t len = 0;
+
+    pthread_mutex_lock(&jsonPos.mutex);
+
+    if (jsonPos.pendingCount) {
+        if (!jsonPos.queueCount) {
+            struct jsonPos *tmp = jsonPos.queue;
+            uint32_t tmpAlloc = jsonPos.queueAlloc;
+            jsonPos.queue = jsonPos.pending;
+            jsonPos.queueAlloc = jsonPos.pendingAlloc;
+            jsonPos.queueCount = jsonPos.pendingCount;
+            jsonPos.pending = tmp;
+            jsonPos.pendingAlloc = tmpAlloc;
+        } else {
+            // encoder still busy, add to its next batch
+            uint32_t count = jsonPos.pendingCount;
+            if (jsonPos.queueCount + count > JSON_POS_QUEUE_MAX) {
+                jsonPos.dropped += jsonPos.queueCount + count - JSON_POS_QUEUE_MAX;
+                count = JSON_POS_QUEUE_MAX - jsonPos.queueCount;
+            }
+            if (jsonPos.queueCount + count > jsonPos.queueAlloc) {
+                uint32_t alloc = jsonPos.queueCount + count;
+                struct jsonPos *queue = realloc(jsonPos.queue, alloc * sizeof(struct jsonPos));
+                if (queue) {
+                    jsonPos.queue = queue;
+                    jsonPos.queueAlloc = alloc;
+                } else {
+                    count = 0;
+                }
+            }
+            memcpy(jsonPos.queue + jsonPos.queueCount, jsonPos.pending, count * sizeof(struct jsonPos));
+            jsonPos.queueCount += count;
+        }
+        jsonPos.pendingCount = 0;
+        pthread_cond_signal(&jsonPos.cond);
+    }
+
+    if (jsonPos.outLen) {
+        char *tmp = jsonPos.drain;
+        size_t tmpAlloc = jsonPos.drainAlloc;
+        jsonPos.drain = jsonPos.out;
+        jsonPos.drainAlloc = jsonPos.outAlloc;
+        len = jsonPos.outLen;
+        jsonPos.out = tmp;
+        jsonPos.outAlloc = tmpAlloc;
+        jsonPos.outLen = 0;
+    }
+
+    pthread_mutex_unlock(&jsonPos.mutex);
+
+    if (jsonPos.dropped) {
+        static uint64_t antiSpam;
+        uint64_t now = mstime();
+        if (now > antiSpam + 30 * SECONDS) {
+            antiSpam = now;
+            fprintf(stderr, "json position output: encoder not keeping up, dropped %"PRIu64" positions (suppressing for 30 seconds)\n",
+                    jsonPos.dropped);
+        }
+        jsonPos.dropped = 0;
+    }
+
+    // one object per write so a flush never splits a line
+    char *line = jsonPos.drain;
+    char *dataEnd = jsonPos.drain + len;
+    while (line < dataEnd) {
+        struct outputAttrs attrs;
+        if (Modes.net_output_filters) {
+            memcpy(&attrs, line, sizeof(attrs));
+            line += sizeof(attrs);
+            outputAttrs = &attrs;
+            outputSeq++;
+        }
+        char *eol = memchr(line, '\n', dataEnd - line);
+        int lineLen = (eol ? eol + 1 : dataEnd) - line;
+        char *p = prepareWrite(&Modes.json_out, lineLen);
+        if (p) {
+            memcpy(p, line, lineLen);
+            completeWrite(&Modes.json_out, p + lineLen);
+        }
+        line += lineLen;
+    }
+    outputAttrs = NULL;
+}
+
 void cleanupNetwork(void) {
+    jsonPosStop();
+
     for (struct net_service *s = Modes.services; s; s = s->next) {
         struct client *c = s->clients, *nc;
         while (c) {
@@ -3737,6 +5431,8 @@ void cleanupNetwork(void) {
                 free(c->sendq);
                 c->sendq = NULL;
             }
+            filterFree(c->filter);
+            clientZlibFree(c);
             free(c);
 
             c = nc;
@@ -3750,6 +5446,11 @@ void cleanupNetwork(void) {
         if (s->writer && s->writer->data) {
             free(s->writer->data);
             s->writer->data = NULL;
+            replayDestroy(s->writer);
+            free(s->writer->filtered);
+            s->writer->filtered = NULL;
+            s->writer->filteredCount = s->writer->filteredAlloc = 0;
+            s->writer->multicast = NULL;
         }
         if (s) free(s);
         s = ns;
@@ -3772,6 +5473,16 @@ void cleanupNetwork(void) {
 
     Modes.net_connectors_count = 0;
 
+    for (int i = 0; i < Modes.net_multicast_count; i++) {
+        struct net_multicast *mc = &Modes.net_multicast[i];
+        if (mc->fd != -1)
+            close(mc->fd);
+        free(mc->group); // start of the strdup'ed option
+    }
+    free(Modes.net_multicast);
+    Modes.net_multicast = NULL;
+    Modes.net_multicast_count = 0;
+
 }
 
 static void read_uuid(struct client *c, char *p, char *eod) {
@@ -3839,40 +5550,51 @@ struct char_buffer generateClientsJson() {
 
     p = safe_snprintf(p, end, "{ \"now\" : %.1f,\n", now / 1000.0);
     p = safe_snprintf(p, end, "  \"format\" : "
-            "[ \"receiverId\", \"host:port\", \"avg. kbit/s\", \"conn time(s)\", \"messageCounter\", \"positionCounter\" ],\n");
+            "[ \"receiverId\", \"host:port\", \"avg. kbit/s\", \"conn time(s)\", \"messageCounter\", \"positionCounter\","
+            " \"quality\", \"quarantined\", \"quarantineDropped\", \"slot\","
+            " \"readCalls\", \"readSize\", \"compactions\", \"compressionRatio\", \"compressionCpu(ms)\" ],\n");
 
     p = safe_snprintf(p, end, "  \"clients\" : [\n");
 
-    for (struct net_service *s = Modes.services; s; s = s->next) {
-        for (struct client *c = s->clients; c; c = c->next) {
-            if (!c->service)
-                continue;
-            if (!s->read_handler)
-                continue;
-
-            // check if we have enough space
-            if ((p + 1000) >= end) {
-                int used = p - buf;
-                buflen *= 2;
-                buf = (char *) realloc(buf, buflen);
-                p = buf + used;
-                end = buf + buflen;
-            }
-
-            double elapsed = (now - c->connectedSince) / 1000.0;
-            p = safe_snprintf(p, end, "[ \"%016"PRIx64"%016"PRIx64"\", \"%s\", %6.2f, %6.1f, %9.0f, %9.0f ],\n",
-                    c->receiverId,
-                    c->receiverId2,
-                    c->proxy_string,
-                    c->bytesReceived / 128.0 / elapsed,
-                    elapsed,
-                    (double) c->messageCounter,
-                    (double) c->positionCounter);
+    // read the published state, the client lists belong to the decode thread
+    struct registry *reg = &Modes.clientRegistry;
+    uint32_t slots = registrySlots(reg);
+    struct clientEntry c;
 
+    for (uint32_t slot = 0; slot < slots; slot++) {
+        if (!registryRead(reg, slot, &c))
+            continue;
 
-            if (p >= end)
-                fprintf(stderr, "buffer overrun client json\n");
+        // check if we have enough space
+        if ((p + 1000) >= end) {
+            int used = p - buf;
+            buflen *= 2;
+            buf = (char *) realloc(buf, buflen);
+            p = buf + used;
+            end = buf + buflen;
         }
+
+        double elapsed = (now - c.connectedSince) / 1000.0;
+        p = safe_snprintf(p, end, "[ \"%016"PRIx64"%016"PRIx64"\", \"%s\", %6.2f, %6.1f, %9.0f, %9.0f, %4.2f, %d, %9.0f, %u, %9.0f, %d, %9.0f, %5.2f, %9.0f ],\n",
+                c.receiverId,
+                c.receiverId2,
+                c.host,
+                c.bytesReceived / 128.0 / elapsed,
+                elapsed,
+                (double) c.messageCounter,
+                (double) c.positionCounter,
+                c.quality,
+                c.quarantined,
+                (double) c.quarantineDropped,
+                slot,
+                (double) c.readCalls,
+                c.readSize,
+                (double) c.compactions,
+                c.zCompressed ? (double) c.zPlain / c.zCompressed : 0.0,
+                (double) c.zCpu);
+
+        if (p >= end)
+            fprintf(stderr, "buffer overrun client json\n");
     }
 
     if (*(p-2) == ',')
@@ -3884,3 +5606,57 @@ struct char_buffer generateClientsJson() {
     cb.buffer = buf;
     return cb;
 }
+
+// per client prometheus metrics, labeled with the registry slot
+struct char_buffer generateClientsProm() {
+    struct char_buffer cb;
+    uint64_t now = mstime();
+
+    size_t buflen = 64 * 1024; // The initial buffer is resized as needed
+    char *buf = (char *) malloc(buflen), *p = buf, *end = buf + buflen;
+
+    struct registry *reg = &Modes.clientRegistry;
+    uint32_t slots = registrySlots(reg);
+    struct clientEntry c;
+
+    for (uint32_t slot = 0; slot < slots; slot++) {
+        if (!registryRead(reg, slot, &c))
+            continue;
+
+        if ((p + 2000) >= end) {
+            int used = p - buf;
+            buflen *= 2;
+            buf = (char *) realloc(buf, buflen);
+            p = buf + used;
+            end = buf + buflen;
+        }
+
+        char labels[400];
+        snprintf(labels, sizeof(labels), "{slot=\"%u\",receiver=\"%016"PRIx64"%016"PRIx64"\",host=\"%s\"}",
+                slot, c.receiverId, c.receiverId2, c.host);
+
+        p = safe_snprintf(p, end, "readsb_net_client_connected_seconds%s %"PRIu64"\n", labels,
+                now > c.connectedSince ? (now - c.connectedSince) / 1000 : 0);
+        p = safe_snprintf(p, end, "readsb_net_client_bytes_received%s %"PRIu64"\n", labels, c.bytesReceived);
+        p = safe_snprintf(p, end, "readsb_net_client_messages%s %"PRIu64"\n", labels, c.messageCounter);
+        p = safe_snprintf(p, end, "readsb_net_client_positions%s %"PRIu64"\n", labels, c.positionCounter);
+        p = safe_snprintf(p, end, "readsb_net_client_quality%s %.2f\n", labels, c.quality);
+        p = safe_snprintf(p, end, "readsb_net_client_quarantined%s %d\n", labels, c.quarantined);
+        p = safe_snprintf(p, end, "readsb_net_client_quarantine_dropped%s %"PRIu64"\n", labels, c.quarantineDropped);
+        p = safe_snprintf(p, end, "readsb_net_client_read_calls%s %"PRIu64"\n", labels, c.readCalls);
+        p = safe_snprintf(p, end, "readsb_net_client_read_size%s %d\n", labels, c.readSize);
+        p = safe_snprintf(p, end, "readsb_net_client_buffer_compactions%s %"PRIu64"\n", labels, c.compactions);
+        if (c.zCompressed) {
+            p = safe_snprintf(p, end, "readsb_net_client_zlib_plain_bytes%s %"PRIu64"\n", labels, c.zPlain);
+            p = safe_snprintf(p, end, "readsb_net_client_zlib_compressed_bytes%s %"PRIu64"\n", labels, c.zCompressed);
+            p = safe_snprintf(p, end, "readsb_net_client_zlib_cpu_seconds%s %.3f\n", labels, c.zCpu / 1000.0);
+        }
+    }
+
+    if (p >= end)
+        fprintf(stderr, "buffer overrun clients prom\n");
+
+    cb.len = p - buf;
+    cb.buffer = buf;
+    return cb;
+}
@@ -26,6 +26,15 @@
 
 #include <sys/socket.h>
 
+#define CLIENT_QUALITY_INTERVAL (10 * SECONDS) // how often input clients are scored
+#define CLIENT_QUARANTINE_MIN (60 * SECONDS) // minimum time a client stays quarantined
+#define CLIENT_IDLE_CHECK (30 * SECONDS) // how often output only clients are read to detect dead connections
+
+// multicast datagram: uint32 source, uint32 sequence (both big endian) followed by whole frames / lines
+#define MULTICAST_HEADER 8
+#define MULTICAST_PAYLOAD 1400 // stays below the usual MTU unless a single write is larger
+#define MULTICAST_DATAGRAM_MAX 2048 // space needed to receive one datagram
+
 // Describes a networking service (group of connections)
 
 struct aircraft;
@@ -66,10 +75,51 @@ struct net_service
     int *listener_fds; // listening FDs
     const char *descr;
     struct client *clients; // linked list of clients connected to this service
+    struct client *timerHead; // clients with a pending timer, ordered by timerDue
+    struct client *timerTail;
     int read_sep_len;
     const char *read_sep; // hander details for input data
 };
 
+// Counters feeding the quality score of an input client
+struct clientQuality
+{
+    uint64_t frames; // beast frames passed to the decoder
+    uint64_t bad; // frames failing CRC / decoding
+    uint64_t garbage; // malformed bytes, unlike client->garbage this doesn't decay
+    uint64_t clockBad; // timestamps jumping backwards
+    uint64_t bytes;
+    uint64_t positions;
+    uint64_t posBad; // positions failing CPR or speed checks
+};
+
+// Subscription filter of an output client ("FILTER ..." command, see handleFilterRequest)
+// all given conditions must match, an empty filter matches everything
+struct outputFilter
+{
+    uint32_t dfMask; // bit n set: DF n passes, 0: any DF
+    uint32_t addrCount;
+    uint32_t *addrs; // sorted, NULL: any address
+    int32_t minAltitude; // only used with hasAlt
+    int8_t hasAlt;
+    int8_t hasBbox;
+    int8_t military; // only aircraft flagged military in the database
+    double bbox[4]; // south, north, west, east; west > east crosses the antimeridian
+};
+
+// What output filters are evaluated against, one per message or json object
+struct outputAttrs
+{
+    uint32_t addr;
+    int32_t altitude;
+    double lat;
+    double lon;
+    int8_t df; // -1: not a Mode S message, passes any DF filter
+    int8_t hasAlt;
+    int8_t hasPos;
+    int8_t military;
+};
+
 // Client connection
 struct net_connector
 {
@@ -84,6 +134,7 @@ struct net_connector
     struct net_service *service;
     int8_t connected;
     int8_t connecting;
+    int8_t compress; // beast_zlib_out, beast_reduce_zlib_out
     int fd;
     uint64_t next_reconnect;
     uint64_t connect_timeout;
@@ -98,12 +149,28 @@ struct net_connector
     pthread_mutex_t mutex;
 };
 
+// UDP multicast output of a writer or input to the Beast input service (--net-multicast)
+struct net_multicast
+{
+    char *group;
+    char *port;
+    char *protocol; // beast_out, sbs_out or beast_in
+    int fd;
+    struct sockaddr_storage addr; // output: destination
+    socklen_t addrlen;
+    uint32_t source; // output: random, receivers notice a restarted sender
+    uint32_t sequence; // output: of the next datagram
+};
+
 // Structure used to describe a networking client
 
 struct client
 {
     struct net_service *service; // Service this client is part of
     struct client* next; // Pointer to next client
+    struct client *timerNext; // timer list of the service
+    struct client *timerPrev;
+    uint64_t timerDue; // 0 if not on the timer list
     int fd; // File descriptor
     int buflen; // Amount of data on buffer
     uint64_t bytesReceived;
@@ -122,6 +189,42 @@ struct client
     int sendq_max; // Max size of SendQ
     uint32_t garbage; // amount of garbage we have received from this client
     struct net_connector *con;
+    int32_t slot; // Modes.clientRegistry, -1 for clients without read handler
+    struct clientQuality qual; // running counters
+    struct clientQuality qualLast; // counters at the last quality update
+    float quality; // 0 (bad) .. 1 (good), smoothed
+    char quarantined; // only every netQuarantineSample-th message is decoded
+    uint32_t sampleCounter;
+    uint64_t quarantinedSince;
+    uint64_t quarantineDropped; // messages not decoded due to quarantine
+    char overloaded; // over the read budget, only the hot set and a sample of the rest are decoded
+    uint32_t overloadRandom; // LCG state picking the overload sample
+    char replaying; // sent from the writer's replay ring until caught up with the live stream
+    char replayHold; // nothing is sent until a RESUME request or REPLAY_HOLD ms after connecting
+    uint64_t replayPos; // next stream offset sent to this client while replaying
+    struct outputFilter *filter; // only matching output is queued for this client, NULL: everything
+    uint64_t lastReceiverId; // filtered clients get their own receiverId frames
+    uint64_t filterSeq; // outputSeq filterMatch was evaluated for
+    char filterMatch;
+    uint64_t lastTimestamp; // previous beast timestamp
+    uint64_t lastTimestampId; // receiverId belonging to lastTimestamp
+    // unprocessed data is buf[bufStart .. bufStart + buflen), it's only moved to the front
+    // when the space behind it gets smaller than readSize
+    int bufStart;
+    int readSize; // bytes requested per read(), adapted to the byte rate of the client
+    uint64_t readBytesLast; // bytesReceived when readSize was last adapted
+    uint64_t readCalls; // read() syscalls
+    uint64_t compactions; // memmoves of unprocessed data to the front of buf
+    // zlib compressed beast: sent to beast_zlib_out connectors, detected on beast input
+    z_stream *zout;
+    z_stream *zin;
+    char *zbuf; // compressed input, CLIENT_READ_MAX bytes
+    uint64_t zPlain; // bytes before compression / after decompression
+    uint64_t zCompressed;
+    struct timespec zCpu; // spent in deflate / inflate
+    struct net_multicast *multicast; // multicast input, datagrams instead of a byte stream
+    uint32_t multicastSource; // sender of the last datagram
+    uint32_t multicastNext; // expected sequence
     char buf[MODES_CLIENT_BUF_SIZE + 4]; // Read buffer+padding
     char proxy_string[256]; // store string received from PROXY protocol v1 (v2 not supported currently)
     char host[NI_MAXHOST]; // For logging
@@ -130,6 +233,21 @@ struct client
 
 // Common writer state for all output sockets of one type
 
+// replay ring of a writer (--net-replay): the most recently flushed part of the output stream
+// offsets count every byte flushed since startup, the byte at offset o is buf[o % size]
+// bounds are the offsets where a flushed buffer starts, data is dropped one buffer at a time
+struct replayRing
+{
+    char *buf;
+    uint64_t size;
+    uint64_t start; // oldest offset still in buf, always a bound
+    uint64_t end; // offset of the next byte to be flushed
+    uint64_t *bounds; // ring of buffer start offsets
+    uint32_t boundsSize;
+    uint32_t boundsFirst;
+    uint32_t boundsCount;
+};
+
 struct net_writer
 {
     void *data; // shared write buffer, sized MODES_OUT_BUF_SIZE
@@ -141,6 +259,19 @@ struct net_writer
     heartbeat_fn send_heartbeat; // function that queues a heartbeat if needed
     uint64_t lastWrite; // time of last write to clients
     uint64_t lastReceiverId;
+    struct replayRing replay; // buf is NULL unless replay is enabled for this writer
+    // clients with an output filter, they get each write copied to their SendQ when it matches
+    // instead of the whole buffer in flushWrites
+    struct client **filtered;
+    int filteredCount;
+    int filteredAlloc;
+    // the current write is a Beast message from writeReceiverId (--net-receiver-id), it starts with
+    // idFrameLen bytes of receiverId frame for the unfiltered clients, filterDeliver replaces that
+    int8_t idWrite;
+    int idFrameLen;
+    uint64_t writeReceiverId;
+    struct net_multicast *multicast; // each flush is also sent as datagrams, NULL: disabled
+    int multicastStart; // first byte of data not sent as datagram yet
 };
 
 struct net_service *serviceInit (const char *descr, struct net_writer *writer, heartbeat_fn hb_handler, read_mode_t mode, const char *sep, read_fn read_handler);
@@ -163,13 +294,13 @@ void cleanupNetwork(void);
 void netFreeClients();
 
 // TODO: move these somewhere else
-struct char_buffer generateAircraftJson();
+struct char_buffer generateAircraftJson(int history);
 struct char_buffer generateGlobeBin(int globe_index, int mil);
 struct char_buffer generateGlobeJson(int globe_index);
 struct char_buffer generateTraceJson(struct aircraft *a, int start, int last);
 struct char_buffer generateReceiverJson ();
-struct char_buffer generateHistoryJson ();
 struct char_buffer generateClientsJson();
+struct char_buffer generateClientsProm();
 void writeJsonToFile (const char* dir, const char *file, struct char_buffer cb);
 void writeJsonToGzip (const char* dir, const char *file, struct char_buffer cb, int gzip);
 struct char_buffer generateVRS(int part, int n_parts, int reduced_data);
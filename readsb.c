@@ -84,6 +84,11 @@ static void sigtermHandler(int dummy) {
     log_with_timestamp("Caught SIGTERM, shutting down..\n");
 }
 
+static void sigusr1Handler(int dummy) {
+    MODES_NOTUSED(dummy);
+    Modes.dumpRecorder = 1; // dumped by the main thread
+}
+
 void receiverPositionChanged(float lat, float lon, float alt) {
     log_with_timestamp("Autodetected receiver location: %.5f, %.5f at %.0fm AMSL", lat, lon, alt);
     writeJsonToFile(Modes.json_dir, "receiver.json", generateReceiverJson()); // location changed
@@ -144,7 +149,12 @@ static void modesInitConfig(void) {
     Modes.net_output_flush_interval = 50; // Default to 50 ms
     Modes.netReceiverId = 0;
     Modes.netIngest = 0;
+    Modes.netQuarantine = 0;
+    Modes.netQuarantineLow = 0.5;
+    Modes.netQuarantineHigh = 0.75;
+    Modes.netQuarantineSample = 8;
     Modes.uuidFile = strdup("/boot/adsbx-uuid");
+    Modes.recorder_file = strdup("/tmp/readsb_recorder.bin");
     Modes.json_trace_interval = 30 * 1000;
     Modes.heatmap_current_interval = -15;
     Modes.heatmap_interval = 60 * SECONDS;
@@ -162,9 +172,10 @@ static void modesInitConfig(void) {
     sdrInitConfig();
 
     reset_stats(&Modes.stats_current);
-    for (int i = 0; i < 90; ++i) {
-        reset_stats(&Modes.stats_10[i]);
-    }
+    // stats.json windows, STATS_WINDOW_1MIN / 5MIN / 15MIN
+    statsWindowAdd(1);
+    statsWindowAdd(5);
+    statsWindowAdd(15);
     //receiverTest();
     Modes.scratch = malloc(sizeof(struct aircraft));
 }
@@ -173,6 +184,10 @@ static void modesInitConfig(void) {
 //
 static void modesInit(void) {
 
+    registryInit(&Modes.receiverRegistry, "receivers", sizeof(struct receiverEntry));
+    receiverInit();
+    registryInit(&Modes.clientRegistry, "clients", sizeof(struct clientEntry));
+
     if (Modes.json_reliable == -13) {
         if (Modes.json_globe_index || Modes.globe_history_dir)
             Modes.json_reliable = 2;
@@ -195,9 +210,6 @@ static void modesInit(void) {
     pthread_mutex_init(&Modes.mainMutex, NULL);
     pthread_cond_init(&Modes.mainCond, NULL);
 
-    pthread_mutex_init(&Modes.data_mutex, NULL);
-    pthread_cond_init(&Modes.data_cond, NULL);
-
     pthread_mutex_init(&Modes.decodeMutex, NULL);
     pthread_cond_init(&Modes.decodeCond, NULL);
 
@@ -233,6 +245,11 @@ static void modesInit(void) {
     // Allocate the various buffers used by Modes
     Modes.trailing_samples = (MODES_PREAMBLE_US + MODES_LONG_MSG_BITS + 16) * 1e-6 * Modes.sample_rate;
 
+    if (Modes.sdrDeviceCount > 1 && (Modes.sdr_type == SDR_NONE || Modes.sdr_type == SDR_MODESBEAST || Modes.sdr_type == SDR_GNS)) {
+        fprintf(stderr, "--add-device requires a local SDR selected with --device-type or --ifile, exiting!\n");
+        cleanup_and_exit(1);
+    }
+
     if (Modes.sdr_type == SDR_NONE) {
         if (Modes.net)
             Modes.net_only = 1;
@@ -246,19 +263,6 @@ static void modesInit(void) {
         Modes.net_only = 0;
     }
 
-    if (!Modes.net_only) {
-        for (int i = 0; i < MODES_MAG_BUFFERS; ++i) {
-            if ((Modes.mag_buffers[i].data = calloc(MODES_MAG_BUF_SAMPLES + Modes.trailing_samples, sizeof (uint16_t))) == NULL) {
-                fprintf(stderr, "Out of memory allocating magnitude buffer.\n");
-                exit(1);
-            }
-
-            Modes.mag_buffers[i].length = 0;
-            Modes.mag_buffers[i].dropped = 0;
-            Modes.mag_buffers[i].sampleTimestamp = 0;
-        }
-    }
-
     // Validate the users Lat/Lon home location inputs
     if ((Modes.fUserLat > 90.0) // Latitude must be -90 to +90
             || (Modes.fUserLat < -90.0) // and
@@ -296,8 +300,7 @@ static void modesInit(void) {
     }
 
     if (Modes.api) {
-        Modes.byLat = malloc(API_INDEX_MAX * sizeof(struct av));
-        Modes.byLon = malloc(API_INDEX_MAX * sizeof(struct av));
+        apiInit();
     }
 
     // Prepare error correction tables
@@ -306,33 +309,12 @@ static void modesInit(void) {
     modeACInit();
 
     icaoFilterAdd(Modes.show_only);
+    hotSetInit();
 
     Modes.json_globe_special_tiles = calloc(GLOBE_SPECIAL_INDEX, sizeof(struct tile));
     init_globe_index(Modes.json_globe_special_tiles);
 }
 
-//
-//=========================================================================
-//
-// We read data using a thread, so the main thread only handles decoding
-// without caring about data acquisition
-//
-static void *readerThreadEntryPoint(void *arg) {
-    MODES_NOTUSED(arg);
-    srandom(get_seed());
-
-    sdrRun();
-
-    // Wake the main thread (if it's still waiting)
-    pthread_mutex_lock(&Modes.data_mutex);
-    if (!Modes.exit)
-        Modes.exit = 2; // unexpected exit
-    pthread_cond_signal(&Modes.data_cond);
-    pthread_mutex_unlock(&Modes.data_mutex);
-
-    pthread_exit(NULL);
-}
-
 static void *jsonThreadEntryPoint(void *arg) {
     MODES_NOTUSED(arg);
     srandom(get_seed());
@@ -355,16 +337,34 @@ static void *jsonThreadEntryPoint(void *arg) {
 
         uint64_t now = mstime();
 
-        struct char_buffer cb = generateAircraftJson();
+        // the history snapshot is taken in the same pass as aircraft.json
+        int history = (ALL_JSON) && now >= next_history;
+
+        // legacy history files: aircraft.json is the snapshot, the binCraft ring isn't needed
+        struct char_buffer cb = generateAircraftJson(history && !Modes.json_history_files);
         if (Modes.json_gzip)
             writeJsonToGzip(Modes.json_dir, "aircraft.json.gz", cb, 5);
+        if (history && Modes.json_history_files) {
+            // writing a file frees the buffer, aircraft.json still needs it
+            struct char_buffer hcb = { .buffer = malloc(cb.len), .len = cb.len };
+            if (hcb.buffer) {
+                char filebuf[PATH_MAX];
+                memcpy(hcb.buffer, cb.buffer, cb.len);
+                snprintf(filebuf, PATH_MAX, "history_%d.json", Modes.json_aircraft_history_next);
+                writeJsonToFile(Modes.json_dir, filebuf, hcb);
+            }
+        }
         writeJsonToFile(Modes.json_dir, "aircraft.json", cb);
 
-        if ((ALL_JSON) && now >= next_history) {
-            char filebuf[PATH_MAX];
-
-            snprintf(filebuf, PATH_MAX, "history_%d.json", Modes.json_aircraft_history_next);
-            writeJsonToFile(Modes.json_dir, filebuf, generateAircraftJson());
+        if (history) {
+            if (!Modes.json_history_files) {
+                // all snapshots in one file, the web interface needs a single request
+                struct char_buffer hb = generateHistoryBin();
+                if (hb.buffer) {
+                    writeJsonToGzip(Modes.json_dir, "history.binCraft", hb, 1);
+                    free(hb.buffer);
+                }
+            }
 
             if (!Modes.json_aircraft_history_full) {
                 writeJsonToFile(Modes.json_dir, "receiver.json", generateReceiverJson()); // number of history entries changed
@@ -469,162 +469,54 @@ static void *jsonGlobeThreadEntryPoint(void *arg) {
 static void *decodeThreadEntryPoint(void *arg) {
     MODES_NOTUSED(arg);
     srandom(get_seed());
+    recorderSetName("decode");
 
     pthread_mutex_lock(&Modes.decodeMutex);
 
     modesInitNet();
 
-    /* If the user specifies --net-only, just run in order to serve network
-     * clients without reading data from the RTL device.
-     * This rules also in case a local Mode-S Beast is connected via USB.
-     */
-
     fprintf(stderr, "startup complete after %.3f seconds.\n", (mstime() - Modes.startup_time) / 1000.0);
 
     interactiveInit();
 
-    if (Modes.net_only) {
-        uint32_t maxSleep = Modes.net_output_flush_interval / 2; // in ms
-        struct timespec ts;
-        clock_gettime(CLOCK_REALTIME, &ts);
-        while (!Modes.exit) {
-            struct timespec start_time;
-            struct timespec watch;
-
-            startWatch(&watch);
-            start_cpu_timing(&start_time);
-
-            backgroundTasks();
-
-            end_cpu_timing(&start_time, &Modes.stats_current.background_cpu);
-            int64_t elapsed = stopWatch(&watch);
-
-            static uint64_t antiSpam;
-            if (elapsed > 100 && mstime() > antiSpam + 30 * SECONDS) {
-                antiSpam = mstime();
-                fprintf(stderr, "<3>High load: net work took %"PRId64" ms, suppressing for 30 seconds!\n", elapsed);
-            }
-            //fprintf(stderr, "net %"PRId64" ms\n", elapsed);
-
-            incTimedwait(&ts, maxSleep);
-
-            int err = pthread_cond_timedwait(&Modes.decodeCond, &Modes.decodeMutex, &ts);
-            if (err && err != ETIMEDOUT)
-                fprintf(stderr, "decode: pthread_cond_timedwait unexpected error: %s\n", strerror(err));
-        }
-    } else {
-        int watchdogCounter = 50; // about 5 seconds
-
-        uint32_t maxSleep = 80; // in ms
-        // Create the thread that will read the data from the device.
-        pthread_mutex_lock(&Modes.data_mutex);
-        pthread_create(&Modes.reader_thread, NULL, readerThreadEntryPoint, NULL);
-
-        struct timespec ts;
-        clock_gettime(CLOCK_REALTIME, &ts);
-        while (!Modes.exit) {
-            struct timespec start_time;
-
-            // Modes.data_mutex is locked, and possibly we have data.
-
-            // copy out reader CPU time and reset it
-            add_timespecs(&Modes.reader_cpu_accumulator, &Modes.stats_current.reader_cpu, &Modes.stats_current.reader_cpu);
-            Modes.reader_cpu_accumulator.tv_sec = 0;
-            Modes.reader_cpu_accumulator.tv_nsec = 0;
-
-            if (Modes.first_free_buffer != Modes.first_filled_buffer) {
-                // FIFO is not empty, process one buffer.
-
-                struct mag_buf *buf;
-
-                start_cpu_timing(&start_time);
-                buf = &Modes.mag_buffers[Modes.first_filled_buffer];
-
-                // Process data after releasing the lock, so that the capturing
-                // thread can read data while we perform computationally expensive
-                // stuff at the same time.
-                pthread_mutex_unlock(&Modes.data_mutex);
-
-                demodulate2400(buf);
-                if (Modes.mode_ac) {
-                    demodulate2400AC(buf);
-                }
-
-                Modes.stats_current.samples_processed += buf->length;
-                Modes.stats_current.samples_dropped += buf->dropped;
-                end_cpu_timing(&start_time, &Modes.stats_current.demod_cpu);
-
-                // Mark the buffer we just processed as completed.
-                pthread_mutex_lock(&Modes.data_mutex);
-                Modes.first_filled_buffer = (Modes.first_filled_buffer + 1) % MODES_MAG_BUFFERS;
-                pthread_cond_signal(&Modes.data_cond);
-                pthread_mutex_unlock(&Modes.data_mutex);
-                watchdogCounter = 50;
-            } else {
-                // Nothing to process this time around.
-                pthread_mutex_unlock(&Modes.data_mutex);
-                if (--watchdogCounter <= 0) {
-                    log_with_timestamp("No data received from the SDR for a long time, it may have wedged, exiting!");
-                    Modes.exit = 1;
-                    sdrCancel();
-                }
-            }
-
-            start_cpu_timing(&start_time);
-            backgroundTasks();
-            end_cpu_timing(&start_time, &Modes.stats_current.background_cpu);
+    // Local SDR devices are read and demodulated by their own threads,
+    // this thread only serves the network clients.
+    sdrStart();
 
-            pthread_mutex_lock(&Modes.data_mutex);
-
-            uint64_t now = mstime();
-
-            if (Modes.first_free_buffer == Modes.first_filled_buffer || now > Modes.next_remove_stale + 1 * SECONDS) {
-                /* wait for more data.
-                 * we should be getting data every 50-60ms. wait for max 80 before we give up and do some background work.
-                 * this is fairly aggressive as all our network I/O runs out of the background work!
-                 */
+    uint32_t maxSleep = Modes.net_output_flush_interval / 2; // in ms
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    while (!Modes.exit) {
+        struct timespec start_time;
+        struct timespec watch;
 
-                // make sure we go to removeStale and the other functions
-                // in trackPeriodicUpdate that require the decodeMutex
-                // (the latest if when we are 2 seconds late, use a short wait
-                // that should be sufficient to make the other thread get the lock)
-                if (now > Modes.next_remove_stale + 1 * SECONDS) {
-                    incTimedwait(&ts, 3);
-                } else {
-                    incTimedwait(&ts, maxSleep);
-                }
+        startWatch(&watch);
+        start_cpu_timing(&start_time);
 
-                pthread_mutex_unlock(&Modes.decodeMutex);
+        backgroundTasks();
 
-                // This unlocks Modes.data_mutex, and waits for Modes.data_cond
-                int err = pthread_cond_timedwait(&Modes.data_cond, &Modes.data_mutex, &ts);
-                if (err && err != ETIMEDOUT)
-                    fprintf(stderr, "decode: pthread_cond_timedwait unexpected error: %s\n", strerror(err));
+        end_cpu_timing(&start_time, &Modes.stats_current.background_cpu);
+        int64_t elapsed = stopWatch(&watch);
 
-                pthread_mutex_lock(&Modes.decodeMutex);
-            }
+        static uint64_t antiSpam;
+        if (elapsed > 100 && mstime() > antiSpam + 30 * SECONDS) {
+            antiSpam = mstime();
+            fprintf(stderr, "<3>High load: net work took %"PRId64" ms, suppressing for 30 seconds!\n", elapsed);
         }
+        //fprintf(stderr, "net %"PRId64" ms\n", elapsed);
 
-        pthread_mutex_unlock(&Modes.data_mutex);
+        incTimedwait(&ts, maxSleep);
 
-        log_with_timestamp("Waiting for receive thread termination");
-        int err;
-        int count = 100;
-        // Wait on reader thread exit
-        while (count-- > 0 && (err = pthread_tryjoin_np(Modes.reader_thread, NULL))) {
-            msleep(100);
-        }
-        if (err) {
-            log_with_timestamp("Receive thread termination failed, will raise SIGKILL on exit!");
-            Modes.exit = SIGKILL;
-        } else {
-            pthread_cond_destroy(&Modes.data_cond); // Thread cleanup - only after the reader thread is dead!
-            pthread_mutex_destroy(&Modes.data_mutex);
-        }
+        int err = pthread_cond_timedwait(&Modes.decodeCond, &Modes.decodeMutex, &ts);
+        if (err && err != ETIMEDOUT)
+            fprintf(stderr, "decode: pthread_cond_timedwait unexpected error: %s\n", strerror(err));
     }
 
     pthread_mutex_unlock(&Modes.decodeMutex);
 
+    // the demod threads need the decodeMutex to finish
+    sdrStop();
+
     pthread_exit(NULL);
 }
 //
@@ -672,6 +564,7 @@ static void backgroundTasks(void) {
     uint64_t now = mstime();
 
     icaoFilterExpire(now);
+    hotSetExpire(now);
 
     if (now > next_second) {
         next_second = now + 1000;
@@ -697,9 +590,13 @@ static void cleanup_and_exit(int code) {
     free(Modes.scratch);
     free(Modes.dev_name);
     free(Modes.filename);
-    free(Modes.byLat);
-    free(Modes.byLon);
+    apiDestroy();
     free(Modes.prom_file);
+    free(Modes.prom_clients_file);
+    free(Modes.recorder_file);
+    free(Modes.recorder_decode);
+    recorderCleanup();
+    statsCleanup();
     free(Modes.json_dir);
     free(Modes.globe_history_dir);
     free(Modes.heatmap_dir);
@@ -722,8 +619,8 @@ static void cleanup_and_exit(int code) {
     free(Modes.beast_serial);
     free(Modes.json_globe_special_tiles);
     free(Modes.uuidFile);
-    free(Modes.dbIndex);
-    free(Modes.db);
+    dbCleanup();
+    historyDestroy();
     /* Go through tracked aircraft chain and free up any used memory */
     for (int j = 0; j < AIRCRAFT_BUCKETS; j++) {
         struct aircraft *a = Modes.aircraft[j], *na;
@@ -731,24 +628,20 @@ static void cleanup_and_exit(int code) {
             na = a->next;
             if (a) {
 
-                if (a->trace) {
-                    free(a->trace);
-                    free(a->trace_all);
-                }
+                traceFree(a);
 
                 free(a);
             }
             a = na;
         }
     }
+    traceChunksCleanup();
 
-    int i;
-    for (i = 0; i < MODES_MAG_BUFFERS; ++i) {
-        free(Modes.mag_buffers[i].data);
-    }
     crcCleanupTables();
 
     receiverCleanup();
+    registryDestroy(&Modes.receiverRegistry);
+    registryDestroy(&Modes.clientRegistry);
 
     for (int i = 0; i <= GLOBE_MAX_INDEX; i++) {
         ca_destroy(&Modes.globeLists[i]);
@@ -788,6 +681,8 @@ static int make_net_connector(char *arg) {
     }
     if (strcmp(con->protocol, "beast_out") != 0
             && strcmp(con->protocol, "beast_reduce_out") != 0
+            && strcmp(con->protocol, "beast_zlib_out") != 0
+            && strcmp(con->protocol, "beast_reduce_zlib_out") != 0
             && strcmp(con->protocol, "beast_in") != 0
             && strcmp(con->protocol, "raw_out") != 0
             && strcmp(con->protocol, "raw_in") != 0
@@ -805,6 +700,7 @@ static int make_net_connector(char *arg) {
        ) {
         fprintf(stderr, "--net-connector: Unknown protocol: %s\n", con->protocol);
         fprintf(stderr, "Supported protocols: beast_out, beast_in, beast_reduce_out, raw_out, raw_in, \n"
+                "beast_zlib_out, beast_reduce_zlib_out, \n"
                 "sbs_out, sbs_out_replay, sbs_out_mlat, sbs_out_jaero, \n"
                 "sbs_in, sbs_in_mlat, sbs_in_jaero, \n"
                 "vrs_out, json_out\n");
@@ -822,6 +718,40 @@ static int make_net_connector(char *arg) {
     return 0;
 }
 
+static int make_net_multicast(char *arg) {
+    struct net_multicast *mc = realloc(Modes.net_multicast, (Modes.net_multicast_count + 1) * sizeof(struct net_multicast));
+    if (!mc) {
+        fprintf(stderr, "realloc error net_multicast\n");
+        exit(1);
+    }
+    Modes.net_multicast = mc;
+    mc = &Modes.net_multicast[Modes.net_multicast_count++];
+    memset(mc, 0, sizeof(struct net_multicast));
+    mc->fd = -1;
+
+    char *s = strdup(arg);
+    mc->group = strtok(s, ",");
+    mc->port = strtok(NULL, ",");
+    mc->protocol = strtok(NULL, ",");
+    if (!mc->group || !mc->port || !mc->protocol) {
+        fprintf(stderr, "--net-multicast: Wrong format: %s\n", arg);
+        fprintf(stderr, "Correct syntax: --net-multicast=group,port,protocol\n");
+        return 1;
+    }
+    if (strcmp(mc->protocol, "beast_out") != 0
+            && strcmp(mc->protocol, "sbs_out") != 0
+            && strcmp(mc->protocol, "beast_in") != 0) {
+        fprintf(stderr, "--net-multicast: Unknown protocol: %s\n", mc->protocol);
+        fprintf(stderr, "Supported protocols: beast_out, sbs_out, beast_in\n");
+        return 1;
+    }
+    if (atol(mc->port) > (1<<16) || atol(mc->port) < 1) {
+        fprintf(stderr, "--net-multicast: port must be in range 1 to 65536\n");
+        return 1;
+    }
+    return 0;
+}
+
 static error_t parse_opt(int key, char *arg, struct argp_state *state) {
     switch (key) {
         case OptDevice:
@@ -830,6 +760,10 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         case OptGain:
             Modes.gain = (int) (atof(arg)*10); // Gain is in tens of DBs
             break;
+        case OptAddDevice:
+            if (!sdrAddDevice(arg))
+                return 1;
+            break;
         case OptFreq:
             Modes.freq = (int) strtoll(arg, NULL, 10);
             break;
@@ -924,6 +858,10 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         case OptStatsRange:
             Modes.stats_range_histo = 1;
             break;
+        case OptStatsWindow:
+            if (statsWindowAdd(atoi(arg)))
+                return 1;
+            break;
         case OptStatsEvery:
             Modes.stats = (uint64_t) (1000 * atof(arg));
             break;
@@ -934,6 +872,9 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         case OptPromFile:
             Modes.prom_file = strdup(arg);
             break;
+        case OptPromClientsFile:
+            Modes.prom_clients_file = strdup(arg);
+            break;
         case OptJsonDir:
             Modes.json_dir = strdup(arg);
             break;
@@ -983,6 +924,9 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         case OptJsonGzip:
             Modes.json_gzip = 1;
             break;
+        case OptJsonHistoryFiles:
+            Modes.json_history_files = 1;
+            break;
         case OptJsonBinCraft:
             Modes.jsonBinCraft = atoi(arg);
             break;
@@ -993,6 +937,12 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         case OptJsonGlobeIndex:
             Modes.json_globe_index = 1;
             break;
+        case OptKeepTraces:
+            if (atof(arg) > 0 && atof(arg) <= 40 * 24)
+                Modes.keep_traces_globe = HOURS * atof(arg);
+            else
+                fprintf(stderr, "--keep-traces: value out of range (0 to 960 hours), using the default\n");
+            break;
         case OptNetHeartbeat:
             Modes.net_heartbeat_interval = (uint64_t) (1000 * atof(arg));
             break;
@@ -1068,6 +1018,17 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
             if (atof(arg) > 0)
                 Modes.net_output_vrs_interval = atof(arg) * SECONDS;
             break;
+        case OptNetJsonPortDelta:
+            Modes.net_output_json_delta = 1;
+            break;
+        case OptNetOutputFilters:
+            Modes.net_output_filters = 1;
+            break;
+        case OptNetReplay:
+            Modes.net_replay_size = 1024 * (uint64_t) atoi(arg);
+            if (Modes.net_replay_size && Modes.net_replay_size < 64 * 1024)
+                Modes.net_replay_size = 64 * 1024;
+            break;
         case OptNetBuffer:
             Modes.net_sndbuf_size = atoi(arg);
             break;
@@ -1083,6 +1044,26 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
         case OptGarbage:
             Modes.garbage_ports = strdup(arg);
             break;
+        case OptNetQuarantine:
+        {
+            char *next;
+            if (!arg) {
+                Modes.netQuarantine = 1;
+                break;
+            }
+            Modes.netQuarantineLow = strtod(arg, &next);
+            Modes.netQuarantineHigh = Modes.netQuarantineLow + 0.25;
+            if (*next == ',')
+                Modes.netQuarantineHigh = strtod(next + 1, &next);
+            if (*next == ',')
+                Modes.netQuarantineSample = atoi(next + 1);
+            Modes.netQuarantine = (Modes.netQuarantineLow > 0);
+            if (Modes.netQuarantineHigh < Modes.netQuarantineLow || Modes.netQuarantineSample < 1) {
+                fprintf(stderr, "--net-quarantine: <high> must not be below <low> and <n> must be at least 1\n");
+                return 1;
+            }
+            break;
+        }
         case OptNetIngest:
             Modes.netIngest = 1;
             break;
@@ -1094,10 +1075,27 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
             if (make_net_connector(arg))
                 return 1;
             break;
+        case OptNetMulticast:
+            if (make_net_multicast(arg))
+                return 1;
+            break;
         case OptNetConnectorDelay:
             Modes.net_connector_delay = (uint64_t) 1000 * atof(arg);
             break;
 
+        case OptHotSet:
+            for (char *p = arg, *next; *p; p = next) {
+                uint32_t addr = strtoul(p, &next, 16);
+                if (next == p || (*next && *next != ',')) {
+                    fprintf(stderr, "--hot-set: invalid address list: %s\n", arg);
+                    break;
+                }
+                if (Modes.hotSetStaticCount < HOT_SET_STATIC_MAX)
+                    Modes.hotSetStatic[Modes.hotSetStaticCount++] = addr;
+                if (*next == ',')
+                    next++;
+            }
+            break;
         case OptTraceFocus:
             Modes.trace_focus = strtol(arg, NULL, 16);
             Modes.interactive = 0;
@@ -1110,6 +1108,14 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
             Modes.keep_traces = 2 * HOURS;
             fprintf(stderr, "cpr_focus = %06x\n", Modes.cpr_focus);
             break;
+        case OptRecorderFile:
+            free(Modes.recorder_file);
+            Modes.recorder_file = strdup(arg);
+            break;
+        case OptRecorderDecode:
+            free(Modes.recorder_decode);
+            Modes.recorder_decode = strdup(arg);
+            break;
         case OptReceiverFocus:
             Modes.receiver_focus = strtoull(arg, NULL, 16);
             fprintf(stderr, "receiver_focus = %016"PRIx64"\n", Modes.receiver_focus);
@@ -1273,6 +1279,8 @@ static void configAfterParse() {
 
     if (Modes.json_globe_index) {
         Modes.keep_traces = 24 * HOURS + 40 * MINUTES; // include 40 minutes overlap, tar1090 needs at least 30 minutes currently
+        if (Modes.keep_traces_globe > Modes.keep_traces)
+            Modes.keep_traces = Modes.keep_traces_globe;
     } else if (Modes.heatmap) {
         Modes.keep_traces = 35 * MINUTES; // heatmap is written every 30 minutes
     }
@@ -1292,11 +1300,16 @@ int main(int argc, char **argv) {
     // signal handlers:
     signal(SIGINT, sigintHandler);
     signal(SIGTERM, sigtermHandler);
-    signal(SIGUSR1, SIG_IGN);
+    signal(SIGUSR1, sigusr1Handler);
 
     // Parse the command line options
     parseCommandLine(argc, argv);
 
+    if (Modes.recorder_decode) {
+        int res = recorderDecode(Modes.recorder_decode);
+        cleanup_and_exit(res ? 1 : 0);
+    }
+
     configAfterParse();
 
     // Initialization
@@ -1319,13 +1332,9 @@ int main(int argc, char **argv) {
     // init stats:
     Modes.stats_current.start = Modes.stats_current.end =
             Modes.stats_alltime.start = Modes.stats_alltime.end =
-            Modes.stats_periodic.start = Modes.stats_periodic.end =
-            Modes.stats_1min.start = Modes.stats_1min.end =
-            Modes.stats_5min.start = Modes.stats_5min.end =
-            Modes.stats_15min.start = Modes.stats_15min.end = mstime();
+            Modes.stats_periodic.start = Modes.stats_periodic.end = mstime();
 
-    for (int j = 0; j < STAT_BUCKETS; ++j)
-        Modes.stats_10[j].start = Modes.stats_10[j].end = Modes.stats_current.start;
+    statsInit(Modes.stats_current.start);
 
     if (Modes.json_dir && Modes.json_globe_index) {
         char pathbuf[PATH_MAX];
@@ -1377,9 +1386,7 @@ int main(int argc, char **argv) {
     }
     // db update on startup
     if (!Modes.exit)
-        dbUpdate();
-    if (!Modes.exit)
-        dbFinishUpdate();
+        dbUpdate(mstime(), mstime() + 1 * HOURS);
 
     for (int thread = 0; thread < STALE_THREADS; thread++) {
         Modes.staleRun[thread] = 1;
@@ -1417,6 +1424,11 @@ int main(int argc, char **argv) {
     while (!Modes.exit) {
         trackPeriodicUpdate();
 
+        if (Modes.dumpRecorder) {
+            Modes.dumpRecorder = 0;
+            recorderDump(Modes.recorder_file);
+        }
+
         incTimedwait(&ts, PERIODIC_UPDATE);
 
         //fprintf(stderr, "%.1f\n", ts.tv_nsec / 1e6);
@@ -1465,10 +1477,6 @@ int main(int argc, char **argv) {
     pthread_cond_signal(&Modes.decodeCond);
     pthread_mutex_unlock(&Modes.decodeMutex);
 
-    pthread_mutex_lock(&Modes.data_mutex);
-    pthread_cond_signal(&Modes.data_cond);
-    pthread_mutex_unlock(&Modes.data_mutex);
-
     pthread_join(Modes.decodeThread, NULL); // Wait on json writer thread exit
 
     // force stats to be done, this must happen before network cleanup as it checks network stuff
@@ -280,8 +280,13 @@ typedef enum {
 #define MODES_NET_HEARTBEAT_INTERVAL 60000      // milliseconds
 
 #define MODES_CLIENT_BUF_SIZE (64*1024)
+#define CLIENT_READ_MIN (2*1024)
+#define CLIENT_READ_MAX (MODES_CLIENT_BUF_SIZE / 2)
 #define MODES_NET_SNDBUF_SIZE (64*1024)
 #define MODES_NET_SNDBUF_MAX  (7)
+#define REPLAY_HOLD 1000 // ms a new client of a replay or filter service can take to send its RESUME or FILTER request
+#define FILTER_ADDR_MAX 4096 // addresses in one output filter
+#define FILTER_HOT_MAX 64 // addresses of an output filter kept in the hot set
 
 #define NET_MAX_CONNECTORS 256
 
@@ -308,7 +313,9 @@ typedef enum {
 #define STALE_THREADS 4
 #define STALE_BUCKETS (AIRCRAFT_BUCKETS / STALE_THREADS)
 
-#define STAT_BUCKETS 90 // 90 * 10 seconds = 15 min (max interval in stats.json)
+#define STAT_BUCKETS 90 // 90 * 10 seconds = 15 min (longest default interval in stats.json)
+#define STATS_WINDOWS_MAX 8 // 1min, 5min, 15min + additional windows (--stats-window)
+#define STATS_WINDOW_MAX_MINUTES (24 * 60)
 
 // mix_fasthash: https://github.com/ZilongTan/fast-hash (MIT License Copyright (C) 2012 Zilong Tan (eric.zltan@gmail.com))
 #define mix_fasthash(h) ({              \
@@ -333,7 +340,12 @@ typedef enum {
 #include "sdr.h"
 #include "globe_index.h"
 #include "receiver.h"
+#include "registry.h"
 #include "aircraft.h"
+#include "history.h"
+#include "recorder.h"
+#include "legs.h"
+#include "misc.h"
 #include "geomag.h"
 
 //======================== structure declarations =========================
@@ -360,6 +372,41 @@ struct mag_buf
 #endif
 };
 
+#define SDR_DEVICES_MAX 8
+
+struct sdrStats
+{
+    uint64_t samples_processed;
+    uint64_t samples_dropped;
+    uint64_t messages; // accepted Mode S messages
+    struct timespec demod_cpu;
+    struct timespec reader_cpu;
+};
+
+// One local SDR device: the reader thread fills the magnitude buffer ring,
+// the demod thread empties it and hands the messages to the tracker
+
+struct sdrDevice
+{
+    int index;
+    sdr_type_t type;
+    char *dev_name; // device index / serial / identifier, file name for additional ifile devices
+    int gain;
+    uint64_t receiverId; // tags the messages of this device, zero if there is only one device
+    void *driver; // driver specific state
+    int8_t started; // reader and demod thread were created
+    pthread_t reader_thread;
+    pthread_t demod_thread;
+    pthread_mutex_t data_mutex; // Mutex to synchronize buffer access
+    pthread_cond_t data_cond; // Conditional variable associated
+    unsigned first_free_buffer; // Entry in mag_buffers that will next be filled with input.
+    unsigned first_filled_buffer; // Entry in mag_buffers that has valid data and will be demodulated next. If equal to next_free_buffer, there is no unprocessed data.
+    struct timespec reader_cpu_accumulator; // CPU time used by the reader thread, copied out and reset by the demod thread under the mutex
+    struct mag_buf mag_buffers[MODES_MAG_BUFFERS]; // Converted magnitude buffers from the device
+    struct sdrStats stats; // since startup, updated under decodeMutex
+    struct sdrStats statsReported; // copy taken by statsUpdate for stats.json
+};
+
 // Program global state
 
 struct _Modes
@@ -367,9 +414,6 @@ struct _Modes
     pthread_mutex_t mainMutex;
     pthread_cond_t mainCond;
 
-    pthread_cond_t data_cond; // Conditional variable associated
-    pthread_t reader_thread;
-    pthread_mutex_t data_mutex; // Mutex to synchronize buffer access
     pthread_t decodeThread; // thread writing json
     pthread_t jsonThread; // thread writing json
     pthread_t jsonGlobeThread; // thread writing json
@@ -399,8 +443,6 @@ struct _Modes
     pthread_cond_t miscCond;
     int8_t miscThreadRunning;
 
-    unsigned first_free_buffer; // Entry in mag_buffers that will next be filled with input.
-    unsigned first_filled_buffer; // Entry in mag_buffers that has valid data and will be demodulated next. If equal to next_free_buffer, there is no unprocessed data.
     unsigned trailing_samples; // extra trailing samples in magnitude buffers
     int exit; // Exit from the main loop when true
     int dc_filter; // should we apply a DC filter?
@@ -420,10 +462,12 @@ struct _Modes
     struct craftArray globeLists[GLOBE_MAX_INDEX+1];
     //struct craftArray activeAircraft;
     struct receiver *receiverTable[RECEIVER_TABLE_SIZE];
-    dbEntry *db;
-    dbEntry **dbIndex;
-    dbEntry *db2;
-    dbEntry **db2Index;
+    struct receiverShard receiverShards[RECEIVER_SHARDS];
+    struct registry receiverRegistry; // published receiver state, see registry.h
+    struct registry clientRegistry; // published network client state
+    struct dbIndex *db; // current aircraft database, see aircraft.h
+    struct dbIndex *dbRetired; // previous database, freed when the next one is published
+    uint32_t dbGeneration;
     uint64_t dbModificationTime;
     uint64_t aircraftCount;
     uint64_t receiverCount;
@@ -441,9 +485,7 @@ struct _Modes
     struct net_writer fatsv_out; // FATSV-format output
     struct net_writer api_out; // some sort of api, who knows really?
     int api; // enable api output
-    int avLen;
-    struct av *byLat;
-    struct av *byLon;
+    struct craftArray *apiGrid; // spatial index for the api, maintained on position updates
 
     // Configuration
     int8_t nfix_crc; // Number of crc bit error(s) to correct
@@ -492,6 +534,8 @@ struct _Modes
     uint32_t cpr_focus;
     uint32_t trace_focus;
     uint32_t show_only; // Only show messages from this ICAO
+    uint32_t hotSetStatic[HOT_SET_STATIC_MAX]; // --hot-set, always part of the hot set (icao_filter.c)
+    int hotSetStaticCount;
     uint64_t receiver_focus;
 
     uint32_t preambleThreshold;
@@ -520,11 +564,17 @@ struct _Modes
     char *net_output_json_ports;
     char *net_output_api_ports;
     char *garbage_ports;
+    int8_t netQuarantine; // quarantine input clients sending bad data
+    int netQuarantineSample; // decode every n-th message of a quarantined client
+    float netQuarantineLow; // quality below which a client is quarantined
+    float netQuarantineHigh; // quality above which it's released
     char *net_output_vrs_ports; // List of VRS output TCP ports
     uint64_t net_output_vrs_interval;
     struct net_connector **net_connectors; // client connectors
     int net_connectors_count;
     int net_connectors_size;
+    struct net_multicast *net_multicast; // --net-multicast, net_io.c
+    int net_multicast_count;
     char *uuidFile;
     char *filename; // Input form file, --ifile option
     char *net_bind_address; // Bind address
@@ -532,11 +582,16 @@ struct _Modes
     char *globe_history_dir;
     char *state_dir;
     char *prom_file;
+    char *prom_clients_file; // per client prometheus output
+    char *recorder_file; // flight recorder dump location (SIGUSR1)
+    char *recorder_decode; // decode this flight recorder dump and exit
+    volatile sig_atomic_t dumpRecorder; // set by SIGUSR1
     int64_t heatmap_current_interval;
     uint32_t heatmap_interval; // don't change data type
     int heatmap;
     char *heatmap_dir;
     uint32_t keep_traces; // how long traces are saved in internal memory
+    uint32_t keep_traces_globe; // --keep-traces, retention with the globe index, older points are decimated (traceResize)
     int json_globe_index; // Enable extra globe indexed json files.
     uint32_t json_trace_interval; // max time ignoring new positions for trace
     struct tile *json_globe_special_tiles;
@@ -545,35 +600,39 @@ struct _Modes
     char *beast_serial; // Modes-S Beast device path
 
     int net_sndbuf_size; // TCP output buffer size (64Kb * 2^n)
+    uint64_t net_replay_size; // bytes kept per writer for reconnecting consumers, 0: disabled (net_io.c)
+    int8_t net_output_json_delta; // json position output: only fields changed since the last object of the aircraft
+    int8_t net_output_filters; // Beast, SBS and json position output clients may send a FILTER command (net_io.c)
+    int8_t json_history_files; // legacy history_N.json instead of history.binCraft
     int json_aircraft_history_next;
     int json_aircraft_history_full;
     int bUserFlags; // Flags relating to the user details
     int8_t biastee;
-    int8_t mday;
-    int8_t traceDay;
-    int8_t doFullTraceWrite;
     int8_t jsonBinCraft; // only write binCraft for globe (1) and also aircraft.json (2)
 
-    struct timespec reader_cpu_accumulator; // CPU time used by the reader thread, copied out and reset by the main thread under the mutex
-    struct mag_buf mag_buffers[MODES_MAG_BUFFERS]; // Converted magnitude buffers from RTL or file input
+    uint64_t traceRolloverDay; // day boundary (ms) the current trace rollover belongs to
+    uint64_t traceRolloverStart; // when the rollover rewrite started
+    uint64_t traceDayFinished; // day boundary (ms) after which the previous day was made readable
+
+    int sdrDeviceCount; // local SDR devices, the first one is selected by --device-type / --device / --gain
+    struct sdrDevice sdrDevices[SDR_DEVICES_MAX];
 
     struct aircraft *scratch;
 
     uint64_t startup_time;
     uint64_t next_stats_update;
     uint64_t next_stats_display;
-    uint64_t next_api_update;
     uint64_t next_remove_stale;
     int8_t updateStats;
     int8_t staleStop;
-    int stats_bucket; // index that has just been writte to
-    struct stats stats_10[STAT_BUCKETS];
+    uint64_t stats_bucket; // number of 10 second buckets completed
+    uint32_t stats_10_len; // 10 second buckets kept, enough for the longest window
+    struct stats *stats_10;
     struct stats stats_current;
     struct stats stats_alltime;
     struct stats stats_periodic;
-    struct stats stats_1min;
-    struct stats stats_5min;
-    struct stats stats_15min;
+    int statsWindowCount;
+    struct statsWindow statsWindows[STATS_WINDOWS_MAX]; // 1min, 5min, 15min, then --stats-window
 
     struct statsCount globalStatsCount;
 
@@ -609,6 +668,7 @@ struct modesMessage
     bool pos_ignore; // associated position is old / delayed / misc error
     bool pos_bad; // speed_check failed
     bool jsonPos; // output a json position
+    bool probation; // first message of an address on probation, no aircraft yet (track.c)
     datasource_t source; // Characterizes the overall message source
     double signalLevel; // RSSI, in the range [0..1], as a fraction of full-scale power
     struct client *client; // network client this message came from, NULL otherwise
@@ -835,6 +895,7 @@ enum {
     OptStats,
     OptStatsRange,
     OptStatsEvery,
+    OptStatsWindow,
     OptOnlyAddr,
     OptMetric,
     OptGnss,
@@ -843,16 +904,22 @@ enum {
     OptReceiverFocus,
     OptCprFocus,
     OptTraceFocus,
+    OptHotSet,
+    OptRecorderFile,
+    OptRecorderDecode,
+    OptAddDevice,
     OptQuiet,
     OptShowOnly,
     OptFilterDF,
     OptJsonDir,
     OptJsonGzip,
+    OptJsonHistoryFiles,
     OptJsonBinCraft,
     OptJsonReliable,
     OptJaeroTimeout,
     OptDbFile,
     OptPromFile,
+    OptPromClientsFile,
     OptGlobeHistoryDir,
     OptStateDir,
     OptHeatmap,
@@ -861,6 +928,7 @@ enum {
     OptJsonLocAcc,
     OptJsonGlobeIndex,
     OptJsonTraceInt,
+    OptKeepTraces,
     OptDcFilter,
     OptBiasTee,
     OptNet,
@@ -885,13 +953,18 @@ enum {
     OptNetRoIntervall,
     OptNetConnector,
     OptNetConnectorDelay,
+    OptNetMulticast,
     OptNetHeartbeat,
     OptNetBuffer,
+    OptNetReplay,
+    OptNetJsonPortDelta,
+    OptNetOutputFilters,
     OptNetVerbatim,
     OptNetReceiverId,
     OptNetReceiverIdJson,
     OptNetIngest,
     OptGarbage,
+    OptNetQuarantine,
     OptUuidFile,
     OptRtlSdrEnableAgc,
     OptRtlSdrPpm,
@@ -914,6 +987,7 @@ enum {
 
 // This one needs modesMessage:
 #include "track.h"
+#include "trace_chunks.h"
 #include "mode_s.h"
 #include "comm_b.h"
 
@@ -13,65 +13,212 @@ uint32_t receiverHash(uint64_t id) {
     return h & (RECEIVER_TABLE_SIZE - 1);
 }
 
-struct receiver *receiverGet(uint64_t id) {
-    struct receiver *r = Modes.receiverTable[receiverHash(id)];
+static inline struct receiverShard *receiverShard(uint32_t hash) {
+    return &Modes.receiverShards[hash >> (RECEIVER_TABLE_HASH_BITS - RECEIVER_SHARD_BITS)];
+}
+
+// lock the shard of the receiver id
+static struct receiverShard *shardLock(uint64_t id, uint32_t *hash) {
+    *hash = receiverHash(id);
+    struct receiverShard *shard = receiverShard(*hash);
+    pthread_mutex_lock(&shard->mutex);
+    return shard;
+}
+
+static void shardUnlock(struct receiverShard *shard) {
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+// all functions below with a shard argument need the shard locked
+
+static struct receiver *receiverGet(uint64_t id, uint32_t hash) {
+    struct receiver *r = Modes.receiverTable[hash];
 
     while (r && r->id != id) {
         r = r->next;
     }
     return r;
 }
-struct receiver *receiverCreate(uint64_t id) {
-    struct receiver *r = receiverGet(id);
+
+// copy the receiver to its registry slot, at most once per second unless forced
+// changes held back by the rate limit are published by receiverTimeout
+static void receiverPublish(struct receiverShard *shard, struct receiver *r, uint64_t now, int force) {
+    if (!force && now < r->published + 1 * SECONDS) {
+        if (!r->dirty) {
+            r->dirty = 1;
+            r->dirtyNext = shard->dirty;
+            shard->dirty = r;
+        }
+        return;
+    }
+    r->published = now;
+
+    struct receiverEntry e = {
+        .id = r->id,
+        .firstSeen = r->firstSeen,
+        .lastSeen = r->lastSeen,
+        .positionCounter = r->positionCounter,
+        .latMin = r->latMin,
+        .latMax = r->latMax,
+        .lonMin = r->lonMin,
+        .lonMax = r->lonMax,
+        .badCounter = r->badCounter,
+        .goodCounter = r->goodCounter,
+        .timedOutCounter = r->timedOutCounter,
+    };
+    registryPublish(&Modes.receiverRegistry, r->slot, &e);
+}
+
+static void bucketUnlink(struct receiver *r) {
+    *r->bucketPrev = r->bucketNext;
+    if (r->bucketNext)
+        r->bucketNext->bucketPrev = r->bucketPrev;
+}
+
+static void bucketLink(struct receiverShard *shard, struct receiver *r) {
+    struct receiver **head = &shard->buckets[r->bucket % RECEIVER_BUCKETS];
+    r->bucketNext = *head;
+    r->bucketPrev = head;
+    if (*head)
+        (*head)->bucketPrev = &r->bucketNext;
+    *head = r;
+}
+
+// update lastSeen, moves the receiver to a newer bucket about once per RECEIVER_BUCKET_WIDTH
+static void receiverSeen(struct receiverShard *shard, struct receiver *r, uint64_t now) {
+    r->lastSeen = now;
+    uint64_t bucket = now / RECEIVER_BUCKET_WIDTH;
+    if (bucket > r->bucket) {
+        bucketUnlink(r);
+        r->bucket = bucket;
+        bucketLink(shard, r);
+    }
+}
+
+static void receiverSetBadExtent(struct receiverShard *shard, struct receiver *r, uint64_t now) {
+    r->badExtent = now;
+    r->badNext = shard->badExtent;
+    shard->badExtent = r;
+}
+
+static struct receiver *receiverCreate(struct receiverShard *shard, uint64_t id, uint32_t hash) {
+    struct receiver *r = receiverGet(id, hash);
     if (r)
         return r;
-    if (Modes.receiverCount > 4 * RECEIVER_TABLE_SIZE)
+    if (__atomic_load_n(&Modes.receiverCount, __ATOMIC_RELAXED) > 4 * RECEIVER_TABLE_SIZE)
         return NULL;
-    uint32_t hash = receiverHash(id);
     r = malloc(sizeof(struct receiver));
+    if (!r)
+        return NULL;
     *r = (struct receiver) {0};
     r->id = id;
     r->next = Modes.receiverTable[hash];
     r->firstSeen = r->lastSeen = mstime();
+    // never put a receiver in a bucket that was already expired
+    r->bucket = r->lastSeen / RECEIVER_BUCKET_WIDTH;
+    if (r->bucket < shard->expired)
+        r->bucket = shard->expired;
+    bucketLink(shard, r);
+    r->slot = registryAlloc(&Modes.receiverRegistry); // published once the caller has filled it in
     Modes.receiverTable[hash] = r;
-    Modes.receiverCount++;
-    if (Modes.receiverCount % (RECEIVER_TABLE_SIZE / 8) == 0)
-        fprintf(stderr, "receiverTable fill: %0.8f\n", Modes.receiverCount / (double) RECEIVER_TABLE_SIZE);
-    if (Modes.debug_receiver && Modes.receiverCount % 128 == 0)
-        fprintf(stderr, "receiverCount: %"PRIu64"\n", Modes.receiverCount);
+    shard->count++;
+    uint64_t count = __atomic_add_fetch(&Modes.receiverCount, 1, __ATOMIC_RELAXED);
+    if (count % (RECEIVER_TABLE_SIZE / 8) == 0)
+        fprintf(stderr, "receiverTable fill: %0.8f\n", count / (double) RECEIVER_TABLE_SIZE);
+    if (Modes.debug_receiver && count % 128 == 0)
+        fprintf(stderr, "receiverCount: %"PRIu64"\n", count);
     return r;
 }
-void receiverTimeout(int part, int nParts, uint64_t now) {
-    int stride = RECEIVER_TABLE_SIZE / nParts;
-    int start = stride * part;
-    int end = start + stride;
-    //fprintf(stderr, "START: %8d END: %8d\n", start, end);
-    for (int i = start; i < end; i++) {
-        struct receiver **r = &Modes.receiverTable[i];
-        struct receiver *del;
-        while (*r) {
-            /*
-            receiver *b = *r;
-            fprintf(stderr, "%016"PRIx64" %9"PRu64" %4.0f %4.0f %4.0f %4.0f\n",
-                    b->id, b->positionCounter,
-                    b->latMin, b->latMax, b->lonMin, b->lonMax);
-            */
-            if (
-                    (Modes.receiverCount > RECEIVER_TABLE_SIZE && (*r)->lastSeen < now - 20 * MINUTES)
-                    || (now > (*r)->lastSeen + 24 * HOURS)
-                    || ((*r)->badExtent && now > (*r)->badExtent + 30 * MINUTES)
-               ) {
-
-                del = *r;
-                *r = (*r)->next;
-                Modes.receiverCount--;
-                free(del);
-            } else {
-                r = &(*r)->next;
+
+static void receiverDelete(struct receiverShard *shard, struct receiver *del) {
+    struct receiver **r = &Modes.receiverTable[receiverHash(del->id)];
+    while (*r && *r != del)
+        r = &(*r)->next;
+    if (*r)
+        *r = del->next;
+
+    bucketUnlink(del);
+
+    if (del->badExtent) {
+        for (r = &shard->badExtent; *r; r = &(*r)->badNext) {
+            if (*r == del) {
+                *r = del->badNext;
+                break;
+            }
+        }
+    }
+    if (del->dirty) {
+        for (r = &shard->dirty; *r; r = &(*r)->dirtyNext) {
+            if (*r == del) {
+                *r = del->dirtyNext;
+                break;
             }
         }
     }
+
+    shard->count--;
+    __atomic_sub_fetch(&Modes.receiverCount, 1, __ATOMIC_RELAXED);
+    registryRelease(&Modes.receiverRegistry, del->slot);
+    free(del);
+}
+
+void receiverInit() {
+    uint64_t now = mstime();
+    for (int i = 0; i < RECEIVER_SHARDS; i++) {
+        struct receiverShard *shard = &Modes.receiverShards[i];
+        pthread_mutex_init(&shard->mutex, NULL);
+        shard->expired = now / RECEIVER_BUCKET_WIDTH;
+    }
 }
+
+static void shardTimeout(struct receiverShard *shard, uint64_t now) {
+    // publish changes held back by the rate limit
+    while (shard->dirty) {
+        struct receiver *r = shard->dirty;
+        shard->dirty = r->dirtyNext;
+        r->dirty = 0;
+        receiverPublish(shard, r, now, 1);
+    }
+
+    for (struct receiver **r = &shard->badExtent; *r;) {
+        if (now > (*r)->badExtent + 30 * MINUTES) {
+            // receiverDelete unlinks it from this list
+            receiverDelete(shard, *r);
+        } else {
+            r = &(*r)->badNext;
+        }
+    }
+
+    uint64_t maxAge = 24 * HOURS;
+    if (__atomic_load_n(&Modes.receiverCount, __ATOMIC_RELAXED) > RECEIVER_TABLE_SIZE)
+        maxAge = 20 * MINUTES;
+    if (now < maxAge)
+        return;
+
+    // every receiver in a bucket before the one containing now - maxAge is expired
+    uint64_t cutoff = (now - maxAge) / RECEIVER_BUCKET_WIDTH;
+    for (; shard->expired < cutoff; shard->expired++) {
+        struct receiver **head = &shard->buckets[shard->expired % RECEIVER_BUCKETS];
+        while (*head)
+            receiverDelete(shard, *head);
+    }
+    // the bucket containing the cutoff needs a closer look
+    for (struct receiver *r = shard->buckets[cutoff % RECEIVER_BUCKETS], *next; r; r = next) {
+        next = r->bucketNext;
+        if (r->lastSeen < now - maxAge)
+            receiverDelete(shard, r);
+    }
+}
+
+void receiverTimeout(uint64_t now) {
+    for (int i = 0; i < RECEIVER_SHARDS; i++) {
+        struct receiverShard *shard = &Modes.receiverShards[i];
+        pthread_mutex_lock(&shard->mutex);
+        shardTimeout(shard, now);
+        pthread_mutex_unlock(&shard->mutex);
+    }
+}
+
 void receiverCleanup() {
     for (int i = 0; i < RECEIVER_TABLE_SIZE; i++) {
         struct receiver *r = Modes.receiverTable[i];
@@ -81,19 +228,31 @@ void receiverCleanup() {
             free(r);
             r = next;
         }
+        Modes.receiverTable[i] = NULL;
     }
+    for (int i = 0; i < RECEIVER_SHARDS; i++)
+        pthread_mutex_destroy(&Modes.receiverShards[i].mutex);
 }
+
+// greatcircle() uses a sphere: 1 degree of latitude is 111.2 km, 1 degree of longitude at most that
+#define RANGE_INNER_DEG 3.5 // within this box in both directions the distance is below 800 km
+#define RANGE_OUTER_DEG 7.3 // a latitude difference above this is more than 800 km
+
 void receiverPositionReceived(struct aircraft *a, uint64_t id, double lat, double lon, uint64_t now) {
     if (bogus_lat_lon(lat, lon))
         return;
     if (lat > 85.0 || lat < -85.0 || lon < -175 || lon > 175)
         return;
-    struct receiver *r = receiverGet(id);
+    uint32_t hash;
+    struct receiverShard *shard = shardLock(id, &hash);
+    struct receiver *r = receiverGet(id, hash);
 
     if (!r || r->positionCounter == 0) {
-        r = receiverCreate(id);
-        if (!r)
+        r = receiverCreate(shard, id, hash);
+        if (!r) {
+            shardUnlock(shard);
             return;
+        }
         r->lonMin = lon;
         r->lonMax = lon;
         r->latMin = lat;
@@ -102,9 +261,9 @@ void receiverPositionReceived(struct aircraft *a, uint64_t id, double lat, doubl
     } else {
 
         // diff before applying new position
-        struct receiver before = *r;
-        double latDiff = before.latMax - before.latMin;
-        double lonDiff = before.lonMax - before.lonMin;
+        double latMin = r->latMin, latMax = r->latMax, lonMin = r->lonMin, lonMax = r->lonMax;
+        double latDiff = latMax - latMin;
+        double lonDiff = lonMax - lonMin;
 
 
         r->lonMin = fmin(r->lonMin, lon);
@@ -116,36 +275,57 @@ void receiverPositionReceived(struct aircraft *a, uint64_t id, double lat, doubl
         double rlat = r->latMin + latDiff / 2;
         double rlon = r->lonMin + lonDiff / 2;
 
-        double distance = greatcircle(rlat, rlon, lat, lon);
+        if (!r->badExtent) {
+            // bounding boxes around the reference decide most positions, the great circle distance
+            // is only needed close to the range limit
+            double dlat = fabs(lat - rlat);
+            double dlon = fabs(lon - rlon);
+            double distance = 0;
+            int outside;
+            if (dlat < RANGE_INNER_DEG && dlon < RANGE_INNER_DEG) {
+                outside = 0;
+            } else if (dlat > RANGE_OUTER_DEG) {
+                outside = 1;
+                distance = greatcircle(rlat, rlon, lat, lon); // for the event and debug output
+            } else {
+                distance = greatcircle(rlat, rlon, lat, lon);
+                outside = distance > RECEIVER_MAX_RANGE;
+            }
+
+            if (outside) {
+                receiverSetBadExtent(shard, r, now);
 
-        if (!r->badExtent && distance > RECEIVER_MAX_RANGE) {
-            r->badExtent = now;
+                recordEvent(REC_RECEIVER_EXTENT, now, a->addr, id, 1, 0, lat, lon, distance, r->positionCounter);
 
-            if (Modes.debug_receiver) {
-                fprintf(stderr, "receiverBadExtent: %0.0f nmi hex: %06x id: %016"PRIx64" #pos: %9"PRIu64" %12.5f %12.5f %4.0f %4.0f %4.0f %4.0f\n",
-                        distance / 1852.0, a->addr, r->id, r->positionCounter,
-                        lat, lon,
-                        before.latMin, before.latMax,
-                        before.lonMin, before.lonMax);
+                if (Modes.debug_receiver) {
+                    fprintf(stderr, "receiverBadExtent: %0.0f nmi hex: %06x id: %016"PRIx64" #pos: %9"PRIu64" %12.5f %12.5f %4.0f %4.0f %4.0f %4.0f\n",
+                            distance / 1852.0, a->addr, r->id, r->positionCounter,
+                            lat, lon,
+                            latMin, latMax,
+                            lonMin, lonMax);
+                }
             }
         }
     }
 
-    r->lastSeen = now;
+    receiverSeen(shard, r, now);
     r->positionCounter++;
     r->goodCounter++;
     r->badCounter = fmax(0, r->badCounter - 0.5);
+
+    receiverPublish(shard, r, now, 0);
+    shardUnlock(shard);
 }
 
-struct receiver *receiverGetReference(uint64_t id, double *lat, double *lon, struct aircraft *a) {
+int receiverGetReference(uint64_t id, double *lat, double *lon, struct aircraft *a) {
     MODES_NOTUSED(a);
-    struct receiver *r = receiverGet(id);
-    if (!r)
-        return NULL;
-    if (r->positionCounter < 100)
-        return NULL;
-    if (r->badExtent)
-        return NULL;
+    uint32_t hash;
+    struct receiverShard *shard = shardLock(id, &hash);
+    struct receiver *r = receiverGet(id, hash);
+    if (!r || r->positionCounter < 100 || r->badExtent) {
+        shardUnlock(shard);
+        return 0;
+    }
 
     double latDiff = r->latMax - r->latMin;
     double lonDiff = r->lonMax - r->lonMin;
@@ -162,26 +342,27 @@ struct receiver *receiverGetReference(uint64_t id, double *lat, double *lon, str
        }
        */
 
-    return r;
-    }
+    shardUnlock(shard);
+    return 1;
+}
 void receiverTest() {
     uint64_t now = mstime();
     for (uint64_t i = 0; i < (1<<22); i++) {
         uint64_t id = i << 22;
-        receiver *r = receiverGet(id);
-        if (!r)
-            r = receiverCreate(id);
-        if (r)
-            r->lastSeen = now;
+        uint32_t hash;
+        struct receiverShard *shard = shardLock(id, &hash);
+        receiverCreate(shard, id, hash);
+        shardUnlock(shard);
     }
     printf("%"PRIu64"\n", Modes.receiverCount);
     for (int i = 0; i < (1<<22); i++) {
-        receiver *r = receiverGet(i);
-        if (!r)
-            r = receiverCreate(i);
+        uint32_t hash;
+        struct receiverShard *shard = shardLock(i, &hash);
+        receiverCreate(shard, i, hash);
+        shardUnlock(shard);
     }
     printf("%"PRIu64"\n", Modes.receiverCount);
-    receiverTimeout(0, 1, mstime());
+    receiverTimeout(now + 25 * HOURS);
     printf("%"PRIu64"\n", Modes.receiverCount);
 }
 
@@ -190,22 +371,26 @@ static inline uint64_t timeout() {
 }
 
 int receiverCheckBad(uint64_t id, uint64_t now) {
-    struct receiver *r = receiverGet(id);
-    if (r && now + timeout() / 2 < r->timedOutUntil)
-        return 1;
-    else
-        return 0;
+    uint32_t hash;
+    struct receiverShard *shard = shardLock(id, &hash);
+    struct receiver *r = receiverGet(id, hash);
+    int bad = (r && now + timeout() / 2 < r->timedOutUntil);
+    shardUnlock(shard);
+    return bad;
 }
 
-struct receiver *receiverBad(uint64_t id, uint32_t addr, uint64_t now) {
-    struct receiver *r = receiverGet(id);
+int receiverBad(uint64_t id, uint32_t addr, uint64_t now, struct receiver *copy) {
+    uint32_t hash;
+    struct receiverShard *shard = shardLock(id, &hash);
+    struct receiver *r = receiverGet(id, hash);
 
     if (!r)
-        r = receiverCreate(id);
+        r = receiverCreate(shard, id, hash);
 
     if (r && now + timeout() / 2 > r->timedOutUntil) {
-        r->lastSeen = now;
+        receiverSeen(shard, r, now);
         r->badCounter++;
+        recordEvent(REC_RECEIVER_BAD, now, addr, id, r->badCounter > 5.99, 0, 0, 0, r->badCounter, r->goodCounter);
         if (r->badCounter > 5.99) {
             r->timedOutCounter++;
             if (Modes.debug_garbage) {
@@ -216,9 +401,14 @@ struct receiver *receiverBad(uint64_t id, uint32_t addr, uint64_t now) {
             r->goodCounter = 0;
             r->badCounter = 0;
         }
-        return r;
+        receiverPublish(shard, r, now, 0);
+        if (copy)
+            *copy = *r;
+        shardUnlock(shard);
+        return 1;
     } else {
-        return NULL;
+        shardUnlock(shard);
+        return 0;
     }
 }
 
@@ -234,35 +424,35 @@ struct char_buffer generateReceiversJson() {
     //p = safe_snprintf(p, end, "  \"columns\" : [ \"receiverId\", \"\"],\n");
     p = safe_snprintf(p, end, "  \"receivers\" : [\n");
 
-    struct receiver *r;
-
-    for (int j = 0; j < RECEIVER_TABLE_SIZE; j++) {
-        for (r = Modes.receiverTable[j]; r; r = r->next) {
-
-            // check if we have enough space
-            if ((p + 1000) >= end) {
-                int used = p - buf;
-                buflen *= 2;
-                buf = (char *) realloc(buf, buflen);
-                p = buf + used;
-                end = buf + buflen;
-            }
-
-            double elapsed = (r->lastSeen - r->firstSeen) / 1000.0 + 1.0;
-            p = safe_snprintf(p, end, "[ \"%016"PRIx64"\", %6.2f, %6.2f, %0.2f, %0.2f, %0.2f, %0.2f ],\n",
-                    r->id,
-                    r->positionCounter / elapsed,
-                    r->timedOutCounter * 3600.0 / elapsed,
-                    r->latMin,
-                    r->latMax,
-                    r->lonMin,
-                    r->lonMax);
-
-
-
-            if (p >= end)
-                fprintf(stderr, "buffer overrun client json\n");
+    struct registry *reg = &Modes.receiverRegistry;
+    uint32_t slots = registrySlots(reg);
+    struct receiverEntry r;
+
+    for (uint32_t slot = 0; slot < slots; slot++) {
+        if (!registryRead(reg, slot, &r))
+            continue;
+
+        // check if we have enough space
+        if ((p + 1000) >= end) {
+            int used = p - buf;
+            buflen *= 2;
+            buf = (char *) realloc(buf, buflen);
+            p = buf + used;
+            end = buf + buflen;
         }
+
+        double elapsed = (r.lastSeen - r.firstSeen) / 1000.0 + 1.0;
+        p = safe_snprintf(p, end, "[ \"%016"PRIx64"\", %6.2f, %6.2f, %0.2f, %0.2f, %0.2f, %0.2f ],\n",
+                r.id,
+                r.positionCounter / elapsed,
+                r.timedOutCounter * 3600.0 / elapsed,
+                r.latMin,
+                r.latMax,
+                r.lonMin,
+                r.lonMax);
+
+        if (p >= end)
+            fprintf(stderr, "buffer overrun client json\n");
     }
 
     if (*(p-2) == ',')
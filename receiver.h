@@ -4,6 +4,15 @@
 #define RECEIVER_TABLE_HASH_BITS 18
 #define RECEIVER_TABLE_SIZE (1 << RECEIVER_TABLE_HASH_BITS)
 
+// the table is split into shards by the top bits of the hash, each with its own lock,
+// so expiry and the json / registry work don't need the global lock
+#define RECEIVER_SHARD_BITS 4
+#define RECEIVER_SHARDS (1 << RECEIVER_SHARD_BITS)
+// receivers are kept in buckets by last seen time, expiry only looks at the oldest buckets
+// the buckets need to cover more than the 24 hour expiry
+#define RECEIVER_BUCKET_WIDTH (1 * MINUTES)
+#define RECEIVER_BUCKETS 2048
+
 typedef struct receiver {
     uint64_t id;
     struct receiver *next;
@@ -20,22 +29,38 @@ typedef struct receiver {
     // reset both counters on timing out a receiver.
     uint64_t timedOutUntil;
     uint32_t timedOutCounter; // how many times a receiver has been timed out
+    int32_t slot; // Modes.receiverRegistry
+    uint64_t published; // last time the registry entry was updated
+    uint64_t bucket; // lastSeen / RECEIVER_BUCKET_WIDTH when it was put in its bucket
+    struct receiver *bucketNext;
+    struct receiver **bucketPrev;
+    struct receiver *badNext; // shard list of receivers with badExtent
+    struct receiver *dirtyNext; // shard list of receivers with unpublished changes
+    int8_t dirty;
 } receiver;
 
+struct receiverShard {
+    pthread_mutex_t mutex;
+    uint64_t expired; // all buckets before this one are empty
+    uint64_t count;
+    struct receiver *buckets[RECEIVER_BUCKETS];
+    struct receiver *badExtent;
+    struct receiver *dirty;
+};
 
 uint32_t receiverHash(uint64_t id);
-struct receiver *receiverGet(uint64_t id);
-struct receiver *receiverCreate(uint64_t id);
 
 struct char_buffer generateReceiversJson();
 
+void receiverInit();
 void receiverPositionReceived(struct aircraft *a, uint64_t id, double lat, double lon, uint64_t now);
-void receiverTimeout(int part, int nParts, uint64_t now);
+void receiverTimeout(uint64_t now);
 void receiverCleanup();
 void receiverTest();
-struct receiver *receiverGetReference(uint64_t id, double *lat, double *lon, struct aircraft *a);
+int receiverGetReference(uint64_t id, double *lat, double *lon, struct aircraft *a);
 int receiverCheckBad(uint64_t id, uint64_t now);
-struct receiver *receiverBad(uint64_t id, uint32_t addr, uint64_t now);
+// copies the receiver to *r if not NULL
+int receiverBad(uint64_t id, uint32_t addr, uint64_t now, struct receiver *r);
 
 
 
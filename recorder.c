@@ -0,0 +1,254 @@
+#include "readsb.h"
+
+// each thread writes to its own ring, no locking on the hot path
+// a dump only reads, events overwritten while dumping are detected via head and dropped
+
+static struct recRing *rings[RECORDER_MAX_RINGS];
+static uint32_t ringCount;
+
+static _Thread_local struct recRing *localRing;
+static _Thread_local int localFailed;
+
+static struct recRing *getRing() {
+    if (localRing || localFailed)
+        return localRing;
+
+    uint32_t index = __atomic_fetch_add(&ringCount, 1, __ATOMIC_RELAXED);
+    if (index >= RECORDER_MAX_RINGS) {
+        localFailed = 1;
+        return NULL;
+    }
+    struct recRing *ring = calloc(1, sizeof(struct recRing));
+    if (!ring) {
+        fprintf(stderr, "recorder: out of memory!\n");
+        localFailed = 1;
+        return NULL;
+    }
+    snprintf(ring->name, sizeof(ring->name), "thread%u", index);
+    __atomic_store_n(&rings[index], ring, __ATOMIC_RELEASE);
+    localRing = ring;
+    return ring;
+}
+
+void recorderSetName(const char *name) {
+    struct recRing *ring = getRing();
+    if (!ring)
+        return;
+    strncpy(ring->name, name, sizeof(ring->name) - 1);
+}
+
+void recordEvent(recType type, uint64_t ts, uint32_t addr, uint64_t receiverId, int result, int flags,
+        double lat, double lon, float v1, float v2) {
+    struct recRing *ring = localRing;
+    if (!ring && !(ring = getRing()))
+        return;
+
+    uint64_t head = ring->head;
+    struct recEvent *ev = &ring->events[head & (RECORDER_RING_SIZE - 1)];
+
+    ev->ts = ts;
+    ev->receiverId = receiverId;
+    ev->addr = addr;
+    ev->type = type;
+    ev->flags = flags;
+    ev->result = result;
+    ev->lat = (int32_t) (lat * 1E6);
+    ev->lon = (int32_t) (lon * 1E6);
+    ev->v1 = v1;
+    ev->v2 = v2;
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int recorderDump(const char *file) {
+    char tmppath[PATH_MAX];
+    snprintf(tmppath, PATH_MAX, "%s.tmp", file);
+
+    FILE *out = fopen(tmppath, "w");
+    if (!out) {
+        fprintf(stderr, "recorderDump: %s: %s\n", tmppath, strerror(errno));
+        return -1;
+    }
+
+    struct recEvent *copy = malloc(RECORDER_RING_SIZE * sizeof(struct recEvent));
+    if (!copy) {
+        fclose(out);
+        return -1;
+    }
+
+    uint32_t nRings = min(__atomic_load_n(&ringCount, __ATOMIC_RELAXED), RECORDER_MAX_RINGS);
+    uint32_t eventSize = sizeof(struct recEvent);
+    uint64_t total = 0;
+
+    fwrite(RECORDER_MAGIC, 8, 1, out);
+    fwrite(&eventSize, sizeof(eventSize), 1, out);
+    fwrite(&nRings, sizeof(nRings), 1, out);
+
+    for (uint32_t i = 0; i < nRings; i++) {
+        struct recRing *ring = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+        char name[16] = { 0 };
+        uint64_t head = 0;
+        uint32_t count = 0;
+
+        if (ring) {
+            uint64_t before = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+            memcpy(copy, ring->events, RECORDER_RING_SIZE * sizeof(struct recEvent));
+            uint64_t after = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+            // the slot for event number 'after' might be in the process of being overwritten
+            uint64_t start = (before > RECORDER_RING_SIZE) ? before - RECORDER_RING_SIZE : 0;
+            if (after + 1 > RECORDER_RING_SIZE && after + 1 - RECORDER_RING_SIZE > start)
+                start = after + 1 - RECORDER_RING_SIZE;
+
+            head = before;
+            count = (before > start) ? before - start : 0;
+            memcpy(name, ring->name, sizeof(name) - 1);
+
+            fwrite(name, sizeof(name), 1, out);
+            fwrite(&head, sizeof(head), 1, out);
+            fwrite(&count, sizeof(count), 1, out);
+            for (uint64_t k = start; k < before; k++) {
+                fwrite(&copy[k & (RECORDER_RING_SIZE - 1)], sizeof(struct recEvent), 1, out);
+            }
+        } else {
+            fwrite(name, sizeof(name), 1, out);
+            fwrite(&head, sizeof(head), 1, out);
+            fwrite(&count, sizeof(count), 1, out);
+        }
+        total += count;
+    }
+
+    free(copy);
+
+    if (fclose(out) != 0 || rename(tmppath, file) != 0) {
+        fprintf(stderr, "recorderDump: %s: %s\n", file, strerror(errno));
+        unlink(tmppath);
+        return -1;
+    }
+
+    fprintf(stderr, "recorderDump: wrote %"PRIu64" events from %u threads to %s\n", total, nRings, file);
+    return 0;
+}
+
+struct recDecoded {
+    struct recEvent ev;
+    uint32_t ring;
+    uint64_t seq; // position in the file
+};
+
+static int compareDecoded(const void *p1, const void *p2) {
+    const struct recDecoded *d1 = p1;
+    const struct recDecoded *d2 = p2;
+    if (d1->ev.ts != d2->ev.ts)
+        return (d1->ev.ts > d2->ev.ts) - (d1->ev.ts < d2->ev.ts);
+    // keep the recording order for events with the same timestamp
+    return (d1->seq > d2->seq) - (d1->seq < d2->seq);
+}
+
+static const char *recTypeString(uint8_t type) {
+    switch (type) {
+        case REC_CPR_GLOBAL: return "cpr_global";
+        case REC_CPR_LOCAL: return "cpr_local";
+        case REC_CPR_RANGE: return "cpr_range";
+        case REC_SPEED_CHECK: return "speed_check";
+        case REC_RECEIVER_BAD: return "receiver_bad";
+        case REC_RECEIVER_EXTENT: return "receiver_extent";
+        case REC_TRACE_ADD: return "trace_add";
+        default: return "unknown";
+    }
+}
+
+int recorderDecode(const char *file) {
+    FILE *in = fopen(file, "r");
+    if (!in) {
+        fprintf(stderr, "recorderDecode: %s: %s\n", file, strerror(errno));
+        return -1;
+    }
+
+    char magic[8];
+    uint32_t eventSize = 0;
+    uint32_t nRings = 0;
+    if (fread(magic, 8, 1, in) != 1
+            || memcmp(magic, RECORDER_MAGIC, 8) != 0
+            || fread(&eventSize, sizeof(eventSize), 1, in) != 1
+            || fread(&nRings, sizeof(nRings), 1, in) != 1
+            || eventSize != sizeof(struct recEvent)
+            || nRings > RECORDER_MAX_RINGS) {
+        fprintf(stderr, "recorderDecode: %s: not a recorder dump or incompatible version\n", file);
+        fclose(in);
+        return -1;
+    }
+
+    char names[RECORDER_MAX_RINGS][16];
+    struct recDecoded *list = NULL;
+    uint64_t len = 0;
+    int err = 0;
+
+    for (uint32_t i = 0; i < nRings && !err; i++) {
+        uint64_t head;
+        uint32_t count;
+        if (fread(names[i], 16, 1, in) != 1
+                || fread(&head, sizeof(head), 1, in) != 1
+                || fread(&count, sizeof(count), 1, in) != 1
+                || count > RECORDER_RING_SIZE) {
+            err = 1;
+            break;
+        }
+        names[i][15] = '\0';
+        list = realloc(list, (len + count) * sizeof(struct recDecoded));
+        if (count && !list) {
+            err = 1;
+            break;
+        }
+        for (uint32_t k = 0; k < count; k++) {
+            if (fread(&list[len].ev, sizeof(struct recEvent), 1, in) != 1) {
+                err = 1;
+                break;
+            }
+            list[len].ring = i;
+            list[len].seq = len;
+            len++;
+        }
+    }
+    fclose(in);
+
+    if (err) {
+        fprintf(stderr, "recorderDecode: %s: truncated file\n", file);
+    }
+
+    qsort(list, len, sizeof(struct recDecoded), compareDecoded);
+
+    for (uint64_t i = 0; i < len; i++) {
+        struct recEvent *ev = &list[i].ev;
+        time_t secs = ev->ts / 1000;
+        struct tm utc;
+        char timebuf[32];
+        gmtime_r(&secs, &utc);
+        strftime(timebuf, sizeof(timebuf), "%F %T", &utc);
+
+        printf("%s.%03u %-10s %-15s %06x rId %016"PRIx64" %s%s%s result: %3d %11.6f %11.6f v1: %10.3f v2: %10.3f\n",
+                timebuf, (unsigned) (ev->ts % 1000),
+                names[list[i].ring],
+                recTypeString(ev->type),
+                ev->addr,
+                ev->receiverId,
+                (ev->flags & REC_SURFACE) ? "S" : "A",
+                (ev->flags & REC_ODD) ? "O" : "E",
+                (ev->flags & REC_MLAT) ? "M" : " ",
+                ev->result,
+                ev->lat / 1E6, ev->lon / 1E6,
+                ev->v1, ev->v2);
+    }
+
+    free(list);
+    return err ? -1 : 0;
+}
+
+void recorderCleanup() {
+    uint32_t nRings = min(ringCount, RECORDER_MAX_RINGS);
+    for (uint32_t i = 0; i < nRings; i++) {
+        free(rings[i]);
+        rings[i] = NULL;
+    }
+    ringCount = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+// flight recorder: per thread ring buffers of compact binary decision records
+// always on, dumped to Modes.recorder_file on SIGUSR1, decoded with --recorder-decode
+
+#define RECORDER_RING_BITS 14
+#define RECORDER_RING_SIZE (1 << RECORDER_RING_BITS)
+#define RECORDER_MAX_RINGS 32
+#define RECORDER_MAGIC "RSBREC01"
+
+typedef enum {
+    REC_NONE = 0,
+    REC_CPR_GLOBAL, // result of doGlobalCPR
+    REC_CPR_LOCAL, // result of doLocalCPR
+    REC_CPR_RANGE, // global CPR failed the max range check, v1: range
+    REC_SPEED_CHECK, // result: inrange, v1: distance, v2: allowed range
+    REC_RECEIVER_BAD, // result: 1 if the receiver was timed out, v1: badCounter
+    REC_RECEIVER_EXTENT, // receiver got a badExtent, v1: distance
+    REC_TRACE_ADD, // result: 0 not used, 1 position used, 2 buffered position used
+    REC_TYPES
+} recType;
+
+// flags
+#define REC_SURFACE (1 << 0)
+#define REC_ODD (1 << 1)
+#define REC_MLAT (1 << 2) // source is MLAT or worse
+
+struct recEvent {
+    uint64_t ts; // milliseconds
+    uint64_t receiverId;
+    uint32_t addr;
+    uint8_t type;
+    uint8_t flags;
+    int16_t result;
+    int32_t lat; // 1E6
+    int32_t lon; // 1E6
+    float v1;
+    float v2;
+};
+
+struct recRing {
+    uint64_t head; // number of events ever written to this ring
+    char name[16];
+    struct recEvent events[RECORDER_RING_SIZE];
+};
+
+void recordEvent(recType type, uint64_t ts, uint32_t addr, uint64_t receiverId, int result, int flags,
+        double lat, double lon, float v1, float v2);
+void recorderSetName(const char *name);
+int recorderDump(const char *file);
+int recorderDecode(const char *file);
+void recorderCleanup();
+
+#endif
@@ -0,0 +1,136 @@
+#include "readsb.h"
+
+struct regSlot {
+    uint32_t seq; // odd while the slot is being written
+    uint32_t active;
+    // entry follows
+};
+
+static inline struct regSlot *getSlot(struct registry *reg, int32_t slot) {
+    char *chunk = __atomic_load_n(&reg->chunks[slot >> REGISTRY_CHUNK_BITS], __ATOMIC_ACQUIRE);
+    return (struct regSlot *) (chunk + (size_t) (slot & (REGISTRY_CHUNK_SIZE - 1)) * reg->slotSize);
+}
+
+static void slotWrite(struct registry *reg, struct regSlot *s, const void *entry, uint32_t active) {
+    uint32_t seq = s->seq;
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    s->active = active;
+    if (entry)
+        memcpy(s + 1, entry, reg->entrySize);
+
+    __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void registryInit(struct registry *reg, const char *name, uint32_t entrySize) {
+    memset(reg, 0, sizeof(struct registry));
+    reg->name = name;
+    reg->entrySize = entrySize;
+    // keep the entries 8 byte aligned
+    reg->slotSize = (sizeof(struct regSlot) + entrySize + 7) & ~7;
+    pthread_mutex_init(&reg->mutex, NULL);
+}
+
+void registryDestroy(struct registry *reg) {
+    for (int i = 0; i < REGISTRY_CHUNKS; i++) {
+        free(reg->chunks[i]);
+        reg->chunks[i] = NULL;
+    }
+    free(reg->freeSlots);
+    reg->freeSlots = NULL;
+    reg->freeCount = reg->freeSize = 0;
+    reg->used = 0;
+    pthread_mutex_destroy(&reg->mutex);
+}
+
+static int32_t slotAlloc(struct registry *reg) {
+    if (reg->freeCount)
+        return reg->freeSlots[--reg->freeCount];
+
+    uint32_t slot = reg->used;
+    if (slot >= REGISTRY_CHUNKS * REGISTRY_CHUNK_SIZE) {
+        static uint64_t antiSpam;
+        uint64_t now = mstime();
+        if (now > antiSpam + 300 * SECONDS) {
+            fprintf(stderr, "registry %s full, not publishing new entries (suppressing for 5 minutes)\n", reg->name);
+            antiSpam = now;
+        }
+        return -1;
+    }
+
+    int c = slot >> REGISTRY_CHUNK_BITS;
+    if (!reg->chunks[c]) {
+        char *chunk = calloc(REGISTRY_CHUNK_SIZE, reg->slotSize);
+        if (!chunk) {
+            fprintf(stderr, "registry %s: out of memory\n", reg->name);
+            return -1;
+        }
+        __atomic_store_n(&reg->chunks[c], chunk, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&reg->used, slot + 1, __ATOMIC_RELEASE);
+    return slot;
+}
+
+int32_t registryAlloc(struct registry *reg) {
+    pthread_mutex_lock(&reg->mutex);
+    int32_t slot = slotAlloc(reg);
+    pthread_mutex_unlock(&reg->mutex);
+    return slot;
+}
+
+void registryPublish(struct registry *reg, int32_t slot, const void *entry) {
+    if (slot < 0)
+        return;
+    slotWrite(reg, getSlot(reg, slot), entry, 1);
+}
+
+void registryRelease(struct registry *reg, int32_t slot) {
+    if (slot < 0)
+        return;
+    slotWrite(reg, getSlot(reg, slot), NULL, 0);
+
+    pthread_mutex_lock(&reg->mutex);
+    if (reg->freeCount == reg->freeSize) {
+        uint32_t size = reg->freeSize ? 2 * reg->freeSize : 256;
+        int32_t *slots = realloc(reg->freeSlots, size * sizeof(int32_t));
+        if (!slots) {
+            pthread_mutex_unlock(&reg->mutex);
+            fprintf(stderr, "registry %s: out of memory\n", reg->name);
+            return; // the slot is lost, no harm done
+        }
+        reg->freeSlots = slots;
+        reg->freeSize = size;
+    }
+    reg->freeSlots[reg->freeCount++] = slot;
+    pthread_mutex_unlock(&reg->mutex);
+}
+
+int registryRead(struct registry *reg, int32_t slot, void *entry) {
+    if (slot < 0 || (uint32_t) slot >= registrySlots(reg))
+        return 0;
+
+    struct regSlot *s = getSlot(reg, slot);
+
+    // a writer only holds a slot for a memcpy, give up after a few tries
+    for (int tries = 0; tries < 1000; tries++) {
+        uint32_t before = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (before & 1)
+            continue;
+
+        uint32_t active = s->active;
+        if (active)
+            memcpy(entry, s + 1, reg->entrySize);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint32_t after = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+        if (before == after)
+            return active;
+    }
+    return 0;
+}
+
+uint32_t registrySlots(struct registry *reg) {
+    return __atomic_load_n(&reg->used, __ATOMIC_ACQUIRE);
+}
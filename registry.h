@@ -0,0 +1,75 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+// registry: stable slot IDs for network clients and receivers
+//
+// the decode side owns clients and receivers and publishes a copy of their counters
+// into the slot of the object, each slot is protected by a seqlock:
+// other threads (clients.json, receivers.json, prometheus output on the misc thread)
+// read consistent copies without walking lists that are modified concurrently
+// each slot has a single writer, the object owning it, slots are reused after being released
+// alloc / release take the registry mutex: receivers are released from the shard pass
+// without decodeMutex while the decode threads create receivers
+
+#define REGISTRY_CHUNK_BITS 10
+#define REGISTRY_CHUNK_SIZE (1 << REGISTRY_CHUNK_BITS)
+#define REGISTRY_CHUNKS 1024 // at most 1M slots per registry
+
+struct registry {
+    const char *name;
+    uint32_t entrySize; // bytes of one published entry
+    uint32_t slotSize; // entry plus seqlock header
+    uint32_t used; // slots handed out so far, readers look at 0 .. used - 1
+    char *chunks[REGISTRY_CHUNKS]; // allocated on demand, only freed on exit
+    int32_t *freeSlots; // stack of released slots
+    uint32_t freeCount;
+    uint32_t freeSize;
+    pthread_mutex_t mutex; // freeSlots, used, chunks
+};
+
+// published state of a network client (net_io.c)
+struct clientEntry {
+    uint64_t receiverId;
+    uint64_t receiverId2;
+    uint64_t connectedSince;
+    uint64_t bytesReceived;
+    uint64_t messageCounter;
+    uint64_t positionCounter;
+    uint64_t quarantineDropped;
+    uint64_t readCalls;
+    uint64_t compactions;
+    uint64_t zPlain; // compressed beast, 0 otherwise
+    uint64_t zCompressed;
+    uint64_t zCpu; // ms
+    int32_t readSize;
+    float quality;
+    int8_t quarantined;
+    char host[256]; // host:port or PROXY protocol string
+};
+
+// published state of a receiver (receiver.c)
+struct receiverEntry {
+    uint64_t id;
+    uint64_t firstSeen;
+    uint64_t lastSeen;
+    uint64_t positionCounter;
+    double latMin;
+    double latMax;
+    double lonMin;
+    double lonMax;
+    float badCounter;
+    int32_t goodCounter;
+    uint32_t timedOutCounter;
+};
+
+void registryInit(struct registry *reg, const char *name, uint32_t entrySize);
+void registryDestroy(struct registry *reg);
+// returns -1 if the registry is full
+int32_t registryAlloc(struct registry *reg);
+void registryPublish(struct registry *reg, int32_t slot, const void *entry);
+void registryRelease(struct registry *reg, int32_t slot);
+// copies the entry, returns 1 if the slot is in use
+int registryRead(struct registry *reg, int32_t slot, void *entry);
+uint32_t registrySlots(struct registry *reg);
+
+#endif
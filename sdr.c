@@ -41,10 +41,10 @@
 typedef struct {
     void (*initConfig)();
     bool(*handleOption)(int, char*);
-    bool(*open)();
-    void (*run)();
-    void (*cancel)();
-    void (*close)();
+    bool(*open)(struct sdrDevice *);
+    void (*run)(struct sdrDevice *);
+    void (*cancel)(struct sdrDevice *);
+    void (*close)(struct sdrDevice *);
     const char *name;
     sdr_type_t sdr_type;
     uint32_t padding;
@@ -60,21 +60,26 @@ static bool noHandleOption(int argc, char *argv) {
     return false;
 }
 
-static bool noOpen() {
+static bool noOpen(struct sdrDevice *sdr) {
+    MODES_NOTUSED(sdr);
     fprintf(stderr, "No SDR device or file selected.\n");
     return true;
 }
 
-static void noRun() {
+static void noRun(struct sdrDevice *sdr) {
+    MODES_NOTUSED(sdr);
 }
 
-static void noCancel() {
+static void noCancel(struct sdrDevice *sdr) {
+    MODES_NOTUSED(sdr);
 }
 
-static void noClose() {
+static void noClose(struct sdrDevice *sdr) {
+    MODES_NOTUSED(sdr);
 }
 
-static bool unsupportedOpen() {
+static bool unsupportedOpen(struct sdrDevice *sdr) {
+    MODES_NOTUSED(sdr);
     fprintf(stderr, "Support for this SDR type was not enabled in this build.\n");
     return false;
 }
@@ -111,6 +116,12 @@ void sdrInitConfig() {
     }
 }
 
+static void listTypes() {
+    for (int i = 0; sdr_handlers[i].name; ++i) {
+        fprintf(stderr, "  %s\n", sdr_handlers[i].name);
+    }
+}
+
 bool sdrHandleOption(int argc, char *argv) {
     switch (argc) {
         case OptDeviceType:
@@ -130,18 +141,16 @@ bool sdrHandleOption(int argc, char *argv) {
     }
 
     fprintf(stderr, "SDR type '%s' not recognized; supported SDR types are:\n", argv);
-    for (int i = 0; sdr_handlers[i].name; ++i) {
-        fprintf(stderr, "  %s\n", sdr_handlers[i].name);
-    }
+    listTypes();
 
     return false;
 }
 
-static sdr_handler *current_handler() {
+static sdr_handler *type_handler(sdr_type_t type) {
     static sdr_handler unsupported_handler = {noInitConfig, noHandleOption, unsupportedOpen, noRun, noCancel, noClose, "unsupported", SDR_NONE, 0};
 
     for (int i = 0; sdr_handlers[i].name; ++i) {
-        if (Modes.sdr_type == sdr_handlers[i].sdr_type) {
+        if (type == sdr_handlers[i].sdr_type) {
             return &sdr_handlers[i];
         }
     }
@@ -149,18 +158,305 @@ static sdr_handler *current_handler() {
     return &unsupported_handler;
 }
 
+// devices with a magnitude buffer ring, beast / gns are handled by the network code
+static int localType(sdr_type_t type) {
+    return type != SDR_NONE && type != SDR_MODESBEAST && type != SDR_GNS;
+}
+
+// --add-device <type>[,<device>[,<gain>]]
+// driver options other than device and gain are shared with the first device
+bool sdrAddDevice(char *arg) {
+    // the first slot is the device selected by --device-type
+    if (Modes.sdrDeviceCount == 0)
+        Modes.sdrDeviceCount = 1;
+
+    if (Modes.sdrDeviceCount >= SDR_DEVICES_MAX) {
+        fprintf(stderr, "--add-device: at most %d SDR devices are supported\n", SDR_DEVICES_MAX);
+        return false;
+    }
+
+    char *copy = strdup(arg);
+    char *saveptr = NULL;
+    char *type = strtok_r(copy, ",", &saveptr);
+    char *name = strtok_r(NULL, ",", &saveptr);
+    char *gain = strtok_r(NULL, ",", &saveptr);
+
+    sdr_handler *handler = NULL;
+    for (int i = 0; type && sdr_handlers[i].name; ++i) {
+        if (!strcasecmp(sdr_handlers[i].name, type))
+            handler = &sdr_handlers[i];
+    }
+    if (!handler || !localType(handler->sdr_type)) {
+        fprintf(stderr, "--add-device: '%s' is not a local SDR type; supported SDR types are:\n", type ? type : "");
+        listTypes();
+        free(copy);
+        return false;
+    }
+
+    struct sdrDevice *sdr = &Modes.sdrDevices[Modes.sdrDeviceCount];
+    sdr->index = Modes.sdrDeviceCount;
+    sdr->type = handler->sdr_type;
+    sdr->dev_name = name ? strdup(name) : NULL;
+    sdr->gain = gain ? (int) (atof(gain) * 10) : MODES_MAX_GAIN; // Gain is in tens of DBs
+
+    Modes.sdrDeviceCount++;
+    free(copy);
+    return true;
+}
+
+//
+// We read data using a thread per device, so the demod threads only handle
+// decoding without caring about data acquisition
+//
+static void *readerThreadEntryPoint(void *arg) {
+    struct sdrDevice *sdr = arg;
+    srandom(get_seed());
+
+    type_handler(sdr->type)->run(sdr);
+
+    // Wake the demod thread (if it's still waiting)
+    pthread_mutex_lock(&sdr->data_mutex);
+    if (!Modes.exit)
+        Modes.exit = 2; // unexpected exit
+    pthread_cond_signal(&sdr->data_cond);
+    pthread_mutex_unlock(&sdr->data_mutex);
+
+    pthread_exit(NULL);
+}
+
+static void *demodThreadEntryPoint(void *arg) {
+    struct sdrDevice *sdr = arg;
+    srandom(get_seed());
+
+    char name[16];
+    snprintf(name, sizeof(name), "demod%d", sdr->index);
+    recorderSetName(name);
+
+    int watchdogCounter = 50; // about 5 seconds
+    uint32_t maxSleep = 80; // in ms
+
+    pthread_mutex_lock(&sdr->data_mutex);
+    while (!Modes.exit) {
+        if (sdr->first_free_buffer == sdr->first_filled_buffer) {
+            // Nothing to process this time around.
+            if (--watchdogCounter <= 0) {
+                log_with_timestamp("No data received from SDR device %d for a long time, it may have wedged, exiting!", sdr->index);
+                Modes.exit = 1;
+                pthread_mutex_unlock(&sdr->data_mutex);
+                sdrCancel(sdr);
+                pthread_mutex_lock(&sdr->data_mutex);
+                break;
+            }
+
+            // we should be getting data every 50-60ms. wait for max 80 before checking the watchdog
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            incTimedwait(&ts, maxSleep);
+
+            // This unlocks data_mutex, and waits for data_cond
+            int err = pthread_cond_timedwait(&sdr->data_cond, &sdr->data_mutex, &ts);
+            if (err && err != ETIMEDOUT)
+                fprintf(stderr, "demod: pthread_cond_timedwait unexpected error: %s\n", strerror(err));
+            continue;
+        }
+        watchdogCounter = 50;
+
+        // FIFO is not empty, process one buffer.
+        struct mag_buf *buf = &sdr->mag_buffers[sdr->first_filled_buffer];
+
+        // copy out reader CPU time and reset it
+        struct timespec reader_cpu = sdr->reader_cpu_accumulator;
+        sdr->reader_cpu_accumulator.tv_sec = 0;
+        sdr->reader_cpu_accumulator.tv_nsec = 0;
+
+        // Process data after releasing the lock, so that the capturing
+        // thread can read data while we perform computationally expensive
+        // stuff at the same time.
+        pthread_mutex_unlock(&sdr->data_mutex);
+
+        // tracking isn't thread safe, the messages go to the tracker from within demodulate2400
+        pthread_mutex_lock(&Modes.decodeMutex);
+
+        struct timespec start_time;
+        struct timespec demod_cpu = { 0, 0 };
+        start_cpu_timing(&start_time);
+
+        demodulate2400(sdr, buf);
+        if (Modes.mode_ac) {
+            demodulate2400AC(sdr, buf);
+        }
+
+        end_cpu_timing(&start_time, &demod_cpu);
+
+        Modes.stats_current.samples_processed += buf->length;
+        Modes.stats_current.samples_dropped += buf->dropped;
+        add_timespecs(&demod_cpu, &Modes.stats_current.demod_cpu, &Modes.stats_current.demod_cpu);
+        add_timespecs(&reader_cpu, &Modes.stats_current.reader_cpu, &Modes.stats_current.reader_cpu);
+
+        sdr->stats.samples_processed += buf->length;
+        sdr->stats.samples_dropped += buf->dropped;
+        add_timespecs(&demod_cpu, &sdr->stats.demod_cpu, &sdr->stats.demod_cpu);
+        add_timespecs(&reader_cpu, &sdr->stats.reader_cpu, &sdr->stats.reader_cpu);
+
+        pthread_mutex_unlock(&Modes.decodeMutex);
+
+        // Mark the buffer we just processed as completed.
+        pthread_mutex_lock(&sdr->data_mutex);
+        sdr->first_filled_buffer = (sdr->first_filled_buffer + 1) % MODES_MAG_BUFFERS;
+        pthread_cond_signal(&sdr->data_cond);
+    }
+    pthread_mutex_unlock(&sdr->data_mutex);
+
+    pthread_exit(NULL);
+}
+
 bool sdrOpen() {
-    return current_handler()->open();
+    // the first device is configured by --device-type, --device and --gain
+    struct sdrDevice *first = &Modes.sdrDevices[0];
+    first->index = 0;
+    first->type = Modes.sdr_type;
+    first->dev_name = Modes.dev_name;
+    first->gain = Modes.gain;
+    if (Modes.sdrDeviceCount == 0)
+        Modes.sdrDeviceCount = 1;
+
+    for (int i = 0; i < Modes.sdrDeviceCount; i++) {
+        struct sdrDevice *sdr = &Modes.sdrDevices[i];
+
+        if (Modes.sdrDeviceCount > 1) {
+            // distinct and stable over restarts as long as the configuration doesn't change
+            char ident[256];
+            snprintf(ident, sizeof(ident), "%d,%s,%s", i, type_handler(sdr->type)->name, sdr->dev_name ? sdr->dev_name : "");
+            sdr->receiverId = fasthash64(ident, strlen(ident), 0x2127599bf4325c37ULL);
+        }
+
+        if (localType(sdr->type)) {
+            pthread_mutex_init(&sdr->data_mutex, NULL);
+            pthread_cond_init(&sdr->data_cond, NULL);
+
+            for (int k = 0; k < MODES_MAG_BUFFERS; ++k) {
+                if ((sdr->mag_buffers[k].data = calloc(MODES_MAG_BUF_SAMPLES + Modes.trailing_samples, sizeof (uint16_t))) == NULL) {
+                    fprintf(stderr, "Out of memory allocating magnitude buffer.\n");
+                    exit(1);
+                }
+
+                sdr->mag_buffers[k].length = 0;
+                sdr->mag_buffers[k].dropped = 0;
+                sdr->mag_buffers[k].sampleTimestamp = 0;
+            }
+        }
+
+        if (!type_handler(sdr->type)->open(sdr))
+            return false;
+
+        if (Modes.sdrDeviceCount > 1)
+            fprintf(stderr, "SDR device %d: %s %s, receiverId %016"PRIx64"\n", i,
+                    type_handler(sdr->type)->name, sdr->dev_name ? sdr->dev_name : "", sdr->receiverId);
+    }
+
+    return true;
+}
+
+void sdrStart() {
+    for (int i = 0; i < Modes.sdrDeviceCount; i++) {
+        struct sdrDevice *sdr = &Modes.sdrDevices[i];
+        if (!localType(sdr->type))
+            continue;
+        // Create the threads that read the data from the device and demodulate it
+        pthread_create(&sdr->reader_thread, NULL, readerThreadEntryPoint, sdr);
+        pthread_create(&sdr->demod_thread, NULL, demodThreadEntryPoint, sdr);
+        sdr->started = 1;
+    }
 }
 
-void sdrRun() {
-    return current_handler()->run();
+// Modes.exit must be set, decodeMutex must not be held
+void sdrStop() {
+    for (int i = 0; i < Modes.sdrDeviceCount; i++) {
+        struct sdrDevice *sdr = &Modes.sdrDevices[i];
+        if (!sdr->started)
+            continue;
+        pthread_mutex_lock(&sdr->data_mutex);
+        pthread_cond_broadcast(&sdr->data_cond);
+        pthread_mutex_unlock(&sdr->data_mutex);
+        pthread_join(sdr->demod_thread, NULL);
+    }
+
+    for (int i = 0; i < Modes.sdrDeviceCount; i++) {
+        struct sdrDevice *sdr = &Modes.sdrDevices[i];
+        if (!sdr->started)
+            continue;
+
+        log_with_timestamp("Waiting for receive thread termination");
+        int err = 0;
+        int count = 100;
+        // Wait on reader thread exit
+        while (count-- > 0 && (err = pthread_tryjoin_np(sdr->reader_thread, NULL))) {
+            // the reader might wait for buffer space
+            pthread_mutex_lock(&sdr->data_mutex);
+            pthread_cond_broadcast(&sdr->data_cond);
+            pthread_mutex_unlock(&sdr->data_mutex);
+            msleep(100);
+        }
+        if (err) {
+            log_with_timestamp("Receive thread termination failed, will raise SIGKILL on exit!");
+            Modes.exit = SIGKILL;
+        } else {
+            sdr->started = 0;
+            pthread_cond_destroy(&sdr->data_cond); // Thread cleanup - only after the reader thread is dead!
+            pthread_mutex_destroy(&sdr->data_mutex);
+        }
+    }
 }
 
-void sdrCancel() {
-    return current_handler()->cancel();
+void sdrCancel(struct sdrDevice *sdr) {
+    type_handler(sdr->type)->cancel(sdr);
 }
 
 void sdrClose() {
-    current_handler()->close();
+    for (int i = 0; i < Modes.sdrDeviceCount; i++) {
+        struct sdrDevice *sdr = &Modes.sdrDevices[i];
+
+        type_handler(sdr->type)->close(sdr);
+
+        for (int k = 0; k < MODES_MAG_BUFFERS; ++k) {
+            free(sdr->mag_buffers[k].data);
+            sdr->mag_buffers[k].data = NULL;
+        }
+        if (i > 0)
+            free(sdr->dev_name); // the first device uses Modes.dev_name
+        sdr->dev_name = NULL;
+    }
+    Modes.sdrDeviceCount = 0;
+}
+
+// called under decodeMutex
+void sdrStatsUpdate() {
+    for (int i = 0; i < Modes.sdrDeviceCount; i++) {
+        struct sdrDevice *sdr = &Modes.sdrDevices[i];
+        sdr->statsReported = sdr->stats;
+    }
+}
+
+char *appendSdrJson(char *p, char *end) {
+    p = safe_snprintf(p, end, "\"sdr\":[");
+    int first = 1;
+    for (int i = 0; i < Modes.sdrDeviceCount; i++) {
+        struct sdrDevice *sdr = &Modes.sdrDevices[i];
+        if (!localType(sdr->type))
+            continue;
+        struct sdrStats *st = &sdr->statsReported;
+        uint64_t demod_cpu = (uint64_t) st->demod_cpu.tv_sec * 1000UL + st->demod_cpu.tv_nsec / 1000000UL;
+        uint64_t reader_cpu = (uint64_t) st->reader_cpu.tv_sec * 1000UL + st->reader_cpu.tv_nsec / 1000000UL;
+        p = safe_snprintf(p, end,
+                "%s{\"index\":%d,\"type\":\"%s\",\"receiver_id\":\"%016"PRIx64"\",\"gain\":%.1f"
+                ",\"samples_processed\":%"PRIu64",\"samples_dropped\":%"PRIu64",\"messages\":%"PRIu64
+                ",\"demod_cpu\":%"PRIu64",\"reader_cpu\":%"PRIu64"}",
+                first ? "" : ",",
+                sdr->index, type_handler(sdr->type)->name, sdr->receiverId, sdr->gain / 10.0,
+                st->samples_processed, st->samples_dropped, st->messages,
+                demod_cpu, reader_cpu);
+        first = 0;
+    }
+    p = safe_snprintf(p, end, "]");
+    return p;
 }
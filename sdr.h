@@ -26,12 +26,22 @@
 #define SDR_H
 
 // Common interface to different SDR inputs.
+//
+// Several local devices can run at the same time (--add-device), each has its own
+// reader thread, magnitude buffer ring and demod thread.
+// All of them feed the one tracker, demodulation and tracking are serialized by decodeMutex.
+
+struct sdrDevice;
 
 void sdrInitConfig ();
 bool sdrHandleOption (int argc, char *argv);
+bool sdrAddDevice (char *arg);
 bool sdrOpen ();
-void sdrRun ();
-void sdrCancel();
+void sdrStart ();
+void sdrStop ();
+void sdrCancel (struct sdrDevice *sdr);
 void sdrClose ();
+void sdrStatsUpdate ();
+char *appendSdrJson (char *p, char *end);
 
 #endif
@@ -93,8 +93,9 @@ static void signalHandlerIO (int sig, siginfo_t *siginfo, void *context)
     }
 }
 
-bool beastOpen(void)
+bool beastOpen(struct sdrDevice *sdr)
 {
+    MODES_NOTUSED(sdr);
     struct termios tios;
     struct sigaction saio;
     saio.sa_sigaction = &signalHandlerIO;
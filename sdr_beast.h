@@ -22,7 +22,7 @@
 
 void beastInitConfig();
 bool beastHandleOption(int argc, char *argv);
-bool beastOpen();
+bool beastOpen(struct sdrDevice *sdr);
 void beastRun();
 void beastClose();
 
@@ -37,6 +37,7 @@ static struct {
     struct bladerf *device;
     iq_convert_fn converter;
     struct converter_state *converter_state;
+    struct sdrDevice *sdr; // only one device of this type per process
 } BladeRF;
 
 void bladeRFInitConfig() {
@@ -148,7 +149,13 @@ static void show_config() {
 
 }
 
-bool bladeRFOpen() {
+bool bladeRFOpen(struct sdrDevice *sdr) {
+    if (BladeRF.sdr && BladeRF.sdr != sdr) {
+        fprintf(stderr, "bladerf: only one device of this type is supported\n");
+        return false;
+    }
+    BladeRF.sdr = sdr;
+
     if (BladeRF.device) {
         return true;
     }
@@ -156,7 +163,7 @@ bool bladeRFOpen() {
     int status;
 
     bladerf_set_usb_reset_on_open(true);
-    if ((status = bladerf_open(&BladeRF.device, Modes.dev_name)) < 0) {
+    if ((status = bladerf_open(&BladeRF.device, sdr->dev_name)) < 0) {
         fprintf(stderr, "Failed to open bladeRF: %s\n", bladerf_strerror(status));
         goto error;
     }
@@ -231,7 +238,7 @@ bool bladeRFOpen() {
         goto error;
     }
 
-    if ((status = bladerf_set_gain(BladeRF.device, BLADERF_MODULE_RX, Modes.gain / 10.0)) < 0) {
+    if ((status = bladerf_set_gain(BladeRF.device, BLADERF_MODULE_RX, sdr->gain / 10.0)) < 0) {
         fprintf(stderr, "bladerf_set_gain(RX) failed: %s\n", bladerf_strerror(status));
         goto error;
     }
@@ -289,35 +296,36 @@ static void *handle_bladerf_samples(struct bladerf *dev,
     static uint64_t nextTimestamp = 0;
     static bool dropping = false;
 
+    struct sdrDevice *sdr = user_data;
+
     MODES_NOTUSED(dev);
     MODES_NOTUSED(stream);
     MODES_NOTUSED(meta);
-    MODES_NOTUSED(user_data);
     MODES_NOTUSED(num_samples);
 
     // record initial time for later sys timestamp calculation
     uint64_t entryTimestamp = mstime();
 
-    pthread_mutex_lock(&Modes.data_mutex);
+    pthread_mutex_lock(&sdr->data_mutex);
     if (Modes.exit) {
-        pthread_mutex_unlock(&Modes.data_mutex);
+        pthread_mutex_unlock(&sdr->data_mutex);
         return BLADERF_STREAM_SHUTDOWN;
     }
 
-    unsigned next_free_buffer = (Modes.first_free_buffer + 1) % MODES_MAG_BUFFERS;
-    struct mag_buf *outbuf = &Modes.mag_buffers[Modes.first_free_buffer];
-    struct mag_buf *lastbuf = &Modes.mag_buffers[(Modes.first_free_buffer + MODES_MAG_BUFFERS - 1) % MODES_MAG_BUFFERS];
-    unsigned free_bufs = (Modes.first_filled_buffer - next_free_buffer + MODES_MAG_BUFFERS) % MODES_MAG_BUFFERS;
+    unsigned next_free_buffer = (sdr->first_free_buffer + 1) % MODES_MAG_BUFFERS;
+    struct mag_buf *outbuf = &sdr->mag_buffers[sdr->first_free_buffer];
+    struct mag_buf *lastbuf = &sdr->mag_buffers[(sdr->first_free_buffer + MODES_MAG_BUFFERS - 1) % MODES_MAG_BUFFERS];
+    unsigned free_bufs = (sdr->first_filled_buffer - next_free_buffer + MODES_MAG_BUFFERS) % MODES_MAG_BUFFERS;
 
     if (free_bufs == 0 || (dropping && free_bufs < MODES_MAG_BUFFERS / 2)) {
         // FIFO is full. Drop this block.
         dropping = true;
-        pthread_mutex_unlock(&Modes.data_mutex);
+        pthread_mutex_unlock(&sdr->data_mutex);
         return samples;
     }
 
     dropping = false;
-    pthread_mutex_unlock(&Modes.data_mutex);
+    pthread_mutex_unlock(&sdr->data_mutex);
 
     // Copy trailing data from last block (or reset if not valid)
     if (outbuf->dropped == 0) {
@@ -404,24 +412,24 @@ static void *handle_bladerf_samples(struct bladerf *dev,
         outbuf->mean_power /= blocks_processed;
 
         // Push the new data to the demodulation thread
-        pthread_mutex_lock(&Modes.data_mutex);
+        pthread_mutex_lock(&sdr->data_mutex);
 
         // accumulate CPU while holding the mutex, and restart measurement
-        end_cpu_timing(&thread_cpu, &Modes.reader_cpu_accumulator);
+        end_cpu_timing(&thread_cpu, &sdr->reader_cpu_accumulator);
         start_cpu_timing(&thread_cpu);
 
-        Modes.mag_buffers[next_free_buffer].dropped = 0;
-        Modes.mag_buffers[next_free_buffer].length = 0; // just in case
-        Modes.first_free_buffer = next_free_buffer;
+        sdr->mag_buffers[next_free_buffer].dropped = 0;
+        sdr->mag_buffers[next_free_buffer].length = 0; // just in case
+        sdr->first_free_buffer = next_free_buffer;
 
-        pthread_cond_signal(&Modes.data_cond);
-        pthread_mutex_unlock(&Modes.data_mutex);
+        pthread_cond_signal(&sdr->data_cond);
+        pthread_mutex_unlock(&sdr->data_mutex);
     }
 
     return samples;
 }
 
-void bladeRFRun() {
+void bladeRFRun(struct sdrDevice *sdr) {
     if (!BladeRF.device) {
         return;
     }
@@ -440,7 +448,7 @@ void bladeRFRun() {
             BLADERF_FORMAT_SC16_Q11_META,
             /* samples_per_buffer */ MODES_MAG_BUF_SAMPLES,
             /* num_transfers */ transfers,
-            /* user_data */ NULL)) < 0) {
+            /* user_data */ sdr)) < 0) {
         fprintf(stderr, "bladerf_init_stream() failed: %s\n", bladerf_strerror(status));
         goto out;
     }
@@ -480,7 +488,10 @@ out:
     }
 }
 
-void bladeRFClose() {
+void bladeRFClose(struct sdrDevice *sdr) {
+    if (sdr != BladeRF.sdr)
+        return;
+
     if (BladeRF.converter) {
         cleanup_converter(BladeRF.converter_state);
         BladeRF.converter = NULL;
@@ -491,4 +502,6 @@ void bladeRFClose() {
         bladerf_close(BladeRF.device);
         BladeRF.device = NULL;
     }
+
+    BladeRF.sdr = NULL;
 }
@@ -28,8 +28,8 @@
 
 void bladeRFInitConfig ();
 bool bladeRFHandleOption (int argc, char *argv);
-bool bladeRFOpen ();
-void bladeRFRun ();
-void bladeRFClose ();
+bool bladeRFOpen (struct sdrDevice *sdr);
+void bladeRFRun (struct sdrDevice *sdr);
+void bladeRFClose (struct sdrDevice *sdr);
 
 #endif
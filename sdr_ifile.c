@@ -55,28 +55,28 @@
 #include "readsb.h"
 #include "sdr_ifile.h"
 
+// options, shared by all ifile devices
 static struct {
     input_format_t input_format;
-    int fd;
-    unsigned bytes_per_sample;
     bool throttle;
     uint8_t padding1;
     uint16_t padding2;
+    const char *filename;
+} ifile;
+
+// per device state
+struct ifileDevice {
+    int fd;
+    unsigned bytes_per_sample;
     void *readbuf;
     iq_convert_fn converter;
     struct converter_state *converter_state;
-    const char *filename;
-} ifile;
+};
 
 void ifileInitConfig(void) {
     ifile.filename = NULL;
     ifile.input_format = INPUT_UC8;
     ifile.throttle = false;
-    ifile.fd = -1;
-    ifile.bytes_per_sample = 0;
-    ifile.readbuf = NULL;
-    ifile.converter = NULL;
-    ifile.converter_state = NULL;
 }
 
 bool ifileHandleOption(int argc, char *argv) {
@@ -112,55 +112,67 @@ bool ifileHandleOption(int argc, char *argv) {
 // instead of using an RTLSDR device
 //
 
-bool ifileOpen(void) {
-    if (!ifile.filename) {
+bool ifileOpen(struct sdrDevice *sdr) {
+    // additional devices take the file name from --add-device
+    const char *filename = sdr->index ? sdr->dev_name : ifile.filename;
+    if (!filename) {
         fprintf(stderr, "SDR type 'ifile' requires an --ifile argument\n");
         return false;
     }
 
-    if (!strcmp(ifile.filename, "-")) {
-        ifile.fd = STDIN_FILENO;
-    } else if ((ifile.fd = open(ifile.filename, O_RDONLY)) < 0) {
+    struct ifileDevice *dev = calloc(1, sizeof(struct ifileDevice));
+    if (!dev) {
+        fprintf(stderr, "ifile: out of memory\n");
+        return false;
+    }
+    dev->fd = -1;
+    sdr->driver = dev;
+
+    if (!strcmp(filename, "-")) {
+        dev->fd = STDIN_FILENO;
+    } else if ((dev->fd = open(filename, O_RDONLY)) < 0) {
         fprintf(stderr, "ifile: could not open %s: %s\n",
-                ifile.filename, strerror(errno));
+                filename, strerror(errno));
+        ifileClose(sdr);
         return false;
     }
 
     switch (ifile.input_format) {
         case INPUT_UC8:
-            ifile.bytes_per_sample = 2;
+            dev->bytes_per_sample = 2;
             break;
         case INPUT_SC16:
         case INPUT_SC16Q11:
-            ifile.bytes_per_sample = 4;
+            dev->bytes_per_sample = 4;
             break;
         default:
             fprintf(stderr, "ifile: unhandled input format\n");
-            ifileClose();
+            ifileClose(sdr);
             return false;
     }
 
-    if (!(ifile.readbuf = malloc(MODES_MAG_BUF_SAMPLES * ifile.bytes_per_sample))) {
+    if (!(dev->readbuf = malloc(MODES_MAG_BUF_SAMPLES * dev->bytes_per_sample))) {
         fprintf(stderr, "ifile: failed to allocate read buffer\n");
-        ifileClose();
+        ifileClose(sdr);
         return false;
     }
 
-    ifile.converter = init_converter(ifile.input_format,
+    dev->converter = init_converter(ifile.input_format,
             Modes.sample_rate,
             Modes.dc_filter,
-            &ifile.converter_state);
-    if (!ifile.converter) {
+            &dev->converter_state);
+    if (!dev->converter) {
         fprintf(stderr, "ifile: can't initialize sample converter\n");
-        ifileClose();
+        ifileClose(sdr);
         return false;
     }
 
     return true;
 }
 
-void ifileRun() {
-    if (ifile.fd < 0)
+void ifileRun(struct sdrDevice *sdr) {
+    struct ifileDevice *dev = sdr->driver;
+    if (!dev || dev->fd < 0)
         return;
 
     int eof = 0;
@@ -173,7 +185,7 @@ void ifileRun() {
 
     clock_gettime(CLOCK_MONOTONIC, &next_buffer_delivery);
 
-    pthread_mutex_lock(&Modes.data_mutex);
+    pthread_mutex_lock(&sdr->data_mutex);
     while (!Modes.exit && !eof) {
         ssize_t nread, toread;
         void *r;
@@ -181,16 +193,16 @@ void ifileRun() {
         unsigned next_free_buffer;
         unsigned slen;
 
-        next_free_buffer = (Modes.first_free_buffer + 1) % MODES_MAG_BUFFERS;
-        if (next_free_buffer == Modes.first_filled_buffer) {
+        next_free_buffer = (sdr->first_free_buffer + 1) % MODES_MAG_BUFFERS;
+        if (next_free_buffer == sdr->first_filled_buffer) {
             // no space for output yet
-            pthread_cond_wait(&Modes.data_cond, &Modes.data_mutex);
+            pthread_cond_wait(&sdr->data_cond, &sdr->data_mutex);
             continue;
         }
 
-        outbuf = &Modes.mag_buffers[Modes.first_free_buffer];
-        lastbuf = &Modes.mag_buffers[(Modes.first_free_buffer + MODES_MAG_BUFFERS - 1) % MODES_MAG_BUFFERS];
-        pthread_mutex_unlock(&Modes.data_mutex);
+        outbuf = &sdr->mag_buffers[sdr->first_free_buffer];
+        lastbuf = &sdr->mag_buffers[(sdr->first_free_buffer + MODES_MAG_BUFFERS - 1) % MODES_MAG_BUFFERS];
+        pthread_mutex_unlock(&sdr->data_mutex);
 
         // Compute the sample timestamp for the start of the block
         outbuf->sampleTimestamp = sampleCounter * 12e6 / Modes.sample_rate;
@@ -206,10 +218,10 @@ void ifileRun() {
         // Get the system time for the start of this block
         outbuf->sysTimestamp = mstime();
 
-        toread = MODES_MAG_BUF_SAMPLES * ifile.bytes_per_sample;
-        r = ifile.readbuf;
+        toread = MODES_MAG_BUF_SAMPLES * dev->bytes_per_sample;
+        r = dev->readbuf;
         while (toread) {
-            nread = read(ifile.fd, r, toread);
+            nread = read(dev->fd, r, toread);
             if (nread <= 0) {
                 if (nread < 0) {
                     fprintf(stderr, "ifile: error reading input file: %s\n", strerror(errno));
@@ -222,10 +234,10 @@ void ifileRun() {
             toread -= nread;
         }
 
-        slen = outbuf->length = MODES_MAG_BUF_SAMPLES - toread / ifile.bytes_per_sample;
+        slen = outbuf->length = MODES_MAG_BUF_SAMPLES - toread / dev->bytes_per_sample;
 
         // Convert the new data
-        ifile.converter(ifile.readbuf, &outbuf->data[Modes.trailing_samples], slen, ifile.converter_state, &outbuf->mean_level, &outbuf->mean_power);
+        dev->converter(dev->readbuf, &outbuf->data[Modes.trailing_samples], slen, dev->converter_state, &outbuf->mean_level, &outbuf->mean_power);
 
         if (ifile.throttle || Modes.interactive) {
             // Wait until we are allowed to release this buffer to the main thread
@@ -237,36 +249,41 @@ void ifileRun() {
             normalize_timespec(&next_buffer_delivery);
         }
 
-        // Push the new data to the main thread
-        pthread_mutex_lock(&Modes.data_mutex);
-        Modes.first_free_buffer = next_free_buffer;
+        // Push the new data to the demod thread
+        pthread_mutex_lock(&sdr->data_mutex);
+        sdr->first_free_buffer = next_free_buffer;
         // accumulate CPU while holding the mutex, and restart measurement
-        end_cpu_timing(&thread_cpu, &Modes.reader_cpu_accumulator);
+        end_cpu_timing(&thread_cpu, &sdr->reader_cpu_accumulator);
         start_cpu_timing(&thread_cpu);
-        pthread_cond_signal(&Modes.data_cond);
+        pthread_cond_signal(&sdr->data_cond);
     }
 
-    // Wait for the main thread to consume all data
-    while (!Modes.exit && Modes.first_filled_buffer != Modes.first_free_buffer)
-        pthread_cond_wait(&Modes.data_cond, &Modes.data_mutex);
+    // Wait for the demod thread to consume all data
+    while (!Modes.exit && sdr->first_filled_buffer != sdr->first_free_buffer)
+        pthread_cond_wait(&sdr->data_cond, &sdr->data_mutex);
 
-    pthread_mutex_unlock(&Modes.data_mutex);
+    pthread_mutex_unlock(&sdr->data_mutex);
 }
 
-void ifileClose() {
-    if (ifile.converter) {
-        cleanup_converter(ifile.converter_state);
-        ifile.converter = NULL;
-        ifile.converter_state = NULL;
-    }
+void ifileClose(struct sdrDevice *sdr) {
+    struct ifileDevice *dev = sdr->driver;
+    if (!dev)
+        return;
 
-    if (ifile.readbuf) {
-        free(ifile.readbuf);
-        ifile.readbuf = NULL;
+    if (dev->converter) {
+        cleanup_converter(dev->converter_state);
+        dev->converter = NULL;
+        dev->converter_state = NULL;
     }
 
-    if (ifile.fd >= 0 && ifile.fd != STDIN_FILENO) {
-        close(ifile.fd);
-        ifile.fd = -1;
+    free(dev->readbuf);
+    dev->readbuf = NULL;
+
+    if (dev->fd >= 0 && dev->fd != STDIN_FILENO) {
+        close(dev->fd);
+        dev->fd = -1;
     }
+
+    free(dev);
+    sdr->driver = NULL;
 }
@@ -29,8 +29,8 @@
 
 void ifileInitConfig ();
 bool ifileHandleOption (int argc, char *argv);
-bool ifileOpen ();
-void ifileRun ();
-void ifileClose ();
+bool ifileOpen (struct sdrDevice *sdr);
+void ifileRun (struct sdrDevice *sdr);
+void ifileClose (struct sdrDevice *sdr);
 
 #endif
@@ -35,6 +35,7 @@ static struct {
     struct converter_state *converter_state;
     char *uri;
     char *network;
+    struct sdrDevice *sdr; // only one device of this type per process
 } PLUTOSDR;
 
 static struct timespec thread_cpu;
@@ -61,8 +62,14 @@ bool plutosdrHandleOption(int argc, char *argv)
     return true;
 }
 
-bool plutosdrOpen()
+bool plutosdrOpen(struct sdrDevice *sdr)
 {
+    if (PLUTOSDR.sdr) {
+        fprintf(stderr, "plutosdr: only one device of this type is supported\n");
+        return false;
+    }
+    PLUTOSDR.sdr = sdr;
+
     PLUTOSDR.ctx = iio_create_default_context();
     if (PLUTOSDR.ctx == NULL && PLUTOSDR.uri != NULL) {
         PLUTOSDR.ctx = iio_create_context_from_uri(PLUTOSDR.uri);
@@ -94,7 +101,7 @@ bool plutosdrOpen()
     int device_count = iio_context_get_devices_count(PLUTOSDR.ctx);
     if (!device_count) {
         fprintf(stderr, "plutosdr: No supported PLUTOSDR devices found.\n");
-        plutosdrClose();
+        plutosdrClose(sdr);
     }
     fprintf(stderr, "plutosdr: Context has %d device(s).\n", device_count);
 
@@ -102,7 +109,7 @@ bool plutosdrOpen()
 
     if (PLUTOSDR.dev == NULL) {
         fprintf(stderr, "plutosdr: Error opening the PLUTOSDR device: %s\n", strerror(errno));
-        plutosdrClose();
+        plutosdrClose(sdr);
     }
 
     struct iio_channel* phy_chn = iio_device_find_channel(iio_context_find_device(PLUTOSDR.ctx, "ad9361-phy"), "voltage0", false);
@@ -110,14 +117,14 @@ bool plutosdrOpen()
     iio_channel_attr_write_longlong(phy_chn, "rf_bandwidth", (long long)1750000);
     iio_channel_attr_write_longlong(phy_chn, "sampling_frequency", (long long)Modes.sample_rate);
 
-    if (Modes.gain == MODES_AUTO_GAIN) {
+    if (sdr->gain == MODES_AUTO_GAIN) {
         iio_channel_attr_write(phy_chn, "gain_control_mode", "slow_attack");
     } else {
         // We use 10th of dB here, max is 77dB up to 1300MHz
-        if (Modes.gain > 770)
-            Modes.gain = 770;
+        if (sdr->gain > 770)
+            sdr->gain = 770;
         iio_channel_attr_write(phy_chn, "gain_control_mode", "manual");
-        iio_channel_attr_write_longlong(phy_chn, "hardwaregain", Modes.gain / 10);
+        iio_channel_attr_write_longlong(phy_chn, "hardwaregain", sdr->gain / 10);
     }
 
     iio_channel_attr_write_bool(
@@ -149,7 +156,7 @@ bool plutosdrOpen()
 
     if (!(PLUTOSDR.readbuf = malloc(MODES_RTL_BUF_SIZE * 4))) {
         fprintf(stderr, "plutosdr: Failed to allocate read buffer\n");
-        plutosdrClose();
+        plutosdrClose(sdr);
         return false;
     }
 
@@ -159,13 +166,13 @@ bool plutosdrOpen()
             &PLUTOSDR.converter_state);
     if (!PLUTOSDR.converter) {
         fprintf(stderr, "plutosdr: Can't initialize sample converter\n");
-        plutosdrClose();
+        plutosdrClose(sdr);
         return false;
     }
     return true;
 }
 
-static void plutosdrCallback(int16_t *buf, uint32_t len) {
+static void plutosdrCallback(struct sdrDevice *sdr, int16_t *buf, uint32_t len) {
     struct mag_buf *outbuf;
     struct mag_buf *lastbuf;
     uint32_t slen;
@@ -177,12 +184,12 @@ static void plutosdrCallback(int16_t *buf, uint32_t len) {
     static int dropping = 0;
     static uint64_t sampleCounter = 0;
 
-    pthread_mutex_lock(&Modes.data_mutex);
+    pthread_mutex_lock(&sdr->data_mutex);
 
-    next_free_buffer = (Modes.first_free_buffer + 1) % MODES_MAG_BUFFERS;
-    outbuf = &Modes.mag_buffers[Modes.first_free_buffer];
-    lastbuf = &Modes.mag_buffers[(Modes.first_free_buffer + MODES_MAG_BUFFERS - 1) % MODES_MAG_BUFFERS];
-    free_bufs = (Modes.first_filled_buffer - next_free_buffer + MODES_MAG_BUFFERS) % MODES_MAG_BUFFERS;
+    next_free_buffer = (sdr->first_free_buffer + 1) % MODES_MAG_BUFFERS;
+    outbuf = &sdr->mag_buffers[sdr->first_free_buffer];
+    lastbuf = &sdr->mag_buffers[(sdr->first_free_buffer + MODES_MAG_BUFFERS - 1) % MODES_MAG_BUFFERS];
+    free_bufs = (sdr->first_filled_buffer - next_free_buffer + MODES_MAG_BUFFERS) % MODES_MAG_BUFFERS;
 
     if (len != MODES_RTL_BUF_SIZE) {
         fprintf(stderr, "weirdness: plutosdr gave us a block with an unusual size (got %u bytes, expected %u bytes)\n",
@@ -209,12 +216,12 @@ static void plutosdrCallback(int16_t *buf, uint32_t len) {
         dropping = 1;
         outbuf->dropped += slen;
         sampleCounter += slen;
-        pthread_mutex_unlock(&Modes.data_mutex);
+        pthread_mutex_unlock(&sdr->data_mutex);
         return;
     }
 
     dropping = 0;
-    pthread_mutex_unlock(&Modes.data_mutex);
+    pthread_mutex_unlock(&sdr->data_mutex);
 
     outbuf->sampleTimestamp = sampleCounter * 12e6 / Modes.sample_rate;
     sampleCounter += slen;
@@ -230,20 +237,20 @@ static void plutosdrCallback(int16_t *buf, uint32_t len) {
     outbuf->length = slen;
     PLUTOSDR.converter(buf, &outbuf->data[Modes.trailing_samples], slen, PLUTOSDR.converter_state, &outbuf->mean_level, &outbuf->mean_power);
 
-    pthread_mutex_lock(&Modes.data_mutex);
+    pthread_mutex_lock(&sdr->data_mutex);
 
-    Modes.mag_buffers[next_free_buffer].dropped = 0;
-    Modes.mag_buffers[next_free_buffer].length = 0;
-    Modes.first_free_buffer = next_free_buffer;
+    sdr->mag_buffers[next_free_buffer].dropped = 0;
+    sdr->mag_buffers[next_free_buffer].length = 0;
+    sdr->first_free_buffer = next_free_buffer;
 
-    end_cpu_timing(&thread_cpu, &Modes.reader_cpu_accumulator);
+    end_cpu_timing(&thread_cpu, &sdr->reader_cpu_accumulator);
     start_cpu_timing(&thread_cpu);
 
-    pthread_cond_signal(&Modes.data_cond);
-    pthread_mutex_unlock(&Modes.data_mutex);
+    pthread_cond_signal(&sdr->data_cond);
+    pthread_mutex_unlock(&sdr->data_mutex);
 }
 
-void plutosdrRun() {
+void plutosdrRun(struct sdrDevice *sdr) {
     void *p_dat, *p_end;
     ptrdiff_t p_inc;
 
@@ -263,11 +270,14 @@ void plutosdrRun() {
             *p++ = ((int16_t*) p_dat)[0]; // Real (I)
             *p++ = ((int16_t*) p_dat)[1]; // Imag (Q)
         }
-        plutosdrCallback(PLUTOSDR.readbuf, len);
+        plutosdrCallback(sdr, PLUTOSDR.readbuf, len);
     }
 }
 
-void plutosdrClose() {
+void plutosdrClose(struct sdrDevice *sdr) {
+    if (sdr != PLUTOSDR.sdr)
+        return;
+
     if(PLUTOSDR.readbuf) {
         free(PLUTOSDR.readbuf);
     }
@@ -290,4 +300,6 @@ void plutosdrClose() {
 
     free(PLUTOSDR.network);
     free(PLUTOSDR.uri);
+
+    PLUTOSDR.sdr = NULL;
 }
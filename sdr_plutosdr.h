@@ -22,9 +22,9 @@
 
 void plutosdrInitConfig();
 bool plutosdrHandleOption(int argc, char *argv);
-bool plutosdrOpen();
-void plutosdrRun();
-void plutosdrClose();
+bool plutosdrOpen(struct sdrDevice *sdr);
+void plutosdrRun(struct sdrDevice *sdr);
+void plutosdrClose(struct sdrDevice *sdr);
 
 #endif /* SDR_PLUTO_H */
 
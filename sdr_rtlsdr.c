@@ -62,26 +62,30 @@
 #  define USE_BOUNCE_BUFFER
 #endif
 
+// options, shared by all rtlsdr devices
 static struct {
+    int ppm_error;
+    bool digital_agc;
+} RTLSDR;
+
+// per device state
+struct rtlsdrDevice {
     iq_convert_fn converter;
     struct converter_state *converter_state;
     rtlsdr_dev_t *dev;
     uint8_t *bounce_buffer;
-    int ppm_error;
-    bool digital_agc;
-} RTLSDR;
+    struct timespec thread_cpu;
+    uint64_t sampleCounter;
+    int dropping;
+};
 
 //
 // =============================== RTLSDR handling ==========================
 //
 
 void rtlsdrInitConfig() {
-    RTLSDR.dev = NULL;
     RTLSDR.digital_agc = false;
     RTLSDR.ppm_error = 0;
-    RTLSDR.converter = NULL;
-    RTLSDR.converter_state = NULL;
-    RTLSDR.bounce_buffer = NULL;
 }
 
 static void show_rtlsdr_devices() {
@@ -154,16 +158,16 @@ bool rtlsdrHandleOption(int argc, char *argv) {
     return true;
 }
 
-bool rtlsdrOpen(void) {
+bool rtlsdrOpen(struct sdrDevice *sdr) {
     if (!rtlsdr_get_device_count()) {
         fprintf(stderr, "rtlsdr: no supported devices found.\n");
         return false;
     }
 
     int dev_index = 0;
-    if (Modes.dev_name) {
-        if ((dev_index = find_device_index(Modes.dev_name)) < 0) {
-            fprintf(stderr, "rtlsdr: no device matching '%s' found.\n", Modes.dev_name);
+    if (sdr->dev_name) {
+        if ((dev_index = find_device_index(sdr->dev_name)) < 0) {
+            fprintf(stderr, "rtlsdr: no device matching '%s' found.\n", sdr->dev_name);
             show_rtlsdr_devices();
             return false;
         }
@@ -181,34 +185,44 @@ bool rtlsdrOpen(void) {
             dev_index, rtlsdr_get_device_name(dev_index),
             manufacturer, product, serial);
 
-    if (rtlsdr_open(&RTLSDR.dev, dev_index) < 0) {
+    struct rtlsdrDevice *rtl = calloc(1, sizeof(struct rtlsdrDevice));
+    if (!rtl) {
+        fprintf(stderr, "rtlsdr: out of memory\n");
+        return false;
+    }
+    sdr->driver = rtl;
+
+    if (rtlsdr_open(&rtl->dev, dev_index) < 0) {
         fprintf(stderr, "rtlsdr: error opening the RTLSDR device: %s\n",
                 strerror(errno));
+        rtlsdrClose(sdr);
         return false;
     }
 
     // Set gain, frequency, sample rate, and reset the device
-    if (Modes.gain == MODES_AUTO_GAIN) {
+    if (sdr->gain == MODES_AUTO_GAIN) {
         fprintf(stderr, "rtlsdr: enabling tuner AGC\n");
-        rtlsdr_set_tuner_gain_mode(RTLSDR.dev, 0);
+        rtlsdr_set_tuner_gain_mode(rtl->dev, 0);
     } else {
         int *gains;
         int numgains;
 
-        numgains = rtlsdr_get_tuner_gains(RTLSDR.dev, NULL);
+        numgains = rtlsdr_get_tuner_gains(rtl->dev, NULL);
         if (numgains <= 0) {
             fprintf(stderr, "rtlsdr: error getting tuner gains\n");
+            rtlsdrClose(sdr);
             return false;
         }
 
         gains = malloc(numgains * sizeof (int));
-        if (rtlsdr_get_tuner_gains(RTLSDR.dev, gains) != numgains) {
+        if (rtlsdr_get_tuner_gains(rtl->dev, gains) != numgains) {
             fprintf(stderr, "rtlsdr: error getting tuner gains\n");
             free(gains);
+            rtlsdrClose(sdr);
             return false;
         }
 
-        int target = (Modes.gain == MODES_MAX_GAIN ? 9999 : Modes.gain);
+        int target = (sdr->gain == MODES_MAX_GAIN ? 9999 : sdr->gain);
         int closest = -1;
 
         for (int i = 0; i < numgains; ++i) {
@@ -216,42 +230,42 @@ bool rtlsdrOpen(void) {
                 closest = i;
         }
 
-        Modes.gain = gains[closest];
-        rtlsdr_set_tuner_gain(RTLSDR.dev, gains[closest]);
+        sdr->gain = gains[closest];
+        rtlsdr_set_tuner_gain(rtl->dev, gains[closest]);
         free(gains);
         fprintf(stderr, "rtlsdr: tuner gain set to %.1f dB\n",
-                rtlsdr_get_tuner_gain(RTLSDR.dev) / 10.0);
+                rtlsdr_get_tuner_gain(rtl->dev) / 10.0);
     }
 
     if (RTLSDR.digital_agc) {
         fprintf(stderr, "rtlsdr: enabling digital AGC\n");
-        rtlsdr_set_agc_mode(RTLSDR.dev, 1);
+        rtlsdr_set_agc_mode(rtl->dev, 1);
     }
 
-    rtlsdr_set_freq_correction(RTLSDR.dev, RTLSDR.ppm_error);
-    rtlsdr_set_center_freq(RTLSDR.dev, Modes.freq);
-    rtlsdr_set_sample_rate(RTLSDR.dev, (unsigned) Modes.sample_rate);
+    rtlsdr_set_freq_correction(rtl->dev, RTLSDR.ppm_error);
+    rtlsdr_set_center_freq(rtl->dev, Modes.freq);
+    rtlsdr_set_sample_rate(rtl->dev, (unsigned) Modes.sample_rate);
 #ifdef ENABLE_RTLSDR_BIASTEE
     // Enable or disable bias tee on GPIO pin 0. (Works only for rtl-sdr.com v3 dongles)
-    rtlsdr_set_bias_tee(RTLSDR.dev, Modes.biastee);
+    rtlsdr_set_bias_tee(rtl->dev, Modes.biastee);
 #endif
 
-    rtlsdr_reset_buffer(RTLSDR.dev);
+    rtlsdr_reset_buffer(rtl->dev);
 
-    RTLSDR.converter = init_converter(INPUT_UC8,
+    rtl->converter = init_converter(INPUT_UC8,
             Modes.sample_rate,
             Modes.dc_filter,
-            &RTLSDR.converter_state);
-    if (!RTLSDR.converter) {
+            &rtl->converter_state);
+    if (!rtl->converter) {
         fprintf(stderr, "rtlsdr: can't initialize sample converter\n");
-        rtlsdrClose();
+        rtlsdrClose(sdr);
         return false;
     }
 
 #ifdef USE_BOUNCE_BUFFER
-    if (!(RTLSDR.bounce_buffer = malloc(MODES_RTL_BUF_SIZE))) {
+    if (!(rtl->bounce_buffer = malloc(MODES_RTL_BUF_SIZE))) {
         fprintf(stderr, "rtlsdr: can't allocate bounce buffer\n");
-        rtlsdrClose();
+        rtlsdrClose(sdr);
         return false;
     }
 #endif
@@ -259,8 +273,6 @@ bool rtlsdrOpen(void) {
     return true;
 }
 
-static struct timespec rtlsdr_thread_cpu;
-
 void rtlsdrCallback(unsigned char *buf, uint32_t len, void *ctx) {
     struct mag_buf *outbuf;
     struct mag_buf *lastbuf;
@@ -269,24 +281,22 @@ void rtlsdrCallback(unsigned char *buf, uint32_t len, void *ctx) {
     unsigned free_bufs;
     unsigned block_duration;
 
-    static int dropping = 0;
-    static uint64_t sampleCounter = 0;
-
     static int antiSpam;
     static int antiSpam2;
 
-    MODES_NOTUSED(ctx);
+    struct sdrDevice *sdr = ctx;
+    struct rtlsdrDevice *rtl = sdr->driver;
 
     // Lock the data buffer variables before accessing them
-    pthread_mutex_lock(&Modes.data_mutex);
+    pthread_mutex_lock(&sdr->data_mutex);
     if (Modes.exit) {
-        rtlsdr_cancel_async(RTLSDR.dev); // ask our caller to exit
+        rtlsdr_cancel_async(rtl->dev); // ask our caller to exit
     }
 
-    next_free_buffer = (Modes.first_free_buffer + 1) % MODES_MAG_BUFFERS;
-    outbuf = &Modes.mag_buffers[Modes.first_free_buffer];
-    lastbuf = &Modes.mag_buffers[(Modes.first_free_buffer + MODES_MAG_BUFFERS - 1) % MODES_MAG_BUFFERS];
-    free_bufs = (Modes.first_filled_buffer - next_free_buffer + MODES_MAG_BUFFERS) % MODES_MAG_BUFFERS;
+    next_free_buffer = (sdr->first_free_buffer + 1) % MODES_MAG_BUFFERS;
+    outbuf = &sdr->mag_buffers[sdr->first_free_buffer];
+    lastbuf = &sdr->mag_buffers[(sdr->first_free_buffer + MODES_MAG_BUFFERS - 1) % MODES_MAG_BUFFERS];
+    free_bufs = (sdr->first_filled_buffer - next_free_buffer + MODES_MAG_BUFFERS) % MODES_MAG_BUFFERS;
 
     // Paranoia! Unlikely, but let's go for belt and suspenders here
 
@@ -305,12 +315,12 @@ void rtlsdrCallback(unsigned char *buf, uint32_t len, void *ctx) {
 
     slen = len / 2; // Drops any trailing odd sample, that's OK
 
-    if (free_bufs == 0 || (dropping && free_bufs < MODES_MAG_BUFFERS / 2)) {
+    if (free_bufs == 0 || (rtl->dropping && free_bufs < MODES_MAG_BUFFERS / 2)) {
         // FIFO is full. Drop this block.
-        dropping = 1;
+        rtl->dropping = 1;
         outbuf->dropped += slen;
-        sampleCounter += slen;
-        pthread_mutex_unlock(&Modes.data_mutex);
+        rtl->sampleCounter += slen;
+        pthread_mutex_unlock(&sdr->data_mutex);
 
         if (--antiSpam <= 0) {
             fprintf(stderr, "FIFO dropped, suppressing this message for 30 seconds.\n");
@@ -319,12 +329,12 @@ void rtlsdrCallback(unsigned char *buf, uint32_t len, void *ctx) {
         return;
     }
 
-    dropping = 0;
-    pthread_mutex_unlock(&Modes.data_mutex);
+    rtl->dropping = 0;
+    pthread_mutex_unlock(&sdr->data_mutex);
 
     // Compute the sample timestamp and system timestamp for the start of the block
-    outbuf->sampleTimestamp = sampleCounter * 12e6 / Modes.sample_rate;
-    sampleCounter += slen;
+    outbuf->sampleTimestamp = rtl->sampleCounter * 12e6 / Modes.sample_rate;
+    rtl->sampleCounter += slen;
 
     if (Modes.debug_sampleCounter && --antiSpam2 <= 0) {
         fprintf(stderr, "sampleTimestamp: %020llu\n", (unsigned long long) outbuf->sampleTimestamp);
@@ -344,57 +354,67 @@ void rtlsdrCallback(unsigned char *buf, uint32_t len, void *ctx) {
 
 #ifdef USE_BOUNCE_BUFFER
     // Work around zero-copy slowness on Pis with 5.x kernels
-    memcpy(RTLSDR.bounce_buffer, buf, slen * 2);
-    buf = RTLSDR.bounce_buffer;
+    memcpy(rtl->bounce_buffer, buf, slen * 2);
+    buf = rtl->bounce_buffer;
 #endif
 
     // Convert the new data
     outbuf->length = slen;
-    RTLSDR.converter(buf, &outbuf->data[Modes.trailing_samples], slen, RTLSDR.converter_state, &outbuf->mean_level, &outbuf->mean_power);
+    rtl->converter(buf, &outbuf->data[Modes.trailing_samples], slen, rtl->converter_state, &outbuf->mean_level, &outbuf->mean_power);
 
     // Push the new data to the demodulation thread
-    pthread_mutex_lock(&Modes.data_mutex);
+    pthread_mutex_lock(&sdr->data_mutex);
 
-    Modes.mag_buffers[next_free_buffer].dropped = 0;
-    Modes.mag_buffers[next_free_buffer].length = 0; // just in case
-    Modes.first_free_buffer = next_free_buffer;
+    sdr->mag_buffers[next_free_buffer].dropped = 0;
+    sdr->mag_buffers[next_free_buffer].length = 0; // just in case
+    sdr->first_free_buffer = next_free_buffer;
 
     // accumulate CPU while holding the mutex, and restart measurement
-    end_cpu_timing(&rtlsdr_thread_cpu, &Modes.reader_cpu_accumulator);
-    start_cpu_timing(&rtlsdr_thread_cpu);
+    end_cpu_timing(&rtl->thread_cpu, &sdr->reader_cpu_accumulator);
+    start_cpu_timing(&rtl->thread_cpu);
 
-    pthread_cond_signal(&Modes.data_cond);
-    pthread_mutex_unlock(&Modes.data_mutex);
+    pthread_cond_signal(&sdr->data_cond);
+    pthread_mutex_unlock(&sdr->data_mutex);
 }
 
-void rtlsdrRun() {
-    if (!RTLSDR.dev) {
+void rtlsdrRun(struct sdrDevice *sdr) {
+    struct rtlsdrDevice *rtl = sdr->driver;
+    if (!rtl || !rtl->dev) {
         return;
     }
 
-    start_cpu_timing(&rtlsdr_thread_cpu);
+    start_cpu_timing(&rtl->thread_cpu);
 
-    rtlsdr_read_async(RTLSDR.dev, rtlsdrCallback, NULL, MODES_RTL_BUFFERS, MODES_RTL_BUF_SIZE);
+    rtlsdr_read_async(rtl->dev, rtlsdrCallback, sdr, MODES_RTL_BUFFERS, MODES_RTL_BUF_SIZE);
     if (!Modes.exit) {
         fprintf(stderr,"rtlsdr_read_async returned unexpectedly, probably lost the USB device, bailing out");
     }
 }
-void rtlsdrCancel() {
-    rtlsdr_cancel_async(RTLSDR.dev); // interrupt read_async
+void rtlsdrCancel(struct sdrDevice *sdr) {
+    struct rtlsdrDevice *rtl = sdr->driver;
+    if (rtl && rtl->dev)
+        rtlsdr_cancel_async(rtl->dev); // interrupt read_async
 }
 
-void rtlsdrClose() {
-    if (RTLSDR.dev) {
-        rtlsdr_close(RTLSDR.dev);
-        RTLSDR.dev = NULL;
+void rtlsdrClose(struct sdrDevice *sdr) {
+    struct rtlsdrDevice *rtl = sdr->driver;
+    if (!rtl)
+        return;
+
+    if (rtl->dev) {
+        rtlsdr_close(rtl->dev);
+        rtl->dev = NULL;
     }
 
-    if (RTLSDR.converter) {
-        cleanup_converter(RTLSDR.converter_state);
-        RTLSDR.converter = NULL;
-        RTLSDR.converter_state = NULL;
+    if (rtl->converter) {
+        cleanup_converter(rtl->converter_state);
+        rtl->converter = NULL;
+        rtl->converter_state = NULL;
     }
 
-    free(RTLSDR.bounce_buffer);
-    RTLSDR.bounce_buffer = NULL;
+    free(rtl->bounce_buffer);
+    rtl->bounce_buffer = NULL;
+
+    free(rtl);
+    sdr->driver = NULL;
 }
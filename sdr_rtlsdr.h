@@ -26,10 +26,10 @@
 #define SDR_RTLSDR_H
 
 void rtlsdrInitConfig ();
-bool rtlsdrOpen ();
-void rtlsdrRun ();
-void rtlsdrCancel();
-void rtlsdrClose ();
+bool rtlsdrOpen (struct sdrDevice *sdr);
+void rtlsdrRun (struct sdrDevice *sdr);
+void rtlsdrCancel (struct sdrDevice *sdr);
+void rtlsdrClose (struct sdrDevice *sdr);
 bool rtlsdrHandleOption (int argc, char *argv);
 
 #endif
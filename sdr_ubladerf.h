@@ -28,8 +28,8 @@
 
 void ubladeRFInitConfig ();
 bool ubladeRFHandleOption (int argc, char *argv);
-bool ubladeRFOpen ();
-void ubladeRFRun ();
-void ubladeRFClose ();
+bool ubladeRFOpen (struct sdrDevice *sdr);
+void ubladeRFRun (struct sdrDevice *sdr);
+void ubladeRFClose (struct sdrDevice *sdr);
 
 #endif
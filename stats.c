@@ -60,6 +60,15 @@ void add_timespecs(const struct timespec *x, const struct timespec *y, struct ti
     z->tv_nsec = z->tv_nsec % 1000000000L;
 }
 
+void sub_timespecs(const struct timespec *x, const struct timespec *y, struct timespec *z) {
+    z->tv_sec = x->tv_sec - y->tv_sec;
+    z->tv_nsec = x->tv_nsec - y->tv_nsec;
+    if (z->tv_nsec < 0) {
+        z->tv_sec -= 1;
+        z->tv_nsec += 1000000000L;
+    }
+}
+
 static void display_range_histogram(struct stats *st);
 
 void display_stats(struct stats *st) {
@@ -132,6 +141,11 @@ void display_stats(struct stats *st) {
         printf("    %u accepted with correct CRC\n", st->remote_accepted[0]);
         for (j = 1; j <= Modes.nfix_crc; ++j)
             printf("    %u accepted with %d-bit error repaired\n", st->remote_accepted[j], j);
+        printf("  %u Mode S messages not decoded due to overload\n", st->remote_overload_sampled);
+        printf("  %u multicast datagrams lost\n", st->remote_multicast_lost);
+
+        printf("Messages to network outputs:\n");
+        printf("  %u multicast datagrams not sent\n", st->multicast_dropped);
     }
 
     printf("%u total usable messages\n",
@@ -169,6 +183,8 @@ void display_stats(struct stats *st) {
     printf("%u non-ES altitude messages from ES-equipped aircraft ignored\n", st->suppressed_altitude_messages);
     printf("%u unique aircraft tracks\n", st->unique_aircraft);
     printf("%u aircraft tracks where only one message was seen\n", st->single_message_aircraft);
+    printf("%u new addresses confirmed by a second message\n", st->probation_promoted);
+    printf("%u new addresses never confirmed (probation expired)\n", st->probation_expired);
 
     {
         uint64_t demod_cpu_millis = (uint64_t) st->demod_cpu.tv_sec * 1000UL + st->demod_cpu.tv_nsec / 1000000UL;
@@ -333,6 +349,11 @@ void add_stats(const struct stats *st1, const struct stats *st2, struct stats *t
     target->remote_received_basestation_invalid = st1->remote_received_basestation_invalid + st2->remote_received_basestation_invalid;
     target->remote_rejected_bad = st1->remote_rejected_bad + st2->remote_rejected_bad;
     target->remote_malformed_beast = st1->remote_malformed_beast + st2->remote_malformed_beast;
+    target->remote_overload_sampled = st1->remote_overload_sampled + st2->remote_overload_sampled;
+    target->remote_multicast_lost = st1->remote_multicast_lost + st2->remote_multicast_lost;
+    target->multicast_dropped = st1->multicast_dropped + st2->multicast_dropped;
+    target->probation_promoted = st1->probation_promoted + st2->probation_promoted;
+    target->probation_expired = st1->probation_expired + st2->probation_expired;
     target->remote_rejected_unknown_icao = st1->remote_rejected_unknown_icao + st2->remote_rejected_unknown_icao;
     for (i = 0; i < MODES_MAX_BITERRORS + 1; ++i)
         target->remote_accepted[i] = st1->remote_accepted[i] + st2->remote_accepted[i];
@@ -378,6 +399,109 @@ void add_stats(const struct stats *st1, const struct stats *st2, struct stats *t
         target->distance_min = st2->distance_min;
 }
 
+// target = st1 - st2 for all the counters, used to remove a bucket from a running window sum
+// start / end and the minimum / maximum values are taken from st1, they can't be subtracted
+// keep this in sync with add_stats
+void sub_stats(const struct stats *st1, const struct stats *st2, struct stats *target) {
+    int i;
+
+    target->start = st1->start;
+    target->end = st1->end;
+
+    target->demod_preambles = st1->demod_preambles - st2->demod_preambles;
+    target->demod_rejected_bad = st1->demod_rejected_bad - st2->demod_rejected_bad;
+    target->demod_rejected_unknown_icao = st1->demod_rejected_unknown_icao - st2->demod_rejected_unknown_icao;
+    for (i = 0; i < MODES_MAX_BITERRORS + 1; ++i)
+        target->demod_accepted[i] = st1->demod_accepted[i] - st2->demod_accepted[i];
+    target->demod_modeac = st1->demod_modeac - st2->demod_modeac;
+
+    for (int i = 0; i < 5; i++) {
+        target->demod_preamblePhase[i] = st1->demod_preamblePhase[i] - st2->demod_preamblePhase[i];
+        target->demod_bestPhase[i] = st1->demod_bestPhase[i] - st2->demod_bestPhase[i];
+    }
+
+    target->samples_processed = st1->samples_processed - st2->samples_processed;
+    target->samples_dropped = st1->samples_dropped - st2->samples_dropped;
+
+    sub_timespecs(&st1->demod_cpu, &st2->demod_cpu, &target->demod_cpu);
+    sub_timespecs(&st1->reader_cpu, &st2->reader_cpu, &target->reader_cpu);
+    sub_timespecs(&st1->background_cpu, &st2->background_cpu, &target->background_cpu);
+    sub_timespecs(&st1->aircraft_json_cpu, &st2->aircraft_json_cpu, &target->aircraft_json_cpu);
+    sub_timespecs(&st1->globe_json_cpu, &st2->globe_json_cpu, &target->globe_json_cpu);
+    sub_timespecs(&st1->heatmap_and_state_cpu, &st2->heatmap_and_state_cpu, &target->heatmap_and_state_cpu);
+    sub_timespecs(&st1->remove_stale_cpu, &st2->remove_stale_cpu, &target->remove_stale_cpu);
+    for (i = 0; i < TRACE_THREADS; i ++) {
+        sub_timespecs(&st1->trace_json_cpu[i], &st2->trace_json_cpu[i], &target->trace_json_cpu[i]);
+    }
+    for (i = 0; i < NUM_TYPES; i ++) {
+        target->pos_by_type[i] = st1->pos_by_type[i] - st2->pos_by_type[i];
+    }
+    target->pos_all = st1->pos_all - st2->pos_all;
+    target->pos_duplicate = st1->pos_duplicate - st2->pos_duplicate;
+    target->pos_garbage = st1->pos_garbage - st2->pos_garbage;
+
+    // noise power:
+    target->noise_power_sum = fmax(0, st1->noise_power_sum - st2->noise_power_sum);
+    target->noise_power_count = st1->noise_power_count - st2->noise_power_count;
+
+    // mean signal power:
+    target->signal_power_sum = fmax(0, st1->signal_power_sum - st2->signal_power_sum);
+    target->signal_power_count = st1->signal_power_count - st2->signal_power_count;
+
+    target->peak_signal_power = st1->peak_signal_power;
+
+    // strong signals
+    target->strong_signal_count = st1->strong_signal_count - st2->strong_signal_count;
+
+    // remote messages:
+    target->remote_received_modeac = st1->remote_received_modeac - st2->remote_received_modeac;
+    target->remote_received_modes = st1->remote_received_modes - st2->remote_received_modes;
+    target->remote_received_basestation_valid = st1->remote_received_basestation_valid - st2->remote_received_basestation_valid;
+    target->remote_received_basestation_invalid = st1->remote_received_basestation_invalid - st2->remote_received_basestation_invalid;
+    target->remote_rejected_bad = st1->remote_rejected_bad - st2->remote_rejected_bad;
+    target->remote_malformed_beast = st1->remote_malformed_beast - st2->remote_malformed_beast;
+    target->remote_overload_sampled = st1->remote_overload_sampled - st2->remote_overload_sampled;
+    target->remote_multicast_lost = st1->remote_multicast_lost - st2->remote_multicast_lost;
+    target->multicast_dropped = st1->multicast_dropped - st2->multicast_dropped;
+    target->probation_promoted = st1->probation_promoted - st2->probation_promoted;
+    target->probation_expired = st1->probation_expired - st2->probation_expired;
+    target->remote_rejected_unknown_icao = st1->remote_rejected_unknown_icao - st2->remote_rejected_unknown_icao;
+    for (i = 0; i < MODES_MAX_BITERRORS + 1; ++i)
+        target->remote_accepted[i] = st1->remote_accepted[i] - st2->remote_accepted[i];
+
+    // total messages:
+    target->messages_total = st1->messages_total - st2->messages_total;
+
+    // CPR decoding:
+    target->cpr_surface = st1->cpr_surface - st2->cpr_surface;
+    target->cpr_airborne = st1->cpr_airborne - st2->cpr_airborne;
+    target->cpr_global_ok = st1->cpr_global_ok - st2->cpr_global_ok;
+    target->cpr_global_bad = st1->cpr_global_bad - st2->cpr_global_bad;
+    target->cpr_global_skipped = st1->cpr_global_skipped - st2->cpr_global_skipped;
+    target->cpr_global_range_checks = st1->cpr_global_range_checks - st2->cpr_global_range_checks;
+    target->cpr_global_speed_checks = st1->cpr_global_speed_checks - st2->cpr_global_speed_checks;
+    target->cpr_local_ok = st1->cpr_local_ok - st2->cpr_local_ok;
+    target->cpr_local_aircraft_relative = st1->cpr_local_aircraft_relative - st2->cpr_local_aircraft_relative;
+    target->cpr_local_receiver_relative = st1->cpr_local_receiver_relative - st2->cpr_local_receiver_relative;
+    target->cpr_local_skipped = st1->cpr_local_skipped - st2->cpr_local_skipped;
+    target->cpr_local_range_checks = st1->cpr_local_range_checks - st2->cpr_local_range_checks;
+    target->cpr_local_speed_checks = st1->cpr_local_speed_checks - st2->cpr_local_speed_checks;
+    target->cpr_filtered = st1->cpr_filtered - st2->cpr_filtered;
+
+    target->suppressed_altitude_messages = st1->suppressed_altitude_messages - st2->suppressed_altitude_messages;
+
+    // aircraft
+    target->unique_aircraft = st1->unique_aircraft - st2->unique_aircraft;
+    target->single_message_aircraft = st1->single_message_aircraft - st2->single_message_aircraft;
+
+    // range histogram
+    for (i = 0; i < RANGE_BUCKET_COUNT; ++i)
+        target->range_histogram[i] = st1->range_histogram[i] - st2->range_histogram[i];
+
+    target->distance_max = st1->distance_max;
+    target->distance_min = st1->distance_min;
+}
+
 void checkDisplayStats(uint64_t now) {
     Modes.stats_current.end = now;
 
@@ -394,38 +518,141 @@ void checkDisplayStats(uint64_t now) {
     }
 }
 
+// add a stats window covering the last 'minutes' minutes (rounded to 10 second buckets)
+int statsWindowAdd(uint32_t minutes) {
+    if (minutes < 1 || minutes > STATS_WINDOW_MAX_MINUTES) {
+        fprintf(stderr, "stats window: %u minutes not in valid range 1 - %d\n", minutes, STATS_WINDOW_MAX_MINUTES);
+        return -1;
+    }
+    uint32_t buckets = minutes * 6;
+    for (int i = 0; i < Modes.statsWindowCount; i++) {
+        if (Modes.statsWindows[i].buckets == buckets)
+            return 0;
+    }
+    if (Modes.statsWindowCount >= STATS_WINDOWS_MAX) {
+        fprintf(stderr, "stats window: at most %d windows supported, ignoring %u minutes\n", STATS_WINDOWS_MAX, minutes);
+        return -1;
+    }
+
+    struct statsWindow *w = &Modes.statsWindows[Modes.statsWindowCount++];
+    *w = (struct statsWindow) {0};
+    w->buckets = buckets;
+    if (minutes % 60 == 0 && minutes > 60)
+        snprintf(w->key, sizeof(w->key), "last%uh", minutes / 60);
+    else
+        snprintf(w->key, sizeof(w->key), "last%umin", minutes);
+
+    return 0;
+}
+
+static void extremumInit(struct statsExtremum *e, uint32_t buckets, size_t offset, int sign) {
+    e->alloc = buckets + 1;
+    e->queue = malloc(e->alloc * sizeof(uint64_t));
+    if (!e->queue) {
+        fprintf(stderr, "statsInit: out of memory!\n");
+        exit(1);
+    }
+    e->head = e->tail = 0;
+    e->offset = offset;
+    e->sign = sign;
+}
+
+static inline double extremumValue(struct statsExtremum *e, uint64_t bucket) {
+    struct stats *st = &Modes.stats_10[bucket % Modes.stats_10_len];
+    return e->sign * *(double *) ((char *) st + e->offset);
+}
+
+// bucket has just been written to stats_10, drop the queued buckets it supersedes
+// and the ones that left the window, the head is then the extremum of the window
+static double extremumPush(struct statsExtremum *e, uint64_t bucket, uint32_t buckets) {
+    double value = extremumValue(e, bucket);
+    while (e->tail > e->head && extremumValue(e, e->queue[(e->tail - 1) % e->alloc]) <= value)
+        e->tail--;
+    e->queue[e->tail++ % e->alloc] = bucket;
+
+    while (e->queue[e->head % e->alloc] + buckets <= bucket)
+        e->head++;
+
+    return e->sign * extremumValue(e, e->queue[e->head % e->alloc]);
+}
+
+void statsInit(uint64_t now) {
+    uint32_t len = STAT_BUCKETS;
+    for (int i = 0; i < Modes.statsWindowCount; i++)
+        len = max(len, Modes.statsWindows[i].buckets);
+
+    Modes.stats_10_len = len;
+    Modes.stats_10 = malloc(len * sizeof(struct stats));
+    if (!Modes.stats_10) {
+        fprintf(stderr, "statsInit: out of memory!\n");
+        exit(1);
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        reset_stats(&Modes.stats_10[i]);
+        Modes.stats_10[i].start = Modes.stats_10[i].end = now;
+    }
+
+    for (int i = 0; i < Modes.statsWindowCount; i++) {
+        struct statsWindow *w = &Modes.statsWindows[i];
+        reset_stats(&w->sum);
+        w->sum.start = w->sum.end = now;
+        extremumInit(&w->peak_signal_power, w->buckets, offsetof(struct stats, peak_signal_power), 1);
+        extremumInit(&w->distance_max, w->buckets, offsetof(struct stats, distance_max), 1);
+        extremumInit(&w->distance_min, w->buckets, offsetof(struct stats, distance_min), -1);
+    }
+}
+
+void statsCleanup() {
+    for (int i = 0; i < Modes.statsWindowCount; i++) {
+        struct statsWindow *w = &Modes.statsWindows[i];
+        free(w->peak_signal_power.queue);
+        free(w->distance_max.queue);
+        free(w->distance_min.queue);
+    }
+    free(Modes.stats_10);
+    Modes.stats_10 = NULL;
+}
+
 void statsUpdate(uint64_t now) {
     Modes.stats_current.end = now;
-    int i;
+
+    sdrStatsUpdate();
 
     Modes.next_stats_update += 10 * SECONDS;
-    Modes.stats_10[Modes.stats_bucket] = Modes.stats_current;
+
+    uint64_t bucket = Modes.stats_bucket;
+    uint32_t len = Modes.stats_10_len;
+
+    // remove the buckets leaving the windows
+    // this needs to happen before the bucket is overwritten in the ring buffer
+    for (int i = 0; i < Modes.statsWindowCount; i++) {
+        struct statsWindow *w = &Modes.statsWindows[i];
+        if (bucket >= w->buckets)
+            sub_stats(&w->sum, &Modes.stats_10[(bucket - w->buckets) % len], &w->sum);
+    }
+
+    Modes.stats_10[bucket % len] = Modes.stats_current;
 
     add_stats(&Modes.stats_current, &Modes.stats_alltime, &Modes.stats_alltime);
     add_stats(&Modes.stats_current, &Modes.stats_periodic, &Modes.stats_periodic);
 
-    reset_stats(&Modes.stats_1min);
-    for (i = 0; i < 6; ++i) {
-        int index = (Modes.stats_bucket - i + STAT_BUCKETS) % STAT_BUCKETS;
-        add_stats(&Modes.stats_10[index], &Modes.stats_1min, &Modes.stats_1min);
-    }
+    for (int i = 0; i < Modes.statsWindowCount; i++) {
+        struct statsWindow *w = &Modes.statsWindows[i];
+        add_stats(&Modes.stats_current, &w->sum, &w->sum);
 
-    reset_stats(&Modes.stats_5min);
-    for (i = 0; i < 30; ++i) {
-        int index = (Modes.stats_bucket - i + STAT_BUCKETS) % STAT_BUCKETS;
-        add_stats(&Modes.stats_10[index], &Modes.stats_5min, &Modes.stats_5min);
-    }
+        uint64_t oldest = (bucket + 1 > w->buckets) ? bucket + 1 - w->buckets : 0;
+        w->sum.start = Modes.stats_10[oldest % len].start;
+        w->sum.end = now;
 
-    reset_stats(&Modes.stats_15min);
-    for (i = 0; i < 90; ++i) {
-        int index = (Modes.stats_bucket - i + STAT_BUCKETS) % STAT_BUCKETS;
-        add_stats(&Modes.stats_10[index], &Modes.stats_15min, &Modes.stats_15min);
+        w->sum.peak_signal_power = extremumPush(&w->peak_signal_power, bucket, w->buckets);
+        w->sum.distance_max = extremumPush(&w->distance_max, bucket, w->buckets);
+        w->sum.distance_min = extremumPush(&w->distance_min, bucket, w->buckets);
     }
 
     reset_stats(&Modes.stats_current);
     Modes.stats_current.start = Modes.stats_current.end = now;
 
-    Modes.stats_bucket = (Modes.stats_bucket + 1) % STAT_BUCKETS;
+    Modes.stats_bucket++;
 }
 
 static char * appendTypeCounts(char *p, char *end) {
@@ -505,12 +732,16 @@ static char * appendStatsJson(char *p, char *end, struct stats *st, const char *
                 ",\"modes\":%u"
                 ",\"basestation\": %u"
                 ",\"bad\":%u"
-                ",\"unknown_icao\":%u",
+                ",\"unknown_icao\":%u"
+                ",\"overload_sampled\":%u"
+                ",\"multicast_lost\":%u",
                 st->remote_received_modeac,
                 st->remote_received_modes,
                 st->remote_received_basestation_valid,
                 st->remote_rejected_bad,
-                st->remote_rejected_unknown_icao);
+                st->remote_rejected_unknown_icao,
+                st->remote_overload_sampled,
+                st->remote_multicast_lost);
 
         for (i = 0; i <= Modes.nfix_crc; ++i) {
             if (i == 0) p = safe_snprintf(p, end, ",\"accepted\":[%u", st->remote_accepted[i]);
@@ -518,6 +749,8 @@ static char * appendStatsJson(char *p, char *end, struct stats *st, const char *
         }
 
         p = safe_snprintf(p, end, "]}");
+
+        p = safe_snprintf(p, end, ",\"network_out\":{\"multicast_dropped\":%u}", st->multicast_dropped);
     }
 
     {
@@ -559,7 +792,9 @@ static char * appendStatsJson(char *p, char *end, struct stats *st, const char *
                 ",\"heatmap_and_state\":%llu"
                 ",\"remove_stale\":%llu}"
                 ",\"tracks\":{\"all\":%u"
-                ",\"single_message\":%u}"
+                ",\"single_message\":%u"
+                ",\"probation_promoted\":%u"
+                ",\"probation_expired\":%u}"
                 ",\"messages\":%u"
                 ",\"max_distance\":%ld"
                 "}",
@@ -588,6 +823,8 @@ static char * appendStatsJson(char *p, char *end, struct stats *st, const char *
             (unsigned long long) remove_stale_cpu_millis,
             st->unique_aircraft,
             st->single_message_aircraft,
+            st->probation_promoted,
+            st->probation_expired,
             st->messages_total,
             (long) st->distance_max);
     }
@@ -608,16 +845,18 @@ struct char_buffer generateStatsJson() {
     p = appendStatsJson(p, end, &Modes.stats_current, "latest");
     p = safe_snprintf(p, end, ",\n");
 
-    p = appendStatsJson(p, end, &Modes.stats_1min, "last1min");
-    p = safe_snprintf(p, end, ",\n");
-
-    p = appendStatsJson(p, end, &Modes.stats_5min, "last5min");
-    p = safe_snprintf(p, end, ",\n");
-
-    p = appendStatsJson(p, end, &Modes.stats_15min, "last15min");
-    p = safe_snprintf(p, end, ",\n");
+    for (int i = 0; i < Modes.statsWindowCount; i++) {
+        p = appendStatsJson(p, end, &Modes.statsWindows[i].sum, Modes.statsWindows[i].key);
+        p = safe_snprintf(p, end, ",\n");
+    }
 
     p = appendStatsJson(p, end, &Modes.stats_alltime, "total");
+    p = safe_snprintf(p, end, ",\n");
+    p = appendMiscJobsJson(p, end);
+    if (!Modes.net_only) {
+        p = safe_snprintf(p, end, ",\n");
+        p = appendSdrJson(p, end);
+    }
     p = safe_snprintf(p, end, "\n}\n");
 
     if (p >= end)
@@ -633,7 +872,7 @@ struct char_buffer generatePromFile() {
     char *buf = (char *) malloc(64 * 1024), *p = buf, *end = buf + 64 * 1024;
     uint64_t now = mstime();
 
-    struct stats *st = &Modes.stats_1min;
+    struct stats *st = &Modes.statsWindows[STATS_WINDOW_1MIN].sum;
 
     unsigned long long trace_json_cpu_millis_sum = 0;
     for (int i = 0; i < TRACE_THREADS; i ++) {
@@ -714,9 +953,14 @@ struct char_buffer generatePromFile() {
     p = safe_snprintf(p, end, "readsb_messages_modeac_valid %u\n", st->remote_received_modeac + st->demod_modeac);
 
     p = safe_snprintf(p, end, "readsb_network_malformed_beast_bytes %u\n", st->remote_malformed_beast);
+    p = safe_snprintf(p, end, "readsb_network_overload_sampled %u\n", st->remote_overload_sampled);
+    p = safe_snprintf(p, end, "readsb_network_multicast_lost %u\n", st->remote_multicast_lost);
+    p = safe_snprintf(p, end, "readsb_network_multicast_dropped %u\n", st->multicast_dropped);
 
     p = safe_snprintf(p, end, "readsb_tracks_all %u\n", st->unique_aircraft);
     p = safe_snprintf(p, end, "readsb_tracks_single_message %u\n", st->single_message_aircraft);
+    p = safe_snprintf(p, end, "readsb_tracks_probation_promoted %u\n", st->probation_promoted);
+    p = safe_snprintf(p, end, "readsb_tracks_probation_expired %u\n", st->probation_expired);
 
     p = safe_snprintf(p, end, "readsb_position_count_total %u\n", st->pos_all);
     p = safe_snprintf(p, end, "readsb_position_count_duplicate %u\n", st->pos_duplicate);
@@ -738,7 +982,7 @@ struct char_buffer generatePromFile() {
     }
 
     if (!Modes.net_only) {
-        p = safe_snprintf(p, end, "readsb_sdr_gain %.1f\n", Modes.gain / 10.0);
+        p = safe_snprintf(p, end, "readsb_sdr_gain %.1f\n", Modes.sdrDevices[0].gain / 10.0);
 
         if (st->signal_power_sum > 0 && st->signal_power_count > 0)
             p = safe_snprintf(p, end, "readsb_signal_avg %.1f\n", 10 * log10(st->signal_power_sum / st->signal_power_count));
@@ -97,6 +97,12 @@ struct stats
   uint32_t remote_rejected_unknown_icao;
   uint32_t remote_accepted[MODES_MAX_BITERRORS + 1];
   uint32_t remote_malformed_beast;
+  uint32_t remote_overload_sampled; // not decoded, client over the read budget and address not in the hot set
+  uint32_t remote_multicast_lost; // datagrams missing in the sequence of a multicast input
+  uint32_t multicast_dropped; // multicast output datagrams the socket didn't take
+  // addresses on probation (track.c)
+  uint32_t probation_promoted;
+  uint32_t probation_expired; // never confirmed by a second message
   // total messages:
   uint32_t messages_total;
   // CPR decoding:
@@ -136,6 +142,32 @@ struct stats
 };
 
 
+// running maximum / minimum of a double field over the buckets of a window
+// (monotonic queue of bucket numbers, O(1) amortized per bucket)
+struct statsExtremum {
+    uint64_t *queue;
+    uint32_t alloc;
+    uint64_t head;
+    uint64_t tail;
+    size_t offset; // offsetof the field in struct stats
+    int sign; // 1: maximum, -1: minimum
+};
+
+// stats over the last 'buckets' 10 second buckets
+// the sum is updated incrementally: add the newest bucket, subtract the one leaving the window
+struct statsWindow {
+    uint32_t buckets;
+    char key[16]; // name in stats.json
+    struct stats sum;
+    struct statsExtremum peak_signal_power;
+    struct statsExtremum distance_max;
+    struct statsExtremum distance_min;
+};
+
+#define STATS_WINDOW_1MIN 0
+#define STATS_WINDOW_5MIN 1
+#define STATS_WINDOW_15MIN 2
+
 struct statsCount {
     uint32_t json_ac_count_pos;
     uint32_t json_ac_count_no_pos;
@@ -175,14 +207,19 @@ struct statsCount {
 };
 
 void add_stats (const struct stats *st1, const struct stats *st2, struct stats *target);
+void sub_stats (const struct stats *st1, const struct stats *st2, struct stats *target);
 void display_stats (struct stats *st);
 void reset_stats (struct stats *st);
 
 void add_timespecs (const struct timespec *x, const struct timespec *y, struct timespec *z);
+void sub_timespecs (const struct timespec *x, const struct timespec *y, struct timespec *z);
 
 struct char_buffer generateStatsJson();
 struct char_buffer generatePromFile();
 
+int statsWindowAdd(uint32_t minutes);
+void statsInit(uint64_t now);
+void statsCleanup();
 void statsUpdate(uint64_t now);
 void checkDisplayStats(uint64_t now);
 void statsResetCount();
@@ -0,0 +1,172 @@
+#include "readsb.h"
+
+#include <assert.h>
+
+// chunks are handed out and returned by the decode thread and the stale threads,
+// the pool is only touched when a trace grows or shrinks by a chunk, a mutex is plenty
+
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+static void **poolFree; // singly linked via the first pointer of each free chunk
+static uint64_t poolFreeCount;
+static uint64_t poolUsed;
+
+static struct traceChunk *chunkAlloc() {
+    pthread_mutex_lock(&poolMutex);
+    void **chunk = poolFree;
+    if (chunk) {
+        poolFree = *chunk;
+        poolFreeCount--;
+    }
+    poolUsed++;
+    pthread_mutex_unlock(&poolMutex);
+
+    if (!chunk) {
+        chunk = malloc(sizeof(struct traceChunk));
+        if (!chunk) {
+            pthread_mutex_lock(&poolMutex);
+            poolUsed--;
+            pthread_mutex_unlock(&poolMutex);
+        }
+    }
+    return (struct traceChunk *) chunk;
+}
+
+static void chunkFree(struct traceChunk *c) {
+    pthread_mutex_lock(&poolMutex);
+    poolUsed--;
+    // keep some chunks around, when many traces are dropped at once the rest goes back to the system
+    if (poolFreeCount < 256 || poolFreeCount < poolUsed / 16) {
+        void **chunk = (void **) c;
+        *chunk = poolFree;
+        poolFree = chunk;
+        poolFreeCount++;
+        c = NULL;
+    }
+    pthread_mutex_unlock(&poolMutex);
+
+    free(c);
+}
+
+void traceChunksCleanup() {
+    pthread_mutex_lock(&poolMutex);
+    while (poolFree) {
+        void **chunk = poolFree;
+        poolFree = *chunk;
+        free(chunk);
+    }
+    poolFreeCount = 0;
+    pthread_mutex_unlock(&poolMutex);
+}
+
+void traceChunksStats(uint64_t *used, uint64_t *cached) {
+    pthread_mutex_lock(&poolMutex);
+    *used = poolUsed;
+    *cached = poolFreeCount;
+    pthread_mutex_unlock(&poolMutex);
+}
+
+// change the size of the pointer ring, the chunks in use start at index 0 afterwards
+static int ringResize(struct aircraft *a, int size) {
+    struct traceChunk **ring = malloc(size * sizeof(struct traceChunk *));
+    if (!ring)
+        return 0;
+    for (int i = 0; i < a->trace_chunk_count; i++)
+        ring[i] = a->trace_chunks[(a->trace_chunk_first + i) & (a->trace_chunk_ring - 1)];
+    free(a->trace_chunks);
+    a->trace_chunks = ring;
+    a->trace_chunk_ring = size;
+    a->trace_chunk_first = 0;
+    return 1;
+}
+
+int traceReserve(struct aircraft *a, int len) {
+    while (a->trace_alloc < len) {
+        if (a->trace_chunk_count == a->trace_chunk_ring) {
+            if (!ringResize(a, a->trace_chunk_ring ? 2 * a->trace_chunk_ring : 4))
+                return 0;
+        }
+        struct traceChunk *c = chunkAlloc();
+        if (!c)
+            return 0;
+        a->trace_chunks[(a->trace_chunk_first + a->trace_chunk_count) & (a->trace_chunk_ring - 1)] = c;
+        a->trace_chunk_count++;
+        a->trace_alloc += TRACE_CHUNK_SIZE;
+    }
+    return 1;
+}
+
+void traceDropStart(struct aircraft *a, int n) {
+    // callers drop whole groups of 4 to keep state and state_all together
+    assert(n % 4 == 0);
+    if (n <= 0 || n % 4 != 0)
+        return;
+
+    a->trace_head += n;
+    a->trace_alloc -= n;
+    while (a->trace_head >= TRACE_CHUNK_SIZE && a->trace_chunk_count > 0) {
+        chunkFree(a->trace_chunks[a->trace_chunk_first]);
+        a->trace_chunk_first = (a->trace_chunk_first + 1) & (a->trace_chunk_ring - 1);
+        a->trace_chunk_count--;
+        a->trace_head -= TRACE_CHUNK_SIZE;
+    }
+}
+
+void traceShrink(struct aircraft *a, int len) {
+    while (a->trace_chunk_count > 1 && a->trace_alloc - TRACE_CHUNK_SIZE >= len) {
+        a->trace_chunk_count--;
+        chunkFree(a->trace_chunks[(a->trace_chunk_first + a->trace_chunk_count) & (a->trace_chunk_ring - 1)]);
+        a->trace_alloc -= TRACE_CHUNK_SIZE;
+    }
+    if (a->trace_chunk_ring > 4 && a->trace_chunk_count <= a->trace_chunk_ring / 4)
+        ringResize(a, a->trace_chunk_ring / 2);
+}
+
+void traceFree(struct aircraft *a) {
+    for (int i = 0; i < a->trace_chunk_count; i++)
+        chunkFree(a->trace_chunks[(a->trace_chunk_first + i) & (a->trace_chunk_ring - 1)]);
+    free(a->trace_chunks);
+    a->trace_chunks = NULL;
+    a->trace_chunk_ring = 0;
+    a->trace_chunk_first = 0;
+    a->trace_chunk_count = 0;
+    a->trace_head = 0;
+    a->trace_alloc = 0;
+}
+
+void traceExport(struct aircraft *a, int len, void *dst) {
+    char *p = dst;
+    // copy whole runs of points within a chunk
+    for (int i = 0; i < len;) {
+        int n = min(len - i, TRACE_CHUNK_SIZE - ((a->trace_head + i) & TRACE_CHUNK_MASK));
+        memcpy(p, getState(a, i), n * sizeof(struct state));
+        p += n * sizeof(struct state);
+        i += n;
+    }
+    for (int i = 0; i < len;) {
+        int n = min(len - i, TRACE_CHUNK_SIZE - ((a->trace_head + i) & TRACE_CHUNK_MASK));
+        int groups = (n + 3) / 4;
+        memcpy(p, getStateAll(a, i), groups * sizeof(struct state_all));
+        p += groups * sizeof(struct state_all);
+        i += n;
+    }
+}
+
+int traceImport(struct aircraft *a, int len, const void *src) {
+    const char *p = src;
+    if (!traceReserve(a, len))
+        return 0;
+    for (int i = 0; i < len;) {
+        int n = min(len - i, TRACE_CHUNK_SIZE - ((a->trace_head + i) & TRACE_CHUNK_MASK));
+        memcpy(getState(a, i), p, n * sizeof(struct state));
+        p += n * sizeof(struct state);
+        i += n;
+    }
+    for (int i = 0; i < len;) {
+        int n = min(len - i, TRACE_CHUNK_SIZE - ((a->trace_head + i) & TRACE_CHUNK_MASK));
+        int groups = (n + 3) / 4;
+        memcpy(getStateAll(a, i), p, groups * sizeof(struct state_all));
+        p += groups * sizeof(struct state_all);
+        i += n;
+    }
+    return 1;
+}
@@ -0,0 +1,56 @@
+#ifndef TRACE_CHUNKS_H
+#define TRACE_CHUNKS_H
+
+// trace storage: the points of a trace live in fixed size chunks taken from a shared pool
+//
+// each aircraft has a ring of chunk pointers (trace_chunks), the first point of the trace is
+// trace_head points into the first chunk, dropping the start of the trace advances trace_head
+// and hands whole chunks back to the pool, growing the trace links another chunk
+// trace_alloc is the number of points that fit without linking another chunk
+//
+// every 4th point has a struct state_all, trace_head is always a multiple of 4 so the state_all
+// of point i is in the same chunk as point i
+
+#define TRACE_CHUNK_BITS 6
+#define TRACE_CHUNK_SIZE (1 << TRACE_CHUNK_BITS) // points per chunk
+#define TRACE_CHUNK_MASK (TRACE_CHUNK_SIZE - 1)
+
+struct traceChunk {
+    struct state state[TRACE_CHUNK_SIZE];
+    struct state_all all[TRACE_CHUNK_SIZE / 4];
+};
+
+static inline struct traceChunk *traceChunk(struct aircraft *a, int k) {
+    return a->trace_chunks[(a->trace_chunk_first + (k >> TRACE_CHUNK_BITS)) & (a->trace_chunk_ring - 1)];
+}
+
+// point i of the trace, i < trace_alloc
+static inline struct state *getState(struct aircraft *a, int i) {
+    int k = a->trace_head + i;
+    return &traceChunk(a, k)->state[k & TRACE_CHUNK_MASK];
+}
+
+// state_all belonging to point i, only every 4th point has one
+static inline struct state_all *getStateAll(struct aircraft *a, int i) {
+    int k = a->trace_head + i;
+    return &traceChunk(a, k)->all[(k & TRACE_CHUNK_MASK) / 4];
+}
+
+// make room for at least len points, returns 0 if out of memory
+int traceReserve(struct aircraft *a, int len);
+// drop the first n points (multiple of 4) and release chunks that are no longer used
+void traceDropStart(struct aircraft *a, int n);
+// release unused chunks at the end while keeping room for len points
+void traceShrink(struct aircraft *a, int len);
+// release all chunks of the trace
+void traceFree(struct aircraft *a);
+
+// copy the first len points to / from the layout used in state files: len states, then (len + 3) / 4 state_all
+void traceExport(struct aircraft *a, int len, void *dst);
+int traceImport(struct aircraft *a, int len, const void *src);
+
+// return cached free chunks to the system
+void traceChunksCleanup();
+void traceChunksStats(uint64_t *used, uint64_t *cached);
+
+#endif
@@ -151,31 +151,6 @@ static int compare_validity(const data_validity *lhs, const data_validity *rhs)
 // CPR position updating
 //
 
-// Distance between points on a spherical earth.
-// This has up to 0.5% error because the earth isn't actually spherical
-// (but we don't use it in situations where that matters)
-
-double greatcircle(double lat0, double lon0, double lat1, double lon1) {
-    double dlat, dlon;
-
-    lat0 = lat0 * M_PI / 180.0;
-    lon0 = lon0 * M_PI / 180.0;
-    lat1 = lat1 * M_PI / 180.0;
-    lon1 = lon1 * M_PI / 180.0;
-
-    dlat = fabs(lat1 - lat0);
-    dlon = fabs(lon1 - lon0);
-
-    // use haversine for small distances for better numerical stability
-    if (dlat < 0.001 && dlon < 0.001) {
-        double a = sin(dlat / 2) * sin(dlat / 2) + cos(lat0) * cos(lat1) * sin(dlon / 2) * sin(dlon / 2);
-        return 6371e3 * 2 * atan2(sqrt(a), sqrt(1.0 - a));
-    }
-
-    // spherical law of cosines
-    return 6371e3 * acos(sin(lat0) * sin(lat1) + cos(lat0) * cos(lat1) * cos(dlon));
-}
-
 static float bearing(double lat0, double lon0, double lat1, double lon1) {
     lat0 = lat0 * M_PI / 180.0;
     lon0 = lon0 * M_PI / 180.0;
@@ -218,6 +193,10 @@ static void update_range_histogram(double lat, double lon) {
     }
 }
 
+static inline int recFlags(struct modesMessage *mm, int surface) {
+    return (surface ? REC_SURFACE : 0) | (mm->cpr_odd ? REC_ODD : 0) | (mm->source <= SOURCE_MLAT ? REC_MLAT : 0);
+}
+
 // return true if it's OK for the aircraft to have travelled from its last known position
 // to a new position at (lat,lon,surface) at a time of now.
 
@@ -319,6 +298,9 @@ static int speed_check(struct aircraft *a, datasource_t source, double lat, doub
 
     inrange = (distance <= range);
 
+    recordEvent(REC_SPEED_CHECK, now, a->addr, mm->receiverId, inrange, recFlags(mm, surface),
+            lat, lon, distance, range);
+
     if ((source > SOURCE_MLAT && track_diff < 190 && !inrange && (Modes.debug_cpr || Modes.debug_speed_check))
             || (a->addr == Modes.cpr_focus && distance > 0.1)) {
 
@@ -345,10 +327,10 @@ static int speed_check(struct aircraft *a, datasource_t source, double lat, doub
             && a->pos_reliable_odd >= Modes.filter_persistence * 3 / 4
             && a->pos_reliable_even >= Modes.filter_persistence * 3 / 4
        ) {
-        struct receiver *r = receiverBad(mm->receiverId, a->addr, now);
-        if (r && Modes.debug_garbage && r->badCounter > 6) {
+        struct receiver r;
+        if (receiverBad(mm->receiverId, a->addr, now, &r) && Modes.debug_garbage && r.badCounter > 6) {
             fprintf(stderr, "hex: %06x id: %016"PRIx64" #good: %6d #bad: %3.0f trackDiff: %3.0f: %7.2fkm/%7.2fkm in %4.1f s, max %4.0f kt\n",
-                    a->addr, r->id, r->goodCounter, r->badCounter,
+                    a->addr, r.id, r.goodCounter, r.badCounter,
                     track_diff,
                     distance / 1000.0,
                     range / 1000.0,
@@ -372,8 +354,8 @@ static int doGlobalCPR(struct aircraft *a, struct modesMessage *mm, double *lat,
     int result;
     int fflag = mm->cpr_odd;
     int surface = (mm->cpr_type == CPR_SURFACE);
-    struct receiver *receiver;
-    double reflat, reflon;
+    int receiver;
+    double reflat = 0, reflon = 0;
 
     // derive NIC, Rc from the worse of the two position
     // smaller NIC is worse; larger Rc is worse
@@ -438,6 +420,8 @@ static int doGlobalCPR(struct aircraft *a, struct modesMessage *mm, double *lat,
     }
 
     if (result < 0) {
+        recordEvent(REC_CPR_GLOBAL, a->seen, a->addr, mm->receiverId, result, recFlags(mm, surface),
+                0, 0, reflat, reflon);
         if (a->addr == Modes.cpr_focus || Modes.debug_cpr) {
             fprintf(stderr, "CPR: decode failure for %06x (%d).\n", a->addr, result);
             fprintf(stderr, "  even: %d %d   odd: %d %d  fflag: %s\n",
@@ -452,6 +436,8 @@ static int doGlobalCPR(struct aircraft *a, struct modesMessage *mm, double *lat,
     if (Modes.maxRange > 0 && (Modes.bUserFlags & MODES_USER_LATLON_VALID)) {
         double range = greatcircle(Modes.fUserLat, Modes.fUserLon, *lat, *lon);
         if (range > Modes.maxRange) {
+            recordEvent(REC_CPR_RANGE, a->seen, a->addr, mm->receiverId, -2, recFlags(mm, surface),
+                    *lat, *lon, range, Modes.maxRange);
             if (a->addr == Modes.cpr_focus) {
                 fprintf(stderr, "Global range check failed: %06x: %.3f,%.3f, max range %.1fkm, actual %.1fkm\n",
                         a->addr, *lat, *lon, Modes.maxRange / 1000.0, range / 1000.0);
@@ -464,9 +450,12 @@ static int doGlobalCPR(struct aircraft *a, struct modesMessage *mm, double *lat,
     // check speed limit
     if (!speed_check(a, mm->source, *lat, *lon, mm, CPR_GLOBAL)) {
         Modes.stats_current.cpr_global_speed_checks++;
-        return -2;
+        result = -2;
     }
 
+    recordEvent(REC_CPR_GLOBAL, a->seen, a->addr, mm->receiverId, result, recFlags(mm, surface),
+            *lat, *lon, reflat, reflon);
+
     return result;
 }
 
@@ -544,6 +533,8 @@ static int doLocalCPR(struct aircraft *a, struct modesMessage *mm, double *lat,
             fflag, surface,
             lat, lon);
     if (result < 0) {
+        recordEvent(REC_CPR_LOCAL, now, a->addr, mm->receiverId, result, recFlags(mm, surface),
+                0, 0, reflat, reflon);
         return result;
     }
 
@@ -552,6 +543,8 @@ static int doLocalCPR(struct aircraft *a, struct modesMessage *mm, double *lat,
         double range = greatcircle(reflat, reflon, *lat, *lon);
         if (range > range_limit) {
             Modes.stats_current.cpr_local_range_checks++;
+            recordEvent(REC_CPR_LOCAL, now, a->addr, mm->receiverId, -1, recFlags(mm, surface),
+                    *lat, *lon, range, range_limit);
             return (-1);
         }
     }
@@ -559,9 +552,14 @@ static int doLocalCPR(struct aircraft *a, struct modesMessage *mm, double *lat,
     // check speed limit
     if (!speed_check(a, mm->source, *lat, *lon, mm, CPR_LOCAL)) {
         Modes.stats_current.cpr_local_speed_checks++;
+        recordEvent(REC_CPR_LOCAL, now, a->addr, mm->receiverId, -2, recFlags(mm, surface),
+                *lat, *lon, reflat, reflon);
         return -2;
     }
 
+    recordEvent(REC_CPR_LOCAL, now, a->addr, mm->receiverId, relative_to, recFlags(mm, surface),
+            *lat, *lon, reflat, reflon);
+
     return relative_to;
 }
 
@@ -633,6 +631,8 @@ static void setPosition(struct aircraft *a, struct modesMessage *mm, uint64_t no
 
     a->lastPosReceiverId = mm->receiverId;
 
+    apiUpdate(a);
+
     if (posReliable(a)) {
         set_globe_index(a, globe_index(a->lat, a->lon));
 
@@ -1106,6 +1106,135 @@ static inline void focusGroundstateChange(struct aircraft *a, struct modesMessag
     }
 }
 
+// probation: a new address only gets a struct aircraft with its second reliable message
+// until then it's kept in a compact table together with its first message,
+// addresses from noise or bit errors expire there without touching the aircraft table
+// same scheme as the icao filter: two tables, the older one is cleared every PROBATION_TTL
+
+#define PROBATION_SIZE 2048 // per table, at most half of it is used
+#define PROBATION_TTL (30 * SECONDS)
+#define PROBATION_EMPTY 0xFFFFFFFF
+#define PROBATION_PROMOTED 0xFFFFFFFE // keeps the probe sequence intact
+
+struct probation {
+    uint32_t addr;
+};
+
+// what's needed to decode the first message again, the rest is derived from the message bits
+struct probationPending {
+    uint64_t timestampMsg;
+    uint64_t sysTimestampMsg;
+    uint64_t receiverId;
+    double signalLevel;
+    unsigned char msg[MODES_LONG_MSG_BYTES];
+    unsigned char verbatim[MODES_LONG_MSG_BYTES];
+    int8_t correctedbits;
+    bool remote;
+};
+
+static struct probation probation[2][PROBATION_SIZE];
+static struct probationPending probationPending[2][PROBATION_SIZE]; // first message of each address
+static int probationActive;
+static int probationCount; // slots used in the active table
+static uint64_t probationFlip;
+
+static void probationExpire(uint64_t now) {
+    if (now < probationFlip)
+        return;
+
+    int first = !probationFlip;
+    probationFlip = now + PROBATION_TTL;
+    probationActive ^= 1;
+    probationCount = 0;
+
+    struct probation *table = probation[probationActive];
+    for (int i = 0; i < PROBATION_SIZE; i++) {
+        if (!first && table[i].addr != PROBATION_EMPTY && table[i].addr != PROBATION_PROMOTED)
+            Modes.stats_current.probation_expired++;
+        table[i].addr = PROBATION_EMPTY;
+    }
+    if (first) {
+        for (int i = 0; i < PROBATION_SIZE; i++)
+            probation[probationActive ^ 1][i].addr = PROBATION_EMPTY;
+    }
+}
+
+static struct probation *probationFind(uint32_t addr, int t) {
+    uint32_t h = aircraftHash(addr) & (PROBATION_SIZE - 1);
+    struct probation *table = probation[t];
+    // tables are never more than half full, probing ends at an empty slot
+    for (; table[h].addr != PROBATION_EMPTY; h = (h + 1) & (PROBATION_SIZE - 1)) {
+        if (table[h].addr == addr)
+            return &table[h];
+    }
+    return NULL;
+}
+
+// returns the aircraft once the address is confirmed, NULL while it's on probation
+static struct aircraft *probationCheck(struct modesMessage *mm, uint64_t now) {
+    // trusted sources and addresses somebody wants to see don't need confirmation
+    if (mm->sbs_in || hotSetTest(mm->addr))
+        return aircraftCreate(mm);
+
+    probationExpire(now);
+
+    for (int t = 0; t < 2; t++) {
+        struct probation *p = probationFind(mm->addr, t);
+        if (!p)
+            continue;
+
+        struct probationPending *pending = &probationPending[t][p - probation[t]];
+        p->addr = PROBATION_PROMOTED;
+        Modes.stats_current.probation_promoted++;
+
+        struct modesMessage first;
+        memset(&first, 0, sizeof(first));
+        first.timestampMsg = pending->timestampMsg;
+        first.sysTimestampMsg = pending->sysTimestampMsg;
+        first.receiverId = pending->receiverId;
+        first.signalLevel = pending->signalLevel;
+        first.remote = pending->remote;
+        // the stored bits are already corrected, this can't fail
+        if (decodeModesMessage(&first, pending->msg) < 0 || first.addr != mm->addr)
+            return aircraftCreate(mm);
+        memcpy(first.verbatim, pending->verbatim, sizeof(first.verbatim));
+        first.correctedbits = pending->correctedbits;
+
+        struct aircraft *a = aircraftCreate(&first);
+        trackUpdateFromMessage(&first);
+        // the first message was held back by useModesMessage, forward it ahead of this one
+        if (Modes.net && !Modes.net_verbatim && !Modes.net_only)
+            modesQueueOutput(&first, a);
+        return a;
+    }
+
+    if (probationCount >= PROBATION_SIZE / 2) {
+        // table full, don't lose aircraft on very busy sites
+        return aircraftCreate(mm);
+    }
+
+    uint32_t h = aircraftHash(mm->addr) & (PROBATION_SIZE - 1);
+    struct probation *table = probation[probationActive];
+    while (table[h].addr != PROBATION_EMPTY)
+        h = (h + 1) & (PROBATION_SIZE - 1);
+
+    table[h].addr = mm->addr;
+    probationCount++;
+
+    struct probationPending *pending = &probationPending[probationActive][h];
+    pending->timestampMsg = mm->timestampMsg;
+    pending->sysTimestampMsg = mm->sysTimestampMsg;
+    pending->receiverId = mm->receiverId;
+    pending->signalLevel = mm->signalLevel;
+    memcpy(pending->msg, mm->msg, sizeof(pending->msg));
+    memcpy(pending->verbatim, mm->verbatim, sizeof(pending->verbatim));
+    pending->correctedbits = mm->correctedbits;
+    pending->remote = mm->remote;
+
+    mm->probation = 1;
+    return NULL;
+}
+
 //
 //=========================================================================
 //
@@ -1128,12 +1257,15 @@ struct aircraft *trackUpdateFromMessage(struct modesMessage *mm) {
     a = aircraftGet(mm->addr);
     if (!a) { // If it's a currently unknown aircraft....
         if (addressReliable(mm)) {
-            a = aircraftCreate(mm); // ., create a new record for it,
+            a = probationCheck(mm, now); // ., create a new record for it once confirmed,
+            if (!a)
+                return NULL;
         } else {
             //fprintf(stderr, "%06x: !a && !addressReliable(mm)\n", mm->addr);
             return NULL;
         }
     }
+    dbRefresh(a);
 
     bool haveScratch = false;
     if (mm->cpr_valid || mm->sbs_pos_valid) {
@@ -1639,8 +1771,8 @@ end_alt:
         int old_jaero = 0;
         if (mm->source == SOURCE_JAERO && a->trace_len > 0) {
             for (int i = max(0, a->trace_len - 10); i < a->trace_len; i++) {
-                if ( (int32_t) (mm->decoded_lat * 1E6) == a->trace[i].lat
-                        && (int32_t) (mm->decoded_lon * 1E6) == a->trace[i].lon )
+                if ( (int32_t) (mm->decoded_lat * 1E6) == getState(a, i)->lat
+                        && (int32_t) (mm->decoded_lon * 1E6) == getState(a, i)->lon )
                     old_jaero = 1;
             }
         }
@@ -1672,8 +1804,7 @@ end_alt:
     if (mm->msgtype == 11 && mm->IID == 0 && mm->correctedbits == 0) {
         double reflat;
         double reflon;
-        struct receiver *r = receiverGetReference(mm->receiverId, &reflat, &reflon, a);
-        if (r) {
+        if (receiverGetReference(mm->receiverId, &reflat, &reflon, a)) {
             a->rr_lat = reflat;
             a->rr_lon = reflon;
             a->rr_seen = now;
@@ -1701,7 +1832,12 @@ end_alt:
         a->last_cpr_type = mm->cpr_type;
 
     if (haveScratch && (mm->garbage || mm->pos_bad || mm->duplicate)) {
+        // the api index entry isn't rolled back, keep the cell in sync with it
+        int api_index = a->api_index;
+        struct legState *legs = a->legs;
         memcpy(a, Modes.scratch, sizeof(struct aircraft));
+        a->api_index = api_index;
+        a->legs = legs;
         if (mm->pos_bad) {
             position_bad(mm, a);
         }
@@ -1820,8 +1956,6 @@ static void trackRemoveStale(uint64_t now) {
         }
     }
 
-    Modes.doFullTraceWrite = 0;
-
     //fprintf(stderr, "removeStale done: running for %ld ms\n", mstime() - Modes.startup_time);
 }
 //
@@ -1890,6 +2024,8 @@ void trackRemoveStaleThread(int thread, int start, int end, uint64_t now) {
                     traceMaintenance(a, now);
                 }
 
+                dbRefresh(a);
+
                 nextPointer = &(a->next);
             }
         }
@@ -2000,14 +2136,15 @@ void trackPeriodicUpdate() {
     if (Modes.updateStats)
         statsUpdate(now); // needs to happen under lock
 
-    int nParts = 5 * MINUTES / PERIODIC_UPDATE;
-    receiverTimeout((upcount % nParts), nParts, now);
-
     end_monotonic_timing(&start_time, &Modes.stats_current.remove_stale_cpu);
     int64_t elapsed = stopWatch(&watch);
 
     unlockThreads();
 
+    // receivers have their own locks, no need to hold up the other threads for this
+    if (upcount % (1 * SECONDS / PERIODIC_UPDATE) == 1)
+        receiverTimeout(now);
+
     static uint64_t antiSpam;
     if (elapsed > 50 && now > antiSpam + 30 * SECONDS) {
         fprintf(stderr, "<3>High load: removeStale took %"PRIu64" ms! Suppressing for 30 seconds\n", elapsed);
@@ -2041,114 +2178,6 @@ void trackPeriodicUpdate() {
     }
 }
 
-void miscStuff() {
-    uint64_t now = mstime();
-
-    struct timespec watch;
-    startWatch(&watch);
-
-    struct timespec start_time;
-    start_cpu_timing(&start_time);
-
-    checkNewDay(now);
-
-    // don't do everything at once ... this stuff isn't that time critical it'll get its turn
-    int enough = 0;
-
-    if (handleHeatmap(now)) {
-        enough = 1;
-    }
-
-    static uint32_t blob; // current blob
-    static uint64_t next_blob;
-    if (Modes.state_dir && !enough && now > next_blob) {
-        enough = 1;
-        save_blob(blob++ % STATE_BLOBS);
-        next_blob = now + 60 * MINUTES / STATE_BLOBS;
-    }
-
-    if (!enough && Modes.api && now > Modes.next_api_update) {
-        // this will probably get its own thread at some point
-        enough = 1;
-        Modes.next_api_update = now + 1 * SECONDS;
-        apiClear();
-        for (int j = 0; j < AIRCRAFT_BUCKETS; j++) {
-            for (struct aircraft *a = Modes.aircraft[j]; a; a = a->next) {
-                apiAdd(a);
-            }
-        }
-        apiSort();
-    }
-
-    static uint64_t next_clients_json;
-    if (!enough && Modes.json_dir && now > next_clients_json) {
-        enough = 1;
-        next_clients_json = now + 10 * SECONDS;
-        if (Modes.netIngest)
-            writeJsonToFile(Modes.json_dir, "clients.json", generateClientsJson());
-        if (Modes.netReceiverIdJson)
-            writeJsonToFile(Modes.json_dir, "receivers.json", generateReceiversJson());
-    }
-
-    if (!enough) {
-        // one iteration later, finish db update if db was updated
-        if (dbFinishUpdate())
-            enough = 1;
-    }
-    static uint64_t next_db_check;
-    if (!enough && now > next_db_check) {
-        enough = 1;
-        dbUpdate();
-        // db update check every 5 min
-        next_db_check = now + 5 * MINUTES;
-    }
-
-    end_cpu_timing(&start_time, &Modes.stats_current.heatmap_and_state_cpu);
-
-    uint64_t elapsed = stopWatch(&watch);
-    static uint64_t antiSpam2;
-    if (elapsed > 2 * SECONDS && now > antiSpam2 + 30 * SECONDS) {
-        fprintf(stderr, "<3>High load: heatmap_and_stuff took %"PRIu64" ms! Suppressing for 30 seconds\n", elapsed);
-        antiSpam2 = now;
-    }
-}
-
-
-void *miscThreadEntryPoint(void *arg) {
-    MODES_NOTUSED(arg);
-
-    pthread_mutex_lock(&Modes.miscMutex);
-
-    srandom(get_seed());
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-
-    while (!Modes.exit) {
-
-        if (mstime() < Modes.next_remove_stale) {
-
-            Modes.miscThreadRunning = 1;
-
-            pthread_mutex_unlock(&Modes.miscMutex);
-            miscStuff();
-            pthread_mutex_lock(&Modes.miscMutex);
-
-            Modes.miscThreadRunning = 0;
-        }
-
-
-        incTimedwait(&ts, 250); // check every quarter second if there is something to do
-
-        int err = pthread_cond_timedwait(&Modes.miscCond, &Modes.miscMutex, &ts);
-        if (err && err != ETIMEDOUT)
-            fprintf(stderr, "main thread: pthread_cond_timedwait unexpected error: %s\n", strerror(err));
-    }
-
-    pthread_mutex_unlock(&Modes.miscMutex);
-
-    pthread_exit(NULL);
-}
-
 /*
 static void adjustExpire(struct aircraft *a, uint64_t timeout) {
 #define F(f,s,e) do { a->f##_valid.stale_interval = (s) * 1000; a->f##_valid.expire_interval = (e) * 1000; } while (0)
@@ -2198,6 +2227,8 @@ static void position_bad(struct modesMessage *mm, struct aircraft *a) {
     if (mm->source < a->position_valid.source)
         return;
 
+    if (mm->client)
+        mm->client->qual.posBad++;
 
     Modes.stats_current.cpr_global_bad++;
 
@@ -2349,10 +2380,10 @@ static void calc_wind(struct aircraft *a, uint64_t now) {
 
     // don't use this code for now
     /*
-    if (a->trace && a->trace_len >= 2) {
-        struct state *last = &(a->trace[a->trace_len-1]);
+    if (a->trace_chunks && a->trace_len >= 2) {
+        struct state *last = getState(a, a->trace_len-1);
         if (now + 1500 < last->timestamp)
-            last = &(a->trace[a->trace_len-2]);
+            last = getState(a, a->trace_len-2);
         float track_diff = fabs(a->track - last->track / 10.0);
         if (last->flags.track_valid && track_diff > 0.5)
             return;
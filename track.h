@@ -236,14 +236,15 @@ struct aircraft
   int trace_len; // current number of points in the trace
   int trace_write; // signal for writing the trace
   int trace_full_write; // signal for writing the complete trace
-  int trace_alloc; // current number of allocated points
+  int trace_alloc; // number of points that fit in the linked chunks
   int destroy; // aircraft is being deleted
   int signalNext; // next index of signalLevel to use
 
   // ----
 
-  struct state *trace; // array of positions representing the aircrafts trace/trail
-  struct state_all *trace_all;
+  struct traceChunk **trace_chunks; // ring of chunks holding the positions of the aircrafts trace/trail (trace_chunks.h)
+  int32_t trace_chunk_first; // ring index of the first chunk
+  int32_t trace_chunk_ring; // size of the ring, power of 2
   int altitude_baro; // Altitude (Baro)
   int alt_reliable;
   int altitude_geom; // Altitude (Geometric)
@@ -251,8 +252,9 @@ struct aircraft
 
   uint64_t trace_next_mw; // timestamp for next full trace write to /run (tmpfs)
   uint64_t trace_next_fw; // timestamp for next full trace write to history_dir (disk)
-  double unused_trace_llat; // last saved lat
-  double unused_trace_llon; // last saved lon
+  uint64_t trace_rollover; // day boundary of the last paced rollover rewrite (checkNewDay / traceMaintenance)
+  int32_t trace_head; // index of the first trace point in the first chunk
+  int32_t trace_chunk_count; // chunks linked in the ring
 
   // ----
 
@@ -285,7 +287,7 @@ struct aircraft
   double lon; // Coordinates obtained from CPR encoded data
   int pos_reliable_odd; // Number of good global CPRs, indicates position reliability
   int pos_reliable_even;
-  int padding1234; // unused
+  int api_index; // cell of the API spatial index this aircraft is listed in, -1 if none
   float gs_last_pos; // Save a groundspeed associated with the last position
 
   float wind_speed;
@@ -302,7 +304,7 @@ struct aircraft
   unsigned ias;
   unsigned tas;
   unsigned squawk; // Squawk
-  unsigned padding2344;
+  uint32_t dbGeneration; // database generation typeCode / registration are from (aircraft.c)
   unsigned nav_altitude_mcp; // FCU/MCP selected altitude
   unsigned nav_altitude_fms; // FMS selected altitude
   unsigned cpr_odd_lat;
@@ -363,7 +365,7 @@ struct aircraft
   unsigned spi : 1; // FS Flight status SPI (Special Position Identification) bit
   unsigned pos_surface : 1; // (a->airground == AG_GROUND) associated with current position
   unsigned last_cpr_type : 2; // mm->cpr_type associated with current position
-  unsigned tracePosBuffered : 1; // denotes if a->trace[a->trace_len] has a valid state buffered in it
+  unsigned tracePosBuffered : 1; // denotes if getState(a, a->trace_len) has a valid state buffered in it
   // 22 bit ??
   unsigned padding_b : 10;
   // 32 bit !!
@@ -417,7 +419,7 @@ struct aircraft
   uint8_t dbFlags;
   uint16_t receiverIds[RECEIVERIDBUFFER]; // RECEIVERIDBUFFER = 12
 
-  void *padding124;
+  struct legState *legs; // leg detection state, see legs.c
 };
 
 /* Mode A/C tracking is done separately, not via the aircraft list,
@@ -496,7 +498,6 @@ trackDataAge (uint64_t now, const data_validity *v)
 }
 
 // calculate great circle distance in meters
-double greatcircle(double lat0, double lon0, double lat1, double lon1);
 void to_state_all(struct aircraft *a, struct state_all *new, uint64_t now);
 
 /* Update aircraft state from data in the provided mesage.
@@ -507,8 +508,6 @@ struct aircraft *trackUpdateFromMessage (struct modesMessage *mm);
 
 /* Call periodically */
 void trackPeriodicUpdate ();
-void miscStuff();
-void *miscThreadEntryPoint(void *arg);
 void *staleThreadEntryPoint(void *arg);
 
 void trackRemoveStaleThread(int thread, int start, int end, uint64_t now);
@@ -587,4 +586,10 @@ static inline int get8bitSignal(struct aircraft *a) {
     if (signal < 1 && signal > 0) signal = 1;
     return nearbyint(signal);
 }
+// refresh type / registration after a database update, only done when the aircraft is next looked at
+static inline void dbRefresh(struct aircraft *a) {
+    if (a->dbGeneration != __atomic_load_n(&Modes.dbGeneration, __ATOMIC_ACQUIRE))
+        updateTypeReg(a);
+}
+
 #endif
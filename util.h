@@ -80,4 +80,7 @@ unsigned int get_seed();
 void incTimedwait(struct timespec *target, uint64_t increment);
 void log_with_timestamp(const char *format, ...) __attribute__ ((format(printf, 1, 2)));
 
+// Distance between points on a spherical earth in metres
+double greatcircle(double lat0, double lon0, double lat1, double lon1);
+
 #endif